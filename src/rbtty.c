@@ -1,17 +1,23 @@
 #include "rbtty.h"
+#include "rbtty_font.h"
+#include "rbtty_layout.h"
+#include "rbtty_queue.h"
+#include "rbtty_registry.h"
 #include "rbtty_screen.h"
-#include <font_rsrc.h>
+#include "rbtty_snapshot.h"
+#include "rbtty_source.h"
+#include "rbtty_stats.h"
+#include "rbtty_utf8.h"
+#include "rbtty_wrap.h"
 #include <lp/lp.h>
-#include <lp/lp_font.h>
 #include <lp/lp_printer.h>
 #include <rb/rbi.h>
 #include <snlsys/math.h>
 #include <snlsys/mem_allocator.h>
 #include <snlsys/ref_count.h>
-#include <limits.h>
 #include <string.h>
+#include <wchar.h>
 
-#define TO_UPPER_font FONT
 #define TO_UPPER_lp LP
 #define TO_UPPER_rbtty RBTTY
 #define TO_UPPER( x ) TO_UPPER_ ## x
@@ -25,28 +31,37 @@ struct rbtty {
   struct rb_context* rb_ctxt;
 
   /* Line printer */
-  struct lp* lp;
-  struct lp_font* font;
   struct lp_printer* printer;
 
-  /* Resource */
-  struct font_system* font_sys;
-  struct font_rsrc* font_rsrc;
+  /* Font, possibly shared with other ttys */
+  struct rbtty_font* font;
+  struct rbtty_font_user font_user;
+
+  /* Viewport */
+  int viewport[4]; /* x, y, width, height */
 
   /* Internal data */
   struct rbtty_screen screen;
-};
+  struct rbtty_layout layout;
+  struct rbtty_queue queue; /* Text printed by the thread safe functions */
+  struct rbtty_source source; /* Attached fd */
+  struct rbtty_registry registry; /* Registered commands */
+  int is_completing; /* A completer is running */
 
-/*******************************************************************************
- *
- * Helper data structure
- *
- ******************************************************************************/
-static const wchar_t rbtty_charset[] =
-  L"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
-  L" &~\"#'{([-|`_\\^@)]=}+$%*,?;.:/!<>";
+  /* Flood coalescing */
+  size_t frame_budget; /* Bytes of queued text written per frame. 0 <=> off */
+  size_t drawn_id; /* Newest line of the previous frame. SIZE_MAX <=> none */
+  size_t skipped_count; /* Lines scrolled past without being drawn */
+  struct rbtty_wrap wrap;
 
-#define RBTTY_CHARSET_LEN (sizeof(rbtty_charset)/sizeof(wchar_t)-1)/* -1 = \0 */
+#ifdef RBTTY_ENABLE_STATS
+  /* Statistics */
+  struct rbtty_mem_counter mem_counter; /* Proxy of the user allocator */
+  struct rbtty_mem_counter screen_mem_counter; /* Proxy of mem_counter */
+  struct rbtty_latency print_latency;
+  struct rbtty_latency draw_latency;
+#endif
+};
 
 /*******************************************************************************
  *
@@ -68,17 +83,52 @@ lp_to_rbtty_error(const enum lp_error lp_err)
   return rbtty_err;
 }
 
-static enum rbtty_error
-font_to_rbtty_error(const enum font_error font_err)
+/* Reference the glyphs of the chars of `row'. The chars whose glyph cannot
+ * be made resident are replaced by the fallback glyph */
+static void
+row_acquire_glyphs(struct rbtty* tty, struct rbtty_row* row)
 {
-  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
-  switch(font_err) {
-    case FONT_INVALID_ARGUMENT: rbtty_err = RBTTY_INVALID_ARGUMENT; break;
-    case FONT_MEMORY_ERROR: rbtty_err = RBTTY_MEMORY_ERROR; break;
-    case FONT_NO_ERROR: rbtty_err = RBTTY_NO_ERROR; break;
-    default: rbtty_err = RBTTY_UNKNOWN_ERROR; break;
+  ASSERT(tty && row && row->is_valid);
+  FOR_EACH(size_t, i, 0, row->runs_count) {
+    wchar_t* c = NULL;
+    for(c = row->text + row->runs[i].offset; *c != L'\0'; ++c) {
+      if(!rbtty_glyph_cache_acquire(&tty->font->glyph_cache, *c)) {
+        *c = tty->font->glyph_fallback;
+        rbtty_glyph_cache_acquire(&tty->font->glyph_cache, *c);
+      }
+    }
   }
-  return rbtty_err;
+}
+
+static void
+row_release_glyphs(struct rbtty* tty, struct rbtty_row* row)
+{
+  ASSERT(tty && row && row->is_valid);
+  FOR_EACH(size_t, i, 0, row->runs_count) {
+    const wchar_t* c = NULL;
+    for(c = row->text + row->runs[i].offset; *c != L'\0'; ++c)
+      rbtty_glyph_cache_release(&tty->font->glyph_cache, *c);
+  }
+}
+
+/* Release the glyphs of the laid out rows and invalidate them */
+static void
+invalidate_rows(struct rbtty* tty)
+{
+  struct rbtty_layout* layout = NULL;
+  ASSERT(tty);
+  layout = &tty->layout;
+  FOR_EACH(size_t, i, 0, layout->rows_count) {
+    if(layout->rows[i].is_valid)
+      row_release_glyphs(tty, layout->rows + i);
+    layout->rows[i].is_valid = 0;
+  }
+  if(layout->cmdrow.is_valid)
+    row_release_glyphs(tty, &layout->cmdrow);
+  if(layout->notice.is_valid)
+    row_release_glyphs(tty, &layout->notice);
+  layout->cmdrow.is_valid = 0;
+  layout->notice.is_valid = 0;
 }
 
 static void
@@ -89,21 +139,293 @@ release_rbtty(struct ref* ref)
 
   tty = CONTAINER_OF(ref, struct rbtty, ref);
 
-  if(tty->lp)
-    LP(ref_put(tty->lp));
-  if(tty->font)
-    LP(font_ref_put(tty->font));
   if(tty->printer)
     LP(printer_ref_put(tty->printer));
+  if(tty->font) {
+    /* The glyphs of a shared font outlive the tty */
+    invalidate_rows(tty);
+    rbtty_font_detach_user(tty->font, &tty->font_user);
+    RBTTY(font_ref_put(tty->font));
+  }
 
-  if(tty->font_sys)
-    FONT(system_ref_put(tty->font_sys));
-  if(tty->font_rsrc)
-    FONT(rsrc_ref_put(tty->font_rsrc));
-
-  RBTTY(screen_shutdown(&tty->screen));
+  if(tty->screen.allocator) /* Null if the creation failed before */
+    RBTTY(screen_shutdown(&tty->screen));
+  rbtty_layout_shutdown(&tty->layout);
+  rbtty_queue_shutdown(&tty->queue);
+  rbtty_source_shutdown(&tty->source);
+  rbtty_registry_shutdown(&tty->registry);
+  rbtty_wrap_shutdown(&tty->wrap);
 
+#ifdef RBTTY_ENABLE_STATS
+  MEM_FREE(tty->mem_counter.proxied, tty);
+#else
   MEM_FREE(tty->allocator, tty);
+#endif
+}
+
+/* Lay out again `row' from the chars in [first, len[ of `chars' */
+static void
+update_row
+  (struct rbtty* tty,
+   struct rbtty_row* row,
+   const wchar_t* chars,
+   const size_t len,
+   const struct rbtty_span* spans,
+   const size_t spans_count,
+   const size_t first,
+   const size_t split)
+{
+  ASSERT(tty && row);
+  if(row->is_valid)
+    row_release_glyphs(tty, row);
+  rbtty_layout_build_row
+    (&tty->layout, row, chars, len, spans, spans_count, first, split);
+  row_acquire_glyphs(tty, row);
+  rbtty_layout_measure_row(row, &tty->font->advance);
+}
+
+/* Number of stdout lines drawn above the cmdrow */
+static FINLINE size_t
+stdout_rows(const struct rbtty* tty)
+{
+  ASSERT(tty);
+  if(tty->font->line_space <= 0 || tty->viewport[3] <= tty->font->line_space)
+    return 0;
+  return (size_t)((tty->viewport[3] - 1) / tty->font->line_space);
+}
+
+/* Convert `info' to the metadata of a line. Return 0 if it is invalid */
+static FINLINE int
+info_to_meta
+  (const struct rbtty_line_info* info,
+   struct rbtty_line_meta* meta)
+{
+  ASSERT(info && meta);
+  if(info->level < RBTTY_LEVEL_DEBUG || info->level > RBTTY_LEVEL_ERROR)
+    return 0;
+  meta->timestamp = info->timestamp;
+  meta->channel = info->channel;
+  meta->level = (uint8_t)info->level;
+  return 1;
+}
+
+/* Adjust the number of laid out rows and columns to the viewport */
+static enum rbtty_error
+setup_layout(struct rbtty* tty)
+{
+  const struct rbtty_font* font = NULL;
+  size_t rows_count = 0;
+  size_t max_columns = 0;
+  ASSERT(tty);
+
+  invalidate_rows(tty);
+
+  font = tty->font;
+  if(font->line_space > 0 && tty->viewport[2] > 0 && tty->viewport[3] > 0) {
+    rows_count = (size_t)(tty->viewport[3] / font->line_space + 1);
+    max_columns = (size_t)
+      (tty->viewport[2] / MAX(font->glyph_min_width, 1) + 1);
+  }
+  rbtty_wrap_set_width(&tty->wrap, tty->viewport[2]);
+  return rbtty_layout_setup(&tty->layout, rows_count, max_columns);
+}
+
+/* Submit the runs of `row' to the printer. If `cursor' is not null, the
+ * cursor is drawn at the split position of the row. The chars are placed
+ * from the positions measured when the row was laid out */
+static enum rbtty_error
+draw_row
+  (struct rbtty* tty,
+   const struct rbtty_row* row,
+   const int y,
+   const int cursor)
+{
+  static const float cursor_color[3] = { 1.f, 1.f, 1.f };
+  int x = 0;
+  int dummy_y = 0;
+  enum lp_error lp_err = LP_NO_ERROR;
+  ASSERT(tty && row && row->is_valid);
+
+  FOR_EACH(size_t, i, 0, row->runs_count) {
+    const struct rbtty_run* run = row->runs + i;
+    const struct rbtty_attrib* attrib =
+      rbtty_palette_get(&tty->screen.palette, run->attrib);
+    lp_err = lp_printer_print_wstring
+      (tty->printer, row->x[run->offset - i], y, row->text + run->offset,
+       attrib->color, &x, &dummy_y);
+    if(lp_err != LP_NO_ERROR)
+      return lp_to_rbtty_error(lp_err);
+  }
+  if(cursor && row->split_run != SIZE_MAX) {
+    lp_err = lp_printer_print_wstring
+      (tty->printer, row->x[rbtty_row_split_column(row)], y, L"_",
+       cursor_color, &x, &dummy_y);
+  }
+  return lp_to_rbtty_error(lp_err);
+}
+
+/* Font change notified to the tty */
+static enum rbtty_error
+font_notify(struct rbtty_font_user* user, const enum rbtty_font_event event)
+{
+  struct rbtty* tty = NULL;
+  ASSERT(user);
+  tty = CONTAINER_OF(user, struct rbtty, font_user);
+  if(event == RBTTY_FONT_RELEASE) {
+    invalidate_rows(tty);
+    return RBTTY_NO_ERROR;
+  }
+  /* The lines are wrapped again with the advances of the new font */
+  rbtty_wrap_invalidate(&tty->wrap);
+  return setup_layout(tty);
+}
+
+/* Lay out the damaged rows and submit the visible ones to the printer */
+static enum rbtty_error
+draw(struct rbtty* tty)
+{
+  struct rbtty_screen* scr = NULL;
+  const struct rbtty_scrollback* sb = NULL;
+  struct rbtty_layout* layout = NULL;
+  size_t line = 0;
+  size_t sub = 0;
+  size_t top_id = SIZE_MAX;
+  size_t bottom_id = SIZE_MAX;
+  int line_space = 0;
+  int y = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(tty);
+
+  scr = &tty->screen;
+  sb = &scr->scrollback;
+  layout = &tty->layout;
+  line_space = tty->font->line_space;
+  rbtty_err = rbtty_queue_drain(&tty->queue, scr,
+    tty->frame_budget ? tty->frame_budget : SIZE_MAX);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  if(!layout->rows_count) /* No font or empty viewport */
+    return RBTTY_NO_ERROR;
+
+  #define CALL(func)                                                           \
+    {                                                                          \
+      rbtty_err = func;                                                        \
+      if(rbtty_err != RBTTY_NO_ERROR)                                          \
+        goto error;                                                            \
+    } (void) 0
+
+  /* Lay out again the cmdbuf and the damaged lines. The cmdbuf lies at the
+   * bottom of the viewport and the stdout lines are drawn upward from the
+   * newest one */
+  if(scr->is_cmdbuf_dirty || !layout->cmdrow.is_valid) {
+    const wchar_t* cstr = NULL;
+    const struct rbtty_span* spans = NULL;
+    size_t spans_count = 0;
+    size_t len = 0;
+    size_t cursor = 0;
+    rbtty_err = rbtty_screen_get_cmdbuf
+      (scr, &cstr, &len, &spans, &spans_count, &cursor);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      goto error;
+    update_row
+      (tty, &layout->cmdrow, cstr, len, spans, spans_count, 0, cursor);
+    /* The command chars preceding the cursor follow the prompt */
+    layout->prompt_len = cursor - rbtty_cmdline_cursor(&scr->cmdline);
+  }
+  rbtty_layout_begin_frame(layout);
+  if(rbtty_screen_view(scr, &tty->wrap, stdout_rows(tty), &line, &sub)) {
+    for(y = line_space; y < tty->viewport[3]; y += line_space) {
+      const struct rbtty_wrap_line* wline = NULL;
+      const size_t sbline = rbtty_screen_line(scr, line);
+      const size_t id = rbtty_scrollback_line_id(sb, sbline);
+      struct rbtty_row* row = rbtty_layout_find_row(layout, id, sub);
+
+      if(bottom_id == SIZE_MAX)
+        bottom_id = id;
+      top_id = id;
+      if(!row->is_valid || row->line_id != id || row->sub != sub
+      || rbtty_screen_is_line_dirty(scr, id)) {
+        const wchar_t* chars = NULL;
+        const struct rbtty_span* spans = NULL;
+        size_t spans_count = 0;
+        size_t len = 0;
+        size_t begin = 0;
+        size_t end = 0;
+        wline = rbtty_wrap_get(&tty->wrap, sb, sbline);
+        rbtty_wrap_row(wline, sub, &begin, &end);
+        rbtty_scrollback_get_line
+          (sb, sbline, &chars, &len, &spans, &spans_count);
+        update_row(tty, row, chars, end, spans, spans_count, begin, SIZE_MAX);
+        row->line_id = id;
+        row->sub = sub;
+      }
+      /* Step to the previous row */
+      if(sub) {
+        --sub;
+      } else if(line) {
+        --line;
+        sub = rbtty_wrap_get
+          (&tty->wrap, sb, rbtty_screen_line(scr, line))->rows_count - 1;
+      } else {
+        break;
+      }
+    }
+  }
+
+  /* Count the new lines that were never drawn. The lines written between
+   * two frames only reach the scrollback, and they are only laid out if they
+   * are visible; the notice reports the lines that scrolled past unseen. The
+   * ids of the lines of a view are not contiguous: they are not counted */
+  if(tty->frame_budget) {
+    if(scr->scroll_id != RBTTY_SCROLL_BOTTOM || bottom_id == SIZE_MAX
+    || scr->view != RBTTY_VIEW_ALL) {
+      tty->skipped_count = 0;
+      tty->drawn_id = SIZE_MAX;
+    } else {
+      if(tty->drawn_id != SIZE_MAX && top_id > tty->drawn_id + 1) {
+        tty->skipped_count += top_id - tty->drawn_id - 1;
+      } else {
+        tty->skipped_count = 0;
+      }
+      tty->drawn_id = bottom_id;
+    }
+    if(tty->skipped_count) {
+      wchar_t text[64];
+      struct rbtty_span span;
+      const int len = swprintf(text, sizeof(text)/sizeof(wchar_t),
+        L"-- %lu lines skipped --", (unsigned long)tty->skipped_count);
+      span.start = 0;
+      span.length = (uint32_t)MAX(len, 0);
+      span.attrib = scr->notice_attrib;
+      update_row
+        (tty, &layout->notice, text, span.length, &span, 1, 0, SIZE_MAX);
+      layout->is_notice = 1;
+    }
+  }
+
+  /* Upload the glyphs rasterized by the layout, at most once per frame */
+  CALL(rbtty_glyph_cache_flush(&tty->font->glyph_cache));
+
+  /* Submit the rows */
+  CALL(draw_row(tty, &layout->cmdrow, 0, 1));
+  FOR_EACH(size_t, i, 0, layout->visible_count) {
+    const int is_top = i + 1 == layout->visible_count;
+    const struct rbtty_row* row =
+      layout->is_notice && is_top ? &layout->notice : layout->visible[i];
+    y = (int)(i + 1) * line_space;
+    CALL(draw_row(tty, row, y, 0));
+  }
+  #undef CALL
+
+  rbtty_err = lp_to_rbtty_error(lp_printer_flush(tty->printer));
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+  rbtty_screen_clear_damage(scr);
+
+exit:
+  return rbtty_err;
+error:
+  goto exit;
 }
 
 /*******************************************************************************
@@ -140,10 +462,22 @@ rbtty_create
     rbtty_err = RBTTY_MEMORY_ERROR;
     goto error;
   }
-  ref_init(&tty->ref);
   tty->allocator = alloc;
+#ifdef RBTTY_ENABLE_STATS
+  /* Count the allocations of the tty, and the bytes allocated by the screen
+   * apart */
+  tty->allocator = rbtty_mem_counter_init(alloc, &tty->mem_counter);
+  rbtty_mem_counter_init(tty->allocator, &tty->screen_mem_counter);
+#endif
+  ref_init(&tty->ref);
   tty->rbi = rbi;
   tty->rb_ctxt = ctxt;
+  /* The infallible initialisations come first, so that release_rbtty never
+   * shuts down a zeroed member, e.g. a source whose zeroed fd is the stdin */
+  rbtty_layout_init(tty->allocator, &tty->layout);
+  rbtty_queue_init(tty->allocator, &tty->queue);
+  rbtty_source_init(tty->allocator, &tty->source);
+  rbtty_registry_init(tty->allocator, &tty->registry);
 
   #define FUNC(prefix, func)                                                   \
     {                                                                          \
@@ -153,16 +487,25 @@ rbtty_create
         goto error;                                                            \
       }                                                                        \
     } (void) 0
-  FUNC(lp, create(tty->rbi, tty->rb_ctxt, tty->allocator, &tty->lp));
-  FUNC(lp, font_create(tty->lp, &tty->font));
-  FUNC(lp, printer_create(tty->lp, &tty->printer));
-  FUNC(lp, printer_set_font(tty->printer, tty->font));
-
-  FUNC(font, system_create(tty->allocator, &tty->font_sys));
-  FUNC(font, rsrc_create(tty->font_sys, NULL, &tty->font_rsrc));
+  /* The own font of the tty may be shared with ttys outliving it. It is thus
+   * not allocated by the counting proxy of the tty */
+  FUNC(rbtty, font_create(tty->rbi, tty->rb_ctxt, alloc, &tty->font));
+  tty->font_user.notify = font_notify;
+  rbtty_font_attach_user(tty->font, &tty->font_user);
+  FUNC(lp, printer_create(tty->font->lp, &tty->printer));
+  FUNC(lp, printer_set_font(tty->printer, tty->font->font));
 
+  FUNC(rbtty, wrap_init(tty->allocator, &tty->font->advance, &tty->wrap));
+#ifdef RBTTY_ENABLE_STATS
+  FUNC(rbtty, screen_init(&tty->screen_mem_counter.allocator, &tty->screen));
+#else
   FUNC(rbtty, screen_init(tty->allocator, &tty->screen));
-  FUNC(rbtty, screen_storage(&tty->screen, 8192));
+#endif
+  FUNC(rbtty, screen_setup_scrollback
+    (&tty->screen, RBTTY_SCROLLBACK_DEFAULT_LINES, 0));
+  FUNC(rbtty, queue_setup
+    (&tty->queue, RBTTY_QUEUE_DEFAULT_SIZE, RBTTY_QUEUE_BLOCK));
+  tty->drawn_id = SIZE_MAX;
   #undef FUNC
 
 exit:
@@ -198,75 +541,81 @@ rbtty_ref_put(struct rbtty* tty)
 enum rbtty_error
 rbtty_set_font(struct rbtty* tty, const char* font_path)
 {
-  struct lp_font_glyph_desc lp_font_glyph_desc_list[RBTTY_CHARSET_LEN];
-  unsigned char* glyph_bitmap_list[RBTTY_CHARSET_LEN];
-  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
-  int glyph_min_width = INT_MAX;
-  int line_space = 0;
-  memset(lp_font_glyph_desc_list, 0, sizeof(lp_font_glyph_desc_list));
-  memset(glyph_bitmap_list, 0, sizeof(glyph_bitmap_list));
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_font_load(tty->font, font_path);
+}
 
-  if(UNLIKELY(!tty || !font_path))
+enum rbtty_error
+rbtty_set_font_async(struct rbtty* tty, const char* font_path)
+{
+  if(UNLIKELY(!tty))
     return RBTTY_INVALID_ARGUMENT;
+  return rbtty_font_load_async(tty->font, font_path);
+}
 
-  #define FUNC(prefix, func)                                                   \
-    {                                                                          \
-      const enum prefix ## _error err = prefix ## _ ## func;                   \
-      if(err != CONCAT( TO_UPPER(prefix), _NO_ERROR )) {                       \
-        rbtty_err = prefix ## _to_rbtty_error(err);                            \
-        goto error;                                                            \
-      }                                                                        \
-    } (void) 0
+enum rbtty_error
+rbtty_set_font_cache_dir(struct rbtty* tty, const char* path)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_font_set_cache_dir(tty->font, path);
+}
 
-  FUNC(font, rsrc_load(tty->font_rsrc, font_path));
-
-  FOR_EACH(size_t, i, 0, RBTTY_CHARSET_LEN) {
-    struct font_glyph_desc font_glyph_desc;
-    struct font_glyph* font_glyph = NULL;
-    int width = 0, height = 0, Bpp = 0;
-
-    FUNC(font, rsrc_get_glyph(tty->font_rsrc, rbtty_charset[i], &font_glyph));
-    FUNC(font, glyph_get_desc(font_glyph, &font_glyph_desc));
-    glyph_min_width = MIN(font_glyph_desc.width, glyph_min_width);
-    lp_font_glyph_desc_list[i].width = font_glyph_desc.width;
-    lp_font_glyph_desc_list[i].character = font_glyph_desc.character;
-    lp_font_glyph_desc_list[i].bitmap_left = font_glyph_desc.bbox.x_min;
-    lp_font_glyph_desc_list[i].bitmap_top = font_glyph_desc.bbox.y_min;
-
-    FUNC(font, glyph_get_bitmap(font_glyph, true, &width, &height, &Bpp, NULL));
-    if(width && height) {
-      const size_t bmp_size = (size_t)(width*height);
-      glyph_bitmap_list[i] = MEM_CALLOC(tty->allocator, bmp_size, (size_t)Bpp);
-      if(UNLIKELY(!glyph_bitmap_list[i])) {
-        rbtty_err = RBTTY_MEMORY_ERROR;
-        goto error;
-      }
-      FUNC(font, glyph_get_bitmap
-        (font_glyph, true, &width, &height, &Bpp, glyph_bitmap_list[i]));
-    }
+enum rbtty_error
+rbtty_poll_font(struct rbtty* tty, int* is_loaded)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_font_poll(tty->font, is_loaded);
+}
+
+enum rbtty_error
+rbtty_attach_font(struct rbtty* tty, struct rbtty_font* font)
+{
+  struct lp_printer* printer = NULL;
+  enum lp_error lp_err = LP_NO_ERROR;
 
-    lp_font_glyph_desc_list[i].bitmap.width = width;
-    lp_font_glyph_desc_list[i].bitmap.height = height;
-    lp_font_glyph_desc_list[i].bitmap.bytes_per_pixel = Bpp;
-    lp_font_glyph_desc_list[i].bitmap.buffer = glyph_bitmap_list[i];
+  if(UNLIKELY(!tty || !font))
+    return RBTTY_INVALID_ARGUMENT;
+  if(font == tty->font)
+    return RBTTY_NO_ERROR;
 
-    FONT(glyph_ref_put(font_glyph));
+  /* The printer draws with the texture of the font and must thus be created
+   * from the line printer of the font */
+  lp_err = lp_printer_create(font->lp, &printer);
+  if(lp_err == LP_NO_ERROR)
+    lp_err = lp_printer_set_font(printer, font->font);
+  if(lp_err == LP_NO_ERROR && (tty->viewport[2] || tty->viewport[3])) {
+    lp_err = lp_printer_set_viewport(printer, tty->viewport[0],
+      tty->viewport[1], tty->viewport[2], tty->viewport[3]);
+  }
+  if(lp_err != LP_NO_ERROR) {
+    if(printer)
+      LP(printer_ref_put(printer));
+    return lp_to_rbtty_error(lp_err);
   }
 
-  FONT(rsrc_get_line_space(tty->font_rsrc, &line_space));
-  FUNC(lp, font_set_data
-    (tty->font, line_space, (int)RBTTY_CHARSET_LEN, lp_font_glyph_desc_list));
+  invalidate_rows(tty);
+  rbtty_font_detach_user(tty->font, &tty->font_user);
+  RBTTY(font_ref_put(tty->font));
+  LP(printer_ref_put(tty->printer));
 
-  #undef FUNC
-exit:
-  FOR_EACH(size_t, i, 0, RBTTY_CHARSET_LEN) {
-    if(glyph_bitmap_list[i]) {
-      MEM_FREE(tty->allocator, glyph_bitmap_list);
-    }
-  }
-  return rbtty_err;
-error:
-  goto exit;
+  RBTTY(font_ref_get(font));
+  rbtty_font_attach_user(font, &tty->font_user);
+  tty->font = font;
+  tty->printer = printer;
+  rbtty_wrap_set_advance(&tty->wrap, &font->advance);
+  return setup_layout(tty);
+}
+
+enum rbtty_error
+rbtty_get_font(struct rbtty* tty, struct rbtty_font** font)
+{
+  if(UNLIKELY(!tty || !font))
+    return RBTTY_INVALID_ARGUMENT;
+  *font = tty->font;
+  return RBTTY_NO_ERROR;
 }
 
 enum rbtty_error
@@ -277,10 +626,18 @@ rbtty_set_viewport
    const int width,
    const int height)
 {
+  enum lp_error lp_err = LP_NO_ERROR;
+
   if(UNLIKELY(!tty || width < 0 || height < 0))
     return RBTTY_INVALID_ARGUMENT;
-  return lp_to_rbtty_error
-    (lp_printer_set_viewport(tty->printer, x, y, width, height));
+  lp_err = lp_printer_set_viewport(tty->printer, x, y, width, height);
+  if(lp_err != LP_NO_ERROR)
+    return lp_to_rbtty_error(lp_err);
+  tty->viewport[0] = x;
+  tty->viewport[1] = y;
+  tty->viewport[2] = width;
+  tty->viewport[3] = height;
+  return setup_layout(tty);
 }
 
 enum rbtty_error
@@ -291,6 +648,368 @@ rbtty_translate_cursor(struct rbtty* tty, const int x)
   return rbtty_screen_translate_cursor(&tty->screen, x);
 }
 
+enum rbtty_error
+rbtty_hit_test
+  (struct rbtty* tty,
+   const int x,
+   const int y,
+   struct rbtty_position* pos,
+   int* is_hit)
+{
+  const struct rbtty_layout* layout = NULL;
+  const struct rbtty_row* row = NULL;
+  size_t irow = 0;
+  size_t column = 0;
+
+  if(UNLIKELY(!tty || !pos || !is_hit))
+    return RBTTY_INVALID_ARGUMENT;
+
+  *is_hit = 0;
+  layout = &tty->layout;
+  if(!layout->rows_count || y < 0 || tty->font->line_space <= 0)
+    return RBTTY_NO_ERROR;
+
+  irow = (size_t)(y / tty->font->line_space);
+  if(irow == 0) {
+    row = &layout->cmdrow;
+    if(!row->is_valid)
+      return RBTTY_NO_ERROR;
+    column = rbtty_layout_pick_column(row, x);
+    if(column < layout->prompt_len) {
+      pos->output = RBTTY_PROMPT;
+      pos->column = column;
+    } else {
+      pos->output = RBTTY_CMDOUT;
+      pos->column = column - layout->prompt_len;
+    }
+    pos->line = 0;
+  } else {
+    const struct rbtty_scrollback* sb = &tty->screen.scrollback;
+    const size_t first_id = rbtty_scrollback_line_id(sb, 0);
+    /* The top row is covered by the notice */
+    if(irow > layout->visible_count
+    || (layout->is_notice && irow == layout->visible_count))
+      return RBTTY_NO_ERROR;
+    row = layout->visible[irow - 1];
+    if(!row->is_valid || row->line_id < first_id) /* Evicted since */
+      return RBTTY_NO_ERROR;
+    pos->output = RBTTY_STDOUT;
+    pos->line = row->line_id - first_id;
+    pos->column = row->first + rbtty_layout_pick_column(row, x);
+  }
+  *is_hit = 1;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_locate
+  (struct rbtty* tty,
+   const struct rbtty_position* pos,
+   int* x,
+   int* y,
+   int* is_visible)
+{
+  const struct rbtty_layout* layout = NULL;
+  const struct rbtty_row* row = NULL;
+
+  if(UNLIKELY(!tty || !pos || !x || !y || !is_visible))
+    return RBTTY_INVALID_ARGUMENT;
+  if(UNLIKELY(pos->output != RBTTY_STDOUT && pos->output != RBTTY_PROMPT
+  && pos->output != RBTTY_CMDOUT))
+    return RBTTY_INVALID_ARGUMENT;
+
+  *is_visible = 0;
+  layout = &tty->layout;
+  if(pos->output == RBTTY_STDOUT) {
+    const struct rbtty_scrollback* sb = &tty->screen.scrollback;
+    size_t id = 0;
+    size_t count = layout->visible_count;
+    if(pos->line >= rbtty_scrollback_lines_count(sb))
+      return RBTTY_NO_ERROR;
+    id = rbtty_scrollback_line_id(sb, pos->line);
+    if(layout->is_notice && count)
+      --count;
+    /* A column at a wrap point is located at the start of the row it begins
+     * rather than at the end of the previous one */
+    FOR_EACH(size_t, i, 0, count) {
+      row = layout->visible[i];
+      if(!row->is_valid || row->line_id != id || pos->column < row->first
+      || pos->column > row->first + row->columns_count)
+        continue;
+      *x = row->x[pos->column - row->first];
+      *y = (int)(i + 1) * tty->font->line_space;
+      *is_visible = 1;
+      if(pos->column < row->first + row->columns_count)
+        break;
+    }
+  } else {
+    /* The command follows the prompt in the cmdrow */
+    const size_t begin = pos->output == RBTTY_CMDOUT ? layout->prompt_len : 0;
+    const size_t end =
+      pos->output == RBTTY_CMDOUT ? SIZE_MAX : layout->prompt_len;
+    size_t column = 0;
+    row = &layout->cmdrow;
+    if(!row->is_valid || begin > row->columns_count
+    || pos->column > row->columns_count - begin || pos->column > end - begin)
+      return RBTTY_NO_ERROR;
+    column = begin + pos->column;
+    *x = row->x[column];
+    *y = 0;
+    *is_visible = 1;
+  }
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_scroll(struct rbtty* tty, const long delta)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  rbtty_screen_scroll(&tty->screen, &tty->wrap, delta, stdout_rows(tty));
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_scroll_page(struct rbtty* tty, const int pages)
+{
+  size_t rows = 0;
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  rows = stdout_rows(tty);
+  rbtty_screen_scroll
+    (&tty->screen, &tty->wrap, pages * (long)MAX(rows, 1), rows);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_scroll_to(struct rbtty* tty, const size_t line)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  rbtty_screen_scroll_to(&tty->screen, &tty->wrap, line, stdout_rows(tty));
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_edit(struct rbtty* tty, const enum rbtty_edit edit)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_screen_edit(&tty->screen, edit);
+}
+
+enum rbtty_error
+rbtty_submit(struct rbtty* tty, const wchar_t** cmd, size_t* len)
+{
+  if(UNLIKELY(!tty || !cmd || !len))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_screen_submit(&tty->screen, cmd, len);
+}
+
+enum rbtty_error
+rbtty_register_command
+  (struct rbtty* tty,
+   const wchar_t* name,
+   enum rbtty_error (*execute)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   enum rbtty_error (*complete)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   void* data)
+{
+  size_t len = 0;
+  if(UNLIKELY(!tty || !name || !execute || tty->is_completing))
+    return RBTTY_INVALID_ARGUMENT;
+  len = wcslen(name);
+  if(UNLIKELY(!len || wcspbrk(name, L" \t\"")))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_registry_add
+    (&tty->registry, name, len, execute, complete, data);
+}
+
+enum rbtty_error
+rbtty_execute
+  (struct rbtty* tty,
+   const wchar_t** cmd,
+   size_t* len,
+   int* is_found)
+{
+  const struct rbtty_registry_command* command = NULL;
+  const struct rbtty_arg* argv = NULL;
+  size_t argc = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+
+  if(UNLIKELY(!tty || !cmd || !len || !is_found))
+    return RBTTY_INVALID_ARGUMENT;
+
+  *is_found = 0;
+  rbtty_err = rbtty_screen_submit(&tty->screen, cmd, len);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  rbtty_err = rbtty_registry_tokenize
+    (&tty->registry, *cmd, *len, 0, &argv, &argc);
+  if(rbtty_err != RBTTY_NO_ERROR || !argc)
+    return rbtty_err;
+  command = rbtty_registry_find(&tty->registry, argv[0].str, argv[0].len);
+  if(!command)
+    return RBTTY_NO_ERROR;
+  *is_found = 1;
+  return command->execute(tty, argc, argv, command->data);
+}
+
+enum rbtty_error
+rbtty_complete(struct rbtty* tty, size_t* count)
+{
+  struct rbtty_screen* scr = NULL;
+  const struct rbtty_registry_command* command = NULL;
+  const struct rbtty_attrib* attrib = NULL;
+  const wchar_t* chars = NULL;
+  const struct rbtty_span* spans = NULL;
+  const struct rbtty_arg* argv = NULL;
+  struct rbtty_arg suffix;
+  size_t argc = 0;
+  size_t len = 0;
+  size_t spans_count = 0;
+  size_t cursor = 0;
+  size_t plen = 0;
+  size_t n = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+
+  if(UNLIKELY(!tty || !count || tty->is_completing))
+    return RBTTY_INVALID_ARGUMENT;
+
+  *count = 0;
+  scr = &tty->screen;
+  rbtty_err = rbtty_screen_get_cmdbuf
+    (scr, &chars, &len, &spans, &spans_count, &cursor);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+
+  /* Split the command chars preceding the cursor, that follow the prompt */
+  plen = cursor - rbtty_cmdline_cursor(&scr->cmdline);
+  rbtty_err = rbtty_registry_tokenize
+    (&tty->registry, chars + plen, cursor - plen, 1, &argv, &argc);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+
+  ASSERT(argc);
+  if(argc == 1) {
+    n = rbtty_registry_complete_name(&tty->registry, argv);
+  } else {
+    rbtty_registry_begin_completion(&tty->registry, argv + argc - 1);
+    command = rbtty_registry_find(&tty->registry, argv[0].str, argv[0].len);
+    if(command && command->complete) {
+      tty->is_completing = 1;
+      rbtty_err = command->complete(tty, argc, argv, command->data);
+      tty->is_completing = 0;
+      if(rbtty_err != RBTTY_NO_ERROR) {
+        rbtty_registry_begin_completion(&tty->registry, argv + argc - 1);
+        return rbtty_err;
+      }
+    }
+    n = rbtty_registry_end_completion(&tty->registry);
+  }
+
+  /* Extend the word with the chars shared by the candidates */
+  attrib = rbtty_palette_get(&scr->palette, scr->cmdout_attrib);
+  rbtty_registry_common_suffix(&tty->registry, &suffix);
+  if(suffix.len) {
+    rbtty_err = rbtty_screen_write_wstring
+      (scr, RBTTY_CMDOUT, suffix.str, suffix.len, attrib->color);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+  }
+  if(n == 1) {
+    rbtty_err = rbtty_screen_write_wstring
+      (scr, RBTTY_CMDOUT, L" ", 1, attrib->color);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+  }
+  *count = n;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_add_completion
+  (struct rbtty* tty,
+   const wchar_t* str,
+   const size_t len)
+{
+  if(UNLIKELY(!tty || (!str && len) || !tty->is_completing))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_registry_add_candidate(&tty->registry, str, len);
+}
+
+enum rbtty_error
+rbtty_get_completions
+  (struct rbtty* tty,
+   const size_t first,
+   const size_t max,
+   struct rbtty_arg* candidates,
+   size_t* count)
+{
+  if(UNLIKELY(!tty || (!candidates && max) || !count))
+    return RBTTY_INVALID_ARGUMENT;
+  *count = rbtty_registry_get_candidates
+    (&tty->registry, first, max, candidates);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_setup_history(struct rbtty* tty, const size_t capacity)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  tty->screen.recall_id = RBTTY_HISTORY_NONE;
+  return rbtty_history_setup(&tty->screen.history, capacity);
+}
+
+enum rbtty_error
+rbtty_setup_scrollback
+  (struct rbtty* tty,
+   const size_t max_lines,
+   const size_t max_bytes)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty || (!max_lines && !max_bytes)))
+    return RBTTY_INVALID_ARGUMENT;
+  rbtty_err = rbtty_screen_setup_scrollback(&tty->screen, max_lines, max_bytes);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  rbtty_wrap_invalidate(&tty->wrap);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_setup_cold_scrollback
+  (struct rbtty* tty,
+   const size_t max_bytes,
+   const char* path)
+{
+  if(UNLIKELY(!tty || (!max_bytes && path)))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_screen_setup_cold_scrollback(&tty->screen, max_bytes, path);
+}
+
+enum rbtty_error
+rbtty_search_history
+  (struct rbtty* tty,
+   const wchar_t* pattern,
+   const size_t len,
+   const int is_next,
+   int* is_found)
+{
+  if(UNLIKELY(!tty || (!pattern && len) || !is_found))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_screen_search_history
+    (&tty->screen, pattern, len, is_next, is_found);
+}
+
 enum rbtty_error
 rbtty_print_wstring
   (struct rbtty* tty, 
@@ -298,8 +1017,357 @@ rbtty_print_wstring
    const wchar_t* str,
    const float color[3])
 {
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
   if(UNLIKELY(!tty || !str || !color))
     return RBTTY_INVALID_ARGUMENT;
-  return rbtty_screen_print_wstring(&tty->screen, output, str, color);
+  {
+    RBTTY_LATENCY_BEGIN(t0);
+    rbtty_err = rbtty_screen_write_wstring
+      (&tty->screen, output, str, wcslen(str), color);
+    RBTTY_LATENCY_END(&tty->print_latency, t0);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_write_wstring
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3])
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty || (!str && len) || !color))
+    return RBTTY_INVALID_ARGUMENT;
+  {
+    RBTTY_LATENCY_BEGIN(t0);
+    rbtty_err = rbtty_screen_write_wstring
+      (&tty->screen, output, str, len, color);
+    RBTTY_LATENCY_END(&tty->print_latency, t0);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_write_utf8
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const char* str,
+   const size_t len,
+   const float color[3])
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty || (!str && len) || !color))
+    return RBTTY_INVALID_ARGUMENT;
+  {
+    RBTTY_LATENCY_BEGIN(t0);
+    rbtty_err = rbtty_screen_write_utf8(&tty->screen, output, str, len, color);
+    RBTTY_LATENCY_END(&tty->print_latency, t0);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_log_wstring
+  (struct rbtty* tty,
+   const struct rbtty_line_info* info,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3])
+{
+  struct rbtty_line_meta meta;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty || !info || (!str && len) || !color
+  || !info_to_meta(info, &meta)))
+    return RBTTY_INVALID_ARGUMENT;
+  {
+    RBTTY_LATENCY_BEGIN(t0);
+    rbtty_err = rbtty_screen_log_wstring(&tty->screen, &meta, str, len, color);
+    RBTTY_LATENCY_END(&tty->print_latency, t0);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_log_utf8
+  (struct rbtty* tty,
+   const struct rbtty_line_info* info,
+   const char* str,
+   const size_t len,
+   const float color[3])
+{
+  struct rbtty_line_meta meta;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty || !info || (!str && len) || !color
+  || !info_to_meta(info, &meta)))
+    return RBTTY_INVALID_ARGUMENT;
+  {
+    RBTTY_LATENCY_BEGIN(t0);
+    rbtty_err = rbtty_screen_log_utf8(&tty->screen, &meta, str, len, color);
+    RBTTY_LATENCY_END(&tty->print_latency, t0);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_get_line_info
+  (struct rbtty* tty,
+   const size_t line,
+   struct rbtty_line_info* info)
+{
+  const struct rbtty_line_meta meta_default = RBTTY_LINE_META_DEFAULT;
+  const struct rbtty_scrollback* sb = NULL;
+  const struct rbtty_line_meta* meta = NULL;
+
+  if(UNLIKELY(!tty || !info))
+    return RBTTY_INVALID_ARGUMENT;
+  sb = &tty->screen.scrollback;
+  if(UNLIKELY(line >= rbtty_scrollback_lines_count(sb)))
+    return RBTTY_INVALID_ARGUMENT;
+  meta = rbtty_scrollback_line_meta(sb, line);
+  if(!meta)
+    meta = &meta_default;
+  info->level = (enum rbtty_level)meta->level;
+  info->channel = meta->channel;
+  info->timestamp = meta->timestamp;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_create_view
+  (struct rbtty* tty,
+   const struct rbtty_filter* filter,
+   size_t* view)
+{
+  if(UNLIKELY(!tty || !filter || !view
+  || filter->min_level < RBTTY_LEVEL_DEBUG
+  || filter->min_level > RBTTY_LEVEL_ERROR
+  || (filter->channel != RBTTY_CHANNEL_ANY && filter->channel > UINT16_MAX)))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_screen_create_view(&tty->screen, filter, view);
+}
+
+enum rbtty_error
+rbtty_remove_view(struct rbtty* tty, const size_t view)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  tty->drawn_id = SIZE_MAX;
+  tty->skipped_count = 0;
+  return rbtty_screen_remove_view(&tty->screen, view);
+}
+
+enum rbtty_error
+rbtty_show_view(struct rbtty* tty, const size_t view)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  tty->drawn_id = SIZE_MAX;
+  tty->skipped_count = 0;
+  return rbtty_screen_show_view(&tty->screen, view);
+}
+
+enum rbtty_error
+rbtty_setup_queue
+  (struct rbtty* tty,
+   const size_t size,
+   const enum rbtty_queue_policy policy)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+
+  if(UNLIKELY(!tty || !size
+  || (policy != RBTTY_QUEUE_BLOCK && policy != RBTTY_QUEUE_DROP)))
+    return RBTTY_INVALID_ARGUMENT;
+  rbtty_err = rbtty_queue_drain(&tty->queue, &tty->screen, SIZE_MAX);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  return rbtty_queue_setup(&tty->queue, size, policy);
+}
+
+enum rbtty_error
+rbtty_queue_wstring
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3])
+{
+  if(UNLIKELY(!tty || (!str && len) || !color))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_queue_push(&tty->queue, output, RBTTY_QUEUE_WCHAR, str,
+    len * sizeof(wchar_t), color);
+}
+
+enum rbtty_error
+rbtty_queue_utf8
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const char* str,
+   const size_t len,
+   const float color[3])
+{
+  if(UNLIKELY(!tty || (!str && len) || !color))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_queue_push(&tty->queue, output, RBTTY_QUEUE_UTF8, str, len,
+    color);
+}
+
+enum rbtty_error
+rbtty_setup_coalescing(struct rbtty* tty, const size_t frame_budget)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  tty->frame_budget = frame_budget;
+  tty->drawn_id = SIZE_MAX;
+  tty->skipped_count = 0;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_flush(struct rbtty* tty)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_queue_drain(&tty->queue, &tty->screen, SIZE_MAX);
+}
+
+enum rbtty_error
+rbtty_draw(struct rbtty* tty)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  {
+    RBTTY_LATENCY_BEGIN(t0);
+    rbtty_err = draw(tty);
+    RBTTY_LATENCY_END(&tty->draw_latency, t0);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_attach_fd
+  (struct rbtty* tty,
+   const int fd,
+   const struct rbtty_fd_options* options)
+{
+  const struct rbtty_fd_options default_options = RBTTY_FD_OPTIONS_DEFAULT;
+  if(UNLIKELY(!tty || fd < 0))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_source_attach
+    (&tty->source, fd, options ? options : &default_options);
+}
+
+enum rbtty_error
+rbtty_detach_fd(struct rbtty* tty)
+{
+  if(UNLIKELY(!tty))
+    return RBTTY_INVALID_ARGUMENT;
+  rbtty_source_detach(&tty->source);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_pump
+  (struct rbtty* tty,
+   const unsigned long budget_us,
+   int* is_drained)
+{
+  uint64_t deadline = 0;
+  int drained = 1;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+
+  if(UNLIKELY(!tty)) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto exit;
+  }
+  if(!rbtty_source_is_attached(&tty->source))
+    goto exit;
+
+  deadline = rbtty_stats_time() + (uint64_t)budget_us * 1000;
+  for(;;) {
+    size_t len = 0;
+    const enum rbtty_source_status status =
+      rbtty_source_read(&tty->source, &len);
+    if(status == RBTTY_SOURCE_AGAIN)
+      break;
+    if(status == RBTTY_SOURCE_END) {
+      rbtty_source_detach(&tty->source);
+      break;
+    }
+    {
+      RBTTY_LATENCY_BEGIN(t0);
+      /* The bytes are decoded in place into the open line of the stdout */
+      rbtty_err = rbtty_screen_write_utf8(&tty->screen, RBTTY_STDOUT,
+        tty->source.buffer, len, tty->source.options.color);
+      RBTTY_LATENCY_END(&tty->print_latency, t0);
+    }
+    if(rbtty_err != RBTTY_NO_ERROR)
+      goto exit;
+    if(rbtty_stats_time() >= deadline) {
+      drained = 0;
+      break;
+    }
+  }
+
+exit:
+  if(is_drained)
+    *is_drained = drained;
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_save_snapshot(struct rbtty* tty, const char* path)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty || !path))
+    return RBTTY_INVALID_ARGUMENT;
+  rbtty_err = rbtty_queue_drain(&tty->queue, &tty->screen, SIZE_MAX);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  return rbtty_snapshot_save(&tty->screen, path);
+}
+
+enum rbtty_error
+rbtty_load_snapshot(struct rbtty* tty, const char* path)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  if(UNLIKELY(!tty || !path))
+    return RBTTY_INVALID_ARGUMENT;
+  /* The laid out rows may reference attributes of the previous palette */
+  invalidate_rows(tty);
+  rbtty_err = rbtty_snapshot_load(&tty->screen, path);
+  rbtty_wrap_invalidate(&tty->wrap);
+  tty->drawn_id = SIZE_MAX;
+  tty->skipped_count = 0;
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_get_stats(struct rbtty* tty, struct rbtty_stats* stats)
+{
+  if(UNLIKELY(!tty || !stats))
+    return RBTTY_INVALID_ARGUMENT;
+  memset(stats, 0, sizeof(struct rbtty_stats));
+#ifdef RBTTY_ENABLE_STATS
+  {
+    const struct rbtty_scrollback* sb = &tty->screen.scrollback;
+    stats->chars_count = sb->chars_count;
+    stats->lines_count = sb->pushed_count;
+    stats->evicted_lines_count = sb->evicted_count;
+    stats->allocations_count =
+      __atomic_load_n(&tty->mem_counter.allocs_count, __ATOMIC_RELAXED);
+    stats->frees_count =
+      __atomic_load_n(&tty->mem_counter.frees_count, __ATOMIC_RELAXED);
+    stats->screen_size =
+      MEM_ALLOCATED_SIZE(&tty->screen_mem_counter.allocator);
+    stats->glyph_hits_count = tty->font->glyph_cache.hits_count;
+    stats->glyph_misses_count = tty->font->glyph_cache.misses_count;
+    stats->print = tty->print_latency;
+    stats->draw = tty->draw_latency;
+  }
+#endif
+  return RBTTY_NO_ERROR;
 }
 
@@ -4,6 +4,7 @@
 #include "rbtty_error.h"
 #include "rbtty_types.h"
 #include <snlsys/snlsys.h>
+#include <wchar.h>
 
 #if defined(RBTTY_SHARED_BUILD)
   #define RBTTY_API EXPORT_SYM
@@ -18,10 +19,86 @@
 #endif
 #define RBTTY(func) RBTTY_CALL(rbtty_##func)
 
+/* Number of buckets of a latency histogram */
+#define RBTTY_LATENCY_BUCKETS_COUNT 32
+
+/* Histogram of the durations of a function. The bucket i counts the calls
+ * that lasted [2^i, 2^(i+1)[ nanoseconds; the last one also counts the
+ * longer calls */
+struct rbtty_latency {
+  uint64_t buckets[RBTTY_LATENCY_BUCKETS_COUNT];
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t max_ns;
+};
+
+/* Cumulated since the creation of the tty */
+struct rbtty_stats {
+  /* Stdout */
+  uint64_t chars_count; /* Chars written into the scrollback */
+  uint64_t lines_count; /* Lines written into the scrollback */
+  uint64_t evicted_lines_count; /* Lines evicted from the scrollback */
+  /* Memory */
+  uint64_t allocations_count; /* Allocations made by the tty */
+  uint64_t frees_count;
+  size_t screen_size; /* Bytes currently allocated by the screen */
+  /* Glyph cache of the font, shared by the ttys drawing with it */
+  uint64_t glyph_hits_count;
+  uint64_t glyph_misses_count; /* Glyphs rasterized on demand */
+  /* Latencies */
+  struct rbtty_latency print; /* rbtty_print_wstring and rbtty_write_<*> */
+  struct rbtty_latency draw;
+};
+
+/* Options of rbtty_attach_fd */
+struct rbtty_fd_options {
+  float color[3]; /* Default color of the read text */
+  size_t buffer_size; /* Size of the read buffer. 0 <=> default size */
+  int follow; /* Keep reading at the end of file, e.g. of a growing file */
+  int close_fd; /* Close the fd when it is detached */
+};
+
+#define RBTTY_FD_OPTIONS_DEFAULT {{1.f, 1.f, 1.f}, 0, 0, 0}
+
+/* Position of a char in the stdout or in the command buffer */
+struct rbtty_position {
+  enum rbtty_output output; /* RBTTY_STDOUT, RBTTY_PROMPT or RBTTY_CMDOUT */
+  size_t line; /* Line of the stdout, 0 being the oldest one */
+  size_t column; /* Char of the line, of the prompt or of the command */
+};
+
+/* Metadata of a line of the stdout. The lines that are not logged have the
+ * RBTTY_LEVEL_INFO level, the channel 0 and a null timestamp */
+struct rbtty_line_info {
+  enum rbtty_level level;
+  uint16_t channel; /* Tag of the line defined by the application */
+  uint64_t timestamp; /* In a unit defined by the application */
+};
+
+/* Match any channel in a filter */
+#define RBTTY_CHANNEL_ANY UINT32_MAX
+
+/* Lines of a level greater than or equal to `min_level' and of the channel
+ * `channel' */
+struct rbtty_filter {
+  enum rbtty_level min_level;
+  uint32_t channel; /* RBTTY_CHANNEL_ANY <=> any channel */
+};
+
+/* View showing all the lines of the stdout */
+#define RBTTY_VIEW_ALL SIZE_MAX
+
+/* Word of a command line. Its chars are not null terminated */
+struct rbtty_arg {
+  const wchar_t* str;
+  size_t len;
+};
+
 struct mem_allocator;
 struct rb_context;
 struct rbi;
 struct rbtty;
+struct rbtty_font;
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,11 +119,48 @@ RBTTY_API enum rbtty_error
 rbtty_ref_put
   (struct rbtty* tty);
 
+/* Load the font of the tty. If its font is shared, the other ttys using it
+ * draw with the new font too */
 RBTTY_API enum rbtty_error
 rbtty_set_font
   (struct rbtty* tty,
    const char* font_path);
 
+/* Define the directory where the rasterized glyphs of the fonts of the tty
+ * are saved. See rbtty_font_set_cache_dir */
+RBTTY_API enum rbtty_error
+rbtty_set_font_cache_dir
+  (struct rbtty* tty,
+   const char* path);
+
+/* Load the font of the tty in background. See rbtty_font_load_async */
+RBTTY_API enum rbtty_error
+rbtty_set_font_async
+  (struct rbtty* tty,
+   const char* font_path);
+
+/* Install the font loaded by rbtty_set_font_async once it is ready. See
+ * rbtty_font_poll */
+RBTTY_API enum rbtty_error
+rbtty_poll_font
+  (struct rbtty* tty,
+   int* is_loaded);
+
+/* Draw the tty with `font' rather than with its current font, e.g. to share
+ * one glyph set and one texture between several ttys. The font must be
+ * created on the render context of the tty */
+RBTTY_API enum rbtty_error
+rbtty_attach_font
+  (struct rbtty* tty,
+   struct rbtty_font* font);
+
+/* Retrieve the font of the tty, either its own font or the attached one. No
+ * reference is taken on the returned font */
+RBTTY_API enum rbtty_error
+rbtty_get_font
+  (struct rbtty* tty,
+   struct rbtty_font** font);
+
 RBTTY_API enum rbtty_error
 rbtty_set_viewport
   (struct rbtty* tty,
@@ -55,11 +169,195 @@ rbtty_set_viewport
    const int width,
    const int height);
 
+/* Submit the visible lines to the line printer. Only the lines modified
+ * since the previous draw are laid out again */
+RBTTY_API enum rbtty_error
+rbtty_draw
+  (struct rbtty* tty);
+
 RBTTY_API enum rbtty_error
 rbtty_translate_cursor
   (struct rbtty* tty,
    const int x);
 
+/* Find the char boundary nearest to the (`x', `y') point of the viewport in
+ * the rows laid out by the last draw; the command line is drawn at the
+ * bottom of the viewport, i.e. at y = 0, and the stdout rows above it. Its
+ * column is the one of the char following the boundary. `is_hit' is set to
+ * 0 if no row was drawn at `y' */
+RBTTY_API enum rbtty_error
+rbtty_hit_test
+  (struct rbtty* tty,
+   const int x,
+   const int y,
+   struct rbtty_position* pos,
+   int* is_hit);
+
+/* Return the point of the viewport where the left side of the `pos' char was
+ * drawn by the last draw. The column following the last char of a row
+ * locates its right side. `is_visible' is set to 0 if the char was not
+ * drawn */
+RBTTY_API enum rbtty_error
+rbtty_locate
+  (struct rbtty* tty,
+   const struct rbtty_position* pos,
+   int* x,
+   int* y,
+   int* is_visible);
+
+/* Scroll the stdout by `delta' rows, toward the older rows if `delta' is
+ * positive. The lines wider than the viewport are wrapped on several rows.
+ * The view does not move as new lines are written, unless it shows the
+ * newest row */
+RBTTY_API enum rbtty_error
+rbtty_scroll
+  (struct rbtty* tty,
+   const long delta);
+
+/* Scroll the stdout by `pages' screens, toward the older lines if `pages' is
+ * positive */
+RBTTY_API enum rbtty_error
+rbtty_scroll_page
+  (struct rbtty* tty,
+   const int pages);
+
+/* Scroll the stdout so that the first row of the `line' line, 0 being the
+ * oldest one, is the top visible row. A line past the newest one shows the
+ * newest rows */
+RBTTY_API enum rbtty_error
+rbtty_scroll_to
+  (struct rbtty* tty,
+   const size_t line);
+
+/* Apply `edit' to the command line at the cursor */
+RBTTY_API enum rbtty_error
+rbtty_edit
+  (struct rbtty* tty,
+   const enum rbtty_edit edit);
+
+/* Move the prompt and the command line to the stdout and clear the command
+ * line. `cmd' points to the `len' chars of the submitted command, without
+ * the prompt. They are valid until the next edit or draw of the tty */
+RBTTY_API enum rbtty_error
+rbtty_submit
+  (struct rbtty* tty,
+   const wchar_t** cmd,
+   size_t* len);
+
+/* Define the maximum number of submitted commands kept in the history. The
+ * history is cleared */
+RBTTY_API enum rbtty_error
+rbtty_setup_history
+  (struct rbtty* tty,
+   const size_t capacity);
+
+/* Define the maximum number of lines of the stdout kept in the scrollback
+ * and the maximum number of bytes used to store them; a null limit is not
+ * enforced. The most recent lines that fit in the new limits are kept and,
+ * once they are reached, the oldest lines are evicted as new ones are
+ * written. The byte budget bounds the storage of the chars, of their
+ * attributes and of the line descriptors. By default, 8192 lines are kept */
+RBTTY_API enum rbtty_error
+rbtty_setup_scrollback
+  (struct rbtty* tty,
+   const size_t max_lines,
+   const size_t max_bytes);
+
+/* Keep the lines evicted from the scrollback in a cold tier where they are
+ * compressed by blocks into at most `max_bytes' bytes. If `path' is not NULL
+ * the compressed blocks are stored in this file, which is created or
+ * truncated and mapped in memory; otherwise they are stored on the heap.
+ * When the cold tier is full, its oldest blocks are evicted. The cold lines
+ * are scrolled through like the other ones and their blocks are
+ * decompressed on demand. The previous cold lines are discarded. A null
+ * `max_bytes' disables the cold tier, which is disabled by default */
+RBTTY_API enum rbtty_error
+rbtty_setup_cold_scrollback
+  (struct rbtty* tty,
+   const size_t max_bytes,
+   const char* path);
+
+/* Reverse incremental search. Replace the command line by the newest
+ * command of the history containing the `len' chars of `pattern', starting
+ * from the command found by the previous search, if any, and not edited
+ * since. If `is_next' is not null, that command is skipped. `is_found' is
+ * set to 0 and the command line is kept if there is no match */
+RBTTY_API enum rbtty_error
+rbtty_search_history
+  (struct rbtty* tty,
+   const wchar_t* pattern,
+   const size_t len,
+   const int is_next,
+   int* is_found);
+
+/* Register the command named by the null terminated `name', which does not
+ * contain blanks nor double quotes, or replace its callbacks if it is
+ * already registered. `execute' is invoked with the `argc' words of the
+ * submitted command line, the first one being the name of the command, and
+ * `complete', which may be NULL, with the words preceding the cursor, the
+ * last one being the word to complete. They must not edit nor submit the
+ * command line of the tty */
+RBTTY_API enum rbtty_error
+rbtty_register_command
+  (struct rbtty* tty,
+   const wchar_t* name,
+   enum rbtty_error (*execute)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   enum rbtty_error (*complete)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   void* data);
+
+/* Submit the command line as rbtty_submit, split it in words separated by
+ * blanks or delimited by double quotes, and execute the registered command
+ * named by the first word. The words reference the submitted chars and are
+ * not copied. `is_found' is set to 0 if no command is registered under this
+ * name, the command line being submitted anyway */
+RBTTY_API enum rbtty_error
+rbtty_execute
+  (struct rbtty* tty,
+   const wchar_t** cmd,
+   size_t* len,
+   int* is_found);
+
+/* Complete the word preceding the cursor, i.e. a command name if it is the
+ * first word and an argument of the command otherwise. The word is extended
+ * with the chars shared by all the candidates, followed by a space if there
+ * is only one. `count' receives the number of candidates */
+RBTTY_API enum rbtty_error
+rbtty_complete
+  (struct rbtty* tty,
+   size_t* count);
+
+/* Add a candidate to the ongoing completion. Must be called by the
+ * `complete' callback of a command; the candidates that do not start with
+ * the completed word are ignored */
+RBTTY_API enum rbtty_error
+rbtty_add_completion
+  (struct rbtty* tty,
+   const wchar_t* str,
+   const size_t len);
+
+/* Write in `candidates' at most `max' candidates of the last completion in
+ * lexicographic order, from the `first' one, and their number in `count'.
+ * They are valid until the next completion or registration */
+RBTTY_API enum rbtty_error
+rbtty_get_completions
+  (struct rbtty* tty,
+   const size_t first,
+   const size_t max,
+   struct rbtty_arg* candidates,
+   size_t* count);
+
+/* Print the null terminated `str' with `color'. On the RBTTY_STDOUT, the
+ * SGR escape sequences define the color of the following text, `color' being
+ * the default one, and bold; the other escape sequences are skipped. A
+ * sequence split across consecutive writes is parsed once completed */
 RBTTY_API enum rbtty_error
 rbtty_print_wstring
   (struct rbtty* tty,
@@ -67,6 +365,240 @@ rbtty_print_wstring
    const wchar_t* str,
    const float color[3]);
 
+/* Print the `len' chars of `str'. `str' does not have to be null terminated
+ * and its size is not limited. See rbtty_print_wstring for the escape
+ * sequences */
+RBTTY_API enum rbtty_error
+rbtty_write_wstring
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3]);
+
+/* Print `len' bytes of UTF-8 encoded text. `str' does not have to be null
+ * terminated and its size is not limited. A multi-byte sequence split across
+ * two consecutive RBTTY_STDOUT writes is decoded once completed */
+RBTTY_API enum rbtty_error
+rbtty_write_utf8
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const char* str,
+   const size_t len,
+   const float color[3]);
+
+/* Print on the RBTTY_STDOUT the `len' chars of `str' as lines tagged with
+ * `info'. The pending output is terminated beforehand and `str' is
+ * terminated by a new line if it does not end with one. See
+ * rbtty_print_wstring for the escape sequences */
+RBTTY_API enum rbtty_error
+rbtty_log_wstring
+  (struct rbtty* tty,
+   const struct rbtty_line_info* info,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3]);
+
+/* Print `len' bytes of UTF-8 encoded text as lines tagged with `info'. See
+ * rbtty_log_wstring */
+RBTTY_API enum rbtty_error
+rbtty_log_utf8
+  (struct rbtty* tty,
+   const struct rbtty_line_info* info,
+   const char* str,
+   const size_t len,
+   const float color[3]);
+
+/* Retrieve the metadata of the line `line' of the stdout, 0 being the oldest
+ * one. The cold lines do not keep their metadata; they are reported as lines
+ * that are not logged */
+RBTTY_API enum rbtty_error
+rbtty_get_line_info
+  (struct rbtty* tty,
+   const size_t line,
+   struct rbtty_line_info* info);
+
+/* Create a view of the lines of the stdout matching `filter'. It is
+ * populated once from the lines of the scrollback and then updated as lines
+ * are written, so that it is shown without scanning the scrollback. The
+ * lines leave the view once moved to the cold tier since the cold lines do
+ * not keep their metadata */
+RBTTY_API enum rbtty_error
+rbtty_create_view
+  (struct rbtty* tty,
+   const struct rbtty_filter* filter,
+   size_t* view);
+
+/* Remove a view created by rbtty_create_view. If it is shown, all the lines
+ * are shown instead */
+RBTTY_API enum rbtty_error
+rbtty_remove_view
+  (struct rbtty* tty,
+   const size_t view);
+
+/* Show the lines of `view', or all the lines if it is RBTTY_VIEW_ALL, from
+ * the newest ones. The lines of rbtty_scroll_to are then the lines of the
+ * view, while the positions of rbtty_hit_test and of rbtty_locate still
+ * reference the lines of the stdout */
+RBTTY_API enum rbtty_error
+rbtty_show_view
+  (struct rbtty* tty,
+   const size_t view);
+
+/* Define the size in bytes of the queue of the thread safe print functions
+ * and what they do when it is full. The queued text is written out before
+ * the queue is resized. Not thread safe */
+RBTTY_API enum rbtty_error
+rbtty_setup_queue
+  (struct rbtty* tty,
+   const size_t size,
+   const enum rbtty_queue_policy policy);
+
+/* Thread safe variant of rbtty_write_wstring. The text is queued and written
+ * out by the next rbtty_flush or rbtty_draw. With the RBTTY_QUEUE_BLOCK
+ * policy, it must not be called by the thread that drains the queue */
+RBTTY_API enum rbtty_error
+rbtty_queue_wstring
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3]);
+
+/* Thread safe variant of rbtty_write_utf8. See rbtty_queue_wstring */
+RBTTY_API enum rbtty_error
+rbtty_queue_utf8
+  (struct rbtty* tty,
+   const enum rbtty_output output,
+   const char* str,
+   const size_t len,
+   const float color[3]);
+
+/* Coalesce the floods of text. Each rbtty_draw writes out at most about
+ * `frame_budget' bytes of queued text, the remaining text being kept queued
+ * for the next frames. While the stdout shows its newest rows, the number of
+ * lines that scrolled past since the previous frame without being drawn is
+ * reported by a notice drawn over the top row, until a frame shows all the
+ * new lines. A null budget disables the coalescing, which is the default */
+RBTTY_API enum rbtty_error
+rbtty_setup_coalescing
+  (struct rbtty* tty,
+   const size_t frame_budget);
+
+/* Write out the queued text. rbtty_draw flushes the queue first, up to the
+ * coalescing budget if any */
+RBTTY_API enum rbtty_error
+rbtty_flush
+  (struct rbtty* tty);
+
+/* Let the tty read the stdout from `fd', e.g. a pipe, a pty or a file. The
+ * fd is switched to the non blocking mode and read by rbtty_pump; its bytes
+ * are handled as by rbtty_write_utf8, with the default color of `options'.
+ * The previously attached fd, if any, is detached. `options' may be NULL */
+RBTTY_API enum rbtty_error
+rbtty_attach_fd
+  (struct rbtty* tty,
+   const int fd,
+   const struct rbtty_fd_options* options);
+
+/* Stop reading the attached fd. Its status flags are restored unless it is
+ * closed, with respect to its options */
+RBTTY_API enum rbtty_error
+rbtty_detach_fd
+  (struct rbtty* tty);
+
+/* Read the attached fd until no byte is available or until `budget_us'
+ * microseconds elapsed; a null budget reads it once. `is_drained', which may
+ * be NULL, is set to 0 if bytes may remain to be read, i.e. if rbtty_pump
+ * has to be called again before waiting for the fd to be readable. The fd
+ * is detached at the end of its stream, unless it is followed */
+RBTTY_API enum rbtty_error
+rbtty_pump
+  (struct rbtty* tty,
+   const unsigned long budget_us,
+   int* is_drained);
+
+/* Save the state of the tty into the snapshot file `path': the lines of the
+ * stdout and their colors, the prompt, the command line, the history and
+ * the scroll position. The queued text is written out first. The cold lines
+ * are not saved. The file is replaced atomically and is only read by builds
+ * of the library with the same data model */
+RBTTY_API enum rbtty_error
+rbtty_save_snapshot
+  (struct rbtty* tty,
+   const char* path);
+
+/* Restore the state of the tty from the snapshot file `path'. The file is
+ * mapped and the lines are copied in bulk, without being parsed. The
+ * scrollback takes the capacity it was saved with and the cold lines are
+ * discarded. On error the state of the tty is kept, except the prompt and
+ * the command line that may have been cleared */
+RBTTY_API enum rbtty_error
+rbtty_load_snapshot
+  (struct rbtty* tty,
+   const char* path);
+
+/* Retrieve the statistics of the tty. They are only gathered if the library
+ * is built with RBTTY_ENABLE_STATS; otherwise they are all null */
+RBTTY_API enum rbtty_error
+rbtty_get_stats
+  (struct rbtty* tty,
+   struct rbtty_stats* stats);
+
+/* A font is the glyph set of a font file, rasterized on demand and uploaded
+ * to the render backend. Each tty is created with its own font, but several
+ * ttys of a render context may draw with the same font: its glyphs are then
+ * rasterized and uploaded once for all of them and a new load of the font
+ * lays out all of them again */
+RBTTY_API enum rbtty_error
+rbtty_font_create
+  (struct rbi* rbi,
+   struct rb_context* ctxt,
+   struct mem_allocator* allocator, /* May be NULL */
+   struct rbtty_font** font);
+
+RBTTY_API enum rbtty_error
+rbtty_font_ref_get
+  (struct rbtty_font* font);
+
+RBTTY_API enum rbtty_error
+rbtty_font_ref_put
+  (struct rbtty_font* font);
+
+RBTTY_API enum rbtty_error
+rbtty_font_load
+  (struct rbtty_font* font,
+   const char* font_path);
+
+/* Define the directory where the rasterized glyphs of the font are saved.
+ * The next loads of a font whose file, line space and charset did not change
+ * read its glyphs from there rather than rasterizing them. The directory
+ * must exist. A NULL `path' disables the glyph files */
+RBTTY_API enum rbtty_error
+rbtty_font_set_cache_dir
+  (struct rbtty_font* font,
+   const char* path);
+
+/* Load the font and rasterize its common glyphs in background, on several
+ * threads. The ttys keep drawing with the current font until the new one is
+ * installed by rbtty_font_poll. A pending load is cancelled by a new call to
+ * rbtty_font_load or rbtty_font_load_async. The allocator of the font must
+ * be thread safe */
+RBTTY_API enum rbtty_error
+rbtty_font_load_async
+  (struct rbtty_font* font,
+   const char* font_path);
+
+/* Check without blocking whether the font loaded by rbtty_font_load_async is
+ * ready and, if so, install it. `is_loaded' is set to 1 if no load is
+ * pending anymore. If the load failed, its error is returned and the
+ * previous font is kept. Must be called on the thread of the render backend,
+ * e.g. before each rbtty_draw */
+RBTTY_API enum rbtty_error
+rbtty_font_poll
+  (struct rbtty_font* font,
+   int* is_loaded);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,126 @@
+#include "rbtty_advance.h"
+#include <font_rsrc.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE size_t
+advance_slot(const struct rbtty_advance* advance, const uint32_t key)
+{
+  size_t slot = (size_t)((key * 2654435761u) >> 8) & (advance->size - 1);
+  while(advance->table[slot].key && advance->table[slot].key != key)
+    slot = (slot + 1) & (advance->size - 1);
+  return slot;
+}
+
+/* Read the advance of `c' from the font */
+static int
+font_advance(const struct rbtty_advance* advance, const wchar_t c)
+{
+  struct font_glyph* glyph = NULL;
+  struct font_glyph_desc desc;
+  int width = advance->fallback_width;
+
+  if(!advance->font_rsrc)
+    return width;
+  if(font_rsrc_get_glyph(advance->font_rsrc, c, &glyph) != FONT_NO_ERROR)
+    return width;
+  if(font_glyph_get_desc(glyph, &desc) == FONT_NO_ERROR)
+    width = desc.width;
+  FONT(glyph_ref_put(glyph));
+  return width;
+}
+
+/* Keep the load factor lower than 1/2. Return 0 on allocation failure */
+static int
+advance_reserve(struct rbtty_advance* advance)
+{
+  struct rbtty_advance_entry* table = advance->table;
+  const size_t prev_size = advance->size;
+  const size_t size = prev_size ? prev_size * 2 : 256;
+
+  if((advance->count + 1) * 2 <= advance->size)
+    return 1;
+  advance->table = MEM_CALLOC
+    (advance->allocator, size, sizeof(struct rbtty_advance_entry));
+  if(!advance->table) {
+    advance->table = table;
+    return 0;
+  }
+  advance->size = size;
+  FOR_EACH(size_t, i, 0, prev_size) {
+    if(table[i].key)
+      advance->table[advance_slot(advance, table[i].key)] = table[i];
+  }
+  if(table)
+    MEM_FREE(advance->allocator, table);
+  return 1;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_advance functions
+ *
+ ******************************************************************************/
+void
+rbtty_advance_init
+  (struct mem_allocator* allocator,
+   struct rbtty_advance* advance)
+{
+  ASSERT(allocator && advance);
+  memset(advance, 0, sizeof(struct rbtty_advance));
+  advance->allocator = allocator;
+}
+
+void
+rbtty_advance_shutdown(struct rbtty_advance* advance)
+{
+  ASSERT(advance);
+  if(advance->table)
+    MEM_FREE(advance->allocator, advance->table);
+  advance->table = NULL;
+  advance->size = advance->count = 0;
+}
+
+void
+rbtty_advance_setup
+  (struct rbtty_advance* advance,
+   struct font_rsrc* font_rsrc,
+   const wchar_t fallback)
+{
+  ASSERT(advance);
+  if(advance->table)
+    memset(advance->table, 0, advance->size * sizeof(advance->table[0]));
+  advance->count = 0;
+  advance->font_rsrc = font_rsrc;
+  advance->fallback_width = 0;
+  advance->fallback_width = font_advance(advance, fallback);
+  FOR_EACH(int, i, 0, RBTTY_ADVANCE_ASCII_COUNT)
+    advance->ascii[i] = font_advance(advance, (wchar_t)i);
+}
+
+int
+rbtty_advance_lookup(struct rbtty_advance* advance, const wchar_t c)
+{
+  const uint32_t key = (uint32_t)c + 1;
+  struct rbtty_advance_entry* entry = NULL;
+  ASSERT(advance);
+
+  if(advance->size) {
+    entry = advance->table + advance_slot(advance, key);
+    if(entry->key)
+      return entry->width;
+  }
+  if(!advance_reserve(advance)) /* Not memoized */
+    return font_advance(advance, c);
+  entry = advance->table + advance_slot(advance, key);
+  entry->key = key;
+  entry->width = font_advance(advance, c);
+  ++advance->count;
+  return entry->width;
+}
+
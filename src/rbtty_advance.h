@@ -0,0 +1,67 @@
+#ifndef RBTTY_ADVANCE_H
+#define RBTTY_ADVANCE_H
+
+#include "rbtty_error.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Number of chars whose advance is stored in the dense table */
+#define RBTTY_ADVANCE_ASCII_COUNT 128
+
+struct font_rsrc;
+struct mem_allocator;
+
+struct rbtty_advance_entry {
+  uint32_t key; /* Char + 1; 0 <=> empty slot */
+  int width;
+};
+
+/* Horizontal advance of the glyphs of a font. The advances of the ASCII
+ * chars are read from the font when it is set up and stored in a dense
+ * table. The advance of another char is read on its first query and
+ * memoized, without rasterizing its glyph */
+struct rbtty_advance {
+  int ascii[RBTTY_ADVANCE_ASCII_COUNT];
+  struct rbtty_advance_entry* table; /* Open addressing hash table */
+  size_t size; /* Power of 2 */
+  size_t count;
+  struct font_rsrc* font_rsrc;
+  int fallback_width;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_advance_init
+  (struct mem_allocator* allocator,
+   struct rbtty_advance* advance);
+
+extern LOCAL_SYM void
+rbtty_advance_shutdown
+  (struct rbtty_advance* advance);
+
+/* Forget the memoized advances and read the next ones from `font_rsrc'. The
+ * chars without glyph advance as the `fallback' char */
+extern LOCAL_SYM void
+rbtty_advance_setup
+  (struct rbtty_advance* advance,
+   struct font_rsrc* font_rsrc,
+   const wchar_t fallback);
+
+/* Advance of a char out of the dense table */
+extern LOCAL_SYM int
+rbtty_advance_lookup
+  (struct rbtty_advance* advance,
+   const wchar_t c);
+
+static FINLINE int
+rbtty_advance_get(struct rbtty_advance* advance, const wchar_t c)
+{
+  ASSERT(advance);
+  if((uint32_t)c < RBTTY_ADVANCE_ASCII_COUNT)
+    return advance->ascii[c];
+  return rbtty_advance_lookup(advance, c);
+}
+
+#endif /* RBTTY_ADVANCE_H */
+
@@ -0,0 +1,392 @@
+#define _POSIX_C_SOURCE 200112L /* clock_gettime */
+
+#include "rbtty.h"
+#include "rbtty_test_utils.h"
+#include <time.h>
+
+/* Number of stdout lines kept by the benchmarked ttys */
+#define SCROLLBACK_LINES 8192
+
+/* Allocation counters of the allocator of the benchmarked tty */
+struct alloc_counter {
+  size_t allocs; /* alloc, calloc and aligned_alloc calls */
+  size_t reallocs;
+  size_t frees;
+};
+
+struct bench {
+  const char* name;
+  size_t ops; /* Printed lines, inserted chars, loaded fonts, ... */
+  size_t chars;
+  double seconds;
+  struct alloc_counter allocs; /* Counted during the measure only */
+};
+
+struct context {
+  struct rbi rbi;
+  struct mem_allocator allocator;
+  struct alloc_counter counter;
+  const char* font_path; /* May be NULL */
+  int is_quick;
+};
+
+/*******************************************************************************
+ *
+ * Counting allocator
+ *
+ ******************************************************************************/
+#define COUNT(counter, field)                                                  \
+  __atomic_add_fetch(&((struct alloc_counter*)(counter))->field, 1,            \
+    __ATOMIC_RELAXED)
+
+static void*
+counter_alloc
+  (void* data,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  COUNT(data, allocs);
+  return mem_default_allocator.alloc
+    (mem_default_allocator.data, size, filename, fileline);
+}
+
+static void*
+counter_calloc
+  (void* data,
+   const size_t nbelmts,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  COUNT(data, allocs);
+  return mem_default_allocator.calloc
+    (mem_default_allocator.data, nbelmts, size, filename, fileline);
+}
+
+static void*
+counter_realloc
+  (void* data,
+   void* mem,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  COUNT(data, reallocs);
+  return mem_default_allocator.realloc
+    (mem_default_allocator.data, mem, size, filename, fileline);
+}
+
+static void*
+counter_aligned_alloc
+  (void* data,
+   const size_t size,
+   const size_t alignment,
+   const char* filename,
+   const unsigned int fileline)
+{
+  COUNT(data, allocs);
+  return mem_default_allocator.aligned_alloc
+    (mem_default_allocator.data, size, alignment, filename, fileline);
+}
+
+static void
+counter_free(void* data, void* mem)
+{
+  if(mem)
+    COUNT(data, frees);
+  mem_default_allocator.free(mem_default_allocator.data, mem);
+}
+
+static size_t
+counter_allocated_size(const void* data)
+{
+  (void)data;
+  return mem_default_allocator.allocated_size(mem_default_allocator.data);
+}
+
+static size_t
+counter_dump(const void* data, char* dump, const size_t max_dump_len)
+{
+  (void)data;
+  return mem_default_allocator.dump
+    (mem_default_allocator.data, dump, max_dump_len);
+}
+
+#undef COUNT
+
+static void
+setup_counting_allocator
+  (struct mem_allocator* allocator,
+   struct alloc_counter* counter)
+{
+  allocator->alloc = counter_alloc;
+  allocator->calloc = counter_calloc;
+  allocator->realloc = counter_realloc;
+  allocator->aligned_alloc = counter_aligned_alloc;
+  allocator->free = counter_free;
+  allocator->allocated_size = counter_allocated_size;
+  allocator->dump = counter_dump;
+  allocator->data = counter;
+}
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static double
+now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1.e-9;
+}
+
+static void
+begin_measure(struct context* ctx, struct bench* bench, double* t0)
+{
+  memset(&ctx->counter, 0, sizeof(struct alloc_counter));
+  bench->ops = bench->chars = 0;
+  *t0 = now();
+}
+
+static void
+end_measure(struct context* ctx, struct bench* bench, const double t0)
+{
+  bench->seconds = now() - t0;
+  bench->allocs = ctx->counter;
+}
+
+/* Emit the result as one JSON object per line */
+static void
+report(const struct bench* bench)
+{
+  const double s = bench->seconds > 0. ? bench->seconds : 1.e-9;
+  printf("{\"bench\": \"%s\", \"ops\": %zu, \"chars\": %zu, "
+    "\"seconds\": %.6f, \"ops_per_s\": %.1f, \"chars_per_s\": %.1f, "
+    "\"allocs\": %zu, \"reallocs\": %zu, \"frees\": %zu}\n",
+    bench->name, bench->ops, bench->chars, bench->seconds,
+    (double)bench->ops / s, (double)bench->chars / s,
+    bench->allocs.allocs, bench->allocs.reallocs, bench->allocs.frees);
+  fflush(stdout);
+}
+
+static struct rbtty*
+create_tty(struct context* ctx)
+{
+  struct rbtty* tty = NULL;
+  if(rbtty_create(&ctx->rbi, NULL, &ctx->allocator, &tty) != RBTTY_NO_ERROR
+  || rbtty_setup_scrollback(tty, SCROLLBACK_LINES, 0) != RBTTY_NO_ERROR
+  || rbtty_set_viewport(tty, 0, 0, 1280, 720) != RBTTY_NO_ERROR) {
+    fprintf(stderr, "Couldn't create the tty.\n");
+    exit(1);
+  }
+  return tty;
+}
+
+/* Fill `line' with `len' printable chars followed by a new line */
+static void
+make_line(char* line, const size_t len, const size_t seed)
+{
+  const char charset[] =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,:;";
+  size_t x = seed * 2654435761u + 1;
+  size_t i = 0;
+  for(i = 0; i < len; ++i) {
+    x = x * 1103515245u + 12345u;
+    line[i] = charset[(x >> 16) % (sizeof(charset) - 1)];
+  }
+  line[len] = '\n';
+}
+
+/*******************************************************************************
+ *
+ * Benchmarks
+ *
+ ******************************************************************************/
+/* Print `count' lines of `len' chars to the stdout, one write per line */
+static enum rbtty_error
+bench_print
+  (struct context* ctx,
+   struct bench* bench,
+   const size_t len,
+   const size_t count,
+   const size_t prefill)
+{
+  const float white[3] = { 1.f, 1.f, 1.f };
+  enum { LINES_COUNT = 64 };
+  struct rbtty* tty = create_tty(ctx);
+  char* lines = malloc(LINES_COUNT * (len + 1));
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  double t0 = 0.;
+  size_t i = 0;
+
+  if(!lines) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto exit;
+  }
+  for(i = 0; i < LINES_COUNT; ++i)
+    make_line(lines + i * (len + 1), len, i);
+  for(i = 0; i < prefill && rbtty_err == RBTTY_NO_ERROR; ++i) {
+    rbtty_err = rbtty_write_utf8(tty, RBTTY_STDOUT,
+      lines + (i % LINES_COUNT) * (len + 1), len + 1, white);
+  }
+
+  begin_measure(ctx, bench, &t0);
+  for(i = 0; i < count && rbtty_err == RBTTY_NO_ERROR; ++i) {
+    rbtty_err = rbtty_write_utf8(tty, RBTTY_STDOUT,
+      lines + (i % LINES_COUNT) * (len + 1), len + 1, white);
+  }
+  end_measure(ctx, bench, t0);
+  bench->ops = i;
+  bench->chars = i * len;
+
+exit:
+  free(lines);
+  RBTTY(ref_put(tty));
+  return rbtty_err;
+}
+
+/* Type `count' chars into the command line, submitting it every 64 chars */
+static enum rbtty_error
+bench_cmdbuf
+  (struct context* ctx,
+   struct bench* bench,
+   const size_t count)
+{
+  const float white[3] = { 1.f, 1.f, 1.f };
+  struct rbtty* tty = create_tty(ctx);
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  double t0 = 0.;
+  size_t i = 0;
+
+  begin_measure(ctx, bench, &t0);
+  for(i = 0; i < count && rbtty_err == RBTTY_NO_ERROR; ++i) {
+    const wchar_t c = (wchar_t)(L'a' + (wchar_t)(i % 26));
+    rbtty_err = rbtty_write_wstring(tty, RBTTY_CMDOUT, &c, 1, white);
+    if(rbtty_err == RBTTY_NO_ERROR && i % 64 == 63) {
+      const wchar_t* cmd = NULL;
+      size_t len = 0;
+      rbtty_err = rbtty_submit(tty, &cmd, &len);
+    }
+  }
+  end_measure(ctx, bench, t0);
+  bench->ops = bench->chars = i;
+
+  RBTTY(ref_put(tty));
+  return rbtty_err;
+}
+
+/* Append `count' colored chunks to the prompt */
+static enum rbtty_error
+bench_prompt
+  (struct context* ctx,
+   struct bench* bench,
+   const size_t count)
+{
+  const float colors[2][3] = {{ 1.f, 1.f, 0.f }, { 0.f, 1.f, 1.f }};
+  const wchar_t chunk[] = L"user@host:~$ ";
+  const size_t len = sizeof(chunk)/sizeof(wchar_t) - 1;
+  struct rbtty* tty = create_tty(ctx);
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  double t0 = 0.;
+  size_t i = 0;
+
+  begin_measure(ctx, bench, &t0);
+  for(i = 0; i < count && rbtty_err == RBTTY_NO_ERROR; ++i) {
+    rbtty_err = rbtty_write_wstring
+      (tty, RBTTY_PROMPT, chunk, len, colors[i % 2]);
+  }
+  end_measure(ctx, bench, t0);
+  bench->ops = i;
+  bench->chars = i * len;
+
+  RBTTY(ref_put(tty));
+  return rbtty_err;
+}
+
+/* Load `count' times the font */
+static enum rbtty_error
+bench_font
+  (struct context* ctx,
+   struct bench* bench,
+   const size_t count)
+{
+  struct rbtty* tty = create_tty(ctx);
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  double t0 = 0.;
+  size_t i = 0;
+
+  begin_measure(ctx, bench, &t0);
+  for(i = 0; i < count && rbtty_err == RBTTY_NO_ERROR; ++i)
+    rbtty_err = rbtty_set_font(tty, ctx->font_path);
+  end_measure(ctx, bench, t0);
+  bench->ops = i;
+
+  RBTTY(ref_put(tty));
+  return rbtty_err;
+}
+
+/*******************************************************************************
+ *
+ * Program
+ *
+ ******************************************************************************/
+static void
+usage(const char* cmd)
+{
+  printf("Usage: %s [-q] [-f FONT]\n", cmd);
+  printf("  -q       run fewer iterations, e.g. as a smoke test\n");
+  printf("  -f FONT  font used to measure the font setup time\n");
+}
+
+int
+main(int argc, char** argv)
+{
+  struct context ctx;
+  struct bench bench;
+  size_t scale = 1;
+  int i = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+
+  memset(&ctx, 0, sizeof(struct context));
+  for(i = 1; i < argc; ++i) {
+    if(!strcmp(argv[i], "-q")) {
+      ctx.is_quick = 1;
+    } else if(!strcmp(argv[i], "-f") && i + 1 < argc) {
+      ctx.font_path = argv[++i];
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  setup_null_rbi(&ctx.rbi);
+  setup_counting_allocator(&ctx.allocator, &ctx.counter);
+  scale = ctx.is_quick ? 1 : 10;
+
+  #define RUN(Name, Func)                                                      \
+    {                                                                          \
+      memset(&bench, 0, sizeof(struct bench));                                 \
+      bench.name = Name;                                                       \
+      rbtty_err = Func;                                                        \
+      if(rbtty_err != RBTTY_NO_ERROR) {                                        \
+        fprintf(stderr, "%s: error %d.\n", Name, (int)rbtty_err);             \
+        return 1;                                                              \
+      }                                                                        \
+      report(&bench);                                                          \
+    } (void)0
+  RUN("print_short_lines", bench_print(&ctx, &bench, 40, scale * 20000, 0));
+  RUN("print_long_lines", bench_print(&ctx, &bench, 2000, scale * 1000, 0));
+  RUN("scrollback_wraparound", bench_print
+    (&ctx, &bench, 80, scale * 20000, 2 * SCROLLBACK_LINES));
+  RUN("cmdbuf_insertion", bench_cmdbuf(&ctx, &bench, scale * 20000));
+  RUN("prompt_change", bench_prompt(&ctx, &bench, scale * 1000));
+  if(ctx.font_path)
+    RUN("font_setup", bench_font(&ctx, &bench, ctx.is_quick ? 1 : 5));
+  #undef RUN
+
+  check_memory_leaks();
+  return 0;
+}
+
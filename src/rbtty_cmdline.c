@@ -0,0 +1,327 @@
+#include "rbtty_cmdline.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+#include <wctype.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE int
+is_word_char(const wchar_t c)
+{
+  return iswalnum((wint_t)c) || c == L'_';
+}
+
+/* Ensure that `*buffer' can store `count' items of `size' bytes */
+static enum rbtty_error
+reserve
+  (struct mem_allocator* allocator,
+   void** buffer,
+   size_t* capacity,
+   const size_t count,
+   const size_t size)
+{
+  size_t new_capacity = 0;
+  void* mem = NULL;
+  ASSERT(allocator && buffer && capacity && size);
+
+  if(count <= *capacity)
+    return RBTTY_NO_ERROR;
+  new_capacity = MAX(*capacity * 2, MAX(count, 64));
+  mem = MEM_REALLOC(allocator, *buffer, new_capacity * size);
+  if(!mem)
+    return RBTTY_MEMORY_ERROR;
+  *buffer = mem;
+  *capacity = new_capacity;
+  return RBTTY_NO_ERROR;
+}
+
+/* Ensure that the gap can store at least `len' chars */
+static enum rbtty_error
+grow_gap(struct rbtty_cmdline* cmdline, const size_t len)
+{
+  wchar_t* chars = NULL;
+  uint16_t* attribs = NULL;
+  size_t capacity = 0;
+  size_t tail_len = 0;
+  ASSERT(cmdline);
+
+  if(cmdline->gap_end - cmdline->gap_begin >= len)
+    return RBTTY_NO_ERROR;
+
+  capacity = MAX(cmdline->capacity * 2, rbtty_cmdline_length(cmdline) + len);
+  capacity = MAX(capacity, 64);
+  chars = MEM_REALLOC
+    (cmdline->allocator, cmdline->chars, capacity * sizeof(wchar_t));
+  if(!chars)
+    return RBTTY_MEMORY_ERROR;
+  cmdline->chars = chars;
+  attribs = MEM_REALLOC
+    (cmdline->allocator, cmdline->attribs, capacity * sizeof(uint16_t));
+  if(!attribs)
+    return RBTTY_MEMORY_ERROR;
+  cmdline->attribs = attribs;
+
+  /* Move the chars following the gap to the end of the new buffer */
+  tail_len = cmdline->capacity - cmdline->gap_end;
+  memmove(chars + capacity - tail_len, chars + cmdline->gap_end,
+    tail_len * sizeof(wchar_t));
+  memmove(attribs + capacity - tail_len, attribs + cmdline->gap_end,
+    tail_len * sizeof(uint16_t));
+  cmdline->gap_end = capacity - tail_len;
+  cmdline->capacity = capacity;
+  return RBTTY_NO_ERROR;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_cmdline functions
+ *
+ ******************************************************************************/
+void
+rbtty_cmdline_init
+  (struct mem_allocator* allocator,
+   struct rbtty_cmdline* cmdline)
+{
+  ASSERT(allocator && cmdline);
+  memset(cmdline, 0, sizeof(struct rbtty_cmdline));
+  cmdline->allocator = allocator;
+}
+
+void
+rbtty_cmdline_shutdown(struct rbtty_cmdline* cmdline)
+{
+  ASSERT(cmdline);
+  if(cmdline->chars)
+    MEM_FREE(cmdline->allocator, cmdline->chars);
+  if(cmdline->attribs)
+    MEM_FREE(cmdline->allocator, cmdline->attribs);
+  if(cmdline->kill_chars)
+    MEM_FREE(cmdline->allocator, cmdline->kill_chars);
+  if(cmdline->kill_attribs)
+    MEM_FREE(cmdline->allocator, cmdline->kill_attribs);
+  if(cmdline->view_chars)
+    MEM_FREE(cmdline->allocator, cmdline->view_chars);
+  if(cmdline->view_spans)
+    MEM_FREE(cmdline->allocator, cmdline->view_spans);
+  rbtty_cmdline_init(cmdline->allocator, cmdline);
+}
+
+void
+rbtty_cmdline_clear(struct rbtty_cmdline* cmdline)
+{
+  ASSERT(cmdline);
+  cmdline->gap_begin = 0;
+  cmdline->gap_end = cmdline->capacity;
+}
+
+enum rbtty_error
+rbtty_cmdline_insert
+  (struct rbtty_cmdline* cmdline,
+   const wchar_t* str,
+   const size_t len,
+   const uint16_t attrib)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(cmdline && (str || !len));
+
+  rbtty_err = grow_gap(cmdline, len);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  wmemcpy(cmdline->chars + cmdline->gap_begin, str, len);
+  FOR_EACH(size_t, i, 0, len)
+    cmdline->attribs[cmdline->gap_begin + i] = attrib;
+  cmdline->gap_begin += len;
+  return RBTTY_NO_ERROR;
+}
+
+void
+rbtty_cmdline_move(struct rbtty_cmdline* cmdline, const size_t pos)
+{
+  size_t n = 0;
+  ASSERT(cmdline);
+
+  n = MIN(pos, rbtty_cmdline_length(cmdline));
+  if(n < cmdline->gap_begin) { /* Move the chars in [n, gap[ after the gap */
+    n = cmdline->gap_begin - n;
+    cmdline->gap_begin -= n;
+    cmdline->gap_end -= n;
+    wmemmove(cmdline->chars + cmdline->gap_end,
+      cmdline->chars + cmdline->gap_begin, n);
+    memmove(cmdline->attribs + cmdline->gap_end,
+      cmdline->attribs + cmdline->gap_begin, n * sizeof(uint16_t));
+  } else if(n > cmdline->gap_begin) { /* Move the chars before the gap */
+    n = n - cmdline->gap_begin;
+    wmemmove(cmdline->chars + cmdline->gap_begin,
+      cmdline->chars + cmdline->gap_end, n);
+    memmove(cmdline->attribs + cmdline->gap_begin,
+      cmdline->attribs + cmdline->gap_end, n * sizeof(uint16_t));
+    cmdline->gap_begin += n;
+    cmdline->gap_end += n;
+  }
+}
+
+enum rbtty_error
+rbtty_cmdline_erase
+  (struct rbtty_cmdline* cmdline,
+   const size_t begin,
+   const size_t end,
+   const int kill)
+{
+  const size_t len = rbtty_cmdline_length(cmdline);
+  const size_t first = MIN(begin, len);
+  const size_t last = MIN(end, len);
+  size_t n = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(cmdline);
+
+  if(first >= last)
+    return RBTTY_NO_ERROR;
+  n = last - first;
+
+  /* Make the erased chars contiguous right after the gap */
+  rbtty_cmdline_move(cmdline, first);
+  if(kill) {
+    void* chars = cmdline->kill_chars;
+    void* attribs = cmdline->kill_attribs;
+    size_t capacity = cmdline->kill_capacity;
+    rbtty_err = reserve
+      (cmdline->allocator, &chars, &capacity, n, sizeof(wchar_t));
+    cmdline->kill_chars = chars;
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+    capacity = cmdline->kill_capacity;
+    rbtty_err = reserve
+      (cmdline->allocator, &attribs, &capacity, n, sizeof(uint16_t));
+    cmdline->kill_attribs = attribs;
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+    cmdline->kill_capacity = capacity;
+    wmemcpy(cmdline->kill_chars, cmdline->chars + cmdline->gap_end, n);
+    memcpy(cmdline->kill_attribs, cmdline->attribs + cmdline->gap_end,
+      n * sizeof(uint16_t));
+    cmdline->kill_len = n;
+  }
+  cmdline->gap_end += n;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_cmdline_yank(struct rbtty_cmdline* cmdline)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(cmdline);
+
+  rbtty_err = grow_gap(cmdline, cmdline->kill_len);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  wmemcpy(cmdline->chars + cmdline->gap_begin, cmdline->kill_chars,
+    cmdline->kill_len);
+  memcpy(cmdline->attribs + cmdline->gap_begin, cmdline->kill_attribs,
+    cmdline->kill_len * sizeof(uint16_t));
+  cmdline->gap_begin += cmdline->kill_len;
+  return RBTTY_NO_ERROR;
+}
+
+size_t
+rbtty_cmdline_word_begin(const struct rbtty_cmdline* cmdline)
+{
+  size_t pos = 0;
+  ASSERT(cmdline);
+  /* The chars preceding the cursor are contiguous */
+  pos = cmdline->gap_begin;
+  while(pos && !is_word_char(cmdline->chars[pos-1]))
+    --pos;
+  while(pos && is_word_char(cmdline->chars[pos-1]))
+    --pos;
+  return pos;
+}
+
+size_t
+rbtty_cmdline_word_end(const struct rbtty_cmdline* cmdline)
+{
+  size_t i = 0;
+  ASSERT(cmdline);
+  /* The chars following the cursor are contiguous */
+  i = cmdline->gap_end;
+  while(i < cmdline->capacity && !is_word_char(cmdline->chars[i]))
+    ++i;
+  while(i < cmdline->capacity && is_word_char(cmdline->chars[i]))
+    ++i;
+  return cmdline->gap_begin + (i - cmdline->gap_end);
+}
+
+enum rbtty_error
+rbtty_cmdline_view
+  (struct rbtty_cmdline* cmdline,
+   const wchar_t* prefix,
+   const size_t prefix_len,
+   const struct rbtty_span* prefix_spans,
+   const size_t prefix_spans_count,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count)
+{
+  const size_t cmd_len = rbtty_cmdline_length(cmdline);
+  const size_t tail_len = cmdline->capacity - cmdline->gap_end;
+  void* buffer = NULL;
+  size_t nspans = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(cmdline && (prefix || !prefix_len));
+  ASSERT(prefix_spans || !prefix_spans_count);
+  ASSERT(chars && len && spans && spans_count);
+
+  /* Worst case: one span per char of the command */
+  buffer = cmdline->view_chars;
+  rbtty_err = reserve(cmdline->allocator, &buffer, &cmdline->view_capacity,
+    prefix_len + cmd_len + 1, sizeof(wchar_t));
+  cmdline->view_chars = buffer;
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  buffer = cmdline->view_spans;
+  rbtty_err = reserve(cmdline->allocator, &buffer,
+    &cmdline->view_spans_capacity, prefix_spans_count + cmd_len + 1,
+    sizeof(struct rbtty_span));
+  cmdline->view_spans = buffer;
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+
+  if(prefix_len)
+    wmemcpy(cmdline->view_chars, prefix, prefix_len);
+  wmemcpy(cmdline->view_chars + prefix_len, cmdline->chars, cmdline->gap_begin);
+  wmemcpy(cmdline->view_chars + prefix_len + cmdline->gap_begin,
+    cmdline->chars + cmdline->gap_end, tail_len);
+  cmdline->view_chars[prefix_len + cmd_len] = L'\0';
+
+  /* Run-length encode the attributes of the command after the prefix ones */
+  if(prefix_spans_count) {
+    memcpy(cmdline->view_spans, prefix_spans,
+      prefix_spans_count * sizeof(struct rbtty_span));
+  }
+  nspans = prefix_spans_count;
+  FOR_EACH(size_t, i, 0, cmd_len) {
+    const size_t j = i < cmdline->gap_begin
+      ? i : i + cmdline->gap_end - cmdline->gap_begin;
+    struct rbtty_span* last = nspans ? cmdline->view_spans + nspans - 1 : NULL;
+    if(last && last->attrib == cmdline->attribs[j]
+    && last->start + last->length == prefix_len + i) {
+      ++last->length;
+    } else {
+      struct rbtty_span* span = cmdline->view_spans + nspans++;
+      span->start = (uint32_t)(prefix_len + i);
+      span->length = 1;
+      span->attrib = cmdline->attribs[j];
+    }
+  }
+
+  *chars = cmdline->view_chars;
+  *len = prefix_len + cmd_len;
+  *spans = cmdline->view_spans;
+  *spans_count = nspans;
+  return RBTTY_NO_ERROR;
+}
+
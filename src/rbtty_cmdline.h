@@ -0,0 +1,127 @@
+#ifndef RBTTY_CMDLINE_H
+#define RBTTY_CMDLINE_H
+
+#include "rbtty_error.h"
+#include "rbtty_palette.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+struct mem_allocator;
+
+/* Command line edited in a gap buffer. The chars and their attribute lie on
+ * both sides of a gap located at the cursor, so that inserting or deleting
+ * at the cursor only moves the bounds of the gap. Moving the cursor moves
+ * the chars between its previous and its new position across the gap */
+struct rbtty_cmdline {
+  wchar_t* chars;
+  uint16_t* attribs; /* Attribute of each char */
+  size_t capacity;
+  size_t gap_begin; /* <=> cursor */
+  size_t gap_end;
+  /* Last killed text, inserted back by rbtty_cmdline_yank */
+  wchar_t* kill_chars;
+  uint16_t* kill_attribs;
+  size_t kill_len;
+  size_t kill_capacity;
+  /* Contiguous copy of the prompt and the command, see rbtty_cmdline_view */
+  wchar_t* view_chars;
+  size_t view_capacity;
+  struct rbtty_span* view_spans;
+  size_t view_spans_capacity;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_cmdline_init
+  (struct mem_allocator* allocator,
+   struct rbtty_cmdline* cmdline);
+
+extern LOCAL_SYM void
+rbtty_cmdline_shutdown
+  (struct rbtty_cmdline* cmdline);
+
+extern LOCAL_SYM void
+rbtty_cmdline_clear
+  (struct rbtty_cmdline* cmdline);
+
+/* Insert `len' chars of `str' at the cursor and move the cursor after them */
+extern LOCAL_SYM enum rbtty_error
+rbtty_cmdline_insert
+  (struct rbtty_cmdline* cmdline,
+   const wchar_t* str,
+   const size_t len,
+   const uint16_t attrib);
+
+/* Move the cursor to the `pos' char, clamped to the command length */
+extern LOCAL_SYM void
+rbtty_cmdline_move
+  (struct rbtty_cmdline* cmdline,
+   const size_t pos);
+
+/* Remove the chars in [begin, end[. If `kill' is not null they are saved
+ * for the next yank */
+extern LOCAL_SYM enum rbtty_error
+rbtty_cmdline_erase
+  (struct rbtty_cmdline* cmdline,
+   const size_t begin,
+   const size_t end,
+   const int kill);
+
+/* Insert the last killed text at the cursor */
+extern LOCAL_SYM enum rbtty_error
+rbtty_cmdline_yank
+  (struct rbtty_cmdline* cmdline);
+
+/* Return the position of the start of the word preceding the cursor */
+extern LOCAL_SYM size_t
+rbtty_cmdline_word_begin
+  (const struct rbtty_cmdline* cmdline);
+
+/* Return the position of the end of the word following the cursor */
+extern LOCAL_SYM size_t
+rbtty_cmdline_word_end
+  (const struct rbtty_cmdline* cmdline);
+
+/* Lay out the `prefix_len' chars of `prefix' followed by the command in a
+ * contiguous buffer, and their attributes as spans. The returned data are
+ * valid until the next modification of the command line */
+extern LOCAL_SYM enum rbtty_error
+rbtty_cmdline_view
+  (struct rbtty_cmdline* cmdline,
+   const wchar_t* prefix,
+   const size_t prefix_len,
+   const struct rbtty_span* prefix_spans,
+   const size_t prefix_spans_count,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count);
+
+static FINLINE size_t
+rbtty_cmdline_length(const struct rbtty_cmdline* cmdline)
+{
+  ASSERT(cmdline);
+  return cmdline->capacity - (cmdline->gap_end - cmdline->gap_begin);
+}
+
+static FINLINE size_t
+rbtty_cmdline_cursor(const struct rbtty_cmdline* cmdline)
+{
+  ASSERT(cmdline);
+  return cmdline->gap_begin;
+}
+
+/* Return the `pos' char of the command */
+static FINLINE wchar_t
+rbtty_cmdline_char(const struct rbtty_cmdline* cmdline, const size_t pos)
+{
+  size_t i = pos;
+  ASSERT(cmdline && pos < rbtty_cmdline_length(cmdline));
+  if(i >= cmdline->gap_begin)
+    i += cmdline->gap_end - cmdline->gap_begin;
+  return cmdline->chars[i];
+}
+
+#endif /* RBTTY_CMDLINE_H */
+
@@ -0,0 +1,440 @@
+#define _POSIX_C_SOURCE 200112L /* open, ftruncate, mmap */
+
+#include "rbtty_cold.h"
+#include "rbtty_lz.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/* The chars and the spans following a line header are 4 bytes aligned since
+ * all the sizes are multiples of 4 */
+struct cold_line {
+  uint32_t length;
+  uint32_t spans_count;
+};
+
+/* Maximum number of lines of a block, i.e. of empty lines */
+#define BLOCK_LINES_MAX (RBTTY_COLD_BLOCK_SIZE / sizeof(struct cold_line))
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static void
+raw_release(struct mem_allocator* allocator, struct rbtty_cold_raw* raw)
+{
+  ASSERT(allocator && raw);
+  if(raw->data)
+    MEM_FREE(allocator, raw->data);
+  if(raw->offsets)
+    MEM_FREE(allocator, raw->offsets);
+  memset(raw, 0, sizeof(struct rbtty_cold_raw));
+  raw->block_id = SIZE_MAX;
+}
+
+static int
+raw_alloc(struct mem_allocator* allocator, struct rbtty_cold_raw* raw)
+{
+  ASSERT(allocator && raw);
+  raw->data = MEM_ALLOC(allocator, RBTTY_COLD_BLOCK_SIZE);
+  raw->offsets = MEM_ALLOC(allocator, BLOCK_LINES_MAX * sizeof(uint32_t));
+  return raw->data && raw->offsets;
+}
+
+/* Register the lines of the `size' bytes of `raw'. Return 0 if they are
+ * corrupted, i.e. if they overrun the block or if one of their spans lies
+ * beyond its line or has an attrib greater or equal to `attribs_count' */
+static int
+raw_index
+  (struct rbtty_cold_raw* raw,
+   const size_t size,
+   const size_t attribs_count)
+{
+  size_t offset = 0;
+  ASSERT(raw && size <= RBTTY_COLD_BLOCK_SIZE);
+
+  raw->lines_count = 0;
+  raw->size = size;
+  while(offset < size) {
+    struct cold_line line;
+    const struct rbtty_span* spans = NULL;
+    if(size - offset < sizeof(line) || raw->lines_count == BLOCK_LINES_MAX)
+      return 0;
+    memcpy(&line, raw->data + offset, sizeof(line));
+    raw->offsets[raw->lines_count++] = (uint32_t)offset;
+    offset += sizeof(line);
+    if(line.length > (size - offset) / sizeof(wchar_t))
+      return 0;
+    offset += line.length * sizeof(wchar_t);
+    if(line.spans_count > (size - offset) / sizeof(struct rbtty_span))
+      return 0;
+    spans = (const struct rbtty_span*)(raw->data + offset);
+    offset += line.spans_count * sizeof(struct rbtty_span);
+    FOR_EACH(size_t, i, 0, (size_t)line.spans_count) {
+      if(spans[i].attrib >= attribs_count
+      || spans[i].start > line.length
+      || spans[i].length > line.length - spans[i].start)
+        return 0;
+    }
+  }
+  return 1;
+}
+
+static void
+raw_get_line
+  (const struct rbtty_cold_raw* raw,
+   const size_t i,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count)
+{
+  const unsigned char* data = NULL;
+  struct cold_line line;
+  ASSERT(raw && i < raw->lines_count);
+  data = raw->data + raw->offsets[i];
+  memcpy(&line, data, sizeof(line));
+  data += sizeof(line);
+  *chars = (const wchar_t*)data;
+  *len = line.length;
+  *spans = (const struct rbtty_span*)(data + line.length * sizeof(wchar_t));
+  *spans_count = line.spans_count;
+}
+
+static FINLINE struct rbtty_cold_block*
+cold_block(struct rbtty_cold* cold, const size_t i)
+{
+  ASSERT(cold && i < cold->blocks_count);
+  return cold->blocks + cold->blocks_first + i;
+}
+
+static void
+cold_pop_block(struct rbtty_cold* cold)
+{
+  const struct rbtty_cold_block* block = NULL;
+  ASSERT(cold && cold->blocks_count);
+  block = cold_block(cold, 0);
+  cold->lines_id += block->lines_count;
+  cold->lines_count -= block->lines_count;
+  ++cold->blocks_first;
+  ++cold->blocks_id;
+  if(!--cold->blocks_count)
+    cold->blocks_first = 0;
+}
+
+/* Ensure that a block descriptor can be added */
+static int
+cold_reserve_block(struct rbtty_cold* cold)
+{
+  struct rbtty_cold_block* blocks = NULL;
+  size_t capacity = 0;
+  ASSERT(cold);
+
+  if(cold->blocks_first + cold->blocks_count < cold->blocks_capacity)
+    return 1;
+  if(cold->blocks_first) { /* Move the descriptors at the beginning */
+    memmove(cold->blocks, cold->blocks + cold->blocks_first,
+      cold->blocks_count * sizeof(struct rbtty_cold_block));
+    cold->blocks_first = 0;
+    return 1;
+  }
+  capacity = cold->blocks_capacity ? cold->blocks_capacity * 2 : 64;
+  blocks = MEM_REALLOC
+    (cold->allocator, cold->blocks, capacity*sizeof(struct rbtty_cold_block));
+  if(!blocks)
+    return 0;
+  cold->blocks = blocks;
+  cold->blocks_capacity = capacity;
+  return 1;
+}
+
+/* Compress the pending lines into a new block */
+static void
+cold_flush(struct rbtty_cold* cold)
+{
+  struct rbtty_cold_block* block = NULL;
+  struct rbtty_cold_raw* pending = NULL;
+  size_t size = 0;
+  size_t offset = 0;
+  ASSERT(cold && cold->pending.lines_count);
+
+  pending = &cold->pending;
+  size = rbtty_lz_compress(pending->data, pending->size, cold->scratch,
+    rbtty_lz_bound(RBTTY_COLD_BLOCK_SIZE));
+  ASSERT(size && size <= cold->store_size);
+  if(!cold_reserve_block(cold)) {
+    /* Discard all the lines rather than leaving a hole in their ids */
+    rbtty_cold_clear(cold);
+    return;
+  }
+
+  /* The block is not split across the store boundaries */
+  offset = cold->store_end;
+  if(offset % cold->store_size + size > cold->store_size)
+    offset += cold->store_size - offset % cold->store_size;
+  while(cold->blocks_count
+     && cold_block(cold, 0)->offset + cold->store_size < offset + size)
+    cold_pop_block(cold);
+  memcpy(cold->store + offset % cold->store_size, cold->scratch, size);
+  cold->store_end = offset + size;
+
+  block = cold->blocks + cold->blocks_first + cold->blocks_count++;
+  block->offset = offset;
+  block->line_id = cold->lines_id + cold->lines_count - pending->lines_count;
+  block->size = (uint32_t)size;
+  block->lines_count = (uint32_t)pending->lines_count;
+  pending->size = 0;
+  pending->lines_count = 0;
+}
+
+/* Return the block decompressed from the stored block `i' */
+static const struct rbtty_cold_raw*
+cold_decode(struct rbtty_cold* cold, const size_t i)
+{
+  const struct rbtty_cold_block* block = NULL;
+  struct rbtty_cold_raw* decoded = NULL;
+  size_t size = 0;
+  ASSERT(cold && i < cold->blocks_count);
+
+  decoded = &cold->decoded;
+  if(decoded->block_id == cold->blocks_id + i)
+    return decoded;
+
+  block = cold_block(cold, i);
+  size = rbtty_lz_decompress(cold->store + block->offset % cold->store_size,
+    block->size, decoded->data, RBTTY_COLD_BLOCK_SIZE);
+  if(size == SIZE_MAX || !raw_index(decoded, size, cold->attribs_count)
+  || decoded->lines_count != block->lines_count) {
+    /* Corrupted block, e.g. the mapped file was modified */
+    decoded->block_id = SIZE_MAX;
+    return NULL;
+  }
+  decoded->block_id = cold->blocks_id + i;
+  return decoded;
+}
+
+static void
+cold_release(struct rbtty_cold* cold)
+{
+  ASSERT(cold);
+  if(cold->fd >= 0) {
+    if(cold->store)
+      munmap(cold->store, cold->store_size);
+    close(cold->fd);
+  } else if(cold->store) {
+    MEM_FREE(cold->allocator, cold->store);
+  }
+  if(cold->blocks)
+    MEM_FREE(cold->allocator, cold->blocks);
+  if(cold->scratch)
+    MEM_FREE(cold->allocator, cold->scratch);
+  raw_release(cold->allocator, &cold->pending);
+  raw_release(cold->allocator, &cold->decoded);
+  cold->store = NULL;
+  cold->store_size = 0;
+  cold->store_end = 0;
+  cold->fd = -1;
+  cold->blocks = NULL;
+  cold->blocks_capacity = 0;
+  cold->scratch = NULL;
+  rbtty_cold_clear(cold);
+}
+
+/*******************************************************************************
+ *
+ * rbtty_cold functions
+ *
+ ******************************************************************************/
+void
+rbtty_cold_init(struct mem_allocator* allocator, struct rbtty_cold* cold)
+{
+  ASSERT(allocator && cold);
+  memset(cold, 0, sizeof(struct rbtty_cold));
+  cold->allocator = allocator;
+  cold->fd = -1;
+  cold->pending.block_id = SIZE_MAX;
+  cold->decoded.block_id = SIZE_MAX;
+}
+
+void
+rbtty_cold_shutdown(struct rbtty_cold* cold)
+{
+  ASSERT(cold);
+  cold_release(cold);
+}
+
+enum rbtty_error
+rbtty_cold_setup
+  (struct rbtty_cold* cold,
+   const size_t max_bytes,
+   const char* path)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(cold);
+
+  cold_release(cold);
+  /* The store holds at least one block whatever its compression ratio */
+  if(UNLIKELY(max_bytes < rbtty_lz_bound(RBTTY_COLD_BLOCK_SIZE))) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto error;
+  }
+  if(!path) {
+    cold->store = MEM_ALLOC(cold->allocator, max_bytes);
+    if(!cold->store) {
+      rbtty_err = RBTTY_MEMORY_ERROR;
+      goto error;
+    }
+  } else {
+    void* mem = MAP_FAILED;
+    cold->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if(cold->fd < 0) {
+      rbtty_err = RBTTY_INVALID_ARGUMENT;
+      goto error;
+    }
+    if(ftruncate(cold->fd, (off_t)max_bytes) == 0) {
+      mem = mmap(NULL, max_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+        cold->fd, 0);
+    }
+    if(mem == MAP_FAILED) {
+      rbtty_err = RBTTY_UNKNOWN_ERROR;
+      goto error;
+    }
+    cold->store = mem;
+  }
+  cold->store_size = max_bytes;
+  cold->scratch = MEM_ALLOC
+    (cold->allocator, rbtty_lz_bound(RBTTY_COLD_BLOCK_SIZE));
+  if(!cold->scratch
+  || !raw_alloc(cold->allocator, &cold->pending)
+  || !raw_alloc(cold->allocator, &cold->decoded)) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto error;
+  }
+
+exit:
+  return rbtty_err;
+error:
+  cold_release(cold);
+  goto exit;
+}
+
+void
+rbtty_cold_clear(struct rbtty_cold* cold)
+{
+  ASSERT(cold);
+  cold->blocks_first = 0;
+  cold->blocks_id += cold->blocks_count;
+  cold->blocks_count = 0;
+  cold->pending.size = 0;
+  cold->pending.lines_count = 0;
+  cold->lines_id += cold->lines_count;
+  cold->lines_count = 0;
+  cold->attribs_count = 0;
+}
+
+void
+rbtty_cold_push
+  (struct rbtty_cold* cold,
+   const size_t id,
+   const wchar_t* chars,
+   const size_t len,
+   const struct rbtty_span* spans,
+   const size_t spans_count)
+{
+  struct rbtty_cold_raw* pending = NULL;
+  struct cold_line line;
+  size_t size = 0;
+  size_t nspans = spans_count;
+  ASSERT(cold && (chars || !len) && (spans || !spans_count));
+
+  if(!cold->store)
+    return;
+  if(!cold->lines_count) {
+    cold->lines_id = id;
+  }
+  ASSERT(id == cold->lines_id + cold->lines_count);
+
+  /* Truncate the line to the block size */
+  line.length = (uint32_t)MIN(len,
+    (RBTTY_COLD_BLOCK_SIZE - sizeof(line) - sizeof(struct rbtty_span))
+    / sizeof(wchar_t));
+  while(nspans && spans[nspans-1].start >= line.length)
+    --nspans;
+  nspans = MIN(nspans, (RBTTY_COLD_BLOCK_SIZE - sizeof(line)
+    - line.length * sizeof(wchar_t)) / sizeof(struct rbtty_span));
+  line.spans_count = (uint32_t)nspans;
+  size = sizeof(line)
+    + line.length * sizeof(wchar_t)
+    + line.spans_count * sizeof(struct rbtty_span);
+
+  pending = &cold->pending;
+  if(pending->size + size > RBTTY_COLD_BLOCK_SIZE)
+    cold_flush(cold);
+  pending->offsets[pending->lines_count++] = (uint32_t)pending->size;
+  memcpy(pending->data + pending->size, &line, sizeof(line));
+  pending->size += sizeof(line);
+  memcpy(pending->data + pending->size, chars,
+    line.length * sizeof(wchar_t));
+  pending->size += line.length * sizeof(wchar_t);
+  memcpy(pending->data + pending->size, spans,
+    line.spans_count * sizeof(struct rbtty_span));
+  if(line.spans_count && (line.length != len || nspans != spans_count)) {
+    /* The last span covers the remaining chars of the truncated line */
+    struct rbtty_span* span = (struct rbtty_span*)
+      (pending->data + pending->size) + line.spans_count - 1;
+    span->length = line.length - span->start;
+  }
+  pending->size += line.spans_count * sizeof(struct rbtty_span);
+  ++cold->lines_count;
+  FOR_EACH(size_t, i, 0, nspans) {
+    cold->attribs_count = MAX(cold->attribs_count, (size_t)spans[i].attrib+1);
+  }
+}
+
+void
+rbtty_cold_get_line
+  (struct rbtty_cold* cold,
+   const size_t id,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count)
+{
+  const struct rbtty_cold_raw* raw = NULL;
+  size_t first = 0;
+  size_t begin = 0;
+  size_t end = 0;
+  ASSERT(cold && chars && len && spans && spans_count);
+  ASSERT(id >= cold->lines_id && id - cold->lines_id < cold->lines_count);
+
+  *chars = NULL;
+  *len = 0;
+  *spans = NULL;
+  *spans_count = 0;
+
+  first = cold->lines_id + cold->lines_count - cold->pending.lines_count;
+  if(id >= first) {
+    raw_get_line(&cold->pending, id - first, chars, len, spans, spans_count);
+    return;
+  }
+  /* Look for the block of the line */
+  end = cold->blocks_count;
+  while(end - begin > 1) {
+    const size_t mid = (begin + end) / 2;
+    if(cold_block(cold, mid)->line_id <= id) {
+      begin = mid;
+    } else {
+      end = mid;
+    }
+  }
+  raw = cold_decode(cold, begin);
+  if(raw) {
+    raw_get_line(raw, id - cold_block(cold, begin)->line_id, chars, len,
+      spans, spans_count);
+  }
+}
+
@@ -0,0 +1,104 @@
+#ifndef RBTTY_COLD_H
+#define RBTTY_COLD_H
+
+#include "rbtty_error.h"
+#include "rbtty_palette.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Size of the uncompressed blocks of lines. Longer lines are truncated */
+#define RBTTY_COLD_BLOCK_SIZE (128 * 1024)
+
+struct mem_allocator;
+
+/* Uncompressed block of lines. A line is a header followed by its chars and
+ * its spans */
+struct rbtty_cold_raw {
+  unsigned char* data;
+  size_t size;
+  uint32_t* offsets; /* Offset of each line into `data' */
+  size_t lines_count;
+  size_t block_id; /* Absolute id of the block. SIZE_MAX <=> none */
+};
+
+struct rbtty_cold_block {
+  size_t offset; /* Logical offset into the store */
+  size_t line_id; /* Absolute id of its first line */
+  uint32_t size; /* Compressed size */
+  uint32_t lines_count;
+};
+
+/* Cold tier of the scrollback, i.e. the lines evicted from the scrollback
+ * compressed by blocks. The blocks are stored in a ring of bytes, allocated
+ * on the heap or mapped from a file, whose oldest blocks are evicted when it
+ * is full. A block is decompressed on demand when one of its lines is
+ * retrieved. Lines have the absolute ids they had in the scrollback */
+struct rbtty_cold {
+  /* Ring of compressed blocks */
+  unsigned char* store;
+  size_t store_size;
+  size_t store_end; /* Logical end of the newest block */
+  int fd; /* File mapped by the store. -1 <=> heap allocated store */
+  /* Descriptors of the stored blocks, the oldest first */
+  struct rbtty_cold_block* blocks;
+  size_t blocks_capacity;
+  size_t blocks_first;
+  size_t blocks_count;
+  size_t blocks_id; /* Absolute id of the oldest block */
+  struct rbtty_cold_raw pending; /* Newest lines, not compressed yet */
+  struct rbtty_cold_raw decoded; /* Last decompressed block */
+  unsigned char* scratch; /* Output of the compression */
+  size_t lines_id; /* Absolute id of the oldest line */
+  size_t lines_count;
+  size_t attribs_count; /* Upper bound of the attribs of the pushed spans */
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_cold_init
+  (struct mem_allocator* allocator,
+   struct rbtty_cold* cold);
+
+extern LOCAL_SYM void
+rbtty_cold_shutdown
+  (struct rbtty_cold* cold);
+
+/* Allocate a store of `max_bytes' bytes, mapped from the file `path' if it
+ * is not NULL. The file is created or truncated. The previous lines are
+ * discarded */
+extern LOCAL_SYM enum rbtty_error
+rbtty_cold_setup
+  (struct rbtty_cold* cold,
+   const size_t max_bytes,
+   const char* path);
+
+/* Discard the lines. The ids of the next lines follow the discarded ones */
+extern LOCAL_SYM void
+rbtty_cold_clear
+  (struct rbtty_cold* cold);
+
+/* Add the line `id' after the newest line. If there is no line, `id' is the
+ * new id of the oldest line; otherwise it must follow the newest one */
+extern LOCAL_SYM void
+rbtty_cold_push
+  (struct rbtty_cold* cold,
+   const size_t id,
+   const wchar_t* chars,
+   const size_t len,
+   const struct rbtty_span* spans,
+   const size_t spans_count);
+
+/* Retrieve the line of absolute id `id'. The returned data are valid until
+ * the next call to a rbtty_cold function */
+extern LOCAL_SYM void
+rbtty_cold_get_line
+  (struct rbtty_cold* cold,
+   const size_t id,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count);
+
+#endif /* RBTTY_COLD_H */
+
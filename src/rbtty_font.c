@@ -0,0 +1,345 @@
+#include "rbtty_font.h"
+#include "rbtty_utf8.h"
+#include <font_rsrc.h>
+#include <lp/lp.h>
+#include <lp/lp_font.h>
+#include <rb/rbi.h>
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <limits.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper data structure
+ *
+ ******************************************************************************/
+/* Glyphs rasterized when the font is loaded. The others are rasterized on
+ * their first use */
+static const wchar_t rbtty_charset[] =
+  L"0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ"
+  L" &~\"#'{([-|`_\\^@)]=}+$%*,?;.:/!<>";
+
+#define RBTTY_CHARSET_LEN (sizeof(rbtty_charset)/sizeof(wchar_t)-1)/* -1 = \0 */
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static enum rbtty_error
+lp_to_rbtty_error(const enum lp_error lp_err)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  switch(lp_err) {
+    case LP_INVALID_ARGUMENT: rbtty_err = RBTTY_INVALID_ARGUMENT; break;
+    case LP_MEMORY_ERROR: rbtty_err = RBTTY_MEMORY_ERROR; break;
+    case LP_NO_ERROR: rbtty_err = RBTTY_NO_ERROR; break;
+    default: rbtty_err = RBTTY_UNKNOWN_ERROR;  break;
+  }
+  return rbtty_err;
+}
+
+static void
+release_font(struct ref* ref)
+{
+  struct rbtty_font* font = NULL;
+  ASSERT(ref);
+
+  font = CONTAINER_OF(ref, struct rbtty_font, ref);
+  ASSERT(is_list_empty(&font->users));
+
+  if(font->font)
+    LP(font_ref_put(font->font));
+  if(font->lp)
+    LP(ref_put(font->lp));
+  if(font->font_rsrc)
+    FONT(rsrc_ref_put(font->font_rsrc));
+  if(font->font_sys)
+    FONT(system_ref_put(font->font_sys));
+
+  rbtty_glyph_cache_shutdown(&font->glyph_cache);
+  rbtty_advance_shutdown(&font->advance);
+  rbtty_font_loader_shutdown(&font->loader);
+  if(font->cache_dir)
+    MEM_FREE(font->allocator, font->cache_dir);
+  MEM_FREE(font->allocator, font);
+}
+
+/* Notify `event' to all the users of `font'. Return the first error */
+static enum rbtty_error
+notify_users(struct rbtty_font* font, const enum rbtty_font_event event)
+{
+  struct list_node* node = NULL;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(font);
+
+  LIST_FOR_EACH(node, &font->users) {
+    struct rbtty_font_user* user =
+      CONTAINER_OF(node, struct rbtty_font_user, node);
+    const enum rbtty_error err = user->notify(user, event);
+    if(err != RBTTY_NO_ERROR && rbtty_err == RBTTY_NO_ERROR)
+      rbtty_err = err;
+  }
+  return rbtty_err;
+}
+
+/* Make `font_rsrc' the font resource and set up the glyph cache from it.
+ * `glyphs' are the already rasterized glyphs of rbtty_charset. The font owns
+ * `font_sys' and `font_rsrc' once this function is called */
+static enum rbtty_error
+install_font
+  (struct rbtty_font* font,
+   struct font_system* font_sys,
+   struct font_rsrc* font_rsrc,
+   const struct lp_font_glyph_desc* glyphs)
+{
+  struct rbtty_glyph_cache* cache = NULL;
+  const struct rbtty_glyph* glyph = NULL;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  int glyph_min_width = INT_MAX;
+  int line_space = 0;
+  ASSERT(font && font_sys && font_rsrc && glyphs);
+
+  cache = &font->glyph_cache;
+  if(font_rsrc != font->font_rsrc) {
+    if(font->font_rsrc)
+      FONT(rsrc_ref_put(font->font_rsrc));
+    font->font_rsrc = font_rsrc;
+  }
+  if(font_sys != font->font_sys) {
+    if(font->font_sys)
+      FONT(system_ref_put(font->font_sys));
+    font->font_sys = font_sys;
+  }
+  FONT(rsrc_get_line_space(font->font_rsrc, &line_space));
+
+  /* The glyphs of the previous font are discarded */
+  notify_users(font, RBTTY_FONT_RELEASE);
+  rbtty_err = rbtty_glyph_cache_setup
+    (cache, RBTTY_GLYPH_CACHE_DEFAULT_SIZE, font->font_rsrc, font->font,
+     line_space);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+  /* Warm up the cache with the common glyphs. Once released, they are the
+   * first candidates to the eviction but stay resident until then */
+  FOR_EACH(size_t, i, 0, RBTTY_CHARSET_LEN) {
+    glyph = rbtty_glyph_cache_insert(cache, glyphs + i);
+    if(!glyph) {
+      rbtty_err = RBTTY_MEMORY_ERROR;
+      goto error;
+    }
+    glyph_min_width = MIN(glyph->desc.width, glyph_min_width);
+  }
+  FOR_EACH(size_t, i, 0, RBTTY_CHARSET_LEN)
+    rbtty_glyph_cache_release(cache, rbtty_charset[i]);
+
+  /* The glyphs of the cursor and of the undrawable chars are never evicted */
+  font->glyph_fallback =
+    rbtty_glyph_cache_acquire(cache, RBTTY_REPLACEMENT_CHAR)
+    ? RBTTY_REPLACEMENT_CHAR : L'?';
+  if(font->glyph_fallback == L'?')
+    rbtty_glyph_cache_acquire(cache, L'?');
+  rbtty_glyph_cache_acquire(cache, L'_');
+  rbtty_advance_setup(&font->advance, font->font_rsrc, font->glyph_fallback);
+
+  rbtty_err = rbtty_glyph_cache_flush(cache);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+  font->line_space = line_space;
+  font->glyph_min_width = glyph_min_width;
+
+  /* The users wrap and lay out their lines again with the new metrics */
+  rbtty_err = notify_users(font, RBTTY_FONT_INSTALL);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+exit:
+  return rbtty_err;
+error:
+  goto exit;
+}
+
+/*******************************************************************************
+ *
+ * Local functions
+ *
+ ******************************************************************************/
+void
+rbtty_font_attach_user(struct rbtty_font* font, struct rbtty_font_user* user)
+{
+  ASSERT(font && user && user->notify);
+  list_add_tail(&font->users, &user->node);
+}
+
+void
+rbtty_font_detach_user(struct rbtty_font* font, struct rbtty_font_user* user)
+{
+  ASSERT(font && user);
+  (void)font;
+  list_del(&user->node);
+}
+
+/*******************************************************************************
+ *
+ * rbtty_font functions
+ *
+ ******************************************************************************/
+enum rbtty_error
+rbtty_font_create
+  (struct rbi* rbi,
+   struct rb_context* ctxt,
+   struct mem_allocator* allocator,
+   struct rbtty_font** out_font)
+{
+  struct rbtty_font* font = NULL;
+  struct mem_allocator* alloc = allocator ? allocator : &mem_default_allocator;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  enum lp_error lp_err = LP_NO_ERROR;
+
+  if(UNLIKELY(!rbi || !out_font)) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  #define RB_FUNC(func_name, ...)                                              \
+    if(!rbi->func_name) {                                                      \
+      rbtty_err = RBTTY_INVALID_ARGUMENT;                                      \
+      goto error;                                                              \
+    }
+  #include <rb/rb_func.h>
+  #undef RB_FUNC
+
+  font = MEM_CALLOC(alloc, 1, sizeof(struct rbtty_font));
+  if(!font) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto error;
+  }
+  font->allocator = alloc;
+  rbtty_err = rbtty_font_loader_init(alloc, &font->loader);
+  if(rbtty_err != RBTTY_NO_ERROR) {
+    MEM_FREE(alloc, font);
+    font = NULL;
+    goto error;
+  }
+  ref_init(&font->ref);
+  list_init(&font->users);
+  rbtty_glyph_cache_init(alloc, &font->glyph_cache);
+  rbtty_advance_init(alloc, &font->advance);
+
+  lp_err = lp_create(rbi, ctxt, alloc, &font->lp);
+  if(lp_err == LP_NO_ERROR)
+    lp_err = lp_font_create(font->lp, &font->font);
+  if(lp_err != LP_NO_ERROR) {
+    rbtty_err = lp_to_rbtty_error(lp_err);
+    goto error;
+  }
+
+exit:
+  if(out_font)
+    *out_font = font;
+  return rbtty_err;
+error:
+  if(font) {
+    RBTTY(font_ref_put(font));
+    font = NULL;
+  }
+  goto exit;
+}
+
+enum rbtty_error
+rbtty_font_ref_get(struct rbtty_font* font)
+{
+  if(UNLIKELY(!font))
+    return RBTTY_INVALID_ARGUMENT;
+  ref_get(&font->ref);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_font_ref_put(struct rbtty_font* font)
+{
+  if(UNLIKELY(!font))
+    return RBTTY_INVALID_ARGUMENT;
+  ref_put(&font->ref, release_font);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_font_load(struct rbtty_font* font, const char* font_path)
+{
+  struct font_system* font_sys = NULL;
+  struct font_rsrc* font_rsrc = NULL;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+
+  if(UNLIKELY(!font || !font_path))
+    return RBTTY_INVALID_ARGUMENT;
+
+  rbtty_err = rbtty_font_loader_run(&font->loader, font_path,
+    rbtty_charset, RBTTY_CHARSET_LEN, font->cache_dir);
+  if(rbtty_err == RBTTY_NO_ERROR) {
+    rbtty_font_loader_take(&font->loader, &font_sys, &font_rsrc);
+    rbtty_err = install_font(font, font_sys, font_rsrc, font->loader.glyphs);
+  }
+  rbtty_font_loader_reset(&font->loader);
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_font_load_async(struct rbtty_font* font, const char* font_path)
+{
+  if(UNLIKELY(!font || !font_path))
+    return RBTTY_INVALID_ARGUMENT;
+  return rbtty_font_loader_start(&font->loader, font_path,
+    rbtty_charset, RBTTY_CHARSET_LEN, font->cache_dir);
+}
+
+enum rbtty_error
+rbtty_font_poll(struct rbtty_font* font, int* is_loaded)
+{
+  struct font_system* font_sys = NULL;
+  struct font_rsrc* font_rsrc = NULL;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  int is_done = 0;
+
+  if(UNLIKELY(!font || !is_loaded))
+    return RBTTY_INVALID_ARGUMENT;
+
+  if(!rbtty_font_loader_is_pending(&font->loader)) {
+    *is_loaded = 1;
+    return RBTTY_NO_ERROR;
+  }
+  rbtty_err = rbtty_font_loader_poll(&font->loader, &is_done);
+  *is_loaded = is_done;
+  if(is_done) {
+    if(rbtty_err == RBTTY_NO_ERROR) {
+      rbtty_font_loader_take(&font->loader, &font_sys, &font_rsrc);
+      rbtty_err = install_font
+        (font, font_sys, font_rsrc, font->loader.glyphs);
+    }
+    rbtty_font_loader_reset(&font->loader);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_font_set_cache_dir(struct rbtty_font* font, const char* path)
+{
+  char* dir = NULL;
+
+  if(UNLIKELY(!font))
+    return RBTTY_INVALID_ARGUMENT;
+  if(path) {
+    const size_t len = strlen(path) + 1;
+    dir = MEM_ALLOC(font->allocator, len);
+    if(!dir)
+      return RBTTY_MEMORY_ERROR;
+    memcpy(dir, path, len);
+  }
+  if(font->cache_dir)
+    MEM_FREE(font->allocator, font->cache_dir);
+  font->cache_dir = dir;
+  return RBTTY_NO_ERROR;
+}
+
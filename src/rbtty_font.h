@@ -0,0 +1,78 @@
+#ifndef RBTTY_FONT_H
+#define RBTTY_FONT_H
+
+#include "rbtty.h"
+#include "rbtty_advance.h"
+#include "rbtty_font_loader.h"
+#include "rbtty_glyph_cache.h"
+#include <snlsys/list.h>
+#include <snlsys/ref_count.h>
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+struct font_rsrc;
+struct font_system;
+struct lp;
+struct lp_font;
+struct mem_allocator;
+struct rb_context;
+struct rbi;
+struct rbtty_font_user;
+
+enum rbtty_font_event {
+  RBTTY_FONT_RELEASE, /* The glyphs are about to be discarded */
+  RBTTY_FONT_INSTALL /* The metrics and the glyphs of the font changed */
+};
+
+/* A user of a font, e.g. a tty, is notified when the font changes. On
+ * RBTTY_FONT_RELEASE it must release the glyphs it references; on
+ * RBTTY_FONT_INSTALL it adapts its layout to the new metrics */
+struct rbtty_font_user {
+  struct list_node node;
+  enum rbtty_error (*notify)
+    (struct rbtty_font_user* user,
+     const enum rbtty_font_event event);
+};
+
+/* Rasterized glyph set of a font, uploaded once to a lp_font and shared by
+ * all the ttys using the font. The glyph cache and the advances are thus
+ * shared too: a glyph rasterized for a tty is resident for the others */
+struct rbtty_font {
+  struct ref ref;
+
+  /* Line printer. The printers of the users are created from `lp' */
+  struct lp* lp;
+  struct lp_font* font;
+
+  /* Resource */
+  struct font_system* font_sys;
+  struct font_rsrc* font_rsrc;
+
+  /* Metrics */
+  int line_space;
+  int glyph_min_width;
+  wchar_t glyph_fallback; /* Always resident glyph of the undrawable chars */
+  char* cache_dir; /* Directory of the glyph files. May be NULL */
+
+  struct rbtty_glyph_cache glyph_cache;
+  struct rbtty_advance advance;
+  struct rbtty_font_loader loader;
+  struct list_node users;
+
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_font_attach_user
+  (struct rbtty_font* font,
+   struct rbtty_font_user* user);
+
+/* The user must have released its glyphs beforehand */
+extern LOCAL_SYM void
+rbtty_font_detach_user
+  (struct rbtty_font* font,
+   struct rbtty_font_user* user);
+
+#endif /* RBTTY_FONT_H */
+
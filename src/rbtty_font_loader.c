@@ -0,0 +1,474 @@
+#define _POSIX_C_SOURCE 200112L /* sysconf */
+
+#include "rbtty_font_loader.h"
+#include "rbtty_glyph_file.h"
+#include <font_rsrc.h>
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+#include <unistd.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static enum rbtty_error
+font_to_rbtty_error(const enum font_error font_err)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  switch(font_err) {
+    case FONT_INVALID_ARGUMENT: rbtty_err = RBTTY_INVALID_ARGUMENT; break;
+    case FONT_MEMORY_ERROR: rbtty_err = RBTTY_MEMORY_ERROR; break;
+    case FONT_NO_ERROR: rbtty_err = RBTTY_NO_ERROR; break;
+    default: rbtty_err = RBTTY_UNKNOWN_ERROR; break;
+  }
+  return rbtty_err;
+}
+
+static int
+is_cancelled(struct rbtty_font_loader* loader)
+{
+  int b = 0;
+  ASSERT(loader);
+  pthread_mutex_lock(&loader->mutex);
+  b = loader->is_cancelled;
+  pthread_mutex_unlock(&loader->mutex);
+  return b;
+}
+
+static void
+worker_release(struct rbtty_font_worker* worker)
+{
+  ASSERT(worker);
+  if(worker->font_rsrc)
+    FONT(rsrc_ref_put(worker->font_rsrc));
+  if(worker->font_sys)
+    FONT(system_ref_put(worker->font_sys));
+  worker->font_rsrc = NULL;
+  worker->font_sys = NULL;
+}
+
+/* Load the font into the font resource of the worker, if not already done */
+static enum font_error
+worker_load(struct rbtty_font_worker* worker)
+{
+  struct rbtty_font_loader* loader = NULL;
+  enum font_error font_err = FONT_NO_ERROR;
+  ASSERT(worker && worker->loader);
+  loader = worker->loader;
+
+  if(worker->font_rsrc)
+    return FONT_NO_ERROR;
+  font_err = font_system_create(loader->allocator, &worker->font_sys);
+  if(font_err != FONT_NO_ERROR)
+    goto error;
+  font_err = font_rsrc_create(worker->font_sys, NULL, &worker->font_rsrc);
+  if(font_err != FONT_NO_ERROR)
+    goto error;
+  font_err = font_rsrc_load(worker->font_rsrc, loader->path);
+  if(font_err != FONT_NO_ERROR)
+    goto error;
+exit:
+  return font_err;
+error:
+  worker_release(worker);
+  goto exit;
+}
+
+/* Load the font and fill the descs of the worker glyphs. Their bitmap buffer
+ * is not allocated yet but their bitmap size is defined */
+static void*
+worker_describe(void* arg)
+{
+  struct rbtty_font_worker* worker = arg;
+  struct rbtty_font_loader* loader = NULL;
+  struct font_glyph* font_glyph = NULL;
+  enum font_error font_err = FONT_NO_ERROR;
+  ASSERT(worker && worker->loader);
+  loader = worker->loader;
+
+  font_err = worker_load(worker);
+  if(font_err != FONT_NO_ERROR)
+    goto exit;
+
+  for(size_t i = worker->first;
+      i < loader->charset_len && !is_cancelled(loader);
+      i += loader->workers_count) {
+    struct lp_font_glyph_desc* desc = loader->glyphs + i;
+    struct font_glyph_desc font_glyph_desc;
+    int width = 0, height = 0, Bpp = 0;
+
+    font_err = font_rsrc_get_glyph
+      (worker->font_rsrc, loader->charset[i], &font_glyph);
+    if(font_err != FONT_NO_ERROR)
+      goto exit;
+    font_err = font_glyph_get_desc(font_glyph, &font_glyph_desc);
+    if(font_err != FONT_NO_ERROR)
+      goto exit;
+    font_err = font_glyph_get_bitmap
+      (font_glyph, true, &width, &height, &Bpp, NULL);
+    if(font_err != FONT_NO_ERROR)
+      goto exit;
+    FONT(glyph_ref_put(font_glyph));
+    font_glyph = NULL;
+
+    desc->character = loader->charset[i];
+    desc->width = font_glyph_desc.width;
+    desc->bitmap_left = font_glyph_desc.bbox.x_min;
+    desc->bitmap_top = font_glyph_desc.bbox.y_min;
+    desc->bitmap.width = width;
+    desc->bitmap.height = height;
+    desc->bitmap.bytes_per_pixel = Bpp;
+  }
+
+exit:
+  if(font_glyph)
+    FONT(glyph_ref_put(font_glyph));
+  worker->error = font_to_rbtty_error(font_err);
+  return NULL;
+}
+
+/* Rasterize the worker glyphs into their slice of the pooled bitmaps */
+static void*
+worker_rasterize(void* arg)
+{
+  struct rbtty_font_worker* worker = arg;
+  struct rbtty_font_loader* loader = NULL;
+  struct font_glyph* font_glyph = NULL;
+  enum font_error font_err = FONT_NO_ERROR;
+  ASSERT(worker && worker->loader);
+  loader = worker->loader;
+
+  for(size_t i = worker->first;
+      i < loader->charset_len && !is_cancelled(loader);
+      i += loader->workers_count) {
+    struct lp_font_glyph_desc* desc = loader->glyphs + i;
+    int width = 0, height = 0, Bpp = 0;
+
+    if(!desc->bitmap.buffer)
+      continue;
+    font_err = font_rsrc_get_glyph
+      (worker->font_rsrc, loader->charset[i], &font_glyph);
+    if(font_err != FONT_NO_ERROR)
+      break;
+    font_err = font_glyph_get_bitmap
+      (font_glyph, true, &width, &height, &Bpp, desc->bitmap.buffer);
+    FONT(glyph_ref_put(font_glyph));
+    if(font_err != FONT_NO_ERROR)
+      break;
+    ASSERT(width == desc->bitmap.width && height == desc->bitmap.height);
+  }
+  worker->error = font_to_rbtty_error(font_err);
+  return NULL;
+}
+
+/* Run `func' on all the workers. The first worker is run by the calling
+ * thread, as well as the workers whose thread cannot be created */
+static enum rbtty_error
+run_workers(struct rbtty_font_loader* loader, void* (*func)(void*))
+{
+  int is_started[RBTTY_FONT_LOADER_THREADS_MAX];
+  ASSERT(loader && func);
+
+  FOR_EACH(size_t, i, 1, loader->workers_count) {
+    is_started[i] = !pthread_create
+      (&loader->workers[i].thread, NULL, func, loader->workers + i);
+  }
+  func(loader->workers);
+  FOR_EACH(size_t, i, 1, loader->workers_count) {
+    if(is_started[i])
+      pthread_join(loader->workers[i].thread, NULL);
+    else
+      func(loader->workers + i);
+  }
+  FOR_EACH(size_t, i, 0, loader->workers_count) {
+    if(loader->workers[i].error != RBTTY_NO_ERROR)
+      return loader->workers[i].error;
+  }
+  return is_cancelled(loader) ? RBTTY_UNKNOWN_ERROR : RBTTY_NO_ERROR;
+}
+
+/* Fill the glyphs of the loader from the glyph file of the font, if any.
+ * Return 0 if the glyph file is missing or outdated. On return `key' is the
+ * key of the glyph file, if it can be defined */
+static int
+load_glyph_file(struct rbtty_font_loader* loader, uint64_t* key, int* is_keyed)
+{
+  int line_space = 0;
+  ASSERT(loader && loader->cache_dir && key && is_keyed);
+
+  *is_keyed = 0;
+  if(font_rsrc_get_line_space(loader->workers[0].font_rsrc, &line_space)
+     != FONT_NO_ERROR)
+    return 0;
+  if(rbtty_glyph_file_key(loader->path, line_space, loader->charset,
+     loader->charset_len, key) != RBTTY_NO_ERROR)
+    return 0;
+  *is_keyed = 1;
+  if(rbtty_glyph_file_map(&loader->file, loader->cache_dir, *key,
+     loader->charset, loader->charset_len) != RBTTY_NO_ERROR)
+    return 0;
+  if(loader->charset_len) {
+    memcpy(loader->glyphs, loader->file.glyphs,
+      loader->charset_len * sizeof(struct lp_font_glyph_desc));
+  }
+  return 1;
+}
+
+static void*
+job(void* arg)
+{
+  struct rbtty_font_loader* loader = arg;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  uint64_t key = 0;
+  int is_keyed = 0;
+  size_t size = 0;
+  ASSERT(loader);
+
+  /* The font resource of the first worker is used by the tty to rasterize
+   * the glyphs on demand. It is thus loaded even though the glyphs of the
+   * charset are read from the glyph file */
+  rbtty_err = font_to_rbtty_error(worker_load(loader->workers));
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto exit;
+  if(loader->cache_dir && load_glyph_file(loader, &key, &is_keyed))
+    goto exit;
+
+  rbtty_err = run_workers(loader, worker_describe);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto exit;
+
+  /* Allocate the bitmaps of all the glyphs at once */
+  FOR_EACH(size_t, i, 0, loader->charset_len) {
+    const struct lp_font_glyph_desc* desc = loader->glyphs + i;
+    size += (size_t)
+      (desc->bitmap.width * desc->bitmap.height * desc->bitmap.bytes_per_pixel);
+  }
+  if(size) {
+    loader->bitmaps = MEM_ALLOC(loader->allocator, size);
+    if(!loader->bitmaps) {
+      rbtty_err = RBTTY_MEMORY_ERROR;
+      goto exit;
+    }
+  }
+  size = 0;
+  FOR_EACH(size_t, i, 0, loader->charset_len) {
+    struct lp_font_glyph_desc* desc = loader->glyphs + i;
+    const size_t bmp_size = (size_t)
+      (desc->bitmap.width * desc->bitmap.height * desc->bitmap.bytes_per_pixel);
+    desc->bitmap.buffer = bmp_size ? loader->bitmaps + size : NULL;
+    size += bmp_size;
+  }
+
+  rbtty_err = run_workers(loader, worker_rasterize);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto exit;
+
+  /* Only the font resource of the first worker is kept */
+  FOR_EACH(size_t, i, 1, loader->workers_count)
+    worker_release(loader->workers + i);
+
+  /* Save the glyphs for the next loads of the font. Failing to write the
+   * glyph file is not an error: the glyphs are just rasterized again */
+  if(is_keyed) {
+    int line_space = 0;
+    FONT(rsrc_get_line_space(loader->workers[0].font_rsrc, &line_space));
+    rbtty_glyph_file_write(loader->allocator, loader->cache_dir, key,
+      line_space, loader->glyphs, loader->charset_len);
+  }
+
+exit:
+  loader->error = rbtty_err;
+  pthread_mutex_lock(&loader->mutex);
+  loader->is_done = 1;
+  pthread_mutex_unlock(&loader->mutex);
+  return NULL;
+}
+
+/* Allocate the job of loading the `font_path' font with `workers_count'
+ * workers */
+static enum rbtty_error
+setup_job
+  (struct rbtty_font_loader* loader,
+   const char* font_path,
+   const wchar_t* charset,
+   const size_t len,
+   const char* cache_dir,
+   const size_t workers_count)
+{
+  size_t path_len = 0;
+  size_t dir_len = 0;
+  ASSERT(loader && font_path && (charset || !len) && workers_count);
+
+  rbtty_font_loader_reset(loader);
+
+  path_len = strlen(font_path) + 1;
+  loader->path = MEM_ALLOC(loader->allocator, path_len);
+  if(cache_dir) {
+    dir_len = strlen(cache_dir) + 1;
+    loader->cache_dir = MEM_ALLOC(loader->allocator, dir_len);
+  }
+  if(len) {
+    loader->glyphs = MEM_CALLOC
+      (loader->allocator, len, sizeof(struct lp_font_glyph_desc));
+  }
+  if(!loader->path
+  || (cache_dir && !loader->cache_dir)
+  || (len && !loader->glyphs)) {
+    rbtty_font_loader_reset(loader);
+    return RBTTY_MEMORY_ERROR;
+  }
+  memcpy(loader->path, font_path, path_len);
+  if(cache_dir)
+    memcpy(loader->cache_dir, cache_dir, dir_len);
+  loader->charset = charset;
+  loader->charset_len = len;
+
+  loader->workers_count = MIN(workers_count, MAX(len, 1));
+  loader->workers_count =
+    MIN(loader->workers_count, RBTTY_FONT_LOADER_THREADS_MAX);
+  FOR_EACH(size_t, i, 0, loader->workers_count) {
+    loader->workers[i].loader = loader;
+    loader->workers[i].first = i;
+    loader->workers[i].error = RBTTY_NO_ERROR;
+  }
+  return RBTTY_NO_ERROR;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_font_loader functions
+ *
+ ******************************************************************************/
+enum rbtty_error
+rbtty_font_loader_init
+  (struct mem_allocator* allocator,
+   struct rbtty_font_loader* loader)
+{
+  ASSERT(allocator && loader);
+  memset(loader, 0, sizeof(struct rbtty_font_loader));
+  if(pthread_mutex_init(&loader->mutex, NULL))
+    return RBTTY_UNKNOWN_ERROR;
+  loader->allocator = allocator;
+  loader->error = RBTTY_NO_ERROR;
+  rbtty_glyph_file_init(allocator, &loader->file);
+  return RBTTY_NO_ERROR;
+}
+
+void
+rbtty_font_loader_shutdown(struct rbtty_font_loader* loader)
+{
+  ASSERT(loader);
+  rbtty_font_loader_reset(loader);
+  pthread_mutex_destroy(&loader->mutex);
+}
+
+enum rbtty_error
+rbtty_font_loader_start
+  (struct rbtty_font_loader* loader,
+   const char* font_path,
+   const wchar_t* charset,
+   const size_t len,
+   const char* cache_dir)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  const long nprocs = sysconf(_SC_NPROCESSORS_ONLN);
+  ASSERT(loader);
+
+  rbtty_err = setup_job(loader, font_path, charset, len, cache_dir,
+    nprocs > 0 ? (size_t)nprocs : 1);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  if(pthread_create(&loader->thread, NULL, job, loader)) {
+    rbtty_font_loader_reset(loader);
+    return RBTTY_UNKNOWN_ERROR;
+  }
+  loader->is_running = 1;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_font_loader_run
+  (struct rbtty_font_loader* loader,
+   const char* font_path,
+   const wchar_t* charset,
+   const size_t len,
+   const char* cache_dir)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(loader);
+
+  rbtty_err = setup_job(loader, font_path, charset, len, cache_dir, 1);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  job(loader);
+  return loader->error;
+}
+
+enum rbtty_error
+rbtty_font_loader_poll(struct rbtty_font_loader* loader, int* is_done)
+{
+  ASSERT(loader && is_done && loader->is_running);
+
+  pthread_mutex_lock(&loader->mutex);
+  *is_done = loader->is_done;
+  pthread_mutex_unlock(&loader->mutex);
+  if(!*is_done)
+    return RBTTY_NO_ERROR;
+
+  pthread_join(loader->thread, NULL);
+  loader->is_running = 0;
+  return loader->error;
+}
+
+void
+rbtty_font_loader_take
+  (struct rbtty_font_loader* loader,
+   struct font_system** font_sys,
+   struct font_rsrc** font_rsrc)
+{
+  ASSERT(loader && font_sys && font_rsrc);
+  ASSERT(!loader->is_running && loader->is_done);
+  ASSERT(loader->error == RBTTY_NO_ERROR);
+  *font_sys = loader->workers[0].font_sys;
+  *font_rsrc = loader->workers[0].font_rsrc;
+  loader->workers[0].font_sys = NULL;
+  loader->workers[0].font_rsrc = NULL;
+}
+
+void
+rbtty_font_loader_reset(struct rbtty_font_loader* loader)
+{
+  ASSERT(loader);
+
+  if(loader->is_running) {
+    pthread_mutex_lock(&loader->mutex);
+    loader->is_cancelled = 1;
+    pthread_mutex_unlock(&loader->mutex);
+    pthread_join(loader->thread, NULL);
+    loader->is_running = 0;
+  }
+  FOR_EACH(size_t, i, 0, loader->workers_count)
+    worker_release(loader->workers + i);
+  rbtty_glyph_file_release(&loader->file);
+  if(loader->path)
+    MEM_FREE(loader->allocator, loader->path);
+  if(loader->cache_dir)
+    MEM_FREE(loader->allocator, loader->cache_dir);
+  if(loader->glyphs)
+    MEM_FREE(loader->allocator, loader->glyphs);
+  if(loader->bitmaps)
+    MEM_FREE(loader->allocator, loader->bitmaps);
+  loader->path = NULL;
+  loader->cache_dir = NULL;
+  loader->glyphs = NULL;
+  loader->bitmaps = NULL;
+  loader->charset = NULL;
+  loader->charset_len = 0;
+  loader->workers_count = 0;
+  loader->is_done = 0;
+  loader->is_cancelled = 0;
+  loader->error = RBTTY_NO_ERROR;
+}
+
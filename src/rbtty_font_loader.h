@@ -0,0 +1,122 @@
+#ifndef RBTTY_FONT_LOADER_H
+#define RBTTY_FONT_LOADER_H
+
+#include "rbtty_error.h"
+#include "rbtty_glyph_file.h"
+#include <lp/lp_font.h>
+#include <snlsys/snlsys.h>
+#include <pthread.h>
+#include <wchar.h>
+
+/* Maximum number of threads rasterizing the glyphs of a font */
+#define RBTTY_FONT_LOADER_THREADS_MAX 8
+
+struct font_rsrc;
+struct font_system;
+struct mem_allocator;
+struct rbtty_font_loader;
+
+struct rbtty_font_worker {
+  struct rbtty_font_loader* loader;
+  pthread_t thread;
+  size_t first; /* Index of the first glyph rasterized by the worker */
+  /* A font resource per worker since it cannot be shared between threads */
+  struct font_system* font_sys;
+  struct font_rsrc* font_rsrc;
+  enum rbtty_error error;
+};
+
+/* Load a font and rasterize a set of its glyphs in background. The job is
+ * run by a dedicated thread that spreads the glyphs over several workers:
+ * the workers first query the bitmap size of their glyphs, then rasterize
+ * them into a single bitmap buffer allocated once with the overall size. If
+ * a cache directory is defined, the glyphs are read from the glyph file of
+ * the font when it exists, and saved into it otherwise */
+struct rbtty_font_loader {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  int is_running; /* The job thread is started and not joined yet */
+  int is_done; /* Protected by the mutex */
+  int is_cancelled; /* Protected by the mutex */
+  enum rbtty_error error;
+
+  char* path;
+  char* cache_dir; /* May be NULL */
+  const wchar_t* charset;
+  size_t charset_len;
+
+  struct rbtty_font_worker workers[RBTTY_FONT_LOADER_THREADS_MAX];
+  size_t workers_count;
+
+  /* Result */
+  struct lp_font_glyph_desc* glyphs; /* One desc per char of the charset */
+  unsigned char* bitmaps; /* Pooled bitmaps of the glyphs */
+  struct rbtty_glyph_file file; /* Mapped bitmaps of the glyphs */
+
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_font_loader_init
+  (struct mem_allocator* allocator,
+   struct rbtty_font_loader* loader);
+
+/* Cancel the pending job, if any, and release the loader */
+extern LOCAL_SYM void
+rbtty_font_loader_shutdown
+  (struct rbtty_font_loader* loader);
+
+/* Cancel the pending job, if any, and start loading the `font_path' font and
+ * rasterizing the `len' glyphs of `charset'. The allocator of the loader must
+ * be thread safe. `cache_dir' may be NULL */
+extern LOCAL_SYM enum rbtty_error
+rbtty_font_loader_start
+  (struct rbtty_font_loader* loader,
+   const char* font_path,
+   const wchar_t* charset,
+   const size_t len,
+   const char* cache_dir);
+
+/* Synchronous variant of rbtty_font_loader_start. The job is run on the
+ * calling thread only. Its result is then retrieved as for a completed
+ * asynchronous job */
+extern LOCAL_SYM enum rbtty_error
+rbtty_font_loader_run
+  (struct rbtty_font_loader* loader,
+   const char* font_path,
+   const wchar_t* charset,
+   const size_t len,
+   const char* cache_dir);
+
+/* Check without blocking whether the pending job is completed. Once it is,
+ * `is_done' is set to 1 and the returned error is the one of the job. The
+ * result must then be retrieved with rbtty_font_loader_take */
+extern LOCAL_SYM enum rbtty_error
+rbtty_font_loader_poll
+  (struct rbtty_font_loader* loader,
+   int* is_done);
+
+/* Transfer the ownership of the loaded font resource to the caller. The
+ * glyphs of the loader remain valid until the next call to
+ * rbtty_font_loader_reset */
+extern LOCAL_SYM void
+rbtty_font_loader_take
+  (struct rbtty_font_loader* loader,
+   struct font_system** font_sys,
+   struct font_rsrc** font_rsrc);
+
+/* Cancel the pending job, if any, and release its result */
+extern LOCAL_SYM void
+rbtty_font_loader_reset
+  (struct rbtty_font_loader* loader);
+
+static FINLINE int
+rbtty_font_loader_is_pending(const struct rbtty_font_loader* loader)
+{
+  ASSERT(loader);
+  return loader->is_running;
+}
+
+#endif /* RBTTY_FONT_LOADER_H */
+
@@ -0,0 +1,326 @@
+#include "rbtty_glyph_cache.h"
+#include "rbtty_stats.h"
+#include <font_rsrc.h>
+#include <lp/lp.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static enum rbtty_error
+lp_to_rbtty_error(const enum lp_error lp_err)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  switch(lp_err) {
+    case LP_INVALID_ARGUMENT: rbtty_err = RBTTY_INVALID_ARGUMENT; break;
+    case LP_MEMORY_ERROR: rbtty_err = RBTTY_MEMORY_ERROR; break;
+    case LP_NO_ERROR: rbtty_err = RBTTY_NO_ERROR; break;
+    default: rbtty_err = RBTTY_UNKNOWN_ERROR;  break;
+  }
+  return rbtty_err;
+}
+
+static FINLINE size_t
+hash_char(const struct rbtty_glyph_cache* cache, const wchar_t c)
+{
+  uint32_t h = (uint32_t)c * 2654435761u; /* Knuth multiplicative hash */
+  ASSERT(cache && cache->buckets_count);
+  return (size_t)(h >> 16) & (cache->buckets_count - 1);
+}
+
+static struct rbtty_glyph*
+cache_find(struct rbtty_glyph_cache* cache, const wchar_t c)
+{
+  uint32_t i = 0;
+  ASSERT(cache);
+  for(i = cache->buckets[hash_char(cache, c)]; i; i = cache->glyphs[i-1].next) {
+    if(cache->glyphs[i-1].desc.character == c)
+      return cache->glyphs + i - 1;
+  }
+  return NULL;
+}
+
+static void
+cache_unlink(struct rbtty_glyph_cache* cache, struct rbtty_glyph* glyph)
+{
+  const uint32_t id = (uint32_t)(glyph - cache->glyphs) + 1;
+  uint32_t* i = NULL;
+  ASSERT(cache && glyph);
+  for(i = cache->buckets + hash_char(cache, glyph->desc.character);
+      *i != id;
+      i = &cache->glyphs[*i-1].next) {
+    ASSERT(*i);
+  }
+  *i = glyph->next;
+  glyph->next = 0;
+}
+
+/* Rasterize the glyph of `c' into `glyph' */
+static int
+cache_rasterize
+  (struct rbtty_glyph_cache* cache,
+   struct rbtty_glyph* glyph,
+   const wchar_t c)
+{
+  struct font_glyph_desc font_glyph_desc;
+  struct font_glyph* font_glyph = NULL;
+  size_t size = 0;
+  int width = 0, height = 0, Bpp = 0;
+  int is_ok = 0;
+  ASSERT(cache && glyph);
+
+  if(font_rsrc_get_glyph(cache->font_rsrc, c, &font_glyph) != FONT_NO_ERROR)
+    goto exit;
+  if(font_glyph_get_desc(font_glyph, &font_glyph_desc) != FONT_NO_ERROR)
+    goto exit;
+  if(font_glyph_get_bitmap
+     (font_glyph, true, &width, &height, &Bpp, NULL) != FONT_NO_ERROR)
+    goto exit;
+
+  /* The bitmap buffer of a glyph slot is reused by the next glyph */
+  size = (size_t)(width * height * Bpp);
+  if(size > glyph->bitmap_capacity) {
+    unsigned char* buffer = MEM_REALLOC
+      (cache->allocator, glyph->desc.bitmap.buffer, size);
+    if(!buffer)
+      goto exit;
+    glyph->desc.bitmap.buffer = buffer;
+    glyph->bitmap_capacity = size;
+  }
+  if(size && font_glyph_get_bitmap
+     (font_glyph, true, &width, &height, &Bpp, glyph->desc.bitmap.buffer)
+     != FONT_NO_ERROR)
+    goto exit;
+
+  glyph->desc.character = c;
+  glyph->desc.width = font_glyph_desc.width;
+  glyph->desc.bitmap_left = font_glyph_desc.bbox.x_min;
+  glyph->desc.bitmap_top = font_glyph_desc.bbox.y_min;
+  glyph->desc.bitmap.width = width;
+  glyph->desc.bitmap.height = height;
+  glyph->desc.bitmap.bytes_per_pixel = Bpp;
+  is_ok = 1;
+
+exit:
+  if(font_glyph)
+    FONT(glyph_ref_put(font_glyph));
+  return is_ok;
+}
+
+/* Pick a free slot or evict the least recently used glyph. Return NULL if
+ * all the glyphs are referenced */
+static struct rbtty_glyph*
+cache_pick_slot(struct rbtty_glyph_cache* cache)
+{
+  struct rbtty_glyph* glyph = NULL;
+  ASSERT(cache);
+
+  if(!is_list_empty(&cache->free)) {
+    glyph = CONTAINER_OF(list_head(&cache->free), struct rbtty_glyph, lru);
+  } else if(!is_list_empty(&cache->lru)) {
+    glyph = CONTAINER_OF(list_tail(&cache->lru), struct rbtty_glyph, lru);
+    cache_unlink(cache, glyph);
+    glyph->is_used = 0;
+    cache->is_dirty = 1;
+  } else {
+    return NULL;
+  }
+  list_del(&glyph->lru);
+  return glyph;
+}
+
+/* Register the glyph newly stored in `glyph' and reference it */
+static void
+cache_link(struct rbtty_glyph_cache* cache, struct rbtty_glyph* glyph)
+{
+  size_t bucket = 0;
+  ASSERT(cache && glyph && !glyph->is_used);
+  bucket = hash_char(cache, glyph->desc.character);
+  glyph->next = cache->buckets[bucket];
+  cache->buckets[bucket] = (uint32_t)(glyph - cache->glyphs) + 1;
+  glyph->refs = 1;
+  glyph->is_used = 1;
+  cache->is_dirty = 1;
+}
+
+static void
+cache_release(struct rbtty_glyph_cache* cache)
+{
+  ASSERT(cache);
+  FOR_EACH(size_t, i, 0, cache->capacity) {
+    if(cache->glyphs[i].desc.bitmap.buffer)
+      MEM_FREE(cache->allocator, cache->glyphs[i].desc.bitmap.buffer);
+  }
+  if(cache->glyphs)
+    MEM_FREE(cache->allocator, cache->glyphs);
+  if(cache->buckets)
+    MEM_FREE(cache->allocator, cache->buckets);
+  if(cache->upload)
+    MEM_FREE(cache->allocator, cache->upload);
+  cache->glyphs = NULL;
+  cache->buckets = NULL;
+  cache->upload = NULL;
+  cache->capacity = 0;
+  cache->buckets_count = 0;
+  list_init(&cache->lru);
+  list_init(&cache->free);
+}
+
+/*******************************************************************************
+ *
+ * rbtty_glyph_cache functions
+ *
+ ******************************************************************************/
+void
+rbtty_glyph_cache_init
+  (struct mem_allocator* allocator,
+   struct rbtty_glyph_cache* cache)
+{
+  ASSERT(allocator && cache);
+  memset(cache, 0, sizeof(struct rbtty_glyph_cache));
+  cache->allocator = allocator;
+  list_init(&cache->lru);
+  list_init(&cache->free);
+}
+
+void
+rbtty_glyph_cache_shutdown(struct rbtty_glyph_cache* cache)
+{
+  ASSERT(cache);
+  cache_release(cache);
+}
+
+enum rbtty_error
+rbtty_glyph_cache_setup
+  (struct rbtty_glyph_cache* cache,
+   const size_t capacity,
+   struct font_rsrc* font_rsrc,
+   struct lp_font* font,
+   const int line_space)
+{
+  size_t buckets_count = 1;
+  ASSERT(cache && capacity && capacity < UINT32_MAX && font_rsrc && font);
+
+  cache_release(cache);
+  while(buckets_count < capacity)
+    buckets_count *= 2;
+
+  cache->glyphs = MEM_CALLOC
+    (cache->allocator, capacity, sizeof(struct rbtty_glyph));
+  cache->buckets = MEM_CALLOC
+    (cache->allocator, buckets_count, sizeof(uint32_t));
+  cache->upload = MEM_ALLOC
+    (cache->allocator, capacity * sizeof(struct lp_font_glyph_desc));
+  if(!cache->glyphs || !cache->buckets || !cache->upload) {
+    cache_release(cache);
+    return RBTTY_MEMORY_ERROR;
+  }
+  FOR_EACH(size_t, i, 0, capacity)
+    list_add_tail(&cache->free, &cache->glyphs[i].lru);
+  cache->capacity = capacity;
+  cache->buckets_count = buckets_count;
+  cache->font_rsrc = font_rsrc;
+  cache->font = font;
+  cache->line_space = line_space;
+  cache->is_dirty = 1;
+  return RBTTY_NO_ERROR;
+}
+
+const struct rbtty_glyph*
+rbtty_glyph_cache_acquire(struct rbtty_glyph_cache* cache, const wchar_t c)
+{
+  struct rbtty_glyph* glyph = NULL;
+  ASSERT(cache);
+
+  if(!cache->capacity)
+    return NULL;
+
+  glyph = cache_find(cache, c);
+  if(glyph) {
+    RBTTY_STATS_INC(cache->hits_count);
+    if(!glyph->refs++)
+      list_del(&glyph->lru);
+    return glyph;
+  }
+  RBTTY_STATS_INC(cache->misses_count);
+  glyph = cache_pick_slot(cache);
+  if(!glyph)
+    return NULL;
+  if(!cache_rasterize(cache, glyph, c)) {
+    list_add(&cache->free, &glyph->lru);
+    return NULL;
+  }
+  cache_link(cache, glyph);
+  return glyph;
+}
+
+const struct rbtty_glyph*
+rbtty_glyph_cache_insert
+  (struct rbtty_glyph_cache* cache,
+   const struct lp_font_glyph_desc* desc)
+{
+  struct rbtty_glyph* glyph = NULL;
+  unsigned char* buffer = NULL;
+  size_t size = 0;
+  ASSERT(cache && desc);
+
+  if(!cache->capacity || cache_find(cache, desc->character))
+    return NULL;
+  glyph = cache_pick_slot(cache);
+  if(!glyph)
+    return NULL;
+
+  size = (size_t)
+    (desc->bitmap.width * desc->bitmap.height * desc->bitmap.bytes_per_pixel);
+  if(size > glyph->bitmap_capacity) {
+    buffer = MEM_REALLOC(cache->allocator, glyph->desc.bitmap.buffer, size);
+    if(!buffer) {
+      list_add(&cache->free, &glyph->lru);
+      return NULL;
+    }
+    glyph->desc.bitmap.buffer = buffer;
+    glyph->bitmap_capacity = size;
+  }
+  buffer = glyph->desc.bitmap.buffer;
+  glyph->desc = *desc;
+  glyph->desc.bitmap.buffer = buffer;
+  if(size)
+    memcpy(buffer, desc->bitmap.buffer, size);
+  cache_link(cache, glyph);
+  return glyph;
+}
+
+void
+rbtty_glyph_cache_release(struct rbtty_glyph_cache* cache, const wchar_t c)
+{
+  struct rbtty_glyph* glyph = NULL;
+  ASSERT(cache);
+
+  if(!cache->capacity)
+    return;
+  glyph = cache_find(cache, c);
+  if(glyph && glyph->refs && !--glyph->refs)
+    list_add(&cache->lru, &glyph->lru);
+}
+
+enum rbtty_error
+rbtty_glyph_cache_flush(struct rbtty_glyph_cache* cache)
+{
+  size_t count = 0;
+  ASSERT(cache);
+
+  if(!cache->is_dirty || !cache->font)
+    return RBTTY_NO_ERROR;
+
+  FOR_EACH(size_t, i, 0, cache->capacity) {
+    if(cache->glyphs[i].is_used)
+      cache->upload[count++] = cache->glyphs[i].desc;
+  }
+  cache->is_dirty = 0;
+  return lp_to_rbtty_error(lp_font_set_data
+    (cache->font, cache->line_space, (int)count, cache->upload));
+}
+
@@ -0,0 +1,99 @@
+#ifndef RBTTY_GLYPH_CACHE_H
+#define RBTTY_GLYPH_CACHE_H
+
+#include "rbtty_error.h"
+#include <lp/lp_font.h>
+#include <snlsys/list.h>
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Default number of glyphs that can be resident at the same time */
+#define RBTTY_GLYPH_CACHE_DEFAULT_SIZE 1024
+
+struct font_rsrc;
+struct lp_font;
+struct mem_allocator;
+
+struct rbtty_glyph {
+  struct lp_font_glyph_desc desc;
+  /* Linked into the LRU list while unreferenced or into the free list while
+   * unused */
+  struct list_node lru;
+  size_t bitmap_capacity; /* In bytes */
+  uint32_t next; /* Next glyph of the hash bucket */
+  uint32_t refs; /* Number of laid out chars using the glyph */
+  int is_used;
+};
+
+/* Fixed size set of rasterized glyphs. A missing glyph is rasterized on its
+ * first use and evicts the least recently used glyph that is not referenced
+ * by a laid out char. The glyph set is uploaded to the lp_font at most once
+ * per frame, on flush, and only if it changed */
+struct rbtty_glyph_cache {
+  struct rbtty_glyph* glyphs;
+  size_t capacity;
+  uint32_t* buckets; /* Hash table of (glyph index + 1); 0 <=> empty */
+  size_t buckets_count; /* Power of 2 */
+  struct list_node lru; /* Head is the most recently used */
+  struct list_node free;
+  struct lp_font_glyph_desc* upload; /* Scratch of the glyph descs to upload */
+  int is_dirty;
+  /* Font */
+  struct font_rsrc* font_rsrc;
+  struct lp_font* font;
+  int line_space;
+#ifdef RBTTY_ENABLE_STATS
+  /* Statistics */
+  uint64_t hits_count;
+  uint64_t misses_count;
+#endif
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_glyph_cache_init
+  (struct mem_allocator* allocator,
+   struct rbtty_glyph_cache* cache);
+
+extern LOCAL_SYM void
+rbtty_glyph_cache_shutdown
+  (struct rbtty_glyph_cache* cache);
+
+/* Allocate room for `capacity' glyphs of the `font_rsrc' font uploaded to
+ * `font'. The previously cached glyphs are discarded */
+extern LOCAL_SYM enum rbtty_error
+rbtty_glyph_cache_setup
+  (struct rbtty_glyph_cache* cache,
+   const size_t capacity,
+   struct font_rsrc* font_rsrc,
+   struct lp_font* font,
+   const int line_space);
+
+/* Reference the glyph of `c', rasterizing it if necessary. Return NULL if
+ * the glyph cannot be rasterized or if all the glyphs are referenced */
+extern LOCAL_SYM const struct rbtty_glyph*
+rbtty_glyph_cache_acquire
+  (struct rbtty_glyph_cache* cache,
+   const wchar_t c);
+
+/* Copy and reference the already rasterized glyph `desc'. Return NULL if the
+ * glyph is already cached or if it cannot be stored */
+extern LOCAL_SYM const struct rbtty_glyph*
+rbtty_glyph_cache_insert
+  (struct rbtty_glyph_cache* cache,
+   const struct lp_font_glyph_desc* desc);
+
+extern LOCAL_SYM void
+rbtty_glyph_cache_release
+  (struct rbtty_glyph_cache* cache,
+   const wchar_t c);
+
+/* Upload the cached glyphs to the lp_font if they changed since the last
+ * flush */
+extern LOCAL_SYM enum rbtty_error
+rbtty_glyph_cache_flush
+  (struct rbtty_glyph_cache* cache);
+
+#endif /* RBTTY_GLYPH_CACHE_H */
+
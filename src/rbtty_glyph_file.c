@@ -0,0 +1,379 @@
+#define _POSIX_C_SOURCE 200112L /* open, mmap, getpid */
+
+#include "rbtty_glyph_file.h"
+#include <snlsys/mem_allocator.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define GLYPH_FILE_MAGIC "RBTTYGLF"
+#define GLYPH_FILE_BYTE_ORDER 0x01020304u
+
+/* Upper bounds of the dimensions of a glyph bitmap read from a file */
+#define GLYPH_MAX_SIZE 4096
+#define GLYPH_MAX_BYTES_PER_PIXEL 4
+
+/* The file is written in the native byte order. Its fields have a fixed size
+ * and are naturally aligned so that the mapped data can be read in place */
+struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t key;
+  uint32_t glyphs_count;
+  int32_t line_space;
+  uint64_t bitmaps_size;
+};
+
+struct file_glyph {
+  int32_t character;
+  int32_t width;
+  int32_t bitmap_left;
+  int32_t bitmap_top;
+  int32_t bitmap_width;
+  int32_t bitmap_height;
+  int32_t bytes_per_pixel;
+  uint32_t padding;
+  uint64_t offset; /* Offset of the bitmap from the first bitmap */
+};
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE uint64_t
+fnv1a(uint64_t hash, const void* data, const size_t size)
+{
+  const unsigned char* bytes = data;
+  FOR_EACH(size_t, i, 0, size) {
+    hash ^= bytes[i];
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+static FINLINE size_t
+bitmap_size(const int width, const int height, const int bytes_per_pixel)
+{
+  if(width <= 0 || height <= 0 || bytes_per_pixel <= 0)
+    return 0;
+  return (size_t)width * (size_t)height * (size_t)bytes_per_pixel;
+}
+
+/* Check the bitmap dimensions of a record before their product is computed */
+static FINLINE int
+is_glyph_bitmap_valid(const struct file_glyph* rec)
+{
+  ASSERT(rec);
+  return rec->bitmap_width >= 0 && rec->bitmap_width <= GLYPH_MAX_SIZE
+      && rec->bitmap_height >= 0 && rec->bitmap_height <= GLYPH_MAX_SIZE
+      && rec->bytes_per_pixel >= 0
+      && rec->bytes_per_pixel <= GLYPH_MAX_BYTES_PER_PIXEL;
+}
+
+/* Return the allocated path of the `key' glyph file of `dir' */
+static char*
+file_path
+  (struct mem_allocator* allocator,
+   const char* dir,
+   const uint64_t key,
+   const char* suffix)
+{
+  char* path = NULL;
+  int len = 0;
+  ASSERT(allocator && dir && suffix);
+
+  len = snprintf
+    (NULL, 0, "%s/%016llx.rbglyph%s", dir, (unsigned long long)key, suffix);
+  if(len < 0)
+    return NULL;
+  path = MEM_ALLOC(allocator, (size_t)len + 1);
+  if(path) {
+    snprintf(path, (size_t)len + 1, "%s/%016llx.rbglyph%s",
+      dir, (unsigned long long)key, suffix);
+  }
+  return path;
+}
+
+/* Map the whole `path' file in read only */
+static enum rbtty_error
+map_file(const char* path, void** data, size_t* size)
+{
+  struct stat st;
+  int fd = -1;
+  ASSERT(path && data && size);
+
+  *data = NULL;
+  *size = 0;
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return RBTTY_INVALID_ARGUMENT;
+  if(fstat(fd, &st) || st.st_size < 0) {
+    close(fd);
+    return RBTTY_UNKNOWN_ERROR;
+  }
+  if(st.st_size) {
+    void* mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mem == MAP_FAILED) {
+      close(fd);
+      return RBTTY_UNKNOWN_ERROR;
+    }
+    *data = mem;
+    *size = (size_t)st.st_size;
+  }
+  close(fd);
+  return RBTTY_NO_ERROR;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_glyph_file functions
+ *
+ ******************************************************************************/
+void
+rbtty_glyph_file_init
+  (struct mem_allocator* allocator,
+   struct rbtty_glyph_file* file)
+{
+  ASSERT(allocator && file);
+  memset(file, 0, sizeof(struct rbtty_glyph_file));
+  file->allocator = allocator;
+}
+
+void
+rbtty_glyph_file_release(struct rbtty_glyph_file* file)
+{
+  ASSERT(file);
+  if(file->glyphs)
+    MEM_FREE(file->allocator, file->glyphs);
+  if(file->data)
+    munmap(file->data, file->size);
+  file->glyphs = NULL;
+  file->glyphs_count = 0;
+  file->data = NULL;
+  file->size = 0;
+  file->line_space = 0;
+}
+
+enum rbtty_error
+rbtty_glyph_file_key
+  (const char* font_path,
+   const int line_space,
+   const wchar_t* charset,
+   const size_t len,
+   uint64_t* key)
+{
+  const uint32_t version = RBTTY_GLYPH_FILE_VERSION;
+  const int32_t space = line_space;
+  uint64_t hash = 0xCBF29CE484222325ull;
+  uint64_t size = 0;
+  size_t data_size = 0;
+  void* data = NULL;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(font_path && (charset || !len) && key);
+
+  rbtty_err = map_file(font_path, &data, &data_size);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  hash = fnv1a(hash, data, data_size);
+  if(data)
+    munmap(data, data_size);
+  size = data_size;
+
+  hash = fnv1a(hash, &size, sizeof(size));
+  hash = fnv1a(hash, &space, sizeof(space));
+  hash = fnv1a(hash, &version, sizeof(version));
+  FOR_EACH(size_t, i, 0, len) {
+    const uint32_t c = (uint32_t)charset[i];
+    hash = fnv1a(hash, &c, sizeof(c));
+  }
+  *key = hash;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_glyph_file_map
+  (struct rbtty_glyph_file* file,
+   const char* dir,
+   const uint64_t key,
+   const wchar_t* charset,
+   const size_t len)
+{
+  const struct file_header* header = NULL;
+  const struct file_glyph* records = NULL;
+  const unsigned char* bitmaps = NULL;
+  char* path = NULL;
+  size_t table_size = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(file && dir && (charset || !len));
+
+  rbtty_glyph_file_release(file);
+  path = file_path(file->allocator, dir, key, "");
+  if(!path) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto error;
+  }
+  rbtty_err = map_file(path, &file->data, &file->size);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+  /* Validate the header */
+  rbtty_err = RBTTY_UNKNOWN_ERROR;
+  if(file->size < sizeof(struct file_header))
+    goto error;
+  header = file->data;
+  table_size = len * sizeof(struct file_glyph);
+  if(memcmp(header->magic, GLYPH_FILE_MAGIC, sizeof(header->magic))
+  || header->version != RBTTY_GLYPH_FILE_VERSION
+  || header->byte_order != GLYPH_FILE_BYTE_ORDER
+  || header->key != key
+  || header->glyphs_count != len
+  || file->size - sizeof(struct file_header) < table_size
+  || file->size - sizeof(struct file_header) - table_size
+     < header->bitmaps_size)
+    goto error;
+  records = (const struct file_glyph*)(header + 1);
+  bitmaps = (const unsigned char*)(records + len);
+
+  file->glyphs = MEM_ALLOC
+    (file->allocator, len * sizeof(struct lp_font_glyph_desc));
+  if(len && !file->glyphs) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto error;
+  }
+  FOR_EACH(size_t, i, 0, len) {
+    const struct file_glyph* rec = records + i;
+    struct lp_font_glyph_desc* desc = file->glyphs + i;
+    size_t size = 0;
+    /* An invalid record is handled as a stale file, i.e. a cache miss */
+    if(!is_glyph_bitmap_valid(rec))
+      goto error;
+    size = bitmap_size
+      (rec->bitmap_width, rec->bitmap_height, rec->bytes_per_pixel);
+    if((wchar_t)rec->character != charset[i]
+    || rec->offset > header->bitmaps_size
+    || header->bitmaps_size - rec->offset < size)
+      goto error;
+    desc->character = (wchar_t)rec->character;
+    desc->width = rec->width;
+    desc->bitmap_left = rec->bitmap_left;
+    desc->bitmap_top = rec->bitmap_top;
+    desc->bitmap.width = rec->bitmap_width;
+    desc->bitmap.height = rec->bitmap_height;
+    desc->bitmap.bytes_per_pixel = rec->bytes_per_pixel;
+    /* The mapping is read only while lp only reads the bitmaps */
+    desc->bitmap.buffer = size ? (unsigned char*)(bitmaps + rec->offset) : NULL;
+  }
+  file->glyphs_count = len;
+  file->line_space = header->line_space;
+  rbtty_err = RBTTY_NO_ERROR;
+
+exit:
+  if(path)
+    MEM_FREE(file->allocator, path);
+  return rbtty_err;
+error:
+  rbtty_glyph_file_release(file);
+  goto exit;
+}
+
+enum rbtty_error
+rbtty_glyph_file_write
+  (struct mem_allocator* allocator,
+   const char* dir,
+   const uint64_t key,
+   const int line_space,
+   const struct lp_font_glyph_desc* glyphs,
+   const size_t count)
+{
+  struct file_header header;
+  char* path = NULL;
+  char* tmp_path = NULL;
+  char suffix[32];
+  FILE* stream = NULL;
+  uint64_t offset = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(allocator && dir && (glyphs || !count));
+
+  if(count > UINT32_MAX)
+    return RBTTY_INVALID_ARGUMENT;
+
+  /* Write a temporary file renamed once complete so that concurrent readers
+   * never see a partial file */
+  snprintf(suffix, sizeof(suffix), ".%ld.tmp", (long)getpid());
+  path = file_path(allocator, dir, key, "");
+  tmp_path = file_path(allocator, dir, key, suffix);
+  if(!path || !tmp_path) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto error;
+  }
+  stream = fopen(tmp_path, "wb");
+  if(!stream) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GLYPH_FILE_MAGIC, sizeof(header.magic));
+  header.version = RBTTY_GLYPH_FILE_VERSION;
+  header.byte_order = GLYPH_FILE_BYTE_ORDER;
+  header.key = key;
+  header.glyphs_count = (uint32_t)count;
+  header.line_space = line_space;
+  FOR_EACH(size_t, i, 0, count) {
+    header.bitmaps_size += bitmap_size(glyphs[i].bitmap.width,
+      glyphs[i].bitmap.height, glyphs[i].bitmap.bytes_per_pixel);
+  }
+
+  rbtty_err = RBTTY_UNKNOWN_ERROR;
+  if(fwrite(&header, sizeof(header), 1, stream) != 1)
+    goto error;
+  FOR_EACH(size_t, i, 0, count) {
+    struct file_glyph rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.character = (int32_t)glyphs[i].character;
+    rec.width = glyphs[i].width;
+    rec.bitmap_left = glyphs[i].bitmap_left;
+    rec.bitmap_top = glyphs[i].bitmap_top;
+    rec.bitmap_width = glyphs[i].bitmap.width;
+    rec.bitmap_height = glyphs[i].bitmap.height;
+    rec.bytes_per_pixel = glyphs[i].bitmap.bytes_per_pixel;
+    rec.offset = offset;
+    offset += bitmap_size(rec.bitmap_width, rec.bitmap_height,
+      rec.bytes_per_pixel);
+    if(fwrite(&rec, sizeof(rec), 1, stream) != 1)
+      goto error;
+  }
+  FOR_EACH(size_t, i, 0, count) {
+    const size_t size = bitmap_size(glyphs[i].bitmap.width,
+      glyphs[i].bitmap.height, glyphs[i].bitmap.bytes_per_pixel);
+    if(size && fwrite(glyphs[i].bitmap.buffer, size, 1, stream) != 1)
+      goto error;
+  }
+  if(fclose(stream)) {
+    stream = NULL;
+    goto error;
+  }
+  stream = NULL;
+  if(rename(tmp_path, path))
+    goto error;
+  rbtty_err = RBTTY_NO_ERROR;
+
+exit:
+  if(path)
+    MEM_FREE(allocator, path);
+  if(tmp_path)
+    MEM_FREE(allocator, tmp_path);
+  return rbtty_err;
+error:
+  if(stream)
+    fclose(stream);
+  if(tmp_path)
+    remove(tmp_path);
+  goto exit;
+}
+
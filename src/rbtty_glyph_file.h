@@ -0,0 +1,68 @@
+#ifndef RBTTY_GLYPH_FILE_H
+#define RBTTY_GLYPH_FILE_H
+
+#include "rbtty_error.h"
+#include <lp/lp_font.h>
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Bump it whenever the layout of the file or the rasterization changes */
+#define RBTTY_GLYPH_FILE_VERSION 1
+
+struct mem_allocator;
+
+/* Read only mapping of a glyph file. A glyph file stores the rasterized
+ * glyphs of a charset, i.e. their descs followed by their packed bitmaps. It
+ * is identified by a key hashed from the content of the font file, the line
+ * space of the font and the charset */
+struct rbtty_glyph_file {
+  void* data;
+  size_t size;
+  struct lp_font_glyph_desc* glyphs; /* Bitmaps point into the mapping */
+  size_t glyphs_count;
+  int line_space;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_glyph_file_init
+  (struct mem_allocator* allocator,
+   struct rbtty_glyph_file* file);
+
+/* Unmap the file if it is mapped */
+extern LOCAL_SYM void
+rbtty_glyph_file_release
+  (struct rbtty_glyph_file* file);
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_glyph_file_key
+  (const char* font_path,
+   const int line_space,
+   const wchar_t* charset,
+   const size_t len,
+   uint64_t* key);
+
+/* Map the `key' glyph file of the `dir' directory. Return RBTTY_NO_ERROR if
+ * it exists and stores the glyphs of the `len' chars of `charset' */
+extern LOCAL_SYM enum rbtty_error
+rbtty_glyph_file_map
+  (struct rbtty_glyph_file* file,
+   const char* dir,
+   const uint64_t key,
+   const wchar_t* charset,
+   const size_t len);
+
+/* Write the `count' glyphs into the `key' glyph file of the `dir' directory.
+ * The file is replaced atomically */
+extern LOCAL_SYM enum rbtty_error
+rbtty_glyph_file_write
+  (struct mem_allocator* allocator,
+   const char* dir,
+   const uint64_t key,
+   const int line_space,
+   const struct lp_font_glyph_desc* glyphs,
+   const size_t count);
+
+#endif /* RBTTY_GLYPH_FILE_H */
+
@@ -0,0 +1,503 @@
+#include "rbtty_history.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+#define TRIGRAM_USED_BIT (1ull << 63)
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE uint64_t
+hash_str(const wchar_t* str, const size_t len)
+{
+  uint64_t hash = 0xCBF29CE484222325ull; /* FNV-1a */
+  FOR_EACH(size_t, i, 0, len) {
+    hash ^= (uint64_t)(uint32_t)str[i];
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+static FINLINE int
+cmp_str
+  (const wchar_t* a,
+   const size_t a_len,
+   const wchar_t* b,
+   const size_t b_len)
+{
+  const int cmp = wmemcmp(a, b, MIN(a_len, b_len));
+  if(cmp)
+    return cmp;
+  return a_len < b_len ? -1 : (a_len > b_len);
+}
+
+/* Return 0 if `entry' starts with `prefix' and the order of `entry' with
+ * respect to the commands starting with `prefix' otherwise */
+static FINLINE int
+cmp_prefix
+  (const struct rbtty_history_entry* entry,
+   const wchar_t* prefix,
+   const size_t len)
+{
+  if(entry->len >= len)
+    return wmemcmp(entry->chars, prefix, len);
+  return cmp_str(entry->chars, entry->len, prefix, len);
+}
+
+static FINLINE int
+has_substring
+  (const struct rbtty_history_entry* entry,
+   const wchar_t* pattern,
+   const size_t len)
+{
+  size_t i = 0;
+  if(!len)
+    return 1;
+  for(i = 0; i + len <= entry->len; ++i) {
+    const wchar_t* c = wmemchr(entry->chars + i, pattern[0], entry->len - i);
+    if(!c)
+      break;
+    i = (size_t)(c - entry->chars);
+    if(i + len <= entry->len && !wmemcmp(c, pattern, len))
+      return 1;
+  }
+  return 0;
+}
+
+static FINLINE struct rbtty_history_entry*
+history_entry(const struct rbtty_history* history, const size_t id)
+{
+  return (struct rbtty_history_entry*)rbtty_history_get(history, id);
+}
+
+/* Index in the sorted ids of the first command that is not lower than the
+ * commands starting with `prefix'. If `is_upper' is not null, return the
+ * index of the first command greater than them */
+static size_t
+sorted_bound
+  (const struct rbtty_history* history,
+   const wchar_t* prefix,
+   const size_t len,
+   const int is_upper)
+{
+  size_t lo = 0;
+  size_t hi = history->count;
+  while(lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    const int cmp = cmp_prefix
+      (history_entry(history, history->sorted[mid]), prefix, len);
+    if(cmp < 0 || (is_upper && cmp == 0)) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/* Return the id of the live `len' chars of `str' or RBTTY_HISTORY_NONE */
+static size_t
+dedup_find
+  (const struct rbtty_history* history,
+   const wchar_t* str,
+   const size_t len,
+   const uint64_t hash)
+{
+  size_t id = history->buckets[hash & (history->buckets_count - 1)];
+  while(id != RBTTY_HISTORY_NONE) {
+    const struct rbtty_history_entry* entry = history_entry(history, id);
+    ASSERT(entry);
+    if(entry->hash == hash && !cmp_str(entry->chars, entry->len, str, len))
+      break;
+    id = entry->next;
+  }
+  return id;
+}
+
+static FINLINE uint64_t
+trigram_key(const wchar_t* str)
+{
+  return TRIGRAM_USED_BIT
+    | ((uint64_t)((uint32_t)str[0] & 0x1FFFFF) << 42)
+    | ((uint64_t)((uint32_t)str[1] & 0x1FFFFF) << 21)
+    | (uint64_t)((uint32_t)str[2] & 0x1FFFFF);
+}
+
+static FINLINE size_t
+trigram_slot(const struct rbtty_history* history, const uint64_t key)
+{
+  size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+  slot &= history->trigrams_size - 1;
+  while(history->trigrams[slot].key && history->trigrams[slot].key != key)
+    slot = (slot + 1) & (history->trigrams_size - 1);
+  return slot;
+}
+
+static const struct rbtty_trigram*
+trigram_find(const struct rbtty_history* history, const uint64_t key)
+{
+  const struct rbtty_trigram* trigram = NULL;
+  if(!history->trigrams_size)
+    return NULL;
+  trigram = history->trigrams + trigram_slot(history, key);
+  return trigram->key ? trigram : NULL;
+}
+
+/* Return the posting list of `key', registering it if necessary */
+static struct rbtty_trigram*
+trigram_get(struct rbtty_history* history, const uint64_t key)
+{
+  struct rbtty_trigram* trigram = NULL;
+
+  /* Keep the load factor lower than 1/2 */
+  if((history->trigrams_count + 1) * 2 > history->trigrams_size) {
+    struct rbtty_trigram* trigrams = history->trigrams;
+    const size_t prev_size = history->trigrams_size;
+    const size_t size = prev_size ? prev_size * 2 : 256;
+
+    history->trigrams = MEM_CALLOC
+      (history->allocator, size, sizeof(struct rbtty_trigram));
+    if(!history->trigrams) {
+      history->trigrams = trigrams;
+      return NULL;
+    }
+    history->trigrams_size = size;
+    FOR_EACH(size_t, i, 0, prev_size) {
+      if(trigrams[i].key)
+        history->trigrams[trigram_slot(history, trigrams[i].key)] = trigrams[i];
+    }
+    if(trigrams)
+      MEM_FREE(history->allocator, trigrams);
+  }
+  trigram = history->trigrams + trigram_slot(history, key);
+  if(!trigram->key) {
+    trigram->key = key;
+    ++history->trigrams_count;
+  }
+  return trigram;
+}
+
+/* Append `id' to the posting list of `trigram' */
+static enum rbtty_error
+trigram_append
+  (struct rbtty_history* history,
+   struct rbtty_trigram* trigram,
+   const size_t id)
+{
+  if(trigram->count && trigram->ids[trigram->count - 1] == id)
+    return RBTTY_NO_ERROR; /* Trigram repeated in the command */
+
+  /* Discard the ids of the entries that left the ring */
+  while(trigram->begin < trigram->count
+     && trigram->ids[trigram->begin] < history->first)
+    ++trigram->begin;
+  if(trigram->begin && trigram->begin >= trigram->count / 2) {
+    trigram->count -= trigram->begin;
+    memmove(trigram->ids, trigram->ids + trigram->begin,
+      trigram->count * sizeof(size_t));
+    trigram->begin = 0;
+  }
+  if(trigram->count == trigram->capacity) {
+    const size_t capacity = MAX(trigram->capacity * 2, 4);
+    size_t* ids = MEM_REALLOC
+      (history->allocator, trigram->ids, capacity * sizeof(size_t));
+    if(!ids)
+      return RBTTY_MEMORY_ERROR;
+    trigram->ids = ids;
+    trigram->capacity = capacity;
+  }
+  trigram->ids[trigram->count++] = id;
+  return RBTTY_NO_ERROR;
+}
+
+/* Remove the id of `entry' from the end of the posting lists */
+static void
+unindex_trigrams
+  (struct rbtty_history* history,
+   const struct rbtty_history_entry* entry)
+{
+  size_t i = 0;
+  for(i = 0; i + 3 <= entry->len; ++i) {
+    struct rbtty_trigram* trigram = (struct rbtty_trigram*)trigram_find
+      (history, trigram_key(entry->chars + i));
+    if(trigram && trigram->count > trigram->begin
+    && trigram->ids[trigram->count - 1] == entry->id)
+      --trigram->count;
+  }
+}
+
+static enum rbtty_error
+index_trigrams
+  (struct rbtty_history* history,
+   const struct rbtty_history_entry* entry)
+{
+  size_t i = 0;
+  for(i = 0; i + 3 <= entry->len; ++i) {
+    struct rbtty_trigram* trigram = trigram_get
+      (history, trigram_key(entry->chars + i));
+    if(!trigram
+    || trigram_append(history, trigram, entry->id) != RBTTY_NO_ERROR) {
+      unindex_trigrams(history, entry);
+      return RBTTY_MEMORY_ERROR;
+    }
+  }
+  return RBTTY_NO_ERROR;
+}
+
+/* Remove the live `id' entry from the ring and from its indices. Its id is
+ * removed lazily from the posting lists */
+static void
+history_remove(struct rbtty_history* history, const size_t id)
+{
+  struct rbtty_history_entry* entry = history_entry(history, id);
+  size_t* link = NULL;
+  size_t i = 0;
+  ASSERT(entry);
+
+  link = history->buckets + (entry->hash & (history->buckets_count - 1));
+  while(*link != id)
+    link = &history_entry(history, *link)->next;
+  *link = entry->next;
+
+  i = sorted_bound(history, entry->chars, entry->len, 0);
+  while(history->sorted[i] != id)
+    ++i; /* Commands prefixed by the entry are sorted after it */
+  memmove(history->sorted + i, history->sorted + i + 1,
+    (history->count - i - 1) * sizeof(size_t));
+  --history->count;
+
+  MEM_FREE(history->allocator, entry->chars);
+  entry->chars = NULL;
+  entry->len = 0;
+}
+
+static void
+history_clear(struct rbtty_history* history)
+{
+  ASSERT(history);
+  FOR_EACH(size_t, i, 0, history->capacity) {
+    if(history->entries[i].chars)
+      MEM_FREE(history->allocator, history->entries[i].chars);
+  }
+  FOR_EACH(size_t, i, 0, history->trigrams_size) {
+    if(history->trigrams[i].ids)
+      MEM_FREE(history->allocator, history->trigrams[i].ids);
+  }
+  if(history->entries)
+    MEM_FREE(history->allocator, history->entries);
+  if(history->buckets)
+    MEM_FREE(history->allocator, history->buckets);
+  if(history->sorted)
+    MEM_FREE(history->allocator, history->sorted);
+  if(history->trigrams)
+    MEM_FREE(history->allocator, history->trigrams);
+  rbtty_history_init(history->allocator, history);
+}
+
+/*******************************************************************************
+ *
+ * rbtty_history functions
+ *
+ ******************************************************************************/
+void
+rbtty_history_init
+  (struct mem_allocator* allocator,
+   struct rbtty_history* history)
+{
+  ASSERT(allocator && history);
+  memset(history, 0, sizeof(struct rbtty_history));
+  history->allocator = allocator;
+}
+
+void
+rbtty_history_shutdown(struct rbtty_history* history)
+{
+  history_clear(history);
+}
+
+enum rbtty_error
+rbtty_history_setup(struct rbtty_history* history, const size_t capacity)
+{
+  size_t buckets_count = 1;
+  ASSERT(history);
+
+  history_clear(history);
+  if(!capacity)
+    return RBTTY_NO_ERROR;
+  /* The bucket count is the power of two greater than or equal to it */
+  if(UNLIKELY(capacity > SIZE_MAX / 2 / sizeof(struct rbtty_history_entry)))
+    return RBTTY_INVALID_ARGUMENT;
+  while(buckets_count < capacity)
+    buckets_count *= 2;
+
+  history->entries = MEM_CALLOC
+    (history->allocator, capacity, sizeof(struct rbtty_history_entry));
+  history->buckets = MEM_ALLOC
+    (history->allocator, buckets_count * sizeof(size_t));
+  history->sorted = MEM_ALLOC(history->allocator, capacity * sizeof(size_t));
+  if(!history->entries || !history->buckets || !history->sorted) {
+    history_clear(history);
+    return RBTTY_MEMORY_ERROR;
+  }
+  FOR_EACH(size_t, i, 0, buckets_count)
+    history->buckets[i] = RBTTY_HISTORY_NONE;
+  history->capacity = capacity;
+  history->buckets_count = buckets_count;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_history_push
+  (struct rbtty_history* history,
+   const wchar_t* str,
+   const size_t len)
+{
+  struct rbtty_history_entry* entry = NULL;
+  wchar_t* chars = NULL;
+  uint64_t hash = 0;
+  size_t id = 0;
+  size_t* bucket = NULL;
+  size_t i = 0;
+  ASSERT(history && (str || !len));
+
+  if(!len || !history->capacity)
+    return RBTTY_NO_ERROR;
+
+  hash = hash_str(str, len);
+  id = dedup_find(history, str, len, hash);
+  if(id != RBTTY_HISTORY_NONE && id == history->end - 1)
+    return RBTTY_NO_ERROR; /* Already the newest command */
+
+  chars = MEM_ALLOC(history->allocator, len * sizeof(wchar_t));
+  if(!chars)
+    return RBTTY_MEMORY_ERROR;
+  wmemcpy(chars, str, len);
+
+  if(id != RBTTY_HISTORY_NONE)
+    history_remove(history, id);
+  if(history->end - history->first == history->capacity) {
+    if(history_entry(history, history->first))
+      history_remove(history, history->first);
+    ++history->first;
+  }
+
+  id = history->end++;
+  entry = history->entries + id % history->capacity;
+  entry->chars = chars;
+  entry->len = len;
+  entry->id = id;
+  entry->hash = hash;
+  bucket = history->buckets + (hash & (history->buckets_count - 1));
+  entry->next = *bucket;
+  *bucket = id;
+
+  i = sorted_bound(history, str, len, 0);
+  memmove(history->sorted + i + 1, history->sorted + i,
+    (history->count - i) * sizeof(size_t));
+  history->sorted[i] = id;
+  ++history->count;
+
+  if(index_trigrams(history, entry) != RBTTY_NO_ERROR) {
+    history_remove(history, id);
+    return RBTTY_MEMORY_ERROR;
+  }
+  return RBTTY_NO_ERROR;
+}
+
+size_t
+rbtty_history_find_prefix
+  (const struct rbtty_history* history,
+   const wchar_t* prefix,
+   const size_t len,
+   const size_t from,
+   const int dir)
+{
+  size_t lo = 0;
+  size_t hi = 0;
+  size_t budget = 0;
+  size_t id = 0;
+  size_t found = RBTTY_HISTORY_NONE;
+  ASSERT(history && (prefix || !len));
+
+  lo = sorted_bound(history, prefix, len, 0);
+  hi = sorted_bound(history, prefix, len, 1);
+  if(lo == hi)
+    return RBTTY_HISTORY_NONE;
+
+  /* Matches are usually recent. Walk the ring from `from' for a bounded
+   * number of steps, about as costly as scanning the ids of the matching
+   * commands, which is then the fallback */
+  budget = (hi - lo) / 8 + 1;
+  id = dir < 0 ? MIN(from, history->end) : from;
+  while(budget--) {
+    const struct rbtty_history_entry* entry = NULL;
+    if(dir < 0 ? id-- <= history->first : ++id >= history->end)
+      return RBTTY_HISTORY_NONE;
+    entry = rbtty_history_get(history, id);
+    if(entry && !cmp_prefix(entry, prefix, len))
+      return id;
+  }
+  FOR_EACH(size_t, i, lo, hi) {
+    id = history->sorted[i];
+    if(dir < 0 && id < from && (found == RBTTY_HISTORY_NONE || id > found))
+      found = id;
+    if(dir >= 0 && id > from && (found == RBTTY_HISTORY_NONE || id < found))
+      found = id;
+  }
+  return found;
+}
+
+size_t
+rbtty_history_find_substring
+  (const struct rbtty_history* history,
+   const wchar_t* pattern,
+   const size_t len,
+   const size_t from)
+{
+  const struct rbtty_trigram* trigram = NULL;
+  size_t lo = 0;
+  size_t hi = 0;
+  size_t i = 0;
+  ASSERT(history && (pattern || !len));
+
+  if(len < 3) { /* Not indexed */
+    size_t id = MIN(from, history->end);
+    while(id-- > history->first) {
+      const struct rbtty_history_entry* entry = rbtty_history_get(history, id);
+      if(entry && has_substring(entry, pattern, len))
+        return id;
+    }
+    return RBTTY_HISTORY_NONE;
+  }
+
+  /* Walk the shortest posting list of the trigrams of the pattern */
+  for(i = 0; i + 3 <= len; ++i) {
+    const struct rbtty_trigram* t = trigram_find
+      (history, trigram_key(pattern + i));
+    if(!t)
+      return RBTTY_HISTORY_NONE;
+    if(!trigram || t->count - t->begin < trigram->count - trigram->begin)
+      trigram = t;
+  }
+  lo = trigram->begin;
+  hi = trigram->count;
+  while(lo < hi) { /* First id not older than `from' */
+    const size_t mid = lo + (hi - lo) / 2;
+    if(trigram->ids[mid] < from) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  while(lo-- > trigram->begin && trigram->ids[lo] >= history->first) {
+    const struct rbtty_history_entry* entry =
+      rbtty_history_get(history, trigram->ids[lo]);
+    if(entry && has_substring(entry, pattern, len))
+      return entry->id;
+  }
+  return RBTTY_HISTORY_NONE;
+}
+
@@ -0,0 +1,122 @@
+#ifndef RBTTY_HISTORY_H
+#define RBTTY_HISTORY_H
+
+#include "rbtty_error.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Default maximum number of commands of the history */
+#define RBTTY_HISTORY_DEFAULT_SIZE 1024
+/* Identifier of no history entry */
+#define RBTTY_HISTORY_NONE SIZE_MAX
+
+struct mem_allocator;
+
+struct rbtty_history_entry {
+  wchar_t* chars; /* NULL <=> removed entry */
+  size_t len;
+  size_t id;
+  size_t next; /* Next entry id of the dedup bucket */
+  uint64_t hash;
+};
+
+/* Posting list of the ids of the entries containing a trigram */
+struct rbtty_trigram {
+  uint64_t key; /* 0 <=> empty slot */
+  size_t* ids; /* Sorted in ascending order */
+  size_t begin; /* Index of the first id that may still be valid */
+  size_t count;
+  size_t capacity;
+};
+
+/* Bounded ring of the submitted commands, identified by increasing ids.
+ * Pushing a command already in the history removes the older one. The
+ * history is indexed by a sorted array of its live entries, in which the
+ * commands starting with a prefix form a contiguous range, and by the
+ * posting lists of the trigrams of its commands for substring search. An
+ * entry removed as a duplicate keeps its slot until the ring wraps around */
+struct rbtty_history {
+  struct rbtty_history_entry* entries; /* Indexed by id % capacity */
+  size_t capacity;
+  size_t first; /* Id of the oldest slot */
+  size_t end; /* Id following the newest entry */
+  size_t count; /* Number of live entries */
+  /* Hash table of the entry ids by command, for deduplication */
+  size_t* buckets; /* RBTTY_HISTORY_NONE <=> empty */
+  size_t buckets_count; /* Power of 2 */
+  /* Ids of the live entries sorted by command */
+  size_t* sorted;
+  /* Open addressing hash table of the trigrams */
+  struct rbtty_trigram* trigrams;
+  size_t trigrams_count;
+  size_t trigrams_size; /* Power of 2 */
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_history_init
+  (struct mem_allocator* allocator,
+   struct rbtty_history* history);
+
+extern LOCAL_SYM void
+rbtty_history_shutdown
+  (struct rbtty_history* history);
+
+/* Allocate room for `capacity' commands. The history is cleared */
+extern LOCAL_SYM enum rbtty_error
+rbtty_history_setup
+  (struct rbtty_history* history,
+   const size_t capacity);
+
+/* Add the `len' chars of `str' as the newest command. Empty commands are
+ * ignored */
+extern LOCAL_SYM enum rbtty_error
+rbtty_history_push
+  (struct rbtty_history* history,
+   const wchar_t* str,
+   const size_t len);
+
+/* Return the id of the newest command older than `from' if `dir' is
+ * negative, or of the oldest command newer than `from' otherwise, starting
+ * with the `len' chars of `prefix'. Return RBTTY_HISTORY_NONE if there is
+ * no such command */
+extern LOCAL_SYM size_t
+rbtty_history_find_prefix
+  (const struct rbtty_history* history,
+   const wchar_t* prefix,
+   const size_t len,
+   const size_t from,
+   const int dir);
+
+/* Return the id of the newest command older than `from' containing the
+ * `len' chars of `pattern', or RBTTY_HISTORY_NONE */
+extern LOCAL_SYM size_t
+rbtty_history_find_substring
+  (const struct rbtty_history* history,
+   const wchar_t* pattern,
+   const size_t len,
+   const size_t from);
+
+/* Id following the newest command */
+static FINLINE size_t
+rbtty_history_end(const struct rbtty_history* history)
+{
+  ASSERT(history);
+  return history->end;
+}
+
+/* Return the live `id' entry or NULL */
+static FINLINE const struct rbtty_history_entry*
+rbtty_history_get(const struct rbtty_history* history, const size_t id)
+{
+  const struct rbtty_history_entry* entry = NULL;
+  ASSERT(history);
+  if(id < history->first || id >= history->end)
+    return NULL;
+  entry = history->entries + id % history->capacity;
+  return entry->chars && entry->id == id ? entry : NULL;
+}
+
+#endif /* RBTTY_HISTORY_H */
+
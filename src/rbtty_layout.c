@@ -0,0 +1,253 @@
+#include "rbtty_advance.h"
+#include "rbtty_layout.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+/* A row has at most one run per char plus the one starting at the split. Each
+ * run is null terminated */
+static FINLINE size_t
+slot_runs_count(const size_t max_columns)
+{
+  return max_columns + 1;
+}
+
+static FINLINE size_t
+slot_text_len(const size_t max_columns)
+{
+  return max_columns + slot_runs_count(max_columns);
+}
+
+/* The positions of the chars are followed by the right side of the row */
+static FINLINE size_t
+slot_x_count(const size_t max_columns)
+{
+  return max_columns + 1;
+}
+
+static void
+layout_release(struct rbtty_layout* layout)
+{
+  ASSERT(layout);
+  if(layout->rows)
+    MEM_FREE(layout->allocator, layout->rows);
+  if(layout->text)
+    MEM_FREE(layout->allocator, layout->text);
+  if(layout->runs)
+    MEM_FREE(layout->allocator, layout->runs);
+  if(layout->x)
+    MEM_FREE(layout->allocator, layout->x);
+  if(layout->visible)
+    MEM_FREE(layout->allocator, layout->visible);
+  layout->rows = NULL;
+  layout->visible = NULL;
+  layout->visible_count = 0;
+  layout->text = NULL;
+  layout->runs = NULL;
+  layout->x = NULL;
+  layout->rows_count = 0;
+  layout->max_columns = 0;
+  memset(&layout->cmdrow, 0, sizeof(struct rbtty_row));
+  memset(&layout->notice, 0, sizeof(struct rbtty_row));
+}
+
+/*******************************************************************************
+ *
+ * rbtty_layout functions
+ *
+ ******************************************************************************/
+void
+rbtty_layout_init
+  (struct mem_allocator* allocator,
+   struct rbtty_layout* layout)
+{
+  ASSERT(allocator && layout);
+  memset(layout, 0, sizeof(struct rbtty_layout));
+  layout->allocator = allocator;
+}
+
+void
+rbtty_layout_shutdown(struct rbtty_layout* layout)
+{
+  ASSERT(layout);
+  layout_release(layout);
+}
+
+enum rbtty_error
+rbtty_layout_setup
+  (struct rbtty_layout* layout,
+   const size_t rows_count,
+   const size_t max_columns)
+{
+  size_t text_len = 0;
+  size_t runs_count = 0;
+  size_t x_count = 0;
+  ASSERT(layout);
+
+  if(rows_count != layout->rows_count || max_columns != layout->max_columns) {
+    layout_release(layout);
+    if(rows_count) {
+      /* One slot per row plus the ones of the cmdrow and of the notice */
+      text_len = slot_text_len(max_columns);
+      runs_count = slot_runs_count(max_columns);
+      x_count = slot_x_count(max_columns);
+      layout->rows = MEM_CALLOC
+        (layout->allocator, rows_count, sizeof(struct rbtty_row));
+      layout->text = MEM_ALLOC
+        (layout->allocator, (rows_count + 2) * text_len * sizeof(wchar_t));
+      layout->runs = MEM_ALLOC
+        (layout->allocator,
+         (rows_count + 2) * runs_count * sizeof(struct rbtty_run));
+      layout->x = MEM_ALLOC
+        (layout->allocator, (rows_count + 2) * x_count * sizeof(int));
+      layout->visible = MEM_ALLOC
+        (layout->allocator, rows_count * sizeof(struct rbtty_row*));
+      if(!layout->rows || !layout->text || !layout->runs || !layout->x
+      || !layout->visible) {
+        layout_release(layout);
+        return RBTTY_MEMORY_ERROR;
+      }
+      layout->rows_count = rows_count;
+      layout->max_columns = max_columns;
+      FOR_EACH(size_t, i, 0, rows_count) {
+        layout->rows[i].text = layout->text + i * text_len;
+        layout->rows[i].runs = layout->runs + i * runs_count;
+        layout->rows[i].x = layout->x + i * x_count;
+      }
+      layout->cmdrow.text = layout->text + rows_count * text_len;
+      layout->cmdrow.runs = layout->runs + rows_count * runs_count;
+      layout->cmdrow.x = layout->x + rows_count * x_count;
+      layout->notice.text = layout->cmdrow.text + text_len;
+      layout->notice.runs = layout->cmdrow.runs + runs_count;
+      layout->notice.x = layout->cmdrow.x + x_count;
+    }
+  }
+  FOR_EACH(size_t, i, 0, layout->rows_count)
+    layout->rows[i].is_valid = 0;
+  layout->cmdrow.is_valid = 0;
+  layout->notice.is_valid = 0;
+  return RBTTY_NO_ERROR;
+}
+
+void
+rbtty_layout_build_row
+  (struct rbtty_layout* layout,
+   struct rbtty_row* row,
+   const wchar_t* chars,
+   const size_t len,
+   const struct rbtty_span* spans,
+   const size_t spans_count,
+   const size_t first,
+   const size_t split)
+{
+  const size_t last = first + MIN(len - MIN(first, len), layout->max_columns);
+  size_t offset = 0;
+  ASSERT(layout && row && row->text && row->runs);
+  ASSERT((chars || !len) && (spans || !spans_count));
+
+  row->first = first;
+  row->runs_count = 0;
+  row->split_run = SIZE_MAX;
+
+  FOR_EACH(size_t, i, 0, spans_count) {
+    size_t begin = MAX(spans[i].start, first);
+    const size_t end = MIN(spans[i].start + spans[i].length, last);
+
+    while(begin < end) {
+      const size_t run_end = split > begin && split < end ? split : end;
+      struct rbtty_run* run = row->runs + row->runs_count;
+      if(begin == split)
+        row->split_run = row->runs_count;
+      run->offset = offset;
+      run->attrib = spans[i].attrib;
+      memcpy
+        (row->text + offset, chars + begin, (run_end-begin)*sizeof(wchar_t));
+      offset += run_end - begin;
+      row->text[offset++] = L'\0';
+      ++row->runs_count;
+      begin = run_end;
+    }
+  }
+  if(row->split_run == SIZE_MAX && split >= first && split <= last)
+    row->split_run = row->runs_count; /* The split lies at the end of row */
+  ASSERT(row->runs_count <= slot_runs_count(layout->max_columns));
+  ASSERT(offset <= slot_text_len(layout->max_columns));
+  row->x[0] = 0;
+  row->columns_count = 0;
+  row->is_valid = 1;
+}
+
+void
+rbtty_layout_measure_row(struct rbtty_row* row, struct rbtty_advance* advance)
+{
+  size_t n = 0;
+  int x = 0;
+  ASSERT(row && row->is_valid && advance);
+
+  FOR_EACH(size_t, i, 0, row->runs_count) {
+    const wchar_t* c = NULL;
+    for(c = row->text + row->runs[i].offset; *c != L'\0'; ++c) {
+      row->x[n++] = x;
+      x += rbtty_advance_get(advance, *c);
+    }
+  }
+  row->x[n] = x;
+  row->columns_count = n;
+}
+
+size_t
+rbtty_layout_pick_column(const struct rbtty_row* row, const int x)
+{
+  size_t lo = 0;
+  size_t hi = 0;
+  ASSERT(row && row->is_valid);
+
+  /* Last column whose left side is not past x */
+  hi = row->columns_count;
+  while(lo < hi) {
+    const size_t mid = lo + (hi - lo + 1) / 2;
+    if(row->x[mid] <= x) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  if(lo < row->columns_count && x - row->x[lo] > row->x[lo + 1] - x)
+    ++lo;
+  return lo;
+}
+
+struct rbtty_row*
+rbtty_layout_find_row
+  (struct rbtty_layout* layout,
+   const size_t line_id,
+   const size_t sub)
+{
+  struct rbtty_row* row = NULL;
+  size_t home = 0;
+  ASSERT(layout && layout->rows_count);
+  ASSERT(layout->visible_count < layout->rows_count);
+
+  /* Probe the rows from the home slot of the row. Since there are more rows
+   * than visible ones, one of them at least is not visible yet */
+  home = (line_id + sub) % layout->rows_count;
+  FOR_EACH(size_t, i, 0, layout->rows_count) {
+    struct rbtty_row* probe = layout->rows + (home + i) % layout->rows_count;
+    if(probe->is_valid && probe->line_id == line_id && probe->sub == sub) {
+      row = probe;
+      break;
+    }
+    if(!row && probe->frame != layout->frame)
+      row = probe;
+  }
+  ASSERT(row && row->frame != layout->frame);
+  row->frame = layout->frame;
+  layout->visible[layout->visible_count++] = row;
+  return row;
+}
+
@@ -0,0 +1,138 @@
+#ifndef RBTTY_LAYOUT_H
+#define RBTTY_LAYOUT_H
+
+#include "rbtty_error.h"
+#include "rbtty_palette.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+struct mem_allocator;
+struct rbtty_advance;
+
+/* Null terminated run of chars sharing the same attribute */
+struct rbtty_run {
+  size_t offset; /* Offset of the run into the text of its row */
+  uint16_t attrib;
+};
+
+/* Laid out text of a row of a line, ready to be submitted to the printer.
+ * Its text, runs and positions lie in a fixed size slot of the layout batch */
+struct rbtty_row {
+  size_t line_id;
+  size_t sub; /* Index of the row in its wrapped line */
+  size_t first; /* Offset of the first char of the row into its line */
+  size_t frame; /* Last frame the row was looked up for */
+  int is_valid;
+  wchar_t* text;
+  struct rbtty_run* runs;
+  size_t runs_count;
+  size_t split_run; /* Index of the run starting at the split position */
+  /* Prefix sums of the advances of the chars of the row: x[i] is the left
+   * side of its i-th char and x[columns_count] its right side */
+  int* x;
+  size_t columns_count;
+};
+
+/* Cache of the laid out rows of the visible lines. All the rows are stored in
+ * one persistent batch allocated once per viewport/font setup: a row owns a
+ * fixed slot of the text and run buffers, so that the whole screen is
+ * submitted to the printer in a single sequential pass followed by one
+ * flush, i.e. one draw call. A row is looked up from its line identifier
+ * and its index in the wrapped line, and is only rebuilt when the line is
+ * damaged; the records of the unchanged lines are reused from one frame to
+ * the next even though they are scrolled */
+struct rbtty_layout {
+  struct rbtty_row* rows;
+  size_t rows_count;
+  struct rbtty_row cmdrow;
+  struct rbtty_row notice; /* Drawn over the top visible row */
+  struct rbtty_row** visible; /* Rows to draw, from the bottom one */
+  size_t visible_count;
+  int is_notice; /* The notice is drawn in the current frame */
+  size_t prompt_len; /* Number of chars of the prompt in the cmdrow */
+  size_t frame;
+  size_t max_columns; /* Maximum number of chars visible in a row */
+  /* Batch */
+  wchar_t* text;
+  struct rbtty_run* runs;
+  int* x;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_layout_init
+  (struct mem_allocator* allocator,
+   struct rbtty_layout* layout);
+
+extern LOCAL_SYM void
+rbtty_layout_shutdown
+  (struct rbtty_layout* layout);
+
+/* Define the number of rows and of columns and allocate the batch
+ * accordingly. Invalidate all the rows */
+extern LOCAL_SYM enum rbtty_error
+rbtty_layout_setup
+  (struct rbtty_layout* layout,
+   const size_t rows_count,
+   const size_t max_columns);
+
+/* Lay out the chars in [first, len[ of `chars' into `row'. The spans and the
+ * `split' char are relative to `chars'. A run boundary is forced at the
+ * `split' char whose run index is then stored in row->split_run */
+extern LOCAL_SYM void
+rbtty_layout_build_row
+  (struct rbtty_layout* layout,
+   struct rbtty_row* row,
+   const wchar_t* chars,
+   const size_t len,
+   const struct rbtty_span* spans,
+   const size_t spans_count,
+   const size_t first,
+   const size_t split);
+
+/* Compute the positions of the chars of `row' from their advances. The row
+ * must be laid out beforehand */
+extern LOCAL_SYM void
+rbtty_layout_measure_row
+  (struct rbtty_row* row,
+   struct rbtty_advance* advance);
+
+/* Return the column of `row' whose left side is the nearest of `x' */
+extern LOCAL_SYM size_t
+rbtty_layout_pick_column
+  (const struct rbtty_row* row,
+   const int x);
+
+/* Column of `row' starting its split run */
+static FINLINE size_t
+rbtty_row_split_column(const struct rbtty_row* row)
+{
+  ASSERT(row && row->split_run <= row->runs_count);
+  if(row->split_run == row->runs_count)
+    return row->columns_count;
+  /* Each preceding run is followed by its null char */
+  return row->runs[row->split_run].offset - row->split_run;
+}
+
+/* Begin the look up of the rows of a new frame */
+static FINLINE void
+rbtty_layout_begin_frame(struct rbtty_layout* layout)
+{
+  ASSERT(layout);
+  ++layout->frame;
+  layout->visible_count = 0;
+  layout->is_notice = 0;
+}
+
+/* Return the row `sub' of the line `line_id' and register it as visible. If
+ * it is not laid out, return a row that is not visible yet in the current
+ * frame, to lay out again */
+extern LOCAL_SYM struct rbtty_row*
+rbtty_layout_find_row
+  (struct rbtty_layout* layout,
+   const size_t line_id,
+   const size_t sub);
+
+#endif /* RBTTY_LAYOUT_H */
+
@@ -0,0 +1,178 @@
+#include "rbtty_lz.h"
+#include <string.h>
+
+#define HASH_BITS 12
+#define MIN_MATCH 4
+#define MAX_OFFSET 65535
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE uint32_t
+read32(const unsigned char* p)
+{
+  uint32_t u;
+  memcpy(&u, p, sizeof(u));
+  return u;
+}
+
+static FINLINE uint32_t
+hash32(const uint32_t u)
+{
+  return (u * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Write the extension bytes of a length whose token nibble is saturated */
+static FINLINE unsigned char*
+write_length(unsigned char* dst, size_t len)
+{
+  for(; len >= 255; len -= 255)
+    *dst++ = 255;
+  *dst++ = (unsigned char)len;
+  return dst;
+}
+
+/* Read the extension bytes of a length. Return 0 on overrun */
+static FINLINE int
+read_length
+  (const unsigned char** src,
+   const unsigned char* src_end,
+   size_t* len)
+{
+  unsigned char byte = 0;
+  do {
+    if(*src >= src_end)
+      return 0;
+    byte = *(*src)++;
+    *len += byte;
+  } while(byte == 255);
+  return 1;
+}
+
+/* Write a sequence of `nlits' literals followed by a match of `match_len'
+ * bytes at `offset', if `match_len' is not null */
+static unsigned char*
+write_sequence
+  (unsigned char* dst,
+   const unsigned char* lits,
+   const size_t nlits,
+   const size_t match_len,
+   const size_t offset)
+{
+  unsigned char* token = dst++;
+  const size_t mlen = match_len ? match_len - MIN_MATCH : 0;
+
+  *token = (unsigned char)((nlits < 15 ? nlits : 15) << 4);
+  if(nlits >= 15)
+    dst = write_length(dst, nlits - 15);
+  memcpy(dst, lits, nlits);
+  dst += nlits;
+  if(match_len) {
+    *token = (unsigned char)(*token | (mlen < 15 ? mlen : 15));
+    *dst++ = (unsigned char)(offset & 0xFF);
+    *dst++ = (unsigned char)(offset >> 8);
+    if(mlen >= 15)
+      dst = write_length(dst, mlen - 15);
+  }
+  return dst;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_lz functions
+ *
+ ******************************************************************************/
+size_t
+rbtty_lz_compress
+  (const void* src,
+   const size_t size,
+   void* dst,
+   const size_t capacity)
+{
+  uint32_t table[1 << HASH_BITS]; /* Position + 1 of the last 4 bytes */
+  const unsigned char* in = src;
+  const unsigned char* lits = in;
+  unsigned char* out = dst;
+  size_t i = 0;
+  ASSERT((src || !size) && dst);
+
+  if(capacity < rbtty_lz_bound(size) || size > UINT32_MAX)
+    return 0;
+
+  memset(table, 0, sizeof(table));
+  while(size >= MIN_MATCH && i <= size - MIN_MATCH) {
+    const uint32_t u = read32(in + i);
+    const uint32_t h = hash32(u);
+    const size_t ref = table[h];
+    size_t len = MIN_MATCH;
+    table[h] = (uint32_t)i + 1;
+
+    if(!ref || i - (ref - 1) > MAX_OFFSET || read32(in + ref - 1) != u) {
+      ++i;
+      continue;
+    }
+    while(i + len < size && in[ref - 1 + len] == in[i + len])
+      ++len;
+    out = write_sequence
+      (out, lits, (size_t)(in + i - lits), len, i - (ref - 1));
+    i += len;
+    lits = in + i;
+  }
+  /* The last literals form a sequence without match */
+  out = write_sequence(out, lits, (size_t)(in + size - lits), 0, 0);
+  return (size_t)(out - (unsigned char*)dst);
+}
+
+size_t
+rbtty_lz_decompress
+  (const void* src,
+   const size_t size,
+   void* dst,
+   const size_t capacity)
+{
+  const unsigned char* in = src;
+  const unsigned char* in_end = in + size;
+  unsigned char* out = dst;
+  unsigned char* out_end = out + capacity;
+  ASSERT((src || !size) && (dst || !capacity));
+
+  while(in < in_end) {
+    const unsigned char token = *in++;
+    size_t nlits = token >> 4;
+    size_t len = token & 0x0F;
+    size_t offset = 0;
+
+    if(nlits == 15 && !read_length(&in, in_end, &nlits))
+      return SIZE_MAX;
+    if(nlits > (size_t)(in_end - in) || nlits > (size_t)(out_end - out))
+      return SIZE_MAX;
+    memcpy(out, in, nlits);
+    in += nlits;
+    out += nlits;
+    if(in == in_end) /* Last sequence */
+      break;
+
+    if(in_end - in < 2)
+      return SIZE_MAX;
+    offset = (size_t)in[0] | (size_t)in[1] << 8;
+    in += 2;
+    if(len == 15 && !read_length(&in, in_end, &len))
+      return SIZE_MAX;
+    len += MIN_MATCH;
+    if(!offset || offset > (size_t)(out - (unsigned char*)dst)
+    || len > (size_t)(out_end - out))
+      return SIZE_MAX;
+    /* The match may overlap the bytes it produces */
+    if(offset >= len) {
+      memcpy(out, out - offset, len);
+      out += len;
+    } else {
+      for(; len; --len, ++out)
+        *out = *(out - offset);
+    }
+  }
+  return (size_t)(out - (unsigned char*)dst);
+}
+
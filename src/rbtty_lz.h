@@ -0,0 +1,37 @@
+#ifndef RBTTY_LZ_H
+#define RBTTY_LZ_H
+
+#include <snlsys/snlsys.h>
+
+/* Byte oriented LZ77 codec in the spirit of LZ4. A compressed block is a
+ * list of sequences, each made of a token, literals copied as is and a back
+ * reference to at most 64 KiB before. It favours speed over ratio */
+
+/* Maximum size of the compression of `size' bytes */
+static FINLINE size_t
+rbtty_lz_bound(const size_t size)
+{
+  return size + size / 255 + 16;
+}
+
+/* Compress the `size' bytes of `src' into `dst' and return the compressed
+ * size, or 0 if it exceeds `capacity' */
+extern LOCAL_SYM size_t
+rbtty_lz_compress
+  (const void* src,
+   const size_t size,
+   void* dst,
+   const size_t capacity);
+
+/* Decompress the `size' bytes of `src' into `dst' and return the
+ * decompressed size, or SIZE_MAX if `src' is corrupted or if the
+ * decompressed data exceed `capacity' */
+extern LOCAL_SYM size_t
+rbtty_lz_decompress
+  (const void* src,
+   const size_t size,
+   void* dst,
+   const size_t capacity);
+
+#endif /* RBTTY_LZ_H */
+
@@ -0,0 +1,181 @@
+#include "rbtty_palette.h"
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE uint32_t
+attrib_hash(const struct rbtty_attrib* attrib)
+{
+  const unsigned char* bytes = (const unsigned char*)attrib;
+  uint32_t hash = 2166136261u; /* FNV-1a */
+  ASSERT(attrib);
+  FOR_EACH(size_t, i, 0, sizeof(struct rbtty_attrib)) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static FINLINE int
+attrib_eq(const struct rbtty_attrib* a, const struct rbtty_attrib* b)
+{
+  ASSERT(a && b);
+  return a->color[0] == b->color[0]
+      && a->color[1] == b->color[1]
+      && a->color[2] == b->color[2];
+}
+
+/* Return the table slot of `attrib' or of the empty slot where to insert it */
+static FINLINE size_t
+palette_lookup
+  (const struct rbtty_palette* palette,
+   const struct rbtty_attrib* attrib)
+{
+  const size_t mask = palette->table_size - 1;
+  size_t slot = 0;
+  ASSERT(palette && attrib && palette->table_size);
+
+  slot = attrib_hash(attrib) & mask;
+  while(palette->table[slot]
+     && !attrib_eq(palette->attribs + palette->table[slot] - 1, attrib)) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/* Return the identifier of the registered attribute whose color is the
+ * nearest of the color of `attrib' */
+static uint16_t
+palette_nearest
+  (const struct rbtty_palette* palette,
+   const struct rbtty_attrib* attrib)
+{
+  float best = 0.f;
+  size_t id = 0;
+  ASSERT(palette && attrib && palette->count);
+
+  FOR_EACH(size_t, i, 0, palette->count) {
+    const float* color = palette->attribs[i].color;
+    const float d[3] = {
+      color[0] - attrib->color[0],
+      color[1] - attrib->color[1],
+      color[2] - attrib->color[2]
+    };
+    const float dst = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+    if(!i || dst < best) {
+      best = dst;
+      id = i;
+    }
+  }
+  return (uint16_t)id;
+}
+
+static enum rbtty_error
+palette_grow(struct rbtty_palette* palette)
+{
+  struct rbtty_attrib* attribs = NULL;
+  uint32_t* table = NULL;
+  size_t capacity = 0;
+  size_t table_size = 0;
+  ASSERT(palette);
+
+  capacity = palette->capacity ? palette->capacity * 2 : 16;
+  table_size = capacity * 2; /* Keep the load factor under 0.5 */
+
+  /* The capacity is only raised once the table is allocated too, so that the
+   * load factor of the current table is kept on error. The reallocated
+   * attributes are adopted anyway since the previous ones are released */
+  attribs = MEM_REALLOC
+    (palette->allocator, palette->attribs,
+     capacity * sizeof(struct rbtty_attrib));
+  if(!attribs)
+    return RBTTY_MEMORY_ERROR;
+  palette->attribs = attribs;
+
+  table = MEM_CALLOC(palette->allocator, table_size, sizeof(uint32_t));
+  if(!table)
+    return RBTTY_MEMORY_ERROR;
+  if(palette->table)
+    MEM_FREE(palette->allocator, palette->table);
+  palette->capacity = capacity;
+  palette->table = table;
+  palette->table_size = table_size;
+
+  /* Rehash the registered attributes */
+  FOR_EACH(size_t, i, 0, palette->count) {
+    const size_t slot = palette_lookup(palette, palette->attribs + i);
+    palette->table[slot] = (uint32_t)(i + 1);
+  }
+  return RBTTY_NO_ERROR;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_palette functions
+ *
+ ******************************************************************************/
+void
+rbtty_palette_init
+  (struct mem_allocator* allocator,
+   struct rbtty_palette* palette)
+{
+  ASSERT(allocator && palette);
+  memset(palette, 0, sizeof(struct rbtty_palette));
+  palette->allocator = allocator;
+}
+
+void
+rbtty_palette_shutdown(struct rbtty_palette* palette)
+{
+  ASSERT(palette);
+  if(palette->attribs)
+    MEM_FREE(palette->allocator, palette->attribs);
+  if(palette->table)
+    MEM_FREE(palette->allocator, palette->table);
+  palette->attribs = NULL;
+  palette->table = NULL;
+  palette->count = 0;
+  palette->capacity = 0;
+  palette->table_size = 0;
+}
+
+enum rbtty_error
+rbtty_palette_register
+  (struct rbtty_palette* palette,
+   const struct rbtty_attrib* attrib,
+   uint16_t* id)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  size_t slot = 0;
+  ASSERT(palette && attrib && id);
+
+  if(palette->table_size) {
+    slot = palette_lookup(palette, attrib);
+    if(palette->table[slot]) {
+      *id = (uint16_t)(palette->table[slot] - 1);
+      return RBTTY_NO_ERROR;
+    }
+  }
+  if(UNLIKELY(palette->count >= RBTTY_PALETTE_MAX_COUNT)) {
+    /* The palette never evicts its attributes. Approximate the new ones
+     * rather than failing, e.g. the writes of a stream of truecolors */
+    *id = palette_nearest(palette, attrib);
+    return RBTTY_NO_ERROR;
+  }
+
+  if(palette->count == palette->capacity) {
+    rbtty_err = palette_grow(palette);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+  }
+  slot = palette_lookup(palette, attrib);
+  palette->attribs[palette->count] = *attrib;
+  palette->table[slot] = (uint32_t)(palette->count + 1);
+  *id = (uint16_t)palette->count;
+  ++palette->count;
+  return RBTTY_NO_ERROR;
+}
+
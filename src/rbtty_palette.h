@@ -0,0 +1,63 @@
+#ifndef RBTTY_PALETTE_H
+#define RBTTY_PALETTE_H
+
+#include "rbtty_error.h"
+#include <snlsys/snlsys.h>
+
+/* Maximum number of attributes that can be registered into a palette */
+#define RBTTY_PALETTE_MAX_COUNT 65536
+
+struct mem_allocator;
+
+struct rbtty_attrib {
+  float color[3];
+};
+
+/* Run of chars sharing the same attribute. Its start is relative to the
+ * beginning of the text */
+struct rbtty_span {
+  uint32_t start;
+  uint32_t length;
+  uint16_t attrib;
+};
+
+/* Table of the attributes shared by the text of a screen. An attribute is
+ * registered once and then referenced by its identifier */
+struct rbtty_palette {
+  struct rbtty_attrib* attribs;
+  size_t count;
+  size_t capacity;
+  /* Open addressing hash table of (attrib id + 1); 0 <=> empty slot */
+  uint32_t* table;
+  size_t table_size; /* Power of 2 */
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_palette_init
+  (struct mem_allocator* allocator,
+   struct rbtty_palette* palette);
+
+extern LOCAL_SYM void
+rbtty_palette_shutdown
+  (struct rbtty_palette* palette);
+
+/* Return the identifier of `attrib', registering it if necessary. Once the
+ * palette is full, the identifier of the registered attribute of nearest
+ * color is returned instead */
+extern LOCAL_SYM enum rbtty_error
+rbtty_palette_register
+  (struct rbtty_palette* palette,
+   const struct rbtty_attrib* attrib,
+   uint16_t* id);
+
+static FINLINE const struct rbtty_attrib*
+rbtty_palette_get(const struct rbtty_palette* palette, const uint16_t id)
+{
+  ASSERT(palette && id < palette->count);
+  return palette->attribs + id;
+}
+
+#endif /* RBTTY_PALETTE_H */
+
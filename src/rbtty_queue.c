@@ -0,0 +1,249 @@
+#define _POSIX_C_SOURCE 200112L /* sched_yield */
+
+#include "rbtty_queue.h"
+#include "rbtty_screen.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <sched.h>
+#include <string.h>
+
+/* Alignment of the records. The room of a padding record is thus always
+ * large enough for its state and its size */
+#define RECORD_ALIGNMENT 8
+
+enum record_state {
+  RECORD_EMPTY, /* Reserved but not published yet */
+  RECORD_PUBLISHED,
+  RECORD_PADDING
+};
+
+struct record {
+  uint32_t state; /* Accessed atomically */
+  uint32_t size; /* Size of the whole record, header included */
+  uint32_t output;
+  uint32_t encoding;
+  float color[3];
+  uint32_t length; /* Size in bytes of the text following the header */
+};
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+/* Largest size of the text of a record */
+static FINLINE size_t
+max_text_size(const struct rbtty_queue* queue)
+{
+  ASSERT(queue && queue->capacity / 2 > sizeof(struct record));
+  return queue->capacity / 2 - sizeof(struct record);
+}
+
+/* Size of the first chunk of `size' bytes of `encoding' text that fits in a
+ * record. UTF-8 texts are split on a char boundary */
+static size_t
+chunk_size
+  (const struct rbtty_queue* queue,
+   const enum rbtty_queue_encoding encoding,
+   const unsigned char* data,
+   const size_t size)
+{
+  size_t chunk = MIN(size, max_text_size(queue));
+  if(chunk == size)
+    return chunk;
+  if(encoding == RBTTY_QUEUE_WCHAR) {
+    chunk -= chunk % sizeof(wchar_t);
+  } else {
+    size_t i = chunk;
+    while(i && (data[i] & 0xC0) == 0x80) /* Continuation byte */
+      --i;
+    if(i)
+      chunk = i;
+  }
+  return chunk;
+}
+
+/* Reserve `size' bytes. Return NULL if the queue is full and the policy is
+ * to drop the records */
+static struct record*
+reserve(struct rbtty_queue* queue, const size_t size)
+{
+  size_t tail = 0;
+  size_t pad = 0;
+  ASSERT(queue && size && size % RECORD_ALIGNMENT == 0);
+  ASSERT(size <= queue->capacity / 2);
+
+  tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  for(;;) {
+    const size_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    const size_t offset = tail & (queue->capacity - 1);
+
+    pad = queue->capacity - offset < size ? queue->capacity - offset : 0;
+    if(tail + pad + size - head > queue->capacity) {
+      if(queue->policy == RBTTY_QUEUE_DROP)
+        return NULL;
+      sched_yield();
+      tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+      continue;
+    }
+    if(__atomic_compare_exchange_n(&queue->tail, &tail, tail + pad + size,
+       1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      break;
+  }
+  if(pad) {
+    struct record* padding = (struct record*)
+      (queue->buffer + (tail & (queue->capacity - 1)));
+    padding->size = (uint32_t)pad;
+    __atomic_store_n(&padding->state, RECORD_PADDING, __ATOMIC_RELEASE);
+  }
+  return (struct record*)
+    (queue->buffer + ((tail + pad) & (queue->capacity - 1)));
+}
+
+/*******************************************************************************
+ *
+ * rbtty_queue functions
+ *
+ ******************************************************************************/
+void
+rbtty_queue_init
+  (struct mem_allocator* allocator,
+   struct rbtty_queue* queue)
+{
+  ASSERT(allocator && queue);
+  memset(queue, 0, sizeof(struct rbtty_queue));
+  queue->allocator = allocator;
+}
+
+void
+rbtty_queue_shutdown(struct rbtty_queue* queue)
+{
+  ASSERT(queue);
+  if(queue->buffer)
+    MEM_FREE(queue->allocator, queue->buffer);
+  queue->buffer = NULL;
+  queue->capacity = 0;
+}
+
+enum rbtty_error
+rbtty_queue_setup
+  (struct rbtty_queue* queue,
+   const size_t size,
+   const enum rbtty_queue_policy policy)
+{
+  size_t capacity = 4 * sizeof(struct record);
+  unsigned char* buffer = NULL;
+  ASSERT(queue);
+
+  if(size > UINT32_MAX)
+    return RBTTY_INVALID_ARGUMENT;
+  while(capacity < size)
+    capacity *= 2;
+  /* The unconsumed records have to be zeroed, see rbtty_queue_drain */
+  buffer = MEM_CALLOC(queue->allocator, capacity, 1);
+  if(!buffer)
+    return RBTTY_MEMORY_ERROR;
+  rbtty_queue_shutdown(queue);
+  queue->buffer = buffer;
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->tail = 0;
+  queue->dropped = 0;
+  queue->policy = policy;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_queue_push
+  (struct rbtty_queue* queue,
+   const enum rbtty_output output,
+   const enum rbtty_queue_encoding encoding,
+   const void* data,
+   const size_t size,
+   const float color[3])
+{
+  const unsigned char* bytes = data;
+  size_t remaining = size;
+  ASSERT(queue && queue->capacity && (data || !size) && color);
+
+  do {
+    const size_t chunk = chunk_size(queue, encoding, bytes, remaining);
+    const size_t record_size = ALIGN_SIZE
+      (sizeof(struct record) + chunk, (size_t)RECORD_ALIGNMENT);
+    struct record* record = reserve(queue, record_size);
+
+    if(!record) {
+      __atomic_add_fetch(&queue->dropped, 1, __ATOMIC_RELAXED);
+      return RBTTY_NO_ERROR;
+    }
+    record->size = (uint32_t)record_size;
+    record->output = (uint32_t)output;
+    record->encoding = (uint32_t)encoding;
+    record->color[0] = color[0];
+    record->color[1] = color[1];
+    record->color[2] = color[2];
+    record->length = (uint32_t)chunk;
+    if(chunk)
+      memcpy(record + 1, bytes, chunk);
+    __atomic_store_n(&record->state, RECORD_PUBLISHED, __ATOMIC_RELEASE);
+
+    bytes += chunk;
+    remaining -= chunk;
+  } while(remaining);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_queue_drain
+  (struct rbtty_queue* queue,
+   struct rbtty_screen* screen,
+   const size_t max_size)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  size_t head = 0;
+  size_t tail = 0;
+  size_t written = 0;
+  ASSERT(queue && screen);
+
+  if(!queue->capacity)
+    return RBTTY_NO_ERROR;
+
+  /* Do not process the records reserved after the drain began, so that the
+   * producers cannot hold the consumer forever */
+  head = queue->head;
+  tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+  while(head != tail && written < max_size) {
+    struct record* record = (struct record*)
+      (queue->buffer + (head & (queue->capacity - 1)));
+    const uint32_t state =
+      __atomic_load_n(&record->state, __ATOMIC_ACQUIRE);
+    size_t size = 0;
+    enum rbtty_error err = RBTTY_NO_ERROR;
+
+    if(state == RECORD_EMPTY)
+      break;
+    size = record->size;
+    if(state == RECORD_PUBLISHED) {
+      const enum rbtty_output output = (enum rbtty_output)record->output;
+      if(record->encoding == RBTTY_QUEUE_WCHAR) {
+        err = rbtty_screen_write_wstring(screen, output,
+          (const wchar_t*)(record + 1), record->length / sizeof(wchar_t),
+          record->color);
+      } else {
+        err = rbtty_screen_write_utf8(screen, output,
+          (const char*)(record + 1), record->length, record->color);
+      }
+      if(err != RBTTY_NO_ERROR && rbtty_err == RBTTY_NO_ERROR)
+        rbtty_err = err;
+      written += record->length;
+    }
+    /* The room of the record may be reused by records of any size. Zero it
+     * so that a state read by the consumer is never the leftover of a
+     * previous record */
+    memset(record, 0, size);
+    head += size;
+    __atomic_store_n(&queue->head, head, __ATOMIC_RELEASE);
+  }
+  return rbtty_err;
+}
+
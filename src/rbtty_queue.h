@@ -0,0 +1,75 @@
+#ifndef RBTTY_QUEUE_H
+#define RBTTY_QUEUE_H
+
+#include "rbtty_error.h"
+#include "rbtty_types.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Default size in bytes of the print queue */
+#define RBTTY_QUEUE_DEFAULT_SIZE (256 * 1024)
+
+struct mem_allocator;
+struct rbtty_screen;
+
+enum rbtty_queue_encoding {
+  RBTTY_QUEUE_UTF8,
+  RBTTY_QUEUE_WCHAR
+};
+
+/* Bounded multi-producer single-consumer ring of print records. A producer
+ * reserves the room of its record by atomically advancing the tail, writes
+ * it and then publishes it by setting its state. The consumer processes the
+ * published records in order, up to the first unpublished one, and releases
+ * their room by advancing the head. A record never wraps around the end of
+ * the ring: the room up to the end is then reserved as a padding record */
+struct rbtty_queue {
+  unsigned char* buffer;
+  size_t capacity; /* Power of 2 */
+  size_t head; /* Written by the consumer only */
+  size_t tail; /* Reservation position of the producers */
+  size_t dropped; /* Number of dropped records */
+  enum rbtty_queue_policy policy;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_queue_init
+  (struct mem_allocator* allocator,
+   struct rbtty_queue* queue);
+
+extern LOCAL_SYM void
+rbtty_queue_shutdown
+  (struct rbtty_queue* queue);
+
+/* Allocate a ring of at least `size' bytes. The pending records are lost.
+ * Not thread safe */
+extern LOCAL_SYM enum rbtty_error
+rbtty_queue_setup
+  (struct rbtty_queue* queue,
+   const size_t size,
+   const enum rbtty_queue_policy policy);
+
+/* Push `size' bytes of `encoding' encoded text. A text that does not fit in
+ * one record is split into several records, whose order is kept but which
+ * may be interleaved with the records of other producers. Thread safe */
+extern LOCAL_SYM enum rbtty_error
+rbtty_queue_push
+  (struct rbtty_queue* queue,
+   const enum rbtty_output output,
+   const enum rbtty_queue_encoding encoding,
+   const void* data,
+   const size_t size,
+   const float color[3]);
+
+/* Write the published records to `screen', until their text exceeds
+ * `max_size' bytes. Must be called by the consumer thread only */
+extern LOCAL_SYM enum rbtty_error
+rbtty_queue_drain
+  (struct rbtty_queue* queue,
+   struct rbtty_screen* screen,
+   const size_t max_size);
+
+#endif /* RBTTY_QUEUE_H */
+
@@ -0,0 +1,610 @@
+#include "rbtty_registry.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE uint64_t
+hash_str(const wchar_t* str, const size_t len)
+{
+  uint64_t hash = 0xCBF29CE484222325ull; /* FNV-1a */
+  FOR_EACH(size_t, i, 0, len) {
+    hash ^= (uint64_t)(uint32_t)str[i];
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+
+static FINLINE int
+is_blank(const wchar_t c)
+{
+  return c == L' ' || c == L'\t';
+}
+
+/* Ensure that `buffer' can store `count' elements of `size' bytes */
+static enum rbtty_error
+reserve
+  (struct mem_allocator* allocator,
+   void** buffer,
+   size_t* capacity,
+   const size_t count,
+   const size_t size)
+{
+  size_t new_capacity = 0;
+  void* mem = NULL;
+  ASSERT(allocator && buffer && capacity && size);
+
+  if(count <= *capacity)
+    return RBTTY_NO_ERROR;
+  new_capacity = MAX(*capacity * 2, MAX(count, 64));
+  mem = MEM_REALLOC(allocator, *buffer, new_capacity * size);
+  if(!mem)
+    return RBTTY_MEMORY_ERROR;
+  *buffer = mem;
+  *capacity = new_capacity;
+  return RBTTY_NO_ERROR;
+}
+
+static FINLINE const wchar_t*
+command_name
+  (const struct rbtty_registry* registry,
+   const struct rbtty_registry_command* cmd)
+{
+  ASSERT(registry && cmd);
+  return registry->names + cmd->name;
+}
+
+/* Return the slot of the command named `name' or the empty slot where it is
+ * inserted */
+static size_t
+find_slot
+  (const struct rbtty_registry* registry,
+   const wchar_t* name,
+   const size_t len,
+   const uint64_t hash)
+{
+  const size_t mask = registry->slots_count - 1;
+  size_t slot = (size_t)hash & mask;
+  ASSERT(registry->slots_count);
+
+  while(registry->slots[slot] != SIZE_MAX) {
+    const struct rbtty_registry_command* cmd =
+      registry->commands + registry->slots[slot];
+    if(cmd->hash == hash && cmd->name_len == len
+    && !wmemcmp(command_name(registry, cmd), name, len))
+      break;
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/* Keep the load factor of the hash table lower than 1/2 */
+static enum rbtty_error
+reserve_slots(struct rbtty_registry* registry)
+{
+  size_t* slots = NULL;
+  size_t count = 0;
+  ASSERT(registry);
+
+  if((registry->commands_count + 1) * 2 <= registry->slots_count)
+    return RBTTY_NO_ERROR;
+  count = registry->slots_count ? registry->slots_count * 2 : 64;
+  slots = MEM_ALLOC(registry->allocator, count * sizeof(size_t));
+  if(!slots)
+    return RBTTY_MEMORY_ERROR;
+  memset(slots, 0xFF, count * sizeof(size_t));
+  if(registry->slots)
+    MEM_FREE(registry->allocator, registry->slots);
+  registry->slots = slots;
+  registry->slots_count = count;
+  FOR_EACH(size_t, i, 0, registry->commands_count) {
+    const struct rbtty_registry_command* cmd = registry->commands + i;
+    slots[find_slot(registry, command_name(registry, cmd), cmd->name_len,
+      cmd->hash)] = i;
+  }
+  return RBTTY_NO_ERROR;
+}
+
+/* Return the child of `node' for `c' or RBTTY_REGISTRY_NONE. If `prev' is
+ * not null, it receives the child preceding the position of `c' */
+static uint32_t
+find_child
+  (const struct rbtty_registry* registry,
+   const uint32_t node,
+   const wchar_t c,
+   uint32_t* prev)
+{
+  uint32_t child = registry->nodes[node].child;
+  uint32_t before = RBTTY_REGISTRY_NONE;
+  while(child != RBTTY_REGISTRY_NONE && registry->nodes[child].c < c) {
+    before = child;
+    child = registry->nodes[child].sibling;
+  }
+  if(prev)
+    *prev = before;
+  if(child == RBTTY_REGISTRY_NONE || registry->nodes[child].c != c)
+    return RBTTY_REGISTRY_NONE;
+  return child;
+}
+
+/* Return the node of the `len' chars of `str' or RBTTY_REGISTRY_NONE */
+static uint32_t
+find_node
+  (const struct rbtty_registry* registry,
+   const wchar_t* str,
+   const size_t len)
+{
+  uint32_t node = 0;
+  ASSERT(registry && registry->nodes_count);
+  FOR_EACH(size_t, i, 0, len) {
+    node = find_child(registry, node, str[i], NULL);
+    if(node == RBTTY_REGISTRY_NONE)
+      break;
+  }
+  return node;
+}
+
+/* Add the name of the `icmd' command to the trie. The nodes are reserved
+ * beforehand, so that it cannot fail */
+static void
+trie_insert(struct rbtty_registry* registry, const size_t icmd)
+{
+  const struct rbtty_registry_command* cmd = registry->commands + icmd;
+  const wchar_t* name = command_name(registry, cmd);
+  uint32_t node = 0;
+  ASSERT(registry->nodes_count + cmd->name_len <= registry->nodes_capacity);
+
+  FOR_EACH(size_t, i, 0, cmd->name_len) {
+    uint32_t prev = RBTTY_REGISTRY_NONE;
+    uint32_t child = find_child(registry, node, name[i], &prev);
+    if(child == RBTTY_REGISTRY_NONE) {
+      struct rbtty_trie_node* new_node = NULL;
+      child = (uint32_t)registry->nodes_count++;
+      new_node = registry->nodes + child;
+      new_node->c = name[i];
+      new_node->parent = node;
+      new_node->child = RBTTY_REGISTRY_NONE;
+      new_node->count = 0;
+      new_node->command = RBTTY_REGISTRY_NONE;
+      if(prev == RBTTY_REGISTRY_NONE) {
+        new_node->sibling = registry->nodes[node].child;
+        registry->nodes[node].child = child;
+      } else {
+        new_node->sibling = registry->nodes[prev].sibling;
+        registry->nodes[prev].sibling = child;
+      }
+    }
+    node = child;
+  }
+  ASSERT(registry->nodes[node].command == RBTTY_REGISTRY_NONE);
+  registry->nodes[node].command = (uint32_t)icmd;
+  /* Count the name in the subtrees of its prefixes */
+  for(;;) {
+    ++registry->nodes[node].count;
+    if(!node)
+      break;
+    node = registry->nodes[node].parent;
+  }
+}
+
+/* Return the node following the subtree of `node' in depth first order,
+ * without leaving the subtree of `root' */
+static uint32_t
+next_subtree
+  (const struct rbtty_registry* registry,
+   const uint32_t root,
+   uint32_t node)
+{
+  while(node != root) {
+    if(registry->nodes[node].sibling != RBTTY_REGISTRY_NONE)
+      return registry->nodes[node].sibling;
+    node = registry->nodes[node].parent;
+  }
+  return RBTTY_REGISTRY_NONE;
+}
+
+static void
+reset_completion(struct rbtty_registry* registry)
+{
+  ASSERT(registry);
+  registry->node = RBTTY_REGISTRY_NONE;
+  registry->word.str = NULL;
+  registry->word.len = 0;
+  registry->candidates_count = 0;
+  registry->candidates_len = 0;
+}
+
+static int
+cmp_candidates(const void* a, const void* b)
+{
+  const struct rbtty_arg* arg0 = &((const struct rbtty_candidate*)a)->arg;
+  const struct rbtty_arg* arg1 = &((const struct rbtty_candidate*)b)->arg;
+  const int i = wmemcmp(arg0->str, arg1->str, MIN(arg0->len, arg1->len));
+  if(i)
+    return i;
+  return arg0->len < arg1->len ? -1 : arg0->len > arg1->len;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_registry functions
+ *
+ ******************************************************************************/
+void
+rbtty_registry_init
+  (struct mem_allocator* allocator,
+   struct rbtty_registry* registry)
+{
+  ASSERT(allocator && registry);
+  memset(registry, 0, sizeof(struct rbtty_registry));
+  registry->allocator = allocator;
+  registry->node = RBTTY_REGISTRY_NONE;
+}
+
+void
+rbtty_registry_shutdown(struct rbtty_registry* registry)
+{
+  ASSERT(registry);
+  if(registry->commands)
+    MEM_FREE(registry->allocator, registry->commands);
+  if(registry->slots)
+    MEM_FREE(registry->allocator, registry->slots);
+  if(registry->names)
+    MEM_FREE(registry->allocator, registry->names);
+  if(registry->nodes)
+    MEM_FREE(registry->allocator, registry->nodes);
+  if(registry->args)
+    MEM_FREE(registry->allocator, registry->args);
+  if(registry->candidates)
+    MEM_FREE(registry->allocator, registry->candidates);
+  if(registry->candidates_chars)
+    MEM_FREE(registry->allocator, registry->candidates_chars);
+  registry->commands = NULL;
+  registry->slots = NULL;
+  registry->names = NULL;
+  registry->nodes = NULL;
+  registry->args = NULL;
+  registry->candidates = NULL;
+  registry->candidates_chars = NULL;
+  registry->commands_count = registry->commands_capacity = 0;
+  registry->slots_count = 0;
+  registry->names_len = registry->names_capacity = 0;
+  registry->nodes_count = registry->nodes_capacity = 0;
+  registry->args_capacity = 0;
+  registry->candidates_capacity = registry->candidates_chars_capacity = 0;
+  reset_completion(registry);
+}
+
+enum rbtty_error
+rbtty_registry_add
+  (struct rbtty_registry* registry,
+   const wchar_t* name,
+   const size_t len,
+   enum rbtty_error (*execute)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   enum rbtty_error (*complete)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   void* data)
+{
+  struct rbtty_registry_command* cmd = NULL;
+  const uint64_t hash = hash_str(name, len);
+  size_t slot = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(registry && name && len && execute);
+
+  reset_completion(registry);
+
+  #define CALL(func)                                                           \
+    {                                                                          \
+      rbtty_err = func;                                                        \
+      if(rbtty_err != RBTTY_NO_ERROR)                                          \
+        return rbtty_err;                                                      \
+    } (void) 0
+  if(registry->slots_count) {
+    slot = find_slot(registry, name, len, hash);
+    if(registry->slots[slot] != SIZE_MAX) {
+      cmd = registry->commands + registry->slots[slot];
+      cmd->execute = execute;
+      cmd->complete = complete;
+      cmd->data = data;
+      return RBTTY_NO_ERROR;
+    }
+  }
+  if(registry->commands_count >= RBTTY_REGISTRY_NONE
+  || len >= RBTTY_REGISTRY_NONE - registry->nodes_count)
+    return RBTTY_MEMORY_ERROR;
+
+  /* Reserve everything beforehand, so that the registry is left unchanged on
+   * error */
+  CALL(reserve(registry->allocator, (void**)&registry->commands,
+    &registry->commands_capacity, registry->commands_count + 1,
+    sizeof(struct rbtty_registry_command)));
+  CALL(reserve(registry->allocator, (void**)&registry->names,
+    &registry->names_capacity, registry->names_len + len, sizeof(wchar_t)));
+  CALL(reserve(registry->allocator, (void**)&registry->nodes,
+    &registry->nodes_capacity, MAX(registry->nodes_count, 1) + len,
+    sizeof(struct rbtty_trie_node)));
+  CALL(reserve_slots(registry));
+  #undef CALL
+
+  if(!registry->nodes_count) { /* Root */
+    registry->nodes[0].c = L'\0';
+    registry->nodes[0].parent = RBTTY_REGISTRY_NONE;
+    registry->nodes[0].child = RBTTY_REGISTRY_NONE;
+    registry->nodes[0].sibling = RBTTY_REGISTRY_NONE;
+    registry->nodes[0].count = 0;
+    registry->nodes[0].command = RBTTY_REGISTRY_NONE;
+    registry->nodes_count = 1;
+  }
+
+  cmd = registry->commands + registry->commands_count;
+  cmd->name = registry->names_len;
+  cmd->name_len = len;
+  cmd->hash = hash;
+  cmd->execute = execute;
+  cmd->complete = complete;
+  cmd->data = data;
+  wmemcpy(registry->names + registry->names_len, name, len);
+  registry->names_len += len;
+  registry->slots[find_slot(registry, name, len, hash)] =
+    registry->commands_count;
+  trie_insert(registry, registry->commands_count);
+  ++registry->commands_count;
+  return RBTTY_NO_ERROR;
+}
+
+const struct rbtty_registry_command*
+rbtty_registry_find
+  (const struct rbtty_registry* registry,
+   const wchar_t* name,
+   const size_t len)
+{
+  size_t slot = 0;
+  ASSERT(registry && (name || !len));
+  if(!registry->slots_count)
+    return NULL;
+  slot = find_slot(registry, name, len, hash_str(name, len));
+  if(registry->slots[slot] == SIZE_MAX)
+    return NULL;
+  return registry->commands + registry->slots[slot];
+}
+
+enum rbtty_error
+rbtty_registry_tokenize
+  (struct rbtty_registry* registry,
+   const wchar_t* str,
+   const size_t len,
+   const int is_open,
+   const struct rbtty_arg** argv,
+   size_t* argc)
+{
+  struct rbtty_arg arg;
+  size_t count = 0;
+  size_t i = 0;
+  int is_word_open = 0; /* The last word is not delimited */
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(registry && (str || !len) && argv && argc);
+
+  #define PUSH(Arg)                                                            \
+    {                                                                          \
+      rbtty_err = reserve(registry->allocator, (void**)&registry->args,        \
+        &registry->args_capacity, count + 1, sizeof(struct rbtty_arg));        \
+      if(rbtty_err != RBTTY_NO_ERROR)                                          \
+        return rbtty_err;                                                      \
+      registry->args[count++] = Arg;                                           \
+    } (void) 0
+  for(;;) {
+    while(i < len && is_blank(str[i]))
+      ++i;
+    if(i == len)
+      break;
+    if(str[i] == L'"') {
+      const wchar_t* end = NULL;
+      arg.str = str + ++i;
+      end = wmemchr(arg.str, L'"', len - i);
+      arg.len = end ? (size_t)(end - arg.str) : len - i;
+      i += arg.len + (end != NULL);
+      is_word_open = !end;
+    } else {
+      arg.str = str + i;
+      while(i < len && !is_blank(str[i]) && str[i] != L'"')
+        ++i;
+      arg.len = (size_t)(str + i - arg.str);
+      is_word_open = i == len;
+    }
+    PUSH(arg);
+  }
+  if(is_open && !is_word_open) {
+    arg.str = str + len;
+    arg.len = 0;
+    PUSH(arg);
+  }
+  #undef PUSH
+  *argv = registry->args;
+  *argc = count;
+  return RBTTY_NO_ERROR;
+}
+
+size_t
+rbtty_registry_complete_name
+  (struct rbtty_registry* registry,
+   const struct rbtty_arg* word)
+{
+  ASSERT(registry && word);
+  reset_completion(registry);
+  registry->word = *word;
+  if(!registry->nodes_count)
+    return 0;
+  registry->node = find_node(registry, word->str, word->len);
+  if(registry->node == RBTTY_REGISTRY_NONE)
+    return 0;
+  return registry->nodes[registry->node].count;
+}
+
+void
+rbtty_registry_begin_completion
+  (struct rbtty_registry* registry,
+   const struct rbtty_arg* word)
+{
+  ASSERT(registry && word);
+  reset_completion(registry);
+  registry->word = *word;
+}
+
+enum rbtty_error
+rbtty_registry_add_candidate
+  (struct rbtty_registry* registry,
+   const wchar_t* str,
+   const size_t len)
+{
+  struct rbtty_candidate* candidate = NULL;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(registry && (str || !len));
+  ASSERT(registry->node == RBTTY_REGISTRY_NONE);
+
+  if(!len || len < registry->word.len
+  || wmemcmp(str, registry->word.str, registry->word.len))
+    return RBTTY_NO_ERROR;
+
+  rbtty_err = reserve(registry->allocator, (void**)&registry->candidates,
+    &registry->candidates_capacity, registry->candidates_count + 1,
+    sizeof(struct rbtty_candidate));
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  rbtty_err = reserve(registry->allocator,
+    (void**)&registry->candidates_chars, &registry->candidates_chars_capacity,
+    registry->candidates_len + len, sizeof(wchar_t));
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+
+  candidate = registry->candidates + registry->candidates_count++;
+  candidate->offset = registry->candidates_len;
+  candidate->arg.str = NULL;
+  candidate->arg.len = len;
+  wmemcpy(registry->candidates_chars + registry->candidates_len, str, len);
+  registry->candidates_len += len;
+  return RBTTY_NO_ERROR;
+}
+
+size_t
+rbtty_registry_end_completion(struct rbtty_registry* registry)
+{
+  size_t count = 0;
+  ASSERT(registry && registry->node == RBTTY_REGISTRY_NONE);
+
+  /* The chars of the candidates do not move anymore */
+  FOR_EACH(size_t, i, 0, registry->candidates_count) {
+    struct rbtty_candidate* candidate = registry->candidates + i;
+    candidate->arg.str = registry->candidates_chars + candidate->offset;
+  }
+  qsort(registry->candidates, registry->candidates_count,
+    sizeof(struct rbtty_candidate), cmp_candidates);
+  FOR_EACH(size_t, i, 0, registry->candidates_count) {
+    if(!count || cmp_candidates
+      (registry->candidates + count - 1, registry->candidates + i))
+      registry->candidates[count++] = registry->candidates[i];
+  }
+  registry->candidates_count = count;
+  return count;
+}
+
+void
+rbtty_registry_common_suffix
+  (const struct rbtty_registry* registry,
+   struct rbtty_arg* suffix)
+{
+  const size_t word_len = registry->word.len;
+  ASSERT(registry && suffix);
+
+  suffix->str = NULL;
+  suffix->len = 0;
+  if(registry->node != RBTTY_REGISTRY_NONE) {
+    /* Descend while the names share their next char */
+    uint32_t node = registry->node;
+    size_t len = 0;
+    while(registry->nodes[node].command == RBTTY_REGISTRY_NONE) {
+      const uint32_t child = registry->nodes[node].child;
+      if(registry->nodes[child].sibling != RBTTY_REGISTRY_NONE)
+        break;
+      node = child;
+      ++len;
+    }
+    if(len) {
+      /* The suffix is read from a name of the subtree */
+      while(registry->nodes[node].command == RBTTY_REGISTRY_NONE)
+        node = registry->nodes[node].child;
+      suffix->str = command_name(registry,
+        registry->commands + registry->nodes[node].command) + word_len;
+      suffix->len = len;
+    }
+  } else if(registry->candidates_count) {
+    /* The candidates are sorted: their common prefix is the one of the
+     * first and of the last candidates */
+    const struct rbtty_arg* first = &registry->candidates[0].arg;
+    const struct rbtty_arg* last =
+      &registry->candidates[registry->candidates_count - 1].arg;
+    size_t len = word_len;
+    while(len < first->len && len < last->len
+    && first->str[len] == last->str[len])
+      ++len;
+    suffix->str = first->str + word_len;
+    suffix->len = len - word_len;
+  }
+}
+
+size_t
+rbtty_registry_get_candidates
+  (const struct rbtty_registry* registry,
+   const size_t first,
+   const size_t max,
+   struct rbtty_arg* candidates)
+{
+  size_t count = 0;
+  ASSERT(registry && (candidates || !max));
+
+  if(registry->node == RBTTY_REGISTRY_NONE) {
+    FOR_EACH(size_t, i, first, registry->candidates_count) {
+      if(count == max)
+        break;
+      candidates[count++] = registry->candidates[i].arg;
+    }
+  } else {
+    /* Skip the subtrees of the names preceding the first one */
+    size_t skip = first;
+    uint32_t node = registry->node;
+    while(node != RBTTY_REGISTRY_NONE && count < max) {
+      const struct rbtty_trie_node* n = registry->nodes + node;
+      if(skip >= n->count) {
+        skip -= n->count;
+        node = next_subtree(registry, registry->node, node);
+        continue;
+      }
+      if(n->command != RBTTY_REGISTRY_NONE) {
+        if(skip) {
+          --skip;
+        } else {
+          const struct rbtty_registry_command* cmd =
+            registry->commands + n->command;
+          candidates[count].str = command_name(registry, cmd);
+          candidates[count].len = cmd->name_len;
+          ++count;
+        }
+      }
+      node = n->child != RBTTY_REGISTRY_NONE
+        ? n->child : next_subtree(registry, registry->node, node);
+    }
+  }
+  return count;
+}
+
@@ -0,0 +1,177 @@
+#ifndef RBTTY_REGISTRY_H
+#define RBTTY_REGISTRY_H
+
+#include "rbtty.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Index of no trie node */
+#define RBTTY_REGISTRY_NONE UINT32_MAX
+
+struct mem_allocator;
+
+struct rbtty_registry_command {
+  size_t name; /* Offset of the name into the names arena */
+  size_t name_len;
+  uint64_t hash;
+  enum rbtty_error (*execute)
+    (struct rbtty* tty,
+     const size_t argc,
+     const struct rbtty_arg* argv,
+     void* data);
+  enum rbtty_error (*complete) /* May be NULL */
+    (struct rbtty* tty,
+     const size_t argc,
+     const struct rbtty_arg* argv,
+     void* data);
+  void* data;
+};
+
+/* Node of the prefix trie of the command names. The children of a node are
+ * linked in ascending order of their char, so that a depth first traversal
+ * visits the names in lexicographic order */
+struct rbtty_trie_node {
+  wchar_t c;
+  uint32_t parent;
+  uint32_t child; /* First child */
+  uint32_t sibling; /* Next child of the parent */
+  uint32_t count; /* Number of names in the subtree */
+  uint32_t command; /* Command named by the path of the node */
+};
+
+/* Candidate of an argument completion */
+struct rbtty_candidate {
+  size_t offset; /* Offset of its chars into the candidates arena */
+  struct rbtty_arg arg; /* Its chars are set when the completion ends */
+};
+
+/* Commands registered by name. A command is looked up from its name in an
+ * open addressing hash table, and the names are indexed by a trie whose
+ * nodes count the names of their subtree: the names starting with a prefix
+ * are listed in order from any rank by skipping whole subtrees, without
+ * scanning the preceding ones */
+struct rbtty_registry {
+  struct rbtty_registry_command* commands;
+  size_t commands_count;
+  size_t commands_capacity;
+  size_t* slots; /* Command indices. SIZE_MAX <=> empty slot */
+  size_t slots_count; /* Power of 2 */
+  wchar_t* names;
+  size_t names_len;
+  size_t names_capacity;
+  struct rbtty_trie_node* nodes; /* The first one is the root */
+  size_t nodes_count;
+  size_t nodes_capacity;
+  /* Words of the last tokenized command line */
+  struct rbtty_arg* args;
+  size_t args_capacity;
+  /* Last completion. Its candidates are either the names of the subtree of
+   * `node' or the sorted argument candidates */
+  uint32_t node; /* RBTTY_REGISTRY_NONE <=> argument candidates */
+  struct rbtty_arg word; /* Completed word */
+  struct rbtty_candidate* candidates;
+  size_t candidates_count;
+  size_t candidates_capacity;
+  wchar_t* candidates_chars;
+  size_t candidates_len;
+  size_t candidates_chars_capacity;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_registry_init
+  (struct mem_allocator* allocator,
+   struct rbtty_registry* registry);
+
+extern LOCAL_SYM void
+rbtty_registry_shutdown
+  (struct rbtty_registry* registry);
+
+/* Register the command named by the `len' chars of `name', or replace its
+ * callbacks if it is already registered. The last completion is reset */
+extern LOCAL_SYM enum rbtty_error
+rbtty_registry_add
+  (struct rbtty_registry* registry,
+   const wchar_t* name,
+   const size_t len,
+   enum rbtty_error (*execute)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   enum rbtty_error (*complete)
+     (struct rbtty* tty,
+      const size_t argc,
+      const struct rbtty_arg* argv,
+      void* data),
+   void* data);
+
+/* Return the command named by the `len' chars of `name' or NULL */
+extern LOCAL_SYM const struct rbtty_registry_command*
+rbtty_registry_find
+  (const struct rbtty_registry* registry,
+   const wchar_t* name,
+   const size_t len);
+
+/* Split the `len' chars of `str' in words separated by blanks; the blanks
+ * between double quotes belong to the word they delimit, quotes excluded.
+ * The words reference the chars of `str' and are valid until the next
+ * tokenization. If `is_open' is not null, an empty word is added when `str'
+ * does not end with a word, i.e. the word to complete */
+extern LOCAL_SYM enum rbtty_error
+rbtty_registry_tokenize
+  (struct rbtty_registry* registry,
+   const wchar_t* str,
+   const size_t len,
+   const int is_open,
+   const struct rbtty_arg** argv,
+   size_t* argc);
+
+/* Begin the completion of `word' as a command name. Return the number of
+ * candidates */
+extern LOCAL_SYM size_t
+rbtty_registry_complete_name
+  (struct rbtty_registry* registry,
+   const struct rbtty_arg* word);
+
+/* Begin the completion of `word' as an argument. The candidates are then
+ * added with rbtty_registry_add_candidate and sorted by
+ * rbtty_registry_end_completion */
+extern LOCAL_SYM void
+rbtty_registry_begin_completion
+  (struct rbtty_registry* registry,
+   const struct rbtty_arg* word);
+
+/* Add a candidate to the argument completion. It is ignored if it is empty
+ * or if it does not start with the completed word */
+extern LOCAL_SYM enum rbtty_error
+rbtty_registry_add_candidate
+  (struct rbtty_registry* registry,
+   const wchar_t* str,
+   const size_t len);
+
+/* Sort the argument candidates and remove the duplicates. Return their
+ * number */
+extern LOCAL_SYM size_t
+rbtty_registry_end_completion
+  (struct rbtty_registry* registry);
+
+/* Return the chars common to all the candidates of the last completion that
+ * follow the completed word */
+extern LOCAL_SYM void
+rbtty_registry_common_suffix
+  (const struct rbtty_registry* registry,
+   struct rbtty_arg* suffix);
+
+/* Write in `candidates' at most `max' candidates of the last completion in
+ * lexicographic order, from the `first' one. Return their number */
+extern LOCAL_SYM size_t
+rbtty_registry_get_candidates
+  (const struct rbtty_registry* registry,
+   const size_t first,
+   const size_t max,
+   struct rbtty_arg* candidates);
+
+#endif /* RBTTY_REGISTRY_H */
+
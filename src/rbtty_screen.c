@@ -1,11 +1,16 @@
 #include "rbtty_screen.h"
+#include "rbtty_wrap.h"
 #include <sl/sl_vector.h>
 #include <sl/sl_wstring.h>
 #include <snlsys/math.h>
 #include <snlsys/mem_allocator.h>
-#include <limits.h>
 #include <string.h>
 
+/* Average number of chars per line used to size the scrollback arenas */
+#define SCROLLBACK_CHARS_PER_LINE 128
+/* Average number of attribute spans per line */
+#define SCROLLBACK_SPANS_PER_LINE 2
+
 static enum rbtty_error
 sl_to_rbtty_error(const enum sl_error sl_err);
 
@@ -24,9 +29,9 @@ text_shutdown(struct mem_allocator* allocator, struct rbtty_text* text)
     SL(free_wstring(text->string));
     text->string = NULL;
   }
-  if(text->color) {
-    SL(free_vector(text->color));
-    text->color = NULL;
+  if(text->spans) {
+    SL(free_vector(text->spans));
+    text->spans = NULL;
   }
 }
 
@@ -45,7 +50,9 @@ text_init(struct mem_allocator* allocator, struct rbtty_text* text)
       }                                                                        \
     } (void) 0
   FUNC(sl_create_wstring(NULL, allocator, &text->string));
-  FUNC(sl_create_vector(sizeof(float)*3, 16, allocator, &text->color));
+  FUNC(sl_create_vector
+    (sizeof(struct rbtty_span), ALIGNOF(struct rbtty_span), allocator,
+     &text->spans));
   #undef FUNC
 
 exit:
@@ -60,29 +67,90 @@ text_clear(struct rbtty_text* text)
 {
   ASSERT(text);
   SL(clear_wstring(text->string));
-  SL(clear_vector(text->color));
+  SL(clear_vector(text->spans));
 }
 
-static void
-text_copy(struct rbtty_text* dst, const struct rbtty_text* src)
+/* Insert the `len' chars of `str' at the `pos' char of `text'. `str' does
+ * not have to be null terminated. The attribute spans of `text' are extended
+ * or split rather than per char attributes being copied */
+static enum rbtty_error
+text_insert
+  (struct rbtty_text* text,
+   const size_t pos,
+   const wchar_t* str,
+   const size_t len,
+   const uint16_t attrib)
 {
-  const wchar_t* src_cstr = NULL;
-  void* src_colors = NULL;
-  void* dst_colors = NULL;
-  size_t colors_count = 0;
-  size_t color_size = 0;
-  ASSERT(dst && src);
+  wchar_t chunk[256];
+  struct rbtty_span new_span;
+  struct rbtty_span* spans = NULL;
+  void* buffer = NULL;
+  size_t spans_count = 0;
+  size_t i = 0;
+  enum sl_error sl_err = SL_NO_ERROR;
+  ASSERT(text && (str || !len));
 
-  /* Copy text */
-  SL(wstring_get(src->string, &src_cstr));
-  SL(wstring_set(dst->string, src_cstr));
+  if(!len)
+    return RBTTY_NO_ERROR;
 
-  /* Copy color */
-  SL(vector_buffer(src->color, &colors_count, &color_size, NULL, &src_colors));
-  SL(clear_vector(dst->color));
-  SL(vector_resize(dst->color, colors_count, NULL));
-  SL(vector_buffer(dst->color, NULL, NULL, NULL, &dst_colors));
-  memcpy(dst_colors, src_colors, colors_count * color_size);
+  /* Insert the string by null terminated chunks */
+  for(i = 0; i < len; ) {
+    const size_t n = MIN(len - i, sizeof(chunk)/sizeof(wchar_t) - 1);
+    wmemcpy(chunk, str + i, n);
+    chunk[n] = L'\0';
+    sl_err = sl_wstring_insert(text->string, pos + i, chunk);
+    if(sl_err != SL_NO_ERROR)
+      return sl_to_rbtty_error(sl_err);
+    i += n;
+  }
+
+  SL(vector_buffer(text->spans, &spans_count, NULL, NULL, &buffer));
+  spans = buffer;
+
+  /* Look for the span into which the chars are inserted */
+  for(i = 0; i < spans_count; ++i) {
+    if(pos < spans[i].start + spans[i].length)
+      break;
+  }
+  if(i == spans_count) { /* Append */
+    if(i && spans[i-1].attrib == attrib) {
+      spans[i-1].length += (uint32_t)len;
+      return RBTTY_NO_ERROR;
+    }
+  } else if(spans[i].attrib == attrib) { /* Extend the span */
+    spans[i].length += (uint32_t)len;
+    ++i;
+    goto shift;
+  } else if(pos == spans[i].start && i && spans[i-1].attrib == attrib) {
+    spans[i-1].length += (uint32_t)len;
+    goto shift;
+  } else if(pos > spans[i].start) { /* Split the span */
+    struct rbtty_span tail = spans[i];
+    tail.length = spans[i].start + spans[i].length - (uint32_t)pos;
+    tail.start = (uint32_t)pos;
+    spans[i].length -= tail.length;
+    ++i;
+    sl_err = sl_vector_insert_n(text->spans, i, 1, &tail);
+    if(sl_err != SL_NO_ERROR)
+      return sl_to_rbtty_error(sl_err);
+    ++spans_count;
+  }
+  new_span.start = (uint32_t)pos;
+  new_span.length = (uint32_t)len;
+  new_span.attrib = attrib;
+  sl_err = sl_vector_insert_n(text->spans, i, 1, &new_span);
+  if(sl_err != SL_NO_ERROR)
+    return sl_to_rbtty_error(sl_err);
+  ++spans_count;
+  ++i;
+
+shift:
+  /* Offset the spans following the inserted chars */
+  SL(vector_buffer(text->spans, NULL, NULL, NULL, &buffer));
+  spans = buffer;
+  for(; i < spans_count; ++i)
+    spans[i].start += (uint32_t)len;
+  return RBTTY_NO_ERROR;
 }
 
 /*******************************************************************************
@@ -103,50 +171,338 @@ sl_to_rbtty_error(const enum sl_error sl_err)
   return rbtty_err;
 }
 
+/* Number of lines that can be drawn, i.e. of lines of the shown view. The
+ * open line is not drawn while it is empty, and never belongs to a view */
+static FINLINE size_t
+screen_lines_count(const struct rbtty_screen* scr)
+{
+  const struct rbtty_scrollback* sb = &scr->scrollback;
+  size_t n = rbtty_scrollback_lines_count(sb);
+  if(n && scr->view != RBTTY_VIEW_ALL) {
+    const struct rbtty_view* view = scr->views + scr->view;
+    return view->count
+      - rbtty_view_lower_bound(view, rbtty_scrollback_hot_line_id(sb));
+  }
+  if(n && !rbtty_scrollback_line_length(sb, n - 1))
+    --n;
+  return n;
+}
+
+static FINLINE size_t
+screen_line_rows
+  (struct rbtty_screen* scr,
+   struct rbtty_wrap* wrap,
+   const size_t line)
+{
+  return rbtty_wrap_get
+    (wrap, &scr->scrollback, rbtty_screen_line(scr, line))->rows_count;
+}
+
+/* Move the position of the `row' row of the `line' line by `n' rows, toward
+ * the older rows if `is_back' is not null. Only the wrap points of the lines
+ * that are moved through are computed */
 static void
-screen_new_buf
+screen_move
   (struct rbtty_screen* scr,
-   const enum rbtty_output output)
+   struct rbtty_wrap* wrap,
+   size_t* line,
+   size_t* row,
+   size_t n,
+   const int is_back)
+{
+  const size_t nlines = screen_lines_count(scr);
+  ASSERT(scr && wrap && line && row && *line < nlines);
+
+  while(n) {
+    if(is_back) {
+      if(*row) {
+        const size_t step = MIN(*row, n);
+        *row -= step;
+        n -= step;
+      } else if(*line) {
+        --*line;
+        *row = screen_line_rows(scr, wrap, *line) - 1;
+        --n;
+      } else {
+        break;
+      }
+    } else {
+      const size_t last = screen_line_rows(scr, wrap, *line) - 1;
+      if(*row < last) {
+        const size_t step = MIN(last - *row, n);
+        *row += step;
+        n -= step;
+      } else if(*line + 1 < nlines) {
+        ++*line;
+        *row = 0;
+        --n;
+      } else {
+        break;
+      }
+    }
+  }
+}
+
+/* Clamp the position of the newest of the `rows' visible rows so that the
+ * view is full. Return whether it is the newest row of the stdout */
+static int
+screen_clamp_view
+  (struct rbtty_screen* scr,
+   struct rbtty_wrap* wrap,
+   const size_t rows,
+   size_t* line,
+   size_t* row)
+{
+  const size_t nlines = screen_lines_count(scr);
+  size_t min_line = 0;
+  size_t min_row = 0;
+  ASSERT(nlines && *line < nlines);
+
+  *row = MIN(*row, screen_line_rows(scr, wrap, *line) - 1);
+  screen_move(scr, wrap, &min_line, &min_row, rows ? rows - 1 : 0, 0);
+  if(*line < min_line || (*line == min_line && *row < min_row)) {
+    *line = min_line;
+    *row = min_row;
+  }
+  return *line == nlines - 1
+      && *row == screen_line_rows(scr, wrap, *line) - 1;
+}
+
+/* Anchor the view on the `row' row of the `line' line */
+static void
+screen_set_view
+  (struct rbtty_screen* scr,
+   struct rbtty_wrap* wrap,
+   const size_t rows,
+   size_t line,
+   size_t row)
+{
+  if(screen_clamp_view(scr, wrap, rows, &line, &row)) {
+    scr->scroll_id = RBTTY_SCROLL_BOTTOM;
+  } else {
+    scr->scroll_id = rbtty_scrollback_line_id
+      (&scr->scrollback, rbtty_screen_line(scr, line));
+    scr->scroll_row = row;
+  }
+}
+
+/* Damage the open line. Since only the open line and the lines following it
+ * can be modified, the damaged lines are tracked by the lowest damaged id */
+static FINLINE void
+screen_damage_stdout(struct rbtty_screen* scr)
 {
-  struct rbtty_line** line = NULL;
-  struct list_node* node = NULL;
+  const struct rbtty_scrollback* sb = NULL;
   ASSERT(scr);
+  sb = &scr->scrollback;
+  if(sb->lines_count) {
+    const size_t n = rbtty_scrollback_lines_count(sb);
+    const size_t id = rbtty_scrollback_line_id(sb, n - 1);
+    scr->dirty_line = MIN(scr->dirty_line, id);
+  }
+}
 
-  if(!scr->lines_list) /* No storage defined => no buf available */
-    return;
+/* Register the closed line `id' into the views it matches */
+static enum rbtty_error
+screen_push_line
+  (struct rbtty_screen* scr,
+   const size_t id,
+   const struct rbtty_line_meta* meta)
+{
+  size_t first_id = 0;
+  ASSERT(scr && meta);
 
-  /* Retrieve the current line associated to the buf */
-  if(output == RBTTY_STDOUT) {
-    line = &scr->outbuf;
-  } else { ASSERT(output == RBTTY_CMDOUT);
-    size_t len = 0;
-    line = &scr->cmdbuf;
-    /* Translate the cursor after the prompt */
-    SL(wstring_length(scr->prompt.string, &len));
-    ASSERT(len <= INT_MAX);
-    scr->cursor = (int)len;
+  /* The lines moved to the cold tier leave the views */
+  first_id = rbtty_scrollback_hot_line_id(&scr->scrollback);
+  FOR_EACH(size_t, i, 0, scr->views_count) {
+    struct rbtty_view* view = scr->views + i;
+    if(view->is_used && rbtty_view_match(view, meta)) {
+      const enum rbtty_error rbtty_err = rbtty_view_push(view, id, first_id);
+      if(rbtty_err != RBTTY_NO_ERROR)
+        return rbtty_err;
+    }
   }
+  return RBTTY_NO_ERROR;
+}
+
+/* Close the open line of the stdout with the current metadata */
+static FINLINE enum rbtty_error
+screen_new_line(struct rbtty_screen* scr)
+{
+  struct rbtty_scrollback* sb = NULL;
+  size_t id = 0;
+  ASSERT(scr);
 
-  /* Flush the retrieved line to the stdout */
-  if(*line) {
-    list_add(&scr->lines_list_stdout, &(*line)->node);
-    *line = NULL;
+  sb = &scr->scrollback;
+  if(!sb->lines_count)
+    return RBTTY_NO_ERROR;
+  screen_damage_stdout(scr);
+  id = rbtty_scrollback_line_id(sb, rbtty_scrollback_lines_count(sb) - 1);
+  rbtty_scrollback_new_line(sb, &scr->meta);
+  return screen_push_line(scr, id, &scr->meta);
+}
+
+/* Close the open line of the stdout if it is not empty, the char pending in
+ * the UTF-8 decoder included */
+static enum rbtty_error
+screen_end_line(struct rbtty_screen* scr, const uint16_t attrib)
+{
+  struct rbtty_scrollback* sb = NULL;
+  wchar_t c;
+  ASSERT(scr);
+
+  sb = &scr->scrollback;
+  if(!sb->lines_count)
+    return RBTTY_NO_ERROR;
+  if(rbtty_utf8_decoder_flush(&scr->utf8, &c)) {
+    screen_damage_stdout(scr);
+    rbtty_scrollback_append(sb, &c, 1, attrib);
   }
+  if(!rbtty_scrollback_line_length(sb, rbtty_scrollback_lines_count(sb) - 1))
+    return RBTTY_NO_ERROR;
+  return screen_new_line(scr);
+}
 
-  /* Associate a new line to the buf */
-  if(is_list_empty(&scr->lines_list_free)) {
-    node = list_tail(&scr->lines_list_stdout);
-  } else {
-    node = list_head(&scr->lines_list_free);
+static enum rbtty_error
+screen_register_attrib
+  (struct rbtty_screen* scr,
+   const float color[3],
+   uint16_t* id)
+{
+  struct rbtty_attrib attrib;
+  ASSERT(scr && color && id);
+  memcpy(attrib.color, color, sizeof(attrib.color));
+  return rbtty_palette_register(&scr->palette, &attrib, id);
+}
+
+/* Register the attribute of the stdout text, i.e. `color' overridden by the
+ * graphic rendition set by the escape sequences */
+static enum rbtty_error
+screen_register_stdout_attrib
+  (struct rbtty_screen* scr,
+   const float color[3],
+   uint16_t* id)
+{
+  float sgr_color[3];
+  ASSERT(scr && color && id);
+  rbtty_sgr_get_color(&scr->sgr, color, sgr_color);
+  scr->sgr.is_changed = 0;
+  return screen_register_attrib(scr, sgr_color, id);
+}
+
+/* Terminate the pending output and tag the following lines with `meta' */
+static enum rbtty_error
+screen_begin_log
+  (struct rbtty_screen* scr,
+   const struct rbtty_line_meta* meta,
+   const float color[3])
+{
+  uint16_t attrib = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && meta && color);
+
+  rbtty_err = screen_register_stdout_attrib(scr, color, &attrib);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  rbtty_err = screen_end_line(scr, attrib);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  scr->meta = *meta;
+  return RBTTY_NO_ERROR;
+}
+
+/* Close the last logged line if the log succeeded, i.e. if `rbtty_err' is
+ * RBTTY_NO_ERROR, and restore the metadata of the lines that are not
+ * logged */
+static enum rbtty_error
+screen_end_log
+  (struct rbtty_screen* scr,
+   const float color[3],
+   enum rbtty_error rbtty_err)
+{
+  const struct rbtty_line_meta meta = RBTTY_LINE_META_DEFAULT;
+  uint16_t attrib = 0;
+  ASSERT(scr && color);
+
+  if(rbtty_err == RBTTY_NO_ERROR)
+    rbtty_err = screen_register_stdout_attrib(scr, color, &attrib);
+  if(rbtty_err == RBTTY_NO_ERROR)
+    rbtty_err = screen_end_line(scr, attrib);
+  scr->meta = meta;
+  return rbtty_err;
+}
+
+/* Append chars to the prompt or insert them at the cursor of the cmdline */
+static enum rbtty_error
+screen_insert
+  (struct rbtty_screen* scr,
+   const enum rbtty_output output,
+   const wchar_t* str,
+   const size_t len,
+   const uint16_t attrib)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && (str || !len));
+
+  if(output == RBTTY_PROMPT) {
+    size_t plen = 0;
+    SL(wstring_length(scr->prompt.string, &plen));
+    rbtty_err = text_insert(&scr->prompt, plen, str, len, attrib);
+  } else { ASSERT(output == RBTTY_CMDOUT);
+    rbtty_err = rbtty_cmdline_insert(&scr->cmdline, str, len, attrib);
+    scr->cmdout_attrib = attrib;
+    scr->recall_id = RBTTY_HISTORY_NONE;
   }
-  list_del(node);
-  (*line) = CONTAINER_OF(node, struct rbtty_line, node);
-  text_clear(&(*line)->text);
+  scr->is_cmdbuf_dirty = 1;
+  return rbtty_err;
+}
+
+/* Replace the cmdline by the `id' history entry */
+static enum rbtty_error
+screen_recall(struct rbtty_screen* scr, const size_t id)
+{
+  const struct rbtty_history_entry* entry = NULL;
+  ASSERT(scr);
+  entry = rbtty_history_get(&scr->history, id);
+  ASSERT(entry);
+  rbtty_cmdline_clear(&scr->cmdline);
+  scr->recall_id = id;
+  scr->is_cmdbuf_dirty = 1;
+  return rbtty_cmdline_insert
+    (&scr->cmdline, entry->chars, entry->len, scr->cmdout_attrib);
+}
+
+/* Recall the previous (`dir' < 0) or next command starting with the chars
+ * preceding the cursor when the recall began */
+static enum rbtty_error
+screen_recall_prefix(struct rbtty_screen* scr, const int dir)
+{
+  struct rbtty_cmdline* cmdline = NULL;
+  size_t id = 0;
+  ASSERT(scr);
 
-  /* Init the cmdbuf with prompt text */
-  if(output == RBTTY_CMDOUT && scr->cursor != 0 /* Prompt exist ? */) {
-    text_copy(&(*line)->text, &scr->prompt);
+  cmdline = &scr->cmdline;
+  if(scr->recall_id == RBTTY_HISTORY_NONE) {
+    if(dir > 0)
+      return RBTTY_NO_ERROR;
+    scr->recall_id = rbtty_history_end(&scr->history);
+    scr->recall_prefix_len = rbtty_cmdline_cursor(cmdline);
+  }
+  /* The chars preceding the cursor are contiguous. The recalled commands
+   * share the prefix and the cursor follows them */
+  ASSERT(scr->recall_prefix_len <= rbtty_cmdline_cursor(cmdline));
+  id = rbtty_history_find_prefix(&scr->history, cmdline->chars,
+    scr->recall_prefix_len, scr->recall_id, dir);
+  if(id != RBTTY_HISTORY_NONE)
+    return screen_recall(scr, id);
+  if(dir > 0) { /* Back to the edited prefix */
+    scr->recall_id = RBTTY_HISTORY_NONE;
+    scr->is_cmdbuf_dirty = 1;
+    return rbtty_cmdline_erase(cmdline, scr->recall_prefix_len,
+      rbtty_cmdline_length(cmdline), 0);
   }
+  if(scr->recall_id == rbtty_history_end(&scr->history))
+    scr->recall_id = RBTTY_HISTORY_NONE; /* No match at all */
+  return RBTTY_NO_ERROR;
 }
 
 static void
@@ -154,21 +510,48 @@ screen_reset_storage(struct rbtty_screen* scr)
 {
   ASSERT(scr);
 
-  FOR_EACH(int, i, 0, scr->lines_count) {
-    text_shutdown(scr->allocator, &scr->lines_list[i].text);
-  }
-  if(scr->lines_list) {
-    MEM_FREE(scr->allocator, scr->lines_list);
-    scr->lines_list = NULL;
+  rbtty_scrollback_clear(&scr->scrollback);
+  rbtty_utf8_decoder_init(&scr->utf8);
+  rbtty_sgr_init(&scr->sgr);
+  rbtty_cmdline_clear(&scr->cmdline);
+  scr->recall_id = RBTTY_HISTORY_NONE;
+  scr->scroll_id = RBTTY_SCROLL_BOTTOM;
+  scr->dirty_line = 0;
+  scr->is_cmdbuf_dirty = 1;
+}
+
+/* Register the closed lines of the scrollback matching `view' into it. The
+ * cold lines are skipped since they do not keep their metadata */
+static enum rbtty_error
+screen_populate_view(struct rbtty_screen* scr, struct rbtty_view* view)
+{
+  const struct rbtty_scrollback* sb = NULL;
+  size_t first_id = 0;
+  size_t ncold = 0;
+  ASSERT(scr && view);
+
+  sb = &scr->scrollback;
+  rbtty_view_clear(view);
+  if(!sb->lines_count)
+    return RBTTY_NO_ERROR;
+  first_id = rbtty_scrollback_hot_line_id(sb);
+  ncold = rbtty_scrollback_cold_lines_count(sb);
+  FOR_EACH(size_t, i, 0, sb->lines_count - 1) {
+    if(rbtty_view_match(view, rbtty_scrollback_line_meta(sb, ncold + i))) {
+      const enum rbtty_error rbtty_err =
+        rbtty_view_push(view, first_id + i, first_id);
+      if(rbtty_err != RBTTY_NO_ERROR)
+        return rbtty_err;
+    }
   }
-  list_init(&scr->lines_list_free);
-  list_init(&scr->lines_list_stdout);
-  scr->lines_list = NULL;
-  scr->outbuf = NULL;
-  scr->cmdbuf = NULL;
-  scr->lines_count = 0;
-  scr->scroll_id = 0;
-  scr->cursor = 0;
+  return RBTTY_NO_ERROR;
+}
+
+static FINLINE int
+screen_is_view(const struct rbtty_screen* scr, const size_t view)
+{
+  ASSERT(scr);
+  return view < scr->views_count && scr->views[view].is_used;
 }
 
 /*******************************************************************************
@@ -179,10 +562,42 @@ screen_reset_storage(struct rbtty_screen* scr)
 enum rbtty_error
 rbtty_screen_init(struct mem_allocator* allocator, struct rbtty_screen* scr)
 {
+  const float white[3] = { 1.f, 1.f, 1.f };
+  const float yellow[3] = { 1.f, 1.f, 0.f };
+  const struct rbtty_line_meta meta = RBTTY_LINE_META_DEFAULT;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
   ASSERT(allocator && scr);
+
   memset(scr, 0, sizeof(struct rbtty_screen));
   scr->allocator = allocator;
-  return text_init(scr->allocator, &scr->prompt);
+  scr->is_cmdbuf_dirty = 1;
+  rbtty_scrollback_init(scr->allocator, &scr->scrollback);
+  rbtty_palette_init(scr->allocator, &scr->palette);
+  rbtty_cmdline_init(scr->allocator, &scr->cmdline);
+  rbtty_history_init(scr->allocator, &scr->history);
+  scr->recall_id = RBTTY_HISTORY_NONE;
+  scr->scroll_id = RBTTY_SCROLL_BOTTOM;
+  scr->meta = meta;
+  scr->view = RBTTY_VIEW_ALL;
+
+  rbtty_err = text_init(scr->allocator, &scr->prompt);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+  rbtty_err = rbtty_history_setup(&scr->history, RBTTY_HISTORY_DEFAULT_SIZE);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+  rbtty_err = screen_register_attrib(scr, white, &scr->cmdout_attrib);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+  rbtty_err = screen_register_attrib(scr, yellow, &scr->notice_attrib);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+exit:
+  return rbtty_err;
+error:
+  rbtty_screen_shutdown(scr);
+  goto exit;
 }
 
 enum rbtty_error
@@ -190,147 +605,677 @@ rbtty_screen_shutdown(struct rbtty_screen* scr)
 {
   ASSERT(scr);
   screen_reset_storage(scr);
+  rbtty_scrollback_shutdown(&scr->scrollback);
+  rbtty_palette_shutdown(&scr->palette);
   text_shutdown(scr->allocator, &scr->prompt);
-  return RBTTY_UNKNOWN_ERROR;
+  rbtty_cmdline_shutdown(&scr->cmdline);
+  rbtty_history_shutdown(&scr->history);
+  FOR_EACH(size_t, i, 0, scr->views_count)
+    rbtty_view_shutdown(scr->views + i);
+  if(scr->views)
+    MEM_FREE(scr->allocator, scr->views);
+  scr->views = NULL;
+  scr->views_count = scr->views_capacity = 0;
+  scr->view = RBTTY_VIEW_ALL;
+  return RBTTY_NO_ERROR;
 }
 
 enum rbtty_error
-rbtty_screen_storage
+rbtty_screen_setup_scrollback
   (struct rbtty_screen* scr,
-   const int lines_count)
+   const size_t max_lines,
+   const size_t max_bytes)
 {
+  const size_t chars_size = SCROLLBACK_CHARS_PER_LINE * sizeof(wchar_t);
+  const size_t spans_size =
+    SCROLLBACK_SPANS_PER_LINE * sizeof(struct rbtty_span);
+  size_t lines_count = max_lines;
+  size_t chars_count = 0;
+  size_t spans_count = 0;
   enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr);
 
-  ASSERT(scr && lines_count <= 0);
-  screen_reset_storage(scr);
-
-  scr->lines_count = lines_count;
-  scr->lines_list = MEM_ALLOC
-    (scr->allocator, (size_t)lines_count * sizeof(struct rbtty_line));
-  if(!scr->lines_list) {
-    rbtty_err = RBTTY_MEMORY_ERROR;
-    goto error;
-  }
-
-  FOR_EACH(int, i, 0, lines_count) {
-    struct rbtty_line* line = scr->lines_list + i;
-    list_init(&line->node);
-    rbtty_err = text_init(scr->allocator, &line->text);
-    if(rbtty_err != RBTTY_NO_ERROR) {
-      goto error;
+  if(!max_bytes) {
+    if(UNLIKELY(lines_count > SIZE_MAX / chars_size)) {
+      rbtty_err = RBTTY_MEMORY_ERROR;
+      goto exit;
+    }
+    chars_count = lines_count * SCROLLBACK_CHARS_PER_LINE;
+    spans_count = lines_count * SCROLLBACK_SPANS_PER_LINE;
+  } else {
+    size_t size = 0;
+    if(!lines_count) {
+      lines_count = max_bytes
+        / (sizeof(struct rbtty_line) + chars_size + spans_size);
     }
-    list_add(&scr->lines_list_free, &line->node);
+    /* The line ring uses at most half of the budget so that the budget of a
+     * small number of long lines is not eaten by their descriptors */
+    lines_count = MIN(lines_count, max_bytes/2 / sizeof(struct rbtty_line));
+    /* Share the remaining bytes between the arenas as for average lines */
+    size = max_bytes - lines_count * sizeof(struct rbtty_line);
+    chars_count = (size_t)
+      ((double)size * (double)chars_size / (double)(chars_size + spans_size))
+      / sizeof(wchar_t);
+    spans_count = (size - chars_count*sizeof(wchar_t))
+      / sizeof(struct rbtty_span);
   }
+  /* The bytes past the maximum capacity of the arenas are not used */
+  chars_count = MIN(chars_count, RBTTY_SCROLLBACK_MAX_CAPACITY);
+  spans_count = MIN(spans_count, RBTTY_SCROLLBACK_MAX_CAPACITY);
+  if(UNLIKELY(lines_count < 2 || !chars_count || !spans_count)) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto exit;
+  }
+  rbtty_err = rbtty_scrollback_storage
+    (&scr->scrollback, lines_count, chars_count, spans_count);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto exit;
+  scr->dirty_line = 0;
+
 exit:
   return rbtty_err;
-error:
-  screen_reset_storage(scr);
-  goto exit;
+}
+
+enum rbtty_error
+rbtty_screen_setup_cold_scrollback
+  (struct rbtty_screen* scr,
+   const size_t max_bytes,
+   const char* path)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr);
+
+  rbtty_err = rbtty_scrollback_setup_cold(&scr->scrollback, max_bytes, path);
+  scr->dirty_line = 0; /* The cold lines were discarded in all cases */
+  return rbtty_err;
 }
 
 enum rbtty_error
 rbtty_screen_translate_cursor(struct rbtty_screen* scr, const int trans)
 {
+  size_t pos = 0;
   ASSERT(scr);
 
   if(trans == 0)
     return RBTTY_NO_ERROR;
 
+  scr->recall_id = RBTTY_HISTORY_NONE;
+  pos = rbtty_cmdline_cursor(&scr->cmdline);
   if(trans < 0) {
-    size_t prompt_len = 0;
-    const int x = -trans;
+    pos -= MIN((size_t)-(long)trans, pos);
+  } else {
+    pos += (size_t)trans; /* Clamped by rbtty_cmdline_move */
+  }
+  rbtty_cmdline_move(&scr->cmdline, pos);
+  scr->is_cmdbuf_dirty = 1;
+  return RBTTY_NO_ERROR;
+}
 
-    SL(wstring_length(scr->prompt.string, &prompt_len));
-    ASSERT(scr->cursor >= (int)prompt_len);
-    scr->cursor -= MIN(x, scr->cursor - (int)prompt_len);
+void
+rbtty_screen_scroll
+  (struct rbtty_screen* scr,
+   struct rbtty_wrap* wrap,
+   const long delta,
+   const size_t rows)
+{
+  size_t line = 0;
+  size_t row = 0;
+  ASSERT(scr && wrap);
+
+  if(!rbtty_screen_view(scr, wrap, rows, &line, &row))
+    return;
+  if(delta >= 0) {
+    screen_move(scr, wrap, &line, &row, (size_t)delta, 1);
   } else {
-    size_t len = 0;
-    const int x = trans;
+    screen_move(scr, wrap, &line, &row, (size_t)-(delta + 1) + 1, 0);
+  }
+  screen_set_view(scr, wrap, rows, line, row);
+}
+
+void
+rbtty_screen_scroll_to
+  (struct rbtty_screen* scr,
+   struct rbtty_wrap* wrap,
+   const size_t id,
+   const size_t rows)
+{
+  const size_t nlines = screen_lines_count(scr);
+  size_t line = 0;
+  size_t row = 0;
+  ASSERT(scr && wrap);
+
+  if(!nlines)
+    return;
+  line = MIN(id, nlines - 1);
+  screen_move(scr, wrap, &line, &row, rows ? rows - 1 : 0, 0);
+  screen_set_view(scr, wrap, rows, line, row);
+}
+
+int
+rbtty_screen_view
+  (struct rbtty_screen* scr,
+   struct rbtty_wrap* wrap,
+   const size_t rows,
+   size_t* line,
+   size_t* row)
+{
+  const size_t nlines = screen_lines_count(scr);
+  size_t first_id = 0;
+  ASSERT(scr && wrap && line && row);
 
-    SL(wstring_length(scr->cmdbuf->text.string, &len));
-    ASSERT((int)len >= scr->cursor);
-    scr->cursor += MIN(x, (int)len - scr->cursor);
+  if(!nlines)
+    return 0;
+  if(scr->scroll_id == RBTTY_SCROLL_BOTTOM) {
+    *line = nlines - 1;
+    *row = screen_line_rows(scr, wrap, *line) - 1;
+    return 1;
   }
+  /* The anchor is an absolute id so that the view does not move as new lines
+   * are written. It is clamped if older lines were evicted */
+  first_id = rbtty_scrollback_line_id(&scr->scrollback, 0);
+  if(scr->scroll_id < first_id) {
+    *line = 0;
+    *row = 0;
+  } else if(scr->view == RBTTY_VIEW_ALL) {
+    *line = MIN(scr->scroll_id - first_id, nlines - 1);
+    *row = scr->scroll_row;
+  } else {
+    const struct rbtty_view* view = scr->views + scr->view;
+    const size_t hot_id = rbtty_scrollback_hot_line_id(&scr->scrollback);
+    *line = MIN(rbtty_view_lower_bound(view, MAX(scr->scroll_id, hot_id))
+      - rbtty_view_lower_bound(view, hot_id), nlines - 1);
+    *row = scr->scroll_row;
+  }
+  screen_clamp_view(scr, wrap, rows, line, row);
+  return 1;
+}
 
-  return RBTTY_NO_ERROR;
+enum rbtty_error
+rbtty_screen_edit(struct rbtty_screen* scr, const enum rbtty_edit edit)
+{
+  struct rbtty_cmdline* cmdline = NULL;
+  size_t pos = 0;
+  size_t len = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr);
+
+  cmdline = &scr->cmdline;
+  if(edit == RBTTY_EDIT_HISTORY_PREV)
+    return screen_recall_prefix(scr, -1);
+  if(edit == RBTTY_EDIT_HISTORY_NEXT)
+    return screen_recall_prefix(scr, 1);
+
+  scr->recall_id = RBTTY_HISTORY_NONE;
+  pos = rbtty_cmdline_cursor(cmdline);
+  len = rbtty_cmdline_length(cmdline);
+  switch(edit) {
+    case RBTTY_EDIT_LEFT: rbtty_cmdline_move(cmdline, pos ? pos - 1 : 0); break;
+    case RBTTY_EDIT_RIGHT: rbtty_cmdline_move(cmdline, pos + 1); break;
+    case RBTTY_EDIT_WORD_LEFT:
+      rbtty_cmdline_move(cmdline, rbtty_cmdline_word_begin(cmdline));
+      break;
+    case RBTTY_EDIT_WORD_RIGHT:
+      rbtty_cmdline_move(cmdline, rbtty_cmdline_word_end(cmdline));
+      break;
+    case RBTTY_EDIT_HOME: rbtty_cmdline_move(cmdline, 0); break;
+    case RBTTY_EDIT_END: rbtty_cmdline_move(cmdline, len); break;
+    case RBTTY_EDIT_DELETE:
+      rbtty_err = rbtty_cmdline_erase(cmdline, pos, pos + 1, 0);
+      break;
+    case RBTTY_EDIT_BACKSPACE:
+      if(pos)
+        rbtty_err = rbtty_cmdline_erase(cmdline, pos - 1, pos, 0);
+      break;
+    case RBTTY_EDIT_KILL_TO_END:
+      rbtty_err = rbtty_cmdline_erase(cmdline, pos, len, 1);
+      break;
+    case RBTTY_EDIT_KILL_TO_HOME:
+      rbtty_err = rbtty_cmdline_erase(cmdline, 0, pos, 1);
+      break;
+    case RBTTY_EDIT_KILL_WORD:
+      rbtty_err = rbtty_cmdline_erase
+        (cmdline, rbtty_cmdline_word_begin(cmdline), pos, 1);
+      break;
+    case RBTTY_EDIT_YANK: rbtty_err = rbtty_cmdline_yank(cmdline); break;
+    default: return RBTTY_INVALID_ARGUMENT;
+  }
+  scr->is_cmdbuf_dirty = 1;
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_screen_submit
+  (struct rbtty_screen* scr,
+   const wchar_t** cmd,
+   size_t* cmd_len)
+{
+  const struct rbtty_line_meta meta = RBTTY_LINE_META_DEFAULT;
+  const wchar_t* chars = NULL;
+  const struct rbtty_span* spans = NULL;
+  struct rbtty_scrollback* sb = NULL;
+  size_t len = 0;
+  size_t spans_count = 0;
+  size_t cursor = 0;
+  size_t plen = 0;
+  size_t id = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && cmd && cmd_len);
+
+  rbtty_err = rbtty_screen_get_cmdbuf
+    (scr, &chars, &len, &spans, &spans_count, &cursor);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+
+  /* Flush the prompt and the command to the stdout. The inserted line takes
+   * the id of the open line */
+  sb = &scr->scrollback;
+  screen_damage_stdout(scr);
+  if(sb->lines_count) {
+    id = rbtty_scrollback_line_id(sb, rbtty_scrollback_lines_count(sb) - 1);
+    rbtty_scrollback_insert_line(sb, chars, len, spans, spans_count, &meta);
+    rbtty_err = screen_push_line(scr, id, &meta);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+  }
+
+  /* The view outlives the clear of the cmdline */
+  SL(wstring_length(scr->prompt.string, &plen));
+  *cmd = chars + plen;
+  *cmd_len = len - plen;
+  rbtty_cmdline_clear(&scr->cmdline);
+  scr->recall_id = RBTTY_HISTORY_NONE;
+  scr->is_cmdbuf_dirty = 1;
+  return rbtty_history_push(&scr->history, *cmd, *cmd_len);
+}
+
+enum rbtty_error
+rbtty_screen_search_history
+  (struct rbtty_screen* scr,
+   const wchar_t* pattern,
+   const size_t len,
+   const int is_next,
+   int* is_found)
+{
+  size_t from = 0;
+  size_t id = 0;
+  ASSERT(scr && (pattern || !len) && is_found);
+
+  from = rbtty_history_end(&scr->history);
+  if(scr->recall_id != RBTTY_HISTORY_NONE)
+    from = is_next ? scr->recall_id : scr->recall_id + 1;
+  id = rbtty_history_find_substring(&scr->history, pattern, len, from);
+  *is_found = id != RBTTY_HISTORY_NONE;
+  if(!*is_found)
+    return RBTTY_NO_ERROR;
+  scr->recall_prefix_len = 0;
+  return screen_recall(scr, id);
 }
 
 enum rbtty_error
-rbtty_screen_print_wstring
+rbtty_screen_write_wstring
   (struct rbtty_screen* scr,
    const enum rbtty_output output,
    const wchar_t* str,
+   const size_t len,
    const float color[3])
 {
-  size_t len = 0;
+  uint16_t attrib = 0;
   enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
 
-  ASSERT(scr && str && color);
+  ASSERT(scr && (str || !len) && color);
 
-  len = wcslen(str);
+  if(output == RBTTY_STDOUT) {
+    const wchar_t* tkn = str;
+    const wchar_t* str_end = str + len;
+    const wchar_t* nl = NULL; /* Next new line or str_end */
 
-  #define CALL(func)                                                           \
-    {                                                                          \
-      const enum sl_error sl_err = func;                                       \
-      if(sl_err != SL_NO_ERROR) {                                              \
-        rbtty_err = sl_to_rbtty_error(sl_err);                                 \
-        goto error;                                                            \
-      }                                                                        \
-    } (void) 0
-  if(output == RBTTY_PROMPT) {
-    size_t plen = 0;
+    rbtty_err = screen_register_stdout_attrib(scr, color, &attrib);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
 
-    SL(vector_buffer(scr->prompt.color, &plen, NULL, NULL, NULL));
-    CALL(sl_wstring_append(scr->prompt.string, str));
-    CALL(sl_vector_push_back_n(scr->prompt.color, len, color));
+    screen_damage_stdout(scr);
+    while(tkn < str_end) {
+      const wchar_t* tkn_end = NULL;
 
-    if(scr->cmdbuf) {
-      CALL(sl_wstring_insert(scr->cmdbuf->text.string, plen, str));
-      CALL(sl_vector_insert_n(scr->cmdbuf->text.color, plen, len, color));
+      if(*tkn == RBTTY_SGR_ESC || !rbtty_sgr_is_ground(&scr->sgr)) {
+        tkn += rbtty_sgr_parse_wstring
+          (&scr->sgr, tkn, (size_t)(str_end - tkn));
+        if(scr->sgr.is_changed) {
+          rbtty_err = screen_register_stdout_attrib(scr, color, &attrib);
+          if(rbtty_err != RBTTY_NO_ERROR)
+            return rbtty_err;
+        }
+        continue;
+      }
+      /* Append the chars up to the next new line or escape sequence */
+      if(!nl || nl < tkn) {
+        nl = wmemchr(tkn, L'\n', (size_t)(str_end - tkn));
+        if(!nl)
+          nl = str_end;
+      }
+      tkn_end = wmemchr(tkn, RBTTY_SGR_ESC, (size_t)(nl - tkn));
+      if(!tkn_end)
+        tkn_end = nl;
+      rbtty_scrollback_append
+        (&scr->scrollback, tkn, (size_t)(tkn_end - tkn), attrib);
+      tkn = tkn_end;
+      if(tkn < str_end && *tkn == L'\n') {
+        rbtty_err = screen_new_line(scr);
+        if(rbtty_err != RBTTY_NO_ERROR)
+          return rbtty_err;
+        ++tkn; /* Skip the new line */
+      }
     }
-    scr->cursor += (int)len;
+  } else {
+    rbtty_err = screen_register_attrib(scr, color, &attrib);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+    rbtty_err = screen_insert(scr, output, str, len, attrib);
+  }
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_screen_write_utf8
+  (struct rbtty_screen* scr,
+   const enum rbtty_output output,
+   const char* str,
+   const size_t len,
+   const float color[3])
+{
+  uint16_t attrib = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
 
-  } else if(scr->lines_count > 0) {
-    const size_t cursor = (size_t)scr->cursor;
-    struct rbtty_line* line = NULL;
+  ASSERT(scr && (str || !len) && color);
 
-    if(output == RBTTY_CMDOUT) {
-      line = scr->cmdbuf;
-      CALL(sl_wstring_insert(line->text.string, cursor, str));
-      CALL(sl_vector_insert_n(line->text.color, cursor, len, color));
-      scr->cursor += (int)len;
+  if(output == RBTTY_STDOUT) {
+    const char* tkn = str;
+    const char* str_end = str + len;
+    const char* nl = NULL; /* Next new line or str_end */
 
-    } else { ASSERT(output == RBTTY_STDOUT);
-      wchar_t* tkn = NULL;
-      wchar_t* str_end = NULL;
+    rbtty_err = screen_register_stdout_attrib(scr, color, &attrib);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
 
-      if(len + 1 /* +1 <=> \0 */ > sizeof(scr->scratch)/sizeof(wchar_t)) {
-        rbtty_err = RBTTY_MEMORY_ERROR;
-        goto error;
-      }
-      wcscpy(scr->scratch, str);
-      tkn = scr->scratch;
-      str_end = scr->scratch + len;
-      while((uintptr_t)tkn < (uintptr_t)str_end) {
-        wchar_t* tkn_end = wcschr(tkn, L'\n');
-        if(tkn_end) {
-          *tkn_end = L'\0';
+    screen_damage_stdout(scr);
+    while(tkn < str_end) {
+      const char* tkn_end = NULL;
+      const char* esc = NULL;
+      size_t tkn_len = 0;
+      wchar_t c;
+
+      if(*tkn == RBTTY_SGR_ESC || !rbtty_sgr_is_ground(&scr->sgr)) {
+        /* The escape sequence terminates the pending UTF-8 sequence */
+        if(rbtty_utf8_decoder_flush(&scr->utf8, &c))
+          rbtty_scrollback_append(&scr->scrollback, &c, 1, attrib);
+        tkn += rbtty_sgr_parse_utf8(&scr->sgr, tkn, (size_t)(str_end - tkn));
+        if(scr->sgr.is_changed) {
+          rbtty_err = screen_register_stdout_attrib(scr, color, &attrib);
+          if(rbtty_err != RBTTY_NO_ERROR)
+            return rbtty_err;
         }
-        const size_t tkn_len = wcslen(tkn);
-        line = scr->outbuf;
-        CALL(sl_wstring_append(line->text.string, tkn));
-        CALL(sl_vector_push_back_n(line->text.color, tkn_len, color));
-        tkn += tkn_len + 1; /* +1 <=> \0 */
-        if(tkn_end) {
-          screen_new_buf(scr, RBTTY_STDOUT);
+        continue;
+      }
+
+      /* Token up to the next new line or escape sequence. UTF-8 continuation
+       * bytes cannot be mistaken for them */
+      if(!nl || nl < tkn) {
+        nl = memchr(tkn, '\n', (size_t)(str_end - tkn));
+        if(!nl)
+          nl = str_end;
+      }
+      tkn_len = (size_t)(nl - tkn);
+      esc = memchr(tkn, RBTTY_SGR_ESC, tkn_len);
+      if(esc) {
+        tkn_len = (size_t)(esc - tkn);
+      } else if(nl != str_end) {
+        tkn_end = nl;
+      }
+
+      /* Decode the token in place into the open line. Each byte produces at
+       * most one char, plus one for the sequence pending from a previous
+       * write */
+      while(tkn_len) {
+        size_t n = tkn_len + 1;
+        wchar_t* dst = rbtty_scrollback_reserve(&scr->scrollback, &n, attrib);
+        if(n <= 1) { /* The line is full. Drop the remaining bytes */
+          tkn += tkn_len;
+          break;
         }
+        n = MIN(n - 1, tkn_len);
+        rbtty_scrollback_commit(&scr->scrollback,
+          rbtty_utf8_decode(&scr->utf8, tkn, n, dst), attrib);
+        tkn += n;
+        tkn_len -= n;
+      }
+      if(tkn_end) {
+        if(rbtty_utf8_decoder_flush(&scr->utf8, &c))
+          rbtty_scrollback_append(&scr->scrollback, &c, 1, attrib);
+        rbtty_err = screen_new_line(scr);
+        if(rbtty_err != RBTTY_NO_ERROR)
+          return rbtty_err;
+        ++tkn; /* Skip the new line */
       }
     }
+  } else {
+    struct rbtty_utf8_decoder dec;
+    wchar_t chunk[256];
+    const char* src = str;
+    const char* src_end = str + len;
+
+    rbtty_err = screen_register_attrib(scr, color, &attrib);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      return rbtty_err;
+
+    rbtty_utf8_decoder_init(&dec);
+    while(src < src_end && rbtty_err == RBTTY_NO_ERROR) {
+      const size_t n = MIN
+        ((size_t)(src_end - src), sizeof(chunk)/sizeof(wchar_t) - 1);
+      size_t nchars = rbtty_utf8_decode(&dec, src, n, chunk);
+      src += n;
+      if(src == src_end)
+        nchars += rbtty_utf8_decoder_flush(&dec, chunk + nchars);
+      rbtty_err = screen_insert(scr, output, chunk, nchars, attrib);
+    }
   }
-  #undef CALL
+  return rbtty_err;
+}
+
+enum rbtty_error
+rbtty_screen_log_wstring
+  (struct rbtty_screen* scr,
+   const struct rbtty_line_meta* meta,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3])
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && meta && (str || !len) && color);
+
+  rbtty_err = screen_begin_log(scr, meta, color);
+  if(rbtty_err == RBTTY_NO_ERROR)
+    rbtty_err = rbtty_screen_write_wstring(scr, RBTTY_STDOUT, str, len, color);
+  return screen_end_log(scr, color, rbtty_err);
+}
+
+enum rbtty_error
+rbtty_screen_log_utf8
+  (struct rbtty_screen* scr,
+   const struct rbtty_line_meta* meta,
+   const char* str,
+   const size_t len,
+   const float color[3])
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && meta && (str || !len) && color);
+
+  rbtty_err = screen_begin_log(scr, meta, color);
+  if(rbtty_err == RBTTY_NO_ERROR)
+    rbtty_err = rbtty_screen_write_utf8(scr, RBTTY_STDOUT, str, len, color);
+  return screen_end_log(scr, color, rbtty_err);
+}
+
+enum rbtty_error
+rbtty_screen_create_view
+  (struct rbtty_screen* scr,
+   const struct rbtty_filter* filter,
+   size_t* id)
+{
+  struct rbtty_view* view = NULL;
+  size_t i = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && filter && id);
+
+  /* Reuse the slot of a removed view if any */
+  while(i < scr->views_count && scr->views[i].is_used)
+    ++i;
+  if(i == scr->views_count) {
+    if(scr->views_count == scr->views_capacity) {
+      const size_t capacity = MAX(scr->views_capacity * 2, 4);
+      struct rbtty_view* views = MEM_REALLOC
+        (scr->allocator, scr->views, capacity * sizeof(struct rbtty_view));
+      if(!views)
+        return RBTTY_MEMORY_ERROR;
+      scr->views = views;
+      scr->views_capacity = capacity;
+    }
+    ++scr->views_count;
+  }
+  view = scr->views + i;
+  rbtty_view_init(scr->allocator, filter, view);
+  rbtty_err = screen_populate_view(scr, view);
+  if(rbtty_err != RBTTY_NO_ERROR) {
+    rbtty_view_shutdown(view);
+    return rbtty_err;
+  }
+  view->is_used = 1;
+  *id = i;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_screen_remove_view(struct rbtty_screen* scr, const size_t view)
+{
+  ASSERT(scr);
+  if(!screen_is_view(scr, view))
+    return RBTTY_INVALID_ARGUMENT;
+  rbtty_view_shutdown(scr->views + view);
+  scr->views[view].is_used = 0;
+  if(scr->view == view) {
+    scr->view = RBTTY_VIEW_ALL;
+    scr->scroll_id = RBTTY_SCROLL_BOTTOM;
+  }
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_screen_show_view(struct rbtty_screen* scr, const size_t view)
+{
+  ASSERT(scr);
+  if(view != RBTTY_VIEW_ALL && !screen_is_view(scr, view))
+    return RBTTY_INVALID_ARGUMENT;
+  /* The rows are looked up by line id: the laid out rows of the lines shown
+   * by both views are reused as is */
+  scr->view = view;
+  scr->scroll_id = RBTTY_SCROLL_BOTTOM;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_screen_rebuild_views(struct rbtty_screen* scr)
+{
+  ASSERT(scr);
+  FOR_EACH(size_t, i, 0, scr->views_count) {
+    if(scr->views[i].is_used) {
+      const enum rbtty_error rbtty_err =
+        screen_populate_view(scr, scr->views + i);
+      if(rbtty_err != RBTTY_NO_ERROR) {
+        FOR_EACH(size_t, j, 0, scr->views_count)
+          rbtty_view_clear(scr->views + j);
+        return rbtty_err;
+      }
+    }
+  }
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_screen_get_cmdbuf
+  (struct rbtty_screen* scr,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count,
+   size_t* cursor)
+{
+  const wchar_t* prompt = NULL;
+  void* prompt_spans = NULL;
+  size_t plen = 0;
+  size_t pspans_count = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && chars && len && spans && spans_count && cursor);
+
+  SL(wstring_get(scr->prompt.string, &prompt));
+  SL(wstring_length(scr->prompt.string, &plen));
+  SL(vector_buffer
+    (scr->prompt.spans, &pspans_count, NULL, NULL, &prompt_spans));
+  rbtty_err = rbtty_cmdline_view(&scr->cmdline, prompt, plen, prompt_spans,
+    pspans_count, chars, len, spans, spans_count);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    return rbtty_err;
+  *cursor = plen + rbtty_cmdline_cursor(&scr->cmdline);
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_screen_set_cmdbuf
+  (struct rbtty_screen* scr,
+   const wchar_t* prompt,
+   const size_t plen,
+   const struct rbtty_span* pspans,
+   const size_t pspans_count,
+   const wchar_t* cmd,
+   const uint16_t* attribs,
+   const size_t len,
+   const size_t cursor)
+{
+  size_t i = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && (prompt || !plen) && (pspans || !pspans_count));
+  ASSERT((cmd && attribs) || !len);
+  (void)plen;
+
+  text_clear(&scr->prompt);
+  rbtty_cmdline_clear(&scr->cmdline);
+  scr->recall_id = RBTTY_HISTORY_NONE;
+  scr->is_cmdbuf_dirty = 1;
+
+  FOR_EACH(size_t, ispan, 0, pspans_count) {
+    const struct rbtty_span* span = pspans + ispan;
+    ASSERT(span->start + span->length <= plen);
+    rbtty_err = text_insert
+      (&scr->prompt, span->start, prompt + span->start, span->length,
+       span->attrib);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      goto error;
+  }
+  /* Insert the command by runs of chars sharing the same attribute */
+  while(i < len) {
+    size_t n = 1;
+    while(i + n < len && attribs[i + n] == attribs[i])
+      ++n;
+    rbtty_err = rbtty_cmdline_insert(&scr->cmdline, cmd + i, n, attribs[i]);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      goto error;
+    i += n;
+  }
+  rbtty_cmdline_move(&scr->cmdline, cursor);
 
 exit:
   return rbtty_err;
 error:
+  text_clear(&scr->prompt);
+  rbtty_cmdline_clear(&scr->cmdline);
   goto exit;
 }
+
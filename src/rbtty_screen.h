@@ -1,41 +1,63 @@
 #ifndef RBTTY_SCREEN_H
 #define RBTTY_SCREEN_H
 
+#include "rbtty_cmdline.h"
 #include "rbtty_error.h"
+#include "rbtty_history.h"
+#include "rbtty_palette.h"
+#include "rbtty_scrollback.h"
+#include "rbtty_sgr.h"
 #include "rbtty_types.h"
+#include "rbtty_utf8.h"
+#include "rbtty_view.h"
 #include <snlsys/snlsys.h>
-#include <snlsys/list.h>
+
+/* Scroll position of a screen that shows the newest lines */
+#define RBTTY_SCROLL_BOTTOM SIZE_MAX
 
 struct mem_allocator;
+struct rbtty_wrap;
 struct sl_wstring;
 struct sl_vector;
 
 struct rbtty_text {
   struct sl_wstring* string;
-  struct sl_vector* color; /* vector of float[3] */
-};
-
-struct rbtty_line {
-  struct list_node node;
-  struct rbtty_text text;
+  struct sl_vector* spans; /* vector of struct rbtty_span */
 };
 
 struct rbtty_screen {
-  wchar_t scratch[BUFSIZ];
-  /* Free list of lines */
-  struct list_node lines_list_free;
-  struct list_node lines_list_stdout;
-  struct rbtty_line* lines_list;
+  /* Lines of the stdout. Its open line is the output buffer */
+  struct rbtty_scrollback scrollback;
+  struct rbtty_utf8_decoder utf8; /* Decoder of the UTF-8 stdout stream */
+  struct rbtty_sgr sgr; /* Parser of the escape sequences of the stdout */
+  struct rbtty_line_meta meta; /* Metadata of the lines closed by a write */
+  /* Filtered views of the stdout */
+  struct rbtty_view* views;
+  size_t views_count;
+  size_t views_capacity;
+  /* Attributes referenced by the spans of the text */
+  struct rbtty_palette palette;
   /* tty field */
-  struct rbtty_text prompt;
-  struct rbtty_line* outbuf;
-  struct rbtty_line* cmdbuf;
+  struct rbtty_text prompt; /* Drawn in front of the cmdline */
+  struct rbtty_cmdline cmdline;
+  uint16_t cmdout_attrib; /* Attribute of the recalled commands */
+  uint16_t notice_attrib; /* Attribute of the notices of the tty */
+  /* Submitted commands */
+  struct rbtty_history history;
+  size_t recall_id; /* History entry in the cmdline or RBTTY_HISTORY_NONE */
+  size_t recall_prefix_len; /* Length of the prefix of the recalled entries */
   /* miscellaneous data */
   struct mem_allocator* allocator;
   /* screen data */
-  int lines_count;
-  int scroll_id;
-  int cursor;
+  /* Absolute id of the line of the newest visible row of the stdout, or
+   * RBTTY_SCROLL_BOTTOM to follow the output, and index of the row in the
+   * wrapped line */
+  size_t scroll_id;
+  size_t scroll_row;
+  size_t view; /* Shown view. RBTTY_VIEW_ALL <=> all the lines */
+  /* Damage since the last draw */
+  size_t dirty_line; /* Lowest absolute id of the damaged lines */
+  int is_cmdbuf_dirty;
 };
 
 extern LOCAL_SYM enum rbtty_error
@@ -47,22 +69,200 @@ extern LOCAL_SYM enum rbtty_error
 rbtty_screen_shutdown
   (struct rbtty_screen* screen);
 
+/* Resize the scrollback to at most `max_lines' lines and `max_bytes' bytes,
+ * keeping its most recent lines. A null limit is not enforced but they
+ * cannot be both null */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_setup_scrollback
+  (struct rbtty_screen* screen,
+   const size_t max_lines,
+   const size_t max_bytes);
+
 extern LOCAL_SYM enum rbtty_error
-rbtty_screen_storage
+rbtty_screen_setup_cold_scrollback
   (struct rbtty_screen* screen,
-   const int lines_count_per_screen); 
+   const size_t max_bytes,
+   const char* path);
 
 extern LOCAL_SYM enum rbtty_error
 rbtty_screen_translate_cursor
   (struct rbtty_screen* screen,
    const int x);
 
+/* Scroll the `rows' visible rows of the stdout by `delta' rows, toward the
+ * older rows if `delta' is positive */
+extern LOCAL_SYM void
+rbtty_screen_scroll
+  (struct rbtty_screen* screen,
+   struct rbtty_wrap* wrap,
+   const long delta,
+   const size_t rows);
+
+/* Scroll the `rows' visible rows so that the first row of the line `id', 0
+ * being the oldest line, is the top one */
+extern LOCAL_SYM void
+rbtty_screen_scroll_to
+  (struct rbtty_screen* screen,
+   struct rbtty_wrap* wrap,
+   const size_t id,
+   const size_t rows);
+
+/* Retrieve the newest of the `rows' visible rows, i.e. the `row' row of the
+ * line `line'. Return 0 if there is no line to draw */
+extern LOCAL_SYM int
+rbtty_screen_view
+  (struct rbtty_screen* screen,
+   struct rbtty_wrap* wrap,
+   const size_t rows,
+   size_t* line,
+   size_t* row);
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_edit
+  (struct rbtty_screen* screen,
+   const enum rbtty_edit edit);
+
+/* Move the prompt and the command to the stdout, add the command to the
+ * history and clear the cmdline. The returned command is valid until the
+ * next rbtty_screen_get_cmdbuf */
 extern LOCAL_SYM enum rbtty_error
-rbtty_screen_print_wstring
+rbtty_screen_submit
+  (struct rbtty_screen* screen,
+   const wchar_t** cmd,
+   size_t* len);
+
+/* Replace the cmdline by the newest command containing the `len' chars of
+ * `pattern', starting from the recalled command if any. If `is_next' is not
+ * null the recalled command itself is skipped */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_search_history
+  (struct rbtty_screen* screen,
+   const wchar_t* pattern,
+   const size_t len,
+   const int is_next,
+   int* is_found);
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_write_wstring
   (struct rbtty_screen* screen,
    const enum rbtty_output output,
    const wchar_t* str,
+   const size_t len,
+   const float color[3]);
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_write_utf8
+  (struct rbtty_screen* screen,
+   const enum rbtty_output output,
+   const char* str,
+   const size_t len,
    const float color[3]);
 
+/* Write the `len' chars of `str' on the stdout as lines with the metadata
+ * `meta'. The open line is closed beforehand if it is not empty, and the
+ * last written line is closed */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_log_wstring
+  (struct rbtty_screen* screen,
+   const struct rbtty_line_meta* meta,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3]);
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_log_utf8
+  (struct rbtty_screen* screen,
+   const struct rbtty_line_meta* meta,
+   const char* str,
+   const size_t len,
+   const float color[3]);
+
+/* Create a view of the lines matching `filter' and populate it from the
+ * scrollback */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_create_view
+  (struct rbtty_screen* screen,
+   const struct rbtty_filter* filter,
+   size_t* view);
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_remove_view
+  (struct rbtty_screen* screen,
+   const size_t view);
+
+/* Show the lines of `view' from the newest ones */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_show_view
+  (struct rbtty_screen* screen,
+   const size_t view);
+
+/* Populate again the views from the scrollback, e.g. once it is restored.
+ * On error the views are emptied */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_rebuild_views
+  (struct rbtty_screen* screen);
+
+/* Return the prompt followed by the command and the position of the cursor
+ * in the returned chars. The data are valid until the next call */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_get_cmdbuf
+  (struct rbtty_screen* screen,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count,
+   size_t* cursor);
+
+/* Replace the prompt by the `plen' chars of `prompt' covered by the
+ * `pspans_count' consecutive spans of `pspans', and the command by the `len'
+ * chars of `cmd' whose attributes are `attribs'. The cursor is moved to the
+ * `cursor' char of the command. On error both are cleared */
+extern LOCAL_SYM enum rbtty_error
+rbtty_screen_set_cmdbuf
+  (struct rbtty_screen* screen,
+   const wchar_t* prompt,
+   const size_t plen,
+   const struct rbtty_span* pspans,
+   const size_t pspans_count,
+   const wchar_t* cmd,
+   const uint16_t* attribs,
+   const size_t len,
+   const size_t cursor);
+
+/* Return the index into the scrollback of the line `line' of the shown
+ * view */
+static FINLINE size_t
+rbtty_screen_line(const struct rbtty_screen* screen, const size_t line)
+{
+  const struct rbtty_view* view = NULL;
+  size_t first_id = 0;
+  ASSERT(screen);
+
+  if(screen->view == RBTTY_VIEW_ALL)
+    return line;
+  view = screen->views + screen->view;
+  first_id = rbtty_scrollback_line_id(&screen->scrollback, 0);
+  return view->ids[rbtty_view_lower_bound
+    (view, rbtty_scrollback_hot_line_id(&screen->scrollback)) + line]
+    - first_id;
+}
+
+static FINLINE int
+rbtty_screen_is_line_dirty
+  (const struct rbtty_screen* screen,
+   const size_t line_id)
+{
+  ASSERT(screen);
+  return line_id >= screen->dirty_line;
+}
+
+static FINLINE void
+rbtty_screen_clear_damage(struct rbtty_screen* screen)
+{
+  ASSERT(screen);
+  screen->dirty_line = SIZE_MAX;
+  screen->is_cmdbuf_dirty = 0;
+}
+
 #endif /* RBTTY_SCREEN_H */
 
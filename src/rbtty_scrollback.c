@@ -0,0 +1,643 @@
+#include "rbtty_scrollback.h"
+#include "rbtty_stats.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE struct rbtty_line*
+sb_line(struct rbtty_scrollback* sb, const size_t id)
+{
+  ASSERT(sb && id < sb->lines_count);
+  return sb->lines + (sb->lines_first + id) % sb->lines_capacity;
+}
+
+static FINLINE struct rbtty_line*
+sb_open_line(struct rbtty_scrollback* sb)
+{
+  ASSERT(sb && sb->lines_count);
+  return sb_line(sb, sb->lines_count - 1);
+}
+
+/* Copy the line `id' to the cold tier, if any, before it is evicted */
+static FINLINE void
+sb_move_to_cold(struct rbtty_scrollback* sb, const size_t id)
+{
+  const struct rbtty_line* line = NULL;
+  ASSERT(sb);
+  if(!sb->cold)
+    return;
+  line = sb_line(sb, id);
+  rbtty_cold_push(sb->cold, sb->lines_id + id,
+    sb->chars + line->begin % sb->chars_capacity, line->length,
+    sb->spans + line->spans_begin % sb->spans_capacity, line->spans_count);
+}
+
+static FINLINE void
+sb_pop_line(struct rbtty_scrollback* sb)
+{
+  ASSERT(sb && sb->lines_count > 1); /* The open line is never evicted */
+  sb_move_to_cold(sb, 0);
+  sb->lines_first = (sb->lines_first + 1) % sb->lines_capacity;
+  --sb->lines_count;
+  ++sb->lines_id;
+  RBTTY_STATS_INC(sb->evicted_count);
+}
+
+static FINLINE void
+sb_push_line(struct rbtty_scrollback* sb)
+{
+  ASSERT(sb && sb->lines_count);
+  if(sb->lines_count == sb->lines_capacity)
+    sb_pop_line(sb);
+  ++sb->lines_count;
+  RBTTY_STATS_INC(sb->pushed_count);
+}
+
+static void
+sb_release_cold(struct rbtty_scrollback* sb)
+{
+  ASSERT(sb);
+  if(sb->cold) {
+    rbtty_cold_shutdown(sb->cold);
+    MEM_FREE(sb->allocator, sb->cold);
+    sb->cold = NULL;
+  }
+}
+
+/* Copy the `count' elements of `src' into the `ring' of `capacity' elements
+ * from the logical position `begin' */
+static FINLINE void
+sb_copy_to_ring
+  (void* ring,
+   const size_t capacity,
+   const size_t size,
+   const size_t begin,
+   const void* src,
+   const size_t count)
+{
+  const size_t offset = begin % capacity;
+  const size_t n = MIN(count, capacity - offset);
+  ASSERT(ring && capacity && size && (src || !count) && count <= capacity);
+  if(!count)
+    return;
+  memcpy((char*)ring + offset * size, src, n * size);
+  memcpy(ring, (const char*)src + n * size, (count - n) * size);
+}
+
+/* Define whether chars with the `attrib' attribute cannot extend the last
+ * span of `line' */
+static FINLINE int
+sb_need_span
+  (const struct rbtty_scrollback* sb,
+   const struct rbtty_line* line,
+   const uint16_t attrib)
+{
+  const struct rbtty_span* span = NULL;
+  ASSERT(sb && line);
+  if(!line->spans_count)
+    return 1;
+  span = sb->spans
+    + (line->spans_begin + line->spans_count - 1) % sb->spans_capacity;
+  return span->attrib != attrib;
+}
+
+/* Evict the lines overwritten when the char and span arenas are filled up to
+ * `chars_end' and `spans_end', respectively */
+static void
+sb_evict
+  (struct rbtty_scrollback* sb,
+   const size_t chars_end,
+   const size_t spans_end)
+{
+  ASSERT(sb);
+  while(sb->lines_count > 1) {
+    const struct rbtty_line* line = sb_line(sb, 0);
+    if(line->begin + sb->chars_capacity >= chars_end
+    && line->spans_begin + sb->spans_capacity >= spans_end)
+      break;
+    sb_pop_line(sb);
+  }
+}
+
+/* Shift the logical positions of the lines back by a multiple of the arena
+ * capacities once the open line exceeds RBTTY_SCROLLBACK_MAX_POSITION, so
+ * that they keep fitting in 32 bits. Their offsets into the arenas are
+ * unchanged */
+static void
+sb_rebase(struct rbtty_scrollback* sb)
+{
+  const struct rbtty_line* first = NULL;
+  const struct rbtty_line* open = NULL;
+  uint32_t chars_shift = 0;
+  uint32_t spans_shift = 0;
+  ASSERT(sb && sb->lines_count);
+
+  open = sb_open_line(sb);
+  if(open->begin <= RBTTY_SCROLLBACK_MAX_POSITION
+  && open->spans_begin <= RBTTY_SCROLLBACK_MAX_POSITION)
+    return;
+  first = sb_line(sb, 0);
+  chars_shift = first->begin - first->begin % (uint32_t)sb->chars_capacity;
+  spans_shift =
+    first->spans_begin - first->spans_begin % (uint32_t)sb->spans_capacity;
+  FOR_EACH(size_t, i, 0, sb->lines_count) {
+    struct rbtty_line* line = sb_line(sb, i);
+    line->begin -= chars_shift;
+    line->spans_begin -= spans_shift;
+  }
+}
+
+/* Ensure that the open line can grow by `nchars' chars and `nspans' spans
+ * without being split across the arena boundaries. Return in `nchars' and
+ * `nspans' the number of chars and spans that can be written */
+static void
+sb_reserve
+  (struct rbtty_scrollback* sb,
+   size_t* nchars,
+   size_t* nspans)
+{
+  struct rbtty_line* line = NULL;
+  size_t chars_offset = 0;
+  size_t spans_offset = 0;
+  size_t begin = 0;
+  size_t spans_begin = 0;
+  ASSERT(sb && sb->lines_count && nchars && nspans);
+
+  sb_rebase(sb);
+  line = sb_open_line(sb);
+  *nchars = MIN(*nchars, sb->chars_capacity - line->length);
+  *nspans = MIN(*nspans, sb->spans_capacity - line->spans_count);
+
+  /* Move the open line at the beginning of the arenas if it does not fit */
+  begin = line->begin;
+  chars_offset = begin % sb->chars_capacity;
+  if(chars_offset + line->length + *nchars > sb->chars_capacity)
+    begin += sb->chars_capacity - chars_offset;
+  spans_begin = line->spans_begin;
+  spans_offset = spans_begin % sb->spans_capacity;
+  if(spans_offset + line->spans_count + *nspans > sb->spans_capacity)
+    spans_begin += sb->spans_capacity - spans_offset;
+
+  sb_evict
+    (sb, begin + line->length + *nchars,
+     spans_begin + line->spans_count + *nspans);
+
+  if(begin != line->begin) {
+    memmove
+      (sb->chars, sb->chars + chars_offset, line->length * sizeof(wchar_t));
+    line->begin = (uint32_t)begin;
+  }
+  if(spans_begin != line->spans_begin) {
+    memmove
+      (sb->spans, sb->spans + spans_offset,
+       line->spans_count * sizeof(struct rbtty_span));
+    line->spans_begin = (uint32_t)spans_begin;
+  }
+}
+
+/*******************************************************************************
+ *
+ * rbtty_scrollback functions
+ *
+ ******************************************************************************/
+void
+rbtty_scrollback_init
+  (struct mem_allocator* allocator,
+   struct rbtty_scrollback* sb)
+{
+  ASSERT(allocator && sb);
+  memset(sb, 0, sizeof(struct rbtty_scrollback));
+  sb->allocator = allocator;
+}
+
+void
+rbtty_scrollback_shutdown(struct rbtty_scrollback* sb)
+{
+  ASSERT(sb);
+  if(sb->chars)
+    MEM_FREE(sb->allocator, sb->chars);
+  if(sb->spans)
+    MEM_FREE(sb->allocator, sb->spans);
+  if(sb->lines)
+    MEM_FREE(sb->allocator, sb->lines);
+  sb->chars = NULL;
+  sb->spans = NULL;
+  sb->lines = NULL;
+  sb->chars_capacity = 0;
+  sb->spans_capacity = 0;
+  sb->lines_capacity = 0;
+  sb->lines_id += sb->lines_count;
+  sb->lines_first = 0;
+  sb->lines_count = 0;
+  sb_release_cold(sb);
+}
+
+enum rbtty_error
+rbtty_scrollback_storage
+  (struct rbtty_scrollback* sb,
+   const size_t lines_count,
+   const size_t chars_count,
+   const size_t spans_count)
+{
+  struct rbtty_scrollback dst;
+  size_t first = 0;
+  size_t nchars = 0;
+  size_t nspans = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(sb);
+
+  if(!lines_count) {
+    rbtty_scrollback_shutdown(sb);
+    goto exit;
+  }
+  /* At least one closed line and the open line */
+  if(UNLIKELY(lines_count < 2 || !chars_count || !spans_count
+  || lines_count > SIZE_MAX / sizeof(struct rbtty_line)
+  || chars_count > RBTTY_SCROLLBACK_MAX_CAPACITY
+  || spans_count > RBTTY_SCROLLBACK_MAX_CAPACITY)) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto exit;
+  }
+  /* The arenas are not initialised; their pages are only touched on demand */
+  dst = *sb;
+  dst.chars = MEM_ALLOC(sb->allocator, chars_count * sizeof(wchar_t));
+  dst.spans = MEM_ALLOC(sb->allocator, spans_count*sizeof(struct rbtty_span));
+  dst.lines = MEM_ALLOC(sb->allocator, lines_count*sizeof(struct rbtty_line));
+  if(!dst.chars || !dst.spans || !dst.lines) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto error;
+  }
+  dst.chars_capacity = chars_count;
+  dst.spans_capacity = spans_count;
+  dst.lines_capacity = lines_count;
+  dst.lines_first = 0;
+  dst.lines_count = 0;
+
+  if(!sb->lines_count) {
+    rbtty_scrollback_clear(&dst);
+  } else {
+    /* Look for the oldest line from which the lines fit in the new storage.
+     * The open line is always kept, even though it has to be truncated */
+    const struct rbtty_line* open = sb_open_line(sb);
+    first = sb->lines_count - 1;
+    nchars = MIN(open->length, chars_count);
+    nspans = MIN(open->spans_count, spans_count);
+    while(first && sb->lines_count - first < lines_count) {
+      const struct rbtty_line* line = sb_line(sb, first - 1);
+      if(nchars + line->length > chars_count
+      || nspans + line->spans_count > spans_count)
+        break;
+      nchars += line->length;
+      nspans += line->spans_count;
+      --first;
+    }
+
+    FOR_EACH(size_t, i, 0, first)
+      sb_move_to_cold(sb, i);
+
+    /* Pack the kept lines at the beginning of the new arenas */
+    nchars = nspans = 0;
+    FOR_EACH(size_t, i, first, sb->lines_count) {
+      const struct rbtty_line* src = sb_line(sb, i);
+      struct rbtty_line* line = dst.lines + dst.lines_count++;
+      struct rbtty_span* spans = dst.spans + nspans;
+      line->begin = (uint32_t)nchars;
+      line->length = (uint32_t)MIN(src->length, chars_count - nchars);
+      line->spans_begin = (uint32_t)nspans;
+      line->spans_count = (uint32_t)MIN(src->spans_count, spans_count - nspans);
+      line->meta = src->meta;
+      memcpy(dst.chars + nchars, sb->chars + src->begin % sb->chars_capacity,
+        line->length * sizeof(wchar_t));
+      memcpy(spans, sb->spans + src->spans_begin % sb->spans_capacity,
+        line->spans_count * sizeof(struct rbtty_span));
+      if(line->length != src->length || line->spans_count != src->spans_count) {
+        /* Truncated open line: the last span covers the remaining chars */
+        while(line->spans_count && spans[line->spans_count-1].start
+              >= line->length)
+          --line->spans_count;
+        if(line->spans_count) {
+          struct rbtty_span* span = spans + line->spans_count - 1;
+          span->length = line->length - span->start;
+        }
+      }
+      nchars += line->length;
+      nspans += line->spans_count;
+    }
+    dst.lines_id = sb->lines_id + first;
+    RBTTY_STATS_ADD(dst.evicted_count, first);
+  }
+
+  if(sb->chars)
+    MEM_FREE(sb->allocator, sb->chars);
+  if(sb->spans)
+    MEM_FREE(sb->allocator, sb->spans);
+  if(sb->lines)
+    MEM_FREE(sb->allocator, sb->lines);
+  *sb = dst;
+
+exit:
+  return rbtty_err;
+error:
+  if(dst.chars)
+    MEM_FREE(sb->allocator, dst.chars);
+  if(dst.spans)
+    MEM_FREE(sb->allocator, dst.spans);
+  if(dst.lines)
+    MEM_FREE(sb->allocator, dst.lines);
+  goto exit;
+}
+
+enum rbtty_error
+rbtty_scrollback_setup_cold
+  (struct rbtty_scrollback* sb,
+   const size_t max_bytes,
+   const char* path)
+{
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(sb);
+
+  if(!max_bytes) {
+    sb_release_cold(sb);
+    goto exit;
+  }
+  if(!sb->cold) {
+    sb->cold = MEM_ALLOC(sb->allocator, sizeof(struct rbtty_cold));
+    if(!sb->cold) {
+      rbtty_err = RBTTY_MEMORY_ERROR;
+      goto error;
+    }
+    rbtty_cold_init(sb->allocator, sb->cold);
+  }
+  rbtty_err = rbtty_cold_setup(sb->cold, max_bytes, path);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+exit:
+  return rbtty_err;
+error:
+  sb_release_cold(sb);
+  goto exit;
+}
+
+void
+rbtty_scrollback_clear(struct rbtty_scrollback* sb)
+{
+  const struct rbtty_line_meta meta = RBTTY_LINE_META_DEFAULT;
+  ASSERT(sb);
+  if(sb->cold)
+    rbtty_cold_clear(sb->cold);
+  sb->lines_id += sb->lines_count;
+  sb->lines_first = 0;
+  sb->lines_count = 0;
+  if(sb->lines_capacity) {
+    memset(sb->lines, 0, sizeof(struct rbtty_line));
+    sb->lines->meta = meta;
+    sb->lines_count = 1;
+  }
+}
+
+enum rbtty_error
+rbtty_scrollback_restore
+  (struct rbtty_scrollback* sb,
+   const size_t lines_capacity,
+   const size_t chars_capacity,
+   const size_t spans_capacity,
+   const size_t lines_id,
+   const struct rbtty_line* lines,
+   const size_t lines_count,
+   const wchar_t* chars,
+   const size_t chars_count,
+   const struct rbtty_span* spans,
+   const size_t spans_count)
+{
+  wchar_t* dst_chars = NULL;
+  struct rbtty_span* dst_spans = NULL;
+  struct rbtty_line* dst_lines = NULL;
+  ASSERT(sb && (lines || !lines_count) && lines_count <= lines_capacity);
+  ASSERT((chars || !chars_count) && chars_count <= chars_capacity);
+  ASSERT((spans || !spans_count) && spans_count <= spans_capacity);
+
+  if(!lines_capacity) {
+    rbtty_scrollback_shutdown(sb);
+    sb->lines_id = lines_id;
+    return RBTTY_NO_ERROR;
+  }
+  if(UNLIKELY(!lines_count || !chars_capacity || !spans_capacity
+  || lines_capacity > SIZE_MAX / sizeof(struct rbtty_line)
+  || chars_capacity > RBTTY_SCROLLBACK_MAX_CAPACITY
+  || spans_capacity > RBTTY_SCROLLBACK_MAX_CAPACITY
+  || lines[0].begin > RBTTY_SCROLLBACK_MAX_POSITION
+  || lines[0].spans_begin > RBTTY_SCROLLBACK_MAX_POSITION))
+    return RBTTY_INVALID_ARGUMENT;
+
+  /* The arenas are reallocated only if their capacity changes */
+  dst_chars = sb->chars;
+  dst_spans = sb->spans;
+  dst_lines = sb->lines;
+  if(chars_capacity != sb->chars_capacity)
+    dst_chars = MEM_ALLOC(sb->allocator, chars_capacity * sizeof(wchar_t));
+  if(spans_capacity != sb->spans_capacity) {
+    dst_spans = MEM_ALLOC
+      (sb->allocator, spans_capacity * sizeof(struct rbtty_span));
+  }
+  if(lines_capacity != sb->lines_capacity) {
+    dst_lines = MEM_ALLOC
+      (sb->allocator, lines_capacity * sizeof(struct rbtty_line));
+  }
+  if(!dst_chars || !dst_spans || !dst_lines) {
+    if(dst_chars && dst_chars != sb->chars)
+      MEM_FREE(sb->allocator, dst_chars);
+    if(dst_spans && dst_spans != sb->spans)
+      MEM_FREE(sb->allocator, dst_spans);
+    if(dst_lines && dst_lines != sb->lines)
+      MEM_FREE(sb->allocator, dst_lines);
+    return RBTTY_MEMORY_ERROR;
+  }
+  if(dst_chars != sb->chars && sb->chars)
+    MEM_FREE(sb->allocator, sb->chars);
+  if(dst_spans != sb->spans && sb->spans)
+    MEM_FREE(sb->allocator, sb->spans);
+  if(dst_lines != sb->lines && sb->lines)
+    MEM_FREE(sb->allocator, sb->lines);
+  sb->chars = dst_chars;
+  sb->spans = dst_spans;
+  sb->lines = dst_lines;
+  sb->chars_capacity = chars_capacity;
+  sb->spans_capacity = spans_capacity;
+  sb->lines_capacity = lines_capacity;
+
+  if(sb->cold)
+    rbtty_cold_clear(sb->cold);
+  memcpy(sb->lines, lines, lines_count * sizeof(struct rbtty_line));
+  sb_copy_to_ring(sb->chars, chars_capacity, sizeof(wchar_t),
+    lines[0].begin, chars, chars_count);
+  sb_copy_to_ring(sb->spans, spans_capacity, sizeof(struct rbtty_span),
+    lines[0].spans_begin, spans, spans_count);
+  sb->lines_first = 0;
+  sb->lines_count = lines_count;
+  sb->lines_id = lines_id;
+  return RBTTY_NO_ERROR;
+}
+
+size_t
+rbtty_scrollback_append
+  (struct rbtty_scrollback* sb,
+   const wchar_t* str,
+   const size_t len,
+   const uint16_t attrib)
+{
+  wchar_t* dst = NULL;
+  size_t n = len;
+  ASSERT(sb && (str || !len));
+
+  dst = rbtty_scrollback_reserve(sb, &n, attrib);
+  if(!n)
+    return 0;
+  memcpy(dst, str, n * sizeof(wchar_t));
+  rbtty_scrollback_commit(sb, n, attrib);
+  return n;
+}
+
+wchar_t*
+rbtty_scrollback_reserve
+  (struct rbtty_scrollback* sb,
+   size_t* len,
+   const uint16_t attrib)
+{
+  struct rbtty_line* line = NULL;
+  size_t nspans = 0;
+  ASSERT(sb && len);
+
+  if(!sb->lines_count || !*len) {
+    *len = 0;
+    return NULL;
+  }
+  line = sb_open_line(sb);
+  nspans = sb_need_span(sb, line, attrib) ? 1 : 0;
+  sb_reserve(sb, len, &nspans);
+  line = sb_open_line(sb);
+  return sb->chars + line->begin % sb->chars_capacity + line->length;
+}
+
+void
+rbtty_scrollback_commit
+  (struct rbtty_scrollback* sb,
+   const size_t len,
+   const uint16_t attrib)
+{
+  struct rbtty_line* line = NULL;
+  struct rbtty_span* span = NULL;
+  ASSERT(sb);
+
+  if(!sb->lines_count || !len)
+    return;
+
+  line = sb_open_line(sb);
+  ASSERT(line->length + len <= sb->chars_capacity);
+  span = sb->spans + line->spans_begin % sb->spans_capacity;
+  if(sb_need_span(sb, line, attrib)
+  && line->spans_count < sb->spans_capacity) {
+    span += line->spans_count;
+    span->start = line->length;
+    span->length = 0;
+    span->attrib = attrib;
+    ++line->spans_count;
+  } else {
+    /* Either the attribute of the last span matches or the span arena is
+     * full. In both cases the last span is extended */
+    ASSERT(line->spans_count);
+    span += line->spans_count - 1;
+  }
+  span->length += (uint32_t)len;
+  line->length += (uint32_t)len;
+  RBTTY_STATS_ADD(sb->chars_count, len);
+}
+
+void
+rbtty_scrollback_new_line
+  (struct rbtty_scrollback* sb,
+   const struct rbtty_line_meta* meta)
+{
+  const struct rbtty_line_meta meta_default = RBTTY_LINE_META_DEFAULT;
+  struct rbtty_line* line = NULL;
+  uint32_t begin = 0;
+  uint32_t spans_begin = 0;
+  ASSERT(sb && meta);
+
+  if(!sb->lines_count)
+    return;
+
+  line = sb_open_line(sb);
+  line->meta = *meta;
+  begin = line->begin + line->length;
+  spans_begin = line->spans_begin + line->spans_count;
+  sb_push_line(sb);
+  line = sb_open_line(sb);
+  line->begin = begin;
+  line->length = 0;
+  line->spans_begin = spans_begin;
+  line->spans_count = 0;
+  line->meta = meta_default;
+}
+
+void
+rbtty_scrollback_insert_line
+  (struct rbtty_scrollback* sb,
+   const wchar_t* str,
+   const size_t len,
+   const struct rbtty_span* spans,
+   const size_t spans_count,
+   const struct rbtty_line_meta* meta)
+{
+  struct rbtty_line open;
+  struct rbtty_line* line = NULL;
+  wchar_t* chars_dst = NULL;
+  struct rbtty_span* spans_dst = NULL;
+  size_t nchars = len;
+  size_t nspans = spans_count;
+  ASSERT(sb && (str || !len) && (spans || !spans_count) && meta);
+
+  if(!sb->lines_count)
+    return;
+
+  /* Make room for the new line at the beginning of the open line */
+  sb_reserve(sb, &nchars, &nspans);
+  while(nspans && spans[nspans-1].start >= nchars) /* Clip the spans */
+    --nspans;
+  if(!nspans) /* No room for the attributes of the chars */
+    nchars = 0;
+  open = *sb_open_line(sb);
+  chars_dst = sb->chars + open.begin % sb->chars_capacity;
+  spans_dst = sb->spans + open.spans_begin % sb->spans_capacity;
+  memmove(chars_dst + nchars, chars_dst, open.length * sizeof(wchar_t));
+  memmove
+    (spans_dst + nspans, spans_dst,
+     open.spans_count * sizeof(struct rbtty_span));
+  memcpy(chars_dst, str, nchars * sizeof(wchar_t));
+  memcpy(spans_dst, spans, nspans * sizeof(struct rbtty_span));
+  if(nspans) {
+    /* The last kept span covers the chars of the clipped spans */
+    struct rbtty_span* span = spans_dst + nspans - 1;
+    span->length = (uint32_t)nchars - span->start;
+  }
+
+  /* Register the new line and move the open line after it */
+  line = sb_open_line(sb);
+  line->length = (uint32_t)nchars;
+  line->spans_count = (uint32_t)nspans;
+  line->meta = *meta;
+  sb_push_line(sb);
+  RBTTY_STATS_ADD(sb->chars_count, nchars);
+  line = sb_open_line(sb);
+  line->begin = open.begin + (uint32_t)nchars;
+  line->length = open.length;
+  line->spans_begin = open.spans_begin + (uint32_t)nspans;
+  line->spans_count = open.spans_count;
+  line->meta = open.meta;
+}
+
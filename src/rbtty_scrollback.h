@@ -0,0 +1,265 @@
+#ifndef RBTTY_SCROLLBACK_H
+#define RBTTY_SCROLLBACK_H
+
+#include "rbtty_cold.h"
+#include "rbtty_error.h"
+#include "rbtty_palette.h"
+#include "rbtty_types.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Default number of lines of the scrollback */
+#define RBTTY_SCROLLBACK_DEFAULT_LINES 8192
+
+/* Maximum number of chars and of spans of the arenas */
+#define RBTTY_SCROLLBACK_MAX_CAPACITY (1u << 29)
+/* The logical positions of the lines are rebased when they exceed it, so
+ * that they fit in 32 bits */
+#define RBTTY_SCROLLBACK_MAX_POSITION (1u << 31)
+
+/* Metadata of the lines that are not logged */
+#define RBTTY_LINE_META_DEFAULT {0, 0, RBTTY_LEVEL_INFO}
+
+struct mem_allocator;
+
+/* Metadata of a line, defined when the line is closed */
+struct rbtty_line_meta {
+  uint64_t timestamp;
+  uint16_t channel;
+  uint8_t level; /* enum rbtty_level */
+};
+
+/* A line is a contiguous range of the char arena and a contiguous range of
+ * the span arena. Positions are logical, i.e. they grow monotonically and are
+ * mapped into their arena modulo its capacity. They are shifted back by a
+ * multiple of the capacity once they exceed RBTTY_SCROLLBACK_MAX_POSITION */
+struct rbtty_line {
+  uint32_t begin;
+  uint32_t length;
+  uint32_t spans_begin;
+  uint32_t spans_count;
+  struct rbtty_line_meta meta;
+};
+
+/* Scrollback storage. The characters of all the lines are stored in a flat
+ * arena used as a ring buffer; their attributes are run-length encoded in a
+ * second ring of spans. Both are indexed by a ring of line descriptors. The
+ * last line is always the open one, i.e. the line into which the output is
+ * appended. When an arena or the line ring is full, the oldest lines are
+ * evicted, into the cold tier if any. The cold lines precede the other ones
+ * and are accessed through the same functions */
+struct rbtty_scrollback {
+  /* Arenas */
+  wchar_t* chars;
+  size_t chars_capacity;
+  struct rbtty_span* spans;
+  size_t spans_capacity;
+  /* Ring of line descriptors */
+  struct rbtty_line* lines;
+  size_t lines_capacity;
+  size_t lines_first; /* Ring slot of the oldest line */
+  size_t lines_count; /* Number of lines, open line included */
+  size_t lines_id; /* Absolute identifier of the oldest line */
+  struct rbtty_cold* cold; /* NULL <=> no cold tier */
+#ifdef RBTTY_ENABLE_STATS
+  /* Statistics */
+  uint64_t chars_count; /* Appended chars */
+  uint64_t pushed_count; /* Closed lines */
+  uint64_t evicted_count;
+#endif
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_scrollback_init
+  (struct mem_allocator* allocator,
+   struct rbtty_scrollback* sb);
+
+extern LOCAL_SYM void
+rbtty_scrollback_shutdown
+  (struct rbtty_scrollback* sb);
+
+/* Resize the storage. The most recent lines that fit in the new one are
+ * kept, the open line being truncated if it exceeds the new char or span
+ * capacity. The char and span counts cannot exceed
+ * RBTTY_SCROLLBACK_MAX_CAPACITY and the size of the line storage must fit in
+ * a size_t. On error the storage is left unchanged. A null line count
+ * releases the storage and disables the scrollback */
+extern LOCAL_SYM enum rbtty_error
+rbtty_scrollback_storage
+  (struct rbtty_scrollback* sb,
+   const size_t lines_count,
+   const size_t chars_count,
+   const size_t spans_count);
+
+/* Keep the evicted lines in a cold tier of `max_bytes' bytes stored in the
+ * file `path', or on the heap if it is NULL. The previous cold lines are
+ * discarded. A null `max_bytes' disables the cold tier */
+extern LOCAL_SYM enum rbtty_error
+rbtty_scrollback_setup_cold
+  (struct rbtty_scrollback* sb,
+   const size_t max_bytes,
+   const char* path);
+
+extern LOCAL_SYM void
+rbtty_scrollback_clear
+  (struct rbtty_scrollback* sb);
+
+/* Replace the lines by the `lines_count' lines of `lines', the oldest one
+ * having the absolute id `lines_id', in a storage of the given capacities.
+ * `chars' are the chars of the lines from the logical position of the first
+ * one, and `spans' are their spans likewise. They are copied in bulk into
+ * the arenas at the same logical positions. The lines must fit in the
+ * storage, whose capacities are bounded as in rbtty_scrollback_storage, and
+ * the first one cannot begin past RBTTY_SCROLLBACK_MAX_POSITION. The cold
+ * lines are discarded */
+extern LOCAL_SYM enum rbtty_error
+rbtty_scrollback_restore
+  (struct rbtty_scrollback* sb,
+   const size_t lines_capacity,
+   const size_t chars_capacity,
+   const size_t spans_capacity,
+   const size_t lines_id,
+   const struct rbtty_line* lines,
+   const size_t lines_count,
+   const wchar_t* chars,
+   const size_t chars_count,
+   const struct rbtty_span* spans,
+   const size_t spans_count);
+
+/* Append `len' chars to the open line. Return the number of appended chars,
+ * which is lesser than `len' if the line reaches the arena capacity */
+extern LOCAL_SYM size_t
+rbtty_scrollback_append
+  (struct rbtty_scrollback* sb,
+   const wchar_t* str,
+   const size_t len,
+   const uint16_t attrib);
+
+/* Reserve room for up to `len' chars at the end of the open line and return
+ * the address where to write them. On return `len' is the number of chars
+ * that can actually be written. The written chars are then registered with
+ * rbtty_scrollback_commit */
+extern LOCAL_SYM wchar_t*
+rbtty_scrollback_reserve
+  (struct rbtty_scrollback* sb,
+   size_t* len,
+   const uint16_t attrib);
+
+/* Register the `len' chars written at the address returned by the previous
+ * call to rbtty_scrollback_reserve */
+extern LOCAL_SYM void
+rbtty_scrollback_commit
+  (struct rbtty_scrollback* sb,
+   const size_t len,
+   const uint16_t attrib);
+
+/* Close the open line with the metadata `meta' and open a new one with the
+ * default metadata */
+extern LOCAL_SYM void
+rbtty_scrollback_new_line
+  (struct rbtty_scrollback* sb,
+   const struct rbtty_line_meta* meta);
+
+/* Add a closed line with the metadata `meta' right before the open line.
+ * The line is truncated to the room of the arenas, its last kept span
+ * covering its remaining chars */
+extern LOCAL_SYM void
+rbtty_scrollback_insert_line
+  (struct rbtty_scrollback* sb,
+   const wchar_t* str,
+   const size_t len,
+   const struct rbtty_span* spans,
+   const size_t spans_count,
+   const struct rbtty_line_meta* meta);
+
+static FINLINE size_t
+rbtty_scrollback_cold_lines_count(const struct rbtty_scrollback* sb)
+{
+  ASSERT(sb);
+  return sb->cold ? sb->cold->lines_count : 0;
+}
+
+/* Number of lines, cold lines included */
+static FINLINE size_t
+rbtty_scrollback_lines_count(const struct rbtty_scrollback* sb)
+{
+  ASSERT(sb);
+  return rbtty_scrollback_cold_lines_count(sb) + sb->lines_count;
+}
+
+/* Return the absolute identifier of the line `id'. Absolute identifiers grow
+ * monotonically and are never reused, even after an eviction */
+static FINLINE size_t
+rbtty_scrollback_line_id(const struct rbtty_scrollback* sb, const size_t id)
+{
+  ASSERT(sb);
+  return sb->lines_id - rbtty_scrollback_cold_lines_count(sb) + id;
+}
+
+/* Return the absolute identifier of the oldest line that is not cold */
+static FINLINE size_t
+rbtty_scrollback_hot_line_id(const struct rbtty_scrollback* sb)
+{
+  ASSERT(sb);
+  return sb->lines_id;
+}
+
+/* Retrieve the line `id', 0 being the oldest line. The data of a cold line
+ * are valid until the next retrieval of a line */
+static FINLINE void
+rbtty_scrollback_get_line
+  (const struct rbtty_scrollback* sb,
+   const size_t id,
+   const wchar_t** chars,
+   size_t* len,
+   const struct rbtty_span** spans,
+   size_t* spans_count)
+{
+  const struct rbtty_line* line = NULL;
+  const size_t ncold = rbtty_scrollback_cold_lines_count(sb);
+  ASSERT(sb && chars && len && spans && spans_count);
+  ASSERT(id < ncold + sb->lines_count);
+
+  if(id < ncold) {
+    rbtty_cold_get_line(sb->cold, rbtty_scrollback_line_id(sb, id), chars,
+      len, spans, spans_count);
+    return;
+  }
+  line = sb->lines + (sb->lines_first + id - ncold) % sb->lines_capacity;
+  *chars = sb->chars + line->begin % sb->chars_capacity;
+  *len = line->length;
+  *spans = sb->spans + line->spans_begin % sb->spans_capacity;
+  *spans_count = line->spans_count;
+}
+
+/* Return the metadata of the line `id', 0 being the oldest line, or NULL if
+ * it is a cold line. The cold tier does not keep the metadata */
+static FINLINE const struct rbtty_line_meta*
+rbtty_scrollback_line_meta
+  (const struct rbtty_scrollback* sb,
+   const size_t id)
+{
+  const size_t ncold = rbtty_scrollback_cold_lines_count(sb);
+  ASSERT(sb && id < ncold + sb->lines_count);
+  if(id < ncold)
+    return NULL;
+  return &sb->lines[(sb->lines_first + id - ncold) % sb->lines_capacity].meta;
+}
+
+static FINLINE size_t
+rbtty_scrollback_line_length
+  (const struct rbtty_scrollback* sb,
+   const size_t id)
+{
+  const struct rbtty_span* spans = NULL;
+  const wchar_t* chars = NULL;
+  size_t spans_count = 0;
+  size_t len = 0;
+  rbtty_scrollback_get_line(sb, id, &chars, &len, &spans, &spans_count);
+  return len;
+}
+
+#endif /* RBTTY_SCROLLBACK_H */
+
@@ -0,0 +1,327 @@
+#include "rbtty_sgr.h"
+#include <snlsys/math.h>
+#include <string.h>
+
+/* Classes of the chars of an escape sequence */
+enum {
+  C_OTHER, /* Non ASCII char or DEL */
+  C_CTRL, /* C0 control char executed in the sequence, i.e. ignored */
+  C_ABORT, /* CAN or SUB */
+  C_BEL,
+  C_ESC,
+  C_INTER, /* Intermediate byte */
+  C_DIGIT,
+  C_SEP, /* ';' or ':' */
+  C_PRIV, /* Private marker of a control sequence */
+  C_CSI, /* '[' */
+  C_STR, /* ']', 'P', 'X', '^' or '_' */
+  C_FINAL,
+  C_COUNT
+};
+
+/* Actions of a transition */
+enum {
+  A_NONE,
+  A_CLEAR, /* Begin a control sequence */
+  A_PARAM, /* Accumulate a digit */
+  A_SEP, /* Begin a parameter */
+  A_DISPATCH /* Execute the control sequence */
+};
+
+#define T(state, action) (unsigned char)((action) << 4 | RBTTY_SGR_##state)
+#define G_ T(GROUND, A_NONE)
+#define E_ T(ESCAPE, A_NONE)
+#define EI T(ESCAPE_INTER, A_NONE)
+#define CP T(CSI_PARAM, A_NONE)
+#define CI T(CSI_IGNORE, A_NONE)
+#define S_ T(STRING, A_NONE)
+
+static const unsigned char sgr_class[128] = {
+  C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_BEL,
+  C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL,
+  C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL, C_CTRL,
+  C_ABORT, C_CTRL, C_ABORT, C_ESC, C_CTRL, C_CTRL, C_CTRL, C_CTRL,
+  C_INTER, C_INTER, C_INTER, C_INTER, C_INTER, C_INTER, C_INTER, C_INTER,
+  C_INTER, C_INTER, C_INTER, C_INTER, C_INTER, C_INTER, C_INTER, C_INTER,
+  C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT, C_DIGIT,
+  C_DIGIT, C_DIGIT, C_SEP, C_SEP, C_PRIV, C_PRIV, C_PRIV, C_PRIV,
+  C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL,
+  C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL,
+  C_STR, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL,
+  C_STR, C_FINAL, C_FINAL, C_CSI, C_FINAL, C_STR, C_STR, C_STR,
+  C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL,
+  C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL,
+  C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL,
+  C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_FINAL, C_OTHER
+};
+
+/* Transitions indexed by state and char class. The low nibble is the next
+ * state and the high one the action to perform */
+static const unsigned char
+sgr_transition[RBTTY_SGR_STATES_COUNT][C_COUNT] = {
+  /* OTHER CTRL ABORT BEL ESC INTER DIGIT SEP PRIV CSI STR FINAL */
+  { G_, G_, G_, G_, E_, G_, G_, G_, G_, G_, G_, G_ }, /* GROUND */
+  { G_, E_, G_, E_, E_, EI, G_, G_, G_,
+    T(CSI_PARAM, A_CLEAR), S_, G_ }, /* ESCAPE */
+  { G_, EI, G_, EI, E_, EI, G_, G_, G_, G_, G_, G_ }, /* ESCAPE_INTER */
+  { CI, CP, G_, CP, E_, CI, T(CSI_PARAM, A_PARAM), T(CSI_PARAM, A_SEP), CI,
+    T(GROUND, A_DISPATCH), T(GROUND, A_DISPATCH),
+    T(GROUND, A_DISPATCH) }, /* CSI_PARAM */
+  { CI, CI, G_, CI, E_, CI, CI, CI, CI, G_, G_, G_ }, /* CSI_IGNORE */
+  { S_, S_, G_, G_, E_, S_, S_, S_, S_, S_, S_, S_ } /* STRING */
+};
+
+#undef T
+#undef G_
+#undef E_
+#undef EI
+#undef CP
+#undef CI
+#undef S_
+
+/* The 16 first colors of the xterm palette */
+static const uint8_t sgr_basic_colors[16][3] = {
+  {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+  {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+  {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+  {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}
+};
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE uint8_t
+clamp_component(const uint16_t val)
+{
+  return (uint8_t)MIN(val, 255);
+}
+
+static FINLINE int
+is_subparam(const struct rbtty_sgr* sgr, const size_t i)
+{
+  return i < RBTTY_SGR_MAX_PARAMS && (sgr->subparams >> i) & 1;
+}
+
+/* Parse the color of a 38, 48 or 58 SGR whose arguments begin at the `*i'
+ * parameter, and move `*i' after them. Return 0 if the color is invalid */
+static int
+sgr_extended_color
+  (const struct rbtty_sgr* sgr,
+   size_t* i,
+   const size_t count,
+   enum rbtty_sgr_color* type,
+   uint8_t color[3])
+{
+  size_t n = 0; /* Number of arguments */
+  size_t first = 0; /* Index of the first RGB component */
+  ASSERT(sgr && i && type && color);
+
+  if(*i >= count)
+    return 0;
+  if(is_subparam(sgr, *i)) {
+    /* ISO 8613-6 form, e.g. 38:2:<colorspace>:r:g:b or 38:5:n */
+    while(*i + n < count && is_subparam(sgr, *i + n))
+      ++n;
+    first = n > 3 ? *i + n - 3 : *i; /* Skip the optional color space id */
+  } else {
+    n = sgr->params[*i] == 5 ? 2 : 4;
+    first = *i + 1;
+  }
+  if(*i + n > count)
+    return 0;
+
+  switch(sgr->params[*i]) {
+    case 5:
+      if(n < 2)
+        return 0;
+      *type = RBTTY_SGR_COLOR_INDEXED;
+      color[0] = clamp_component(sgr->params[*i + 1]);
+      break;
+    case 2:
+      if(n < 4)
+        return 0;
+      *type = RBTTY_SGR_COLOR_RGB;
+      color[0] = clamp_component(sgr->params[first + 0]);
+      color[1] = clamp_component(sgr->params[first + 1]);
+      color[2] = clamp_component(sgr->params[first + 2]);
+      break;
+    default: return 0;
+  }
+  *i += n;
+  return 1;
+}
+
+/* Execute the parsed SGR */
+static void
+sgr_dispatch(struct rbtty_sgr* sgr)
+{
+  const size_t count = sgr->iparam + 1;
+  size_t i = 0;
+
+  while(i < count) {
+    const uint16_t p = sgr->params[i++];
+    enum rbtty_sgr_color type = RBTTY_SGR_COLOR_DEFAULT;
+    uint8_t color[3] = {0, 0, 0};
+
+    if(p >= 30 && p <= 37) {
+      sgr->color_type = RBTTY_SGR_COLOR_INDEXED;
+      sgr->color[0] = (uint8_t)(p - 30);
+    } else if(p >= 90 && p <= 97) {
+      sgr->color_type = RBTTY_SGR_COLOR_INDEXED;
+      sgr->color[0] = (uint8_t)(p - 90 + 8);
+    } else {
+      switch(p) {
+        case 0:
+          sgr->color_type = RBTTY_SGR_COLOR_DEFAULT;
+          sgr->is_bold = 0;
+          break;
+        case 1: sgr->is_bold = 1; break;
+        case 22: sgr->is_bold = 0; break;
+        case 39: sgr->color_type = RBTTY_SGR_COLOR_DEFAULT; break;
+        case 38:
+          if(!sgr_extended_color(sgr, &i, count, &type, color)) {
+            i = count; /* Ignore the remaining parameters */
+          } else {
+            sgr->color_type = type;
+            memcpy(sgr->color, color, sizeof(color));
+          }
+          break;
+        case 48: /* The background and underline colors are not drawn */
+        case 58:
+          if(!sgr_extended_color(sgr, &i, count, &type, color))
+            i = count;
+          break;
+        default: /* Unsupported attribute */ break;
+      }
+    }
+  }
+  sgr->is_changed = 1;
+}
+
+/* Run the `c' char through the parser. Return 0 if the parser is in the
+ * ground state and `c' is not part of a sequence */
+static FINLINE int
+sgr_step(struct rbtty_sgr* sgr, const uint32_t c)
+{
+  const int cls = c < 128 ? sgr_class[c] : C_OTHER;
+  const unsigned char t = sgr_transition[sgr->state][cls];
+
+  if(sgr->state == RBTTY_SGR_GROUND && cls != C_ESC)
+    return 0;
+  sgr->state = (enum rbtty_sgr_state)(t & 0xF);
+  switch(t >> 4) {
+    case A_NONE: break;
+    case A_CLEAR:
+      sgr->params[0] = 0;
+      sgr->subparams = 0;
+      sgr->iparam = 0;
+      break;
+    case A_PARAM:
+      if(sgr->iparam < RBTTY_SGR_MAX_PARAMS) {
+        uint16_t* p = sgr->params + sgr->iparam;
+        *p = (uint16_t)MIN((uint32_t)*p * 10 + (c - '0'), UINT16_MAX);
+      }
+      break;
+    case A_SEP:
+      if(++sgr->iparam < RBTTY_SGR_MAX_PARAMS) {
+        sgr->params[sgr->iparam] = 0;
+        if(c == ':')
+          sgr->subparams |= 1u << sgr->iparam;
+      }
+      break;
+    case A_DISPATCH:
+      if(c == 'm') {
+        sgr->iparam = MIN(sgr->iparam, RBTTY_SGR_MAX_PARAMS - 1);
+        sgr_dispatch(sgr);
+      }
+      break;
+    default: ASSERT(0); break;
+  }
+  return 1;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_sgr functions
+ *
+ ******************************************************************************/
+#define PARSE(Type)                                                            \
+  {                                                                            \
+    size_t i = 0;                                                              \
+    ASSERT(sgr && (str || !len));                                              \
+    while(i < len) {                                                           \
+      const uint32_t c = (uint32_t)(Type)str[i];                               \
+      if(c == '\n') { /* Abort the pending sequence */                         \
+        sgr->state = RBTTY_SGR_GROUND;                                         \
+        break;                                                                 \
+      }                                                                        \
+      if(!sgr_step(sgr, c))                                                    \
+        break;                                                                 \
+      ++i;                                                                     \
+      if(sgr->state == RBTTY_SGR_GROUND)                                       \
+        break;                                                                 \
+    }                                                                          \
+    return i;                                                                  \
+  } (void)0
+
+size_t
+rbtty_sgr_parse_utf8
+  (struct rbtty_sgr* sgr,
+   const char* str,
+   const size_t len)
+{
+  PARSE(unsigned char);
+}
+
+size_t
+rbtty_sgr_parse_wstring
+  (struct rbtty_sgr* sgr,
+   const wchar_t* str,
+   const size_t len)
+{
+  PARSE(uint32_t);
+}
+
+#undef PARSE
+
+void
+rbtty_sgr_get_color
+  (const struct rbtty_sgr* sgr,
+   const float default_color[3],
+   float color[3])
+{
+  uint8_t rgb[3] = {0, 0, 0};
+  ASSERT(sgr && default_color && color);
+
+  switch(sgr->color_type) {
+    case RBTTY_SGR_COLOR_DEFAULT:
+      color[0] = default_color[0];
+      color[1] = default_color[1];
+      color[2] = default_color[2];
+      return;
+    case RBTTY_SGR_COLOR_INDEXED: {
+      const uint8_t id = sgr->color[0];
+      if(id < 16) {
+        const uint8_t basic = id < 8 && sgr->is_bold ? id + 8 : id;
+        memcpy(rgb, sgr_basic_colors[basic], sizeof(rgb));
+      } else if(id < 232) { /* 6x6x6 color cube */
+        const uint8_t levels[6] = { 0, 95, 135, 175, 215, 255 };
+        rgb[0] = levels[(id - 16) / 36];
+        rgb[1] = levels[(id - 16) / 6 % 6];
+        rgb[2] = levels[(id - 16) % 6];
+      } else { /* Gray ramp */
+        rgb[0] = rgb[1] = rgb[2] = (uint8_t)(8 + (id - 232) * 10);
+      }
+    } break;
+    case RBTTY_SGR_COLOR_RGB:
+      memcpy(rgb, sgr->color, sizeof(rgb));
+      break;
+    default: ASSERT(0); break;
+  }
+  color[0] = (float)rgb[0] / 255.f;
+  color[1] = (float)rgb[1] / 255.f;
+  color[2] = (float)rgb[2] / 255.f;
+}
+
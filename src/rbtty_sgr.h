@@ -0,0 +1,93 @@
+#ifndef RBTTY_SGR_H
+#define RBTTY_SGR_H
+
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+#define RBTTY_SGR_ESC 0x1B
+/* Maximum number of parameters of a control sequence. The following ones are
+ * ignored */
+#define RBTTY_SGR_MAX_PARAMS 32
+
+enum rbtty_sgr_state {
+  RBTTY_SGR_GROUND, /* Text */
+  RBTTY_SGR_ESCAPE,
+  RBTTY_SGR_ESCAPE_INTER, /* Intermediate bytes of an escape sequence */
+  RBTTY_SGR_CSI_PARAM,
+  RBTTY_SGR_CSI_IGNORE, /* Control sequence that is not a SGR */
+  RBTTY_SGR_STRING, /* OSC, DCS, SOS, PM or APC string */
+  RBTTY_SGR_STATES_COUNT
+};
+
+enum rbtty_sgr_color {
+  RBTTY_SGR_COLOR_DEFAULT,
+  RBTTY_SGR_COLOR_INDEXED, /* One of the 256 colors of the xterm palette */
+  RBTTY_SGR_COLOR_RGB
+};
+
+/* Streaming parser of the ANSI escape sequences of a text. The Select
+ * Graphic Rendition control sequences define the foreground color and the
+ * bold flag of the following text; the other sequences are skipped. A
+ * sequence may be split across several calls to rbtty_sgr_parse_<utf8|
+ * wstring> */
+struct rbtty_sgr {
+  enum rbtty_sgr_state state;
+  uint16_t params[RBTTY_SGR_MAX_PARAMS];
+  uint32_t subparams; /* Bit i is set <=> params[i] follows a colon */
+  size_t iparam; /* Index of the parameter being parsed */
+  /* Graphic rendition */
+  enum rbtty_sgr_color color_type;
+  uint8_t color[3]; /* RGB components, or color index in color[0] */
+  int is_bold;
+  int is_changed; /* The graphic rendition was set */
+};
+
+static FINLINE void
+rbtty_sgr_init(struct rbtty_sgr* sgr)
+{
+  ASSERT(sgr);
+  sgr->state = RBTTY_SGR_GROUND;
+  sgr->subparams = 0;
+  sgr->iparam = 0;
+  sgr->color_type = RBTTY_SGR_COLOR_DEFAULT;
+  sgr->color[0] = sgr->color[1] = sgr->color[2] = 0;
+  sgr->is_bold = 0;
+  sgr->is_changed = 0;
+}
+
+/* Return 1 if no escape sequence is pending */
+static FINLINE int
+rbtty_sgr_is_ground(const struct rbtty_sgr* sgr)
+{
+  ASSERT(sgr);
+  return sgr->state == RBTTY_SGR_GROUND;
+}
+
+/* Parse the escape sequence starting at the first of the `len' bytes of
+ * `str', or pending from a previous call, and return the number of consumed
+ * bytes. The parsing stops at the end of the sequence or before a new line,
+ * which aborts it */
+extern LOCAL_SYM size_t
+rbtty_sgr_parse_utf8
+  (struct rbtty_sgr* sgr,
+   const char* str,
+   const size_t len);
+
+/* Wide char variant of rbtty_sgr_parse_utf8 */
+extern LOCAL_SYM size_t
+rbtty_sgr_parse_wstring
+  (struct rbtty_sgr* sgr,
+   const wchar_t* str,
+   const size_t len);
+
+/* Compute the color of the text from its graphic rendition. `default_color'
+ * is the color of the text whose color is not set. The bold text is drawn
+ * with the bright variant of the 8 basic colors */
+extern LOCAL_SYM void
+rbtty_sgr_get_color
+  (const struct rbtty_sgr* sgr,
+   const float default_color[3],
+   float color[3]);
+
+#endif /* RBTTY_SGR_H */
+
@@ -0,0 +1,550 @@
+#define _POSIX_C_SOURCE 200112L /* open, mmap, getpid */
+
+#include "rbtty_screen.h"
+#include "rbtty_snapshot.h"
+#include <sl/sl_vector.h>
+#include <sl/sl_wstring.h>
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_MAGIC "RBTTYSNP"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define SNAPSHOT_ALIGNMENT 8
+
+/* The file is written in the native byte order and stores the scrollback
+ * data as they are laid out in memory, so that they are copied without being
+ * converted. A snapshot is thus only read by builds with the same size of
+ * wchar_t and size_t. The header is followed by sections aligned on
+ * SNAPSHOT_ALIGNMENT bytes: the attributes, the line descriptors, the chars
+ * and the spans of the scrollback, the chars and the spans of the prompt,
+ * the chars and the attributes of the command, and the lengths and the
+ * chars of the history commands */
+struct file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t wchar_size;
+  uint32_t size_size;
+  /* Scrollback */
+  uint64_t lines_capacity;
+  uint64_t chars_capacity;
+  uint64_t spans_capacity;
+  uint64_t lines_count;
+  uint64_t lines_id; /* Absolute id of the oldest line */
+  uint64_t chars_count; /* From the logical position of the oldest line */
+  uint64_t spans_count; /* Likewise */
+  uint64_t scroll_id;
+  uint64_t scroll_row;
+  /* Palette */
+  uint64_t attribs_count;
+  uint32_t cmdout_attrib;
+  uint32_t notice_attrib;
+  /* Command buffer */
+  uint64_t prompt_len;
+  uint64_t prompt_spans_count;
+  uint64_t cmd_len;
+  uint64_t cmd_cursor;
+  /* History */
+  uint64_t history_capacity;
+  uint64_t history_count;
+  uint64_t history_chars_count;
+};
+
+struct writer {
+  FILE* stream;
+  uint64_t offset;
+  int is_ok;
+};
+
+struct reader {
+  const char* data;
+  size_t size;
+  size_t offset;
+};
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static void
+write_data(struct writer* writer, const void* data, const size_t size)
+{
+  ASSERT(writer && (data || !size));
+  if(writer->is_ok && size && fwrite(data, size, 1, writer->stream) != 1)
+    writer->is_ok = 0;
+  writer->offset += size;
+}
+
+static void
+write_padding(struct writer* writer)
+{
+  static const char zeros[SNAPSHOT_ALIGNMENT];
+  ASSERT(writer);
+  write_data(writer, zeros,
+    (SNAPSHOT_ALIGNMENT - writer->offset % SNAPSHOT_ALIGNMENT)
+    % SNAPSHOT_ALIGNMENT);
+}
+
+/* Write the `count' elements of `ring' from the logical position `begin' */
+static void
+write_ring
+  (struct writer* writer,
+   const void* ring,
+   const size_t capacity,
+   const size_t size,
+   const size_t begin,
+   const size_t count)
+{
+  size_t offset = 0;
+  size_t n = 0;
+  ASSERT(writer && count <= capacity);
+  if(!count)
+    return;
+  offset = begin % capacity;
+  n = MIN(count, capacity - offset);
+  write_data(writer, (const char*)ring + offset * size, n * size);
+  write_data(writer, ring, (count - n) * size);
+}
+
+/* Return the address of the next section of `count' elements of `size'
+ * bytes, or NULL if the file is too small */
+static const void*
+read_section(struct reader* reader, const uint64_t count, const size_t size)
+{
+  const void* section = NULL;
+  size_t n = 0;
+  ASSERT(reader && size);
+
+  if(count > SIZE_MAX / size)
+    return NULL;
+  n = (size_t)count * size;
+  if(n > reader->size - reader->offset)
+    return NULL;
+  section = reader->data + reader->offset;
+  reader->offset += n;
+  reader->offset +=
+    (SNAPSHOT_ALIGNMENT - reader->offset % SNAPSHOT_ALIGNMENT)
+    % SNAPSHOT_ALIGNMENT;
+  reader->offset = MIN(reader->offset, reader->size);
+  return section;
+}
+
+/* Map the whole `path' file in read only */
+static enum rbtty_error
+map_file(const char* path, void** data, size_t* size)
+{
+  struct stat st;
+  int fd = -1;
+  ASSERT(path && data && size);
+
+  *data = NULL;
+  *size = 0;
+  fd = open(path, O_RDONLY);
+  if(fd < 0)
+    return RBTTY_INVALID_ARGUMENT;
+  if(fstat(fd, &st) || st.st_size < 0) {
+    close(fd);
+    return RBTTY_UNKNOWN_ERROR;
+  }
+  if(st.st_size) {
+    void* mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(mem == MAP_FAILED) {
+      close(fd);
+      return RBTTY_UNKNOWN_ERROR;
+    }
+    *data = mem;
+    *size = (size_t)st.st_size;
+  }
+  close(fd);
+  return RBTTY_NO_ERROR;
+}
+
+/* Check that the lines lie in the arenas in order, without crossing their
+ * boundaries, and that their spans lie in their chars. The lines are only
+ * bounds checked; their content is not parsed */
+static int
+check_lines
+  (const struct file_header* header,
+   const struct rbtty_line* lines,
+   const struct rbtty_span* spans)
+{
+  size_t chars_end = 0;
+  size_t spans_end = 0;
+  ASSERT(header && (lines || !header->lines_count));
+
+  if(!header->lines_capacity) {
+    return !header->lines_count && !header->chars_count
+        && !header->spans_count;
+  }
+  if(header->lines_capacity < 2 || !header->chars_capacity
+  || !header->spans_capacity
+  || !header->lines_count || header->lines_count > header->lines_capacity
+  || header->chars_count > header->chars_capacity
+  || header->spans_count > header->spans_capacity
+  /* The logical positions keep growing from the restored ones */
+  || lines[0].begin > RBTTY_SCROLLBACK_MAX_POSITION
+  || lines[0].spans_begin > RBTTY_SCROLLBACK_MAX_POSITION)
+    return 0;
+
+  chars_end = lines[0].begin;
+  spans_end = lines[0].spans_begin;
+  FOR_EACH(size_t, i, 0, (size_t)header->lines_count) {
+    const struct rbtty_line* line = lines + i;
+    const struct rbtty_span* line_spans = NULL;
+    if(line->begin < chars_end || line->spans_begin < spans_end
+    || line->begin - lines[0].begin > header->chars_count
+    || line->length > header->chars_count - (line->begin - lines[0].begin)
+    || line->spans_begin - lines[0].spans_begin > header->spans_count
+    || line->spans_count
+       > header->spans_count - (line->spans_begin - lines[0].spans_begin)
+    || line->begin % header->chars_capacity + line->length
+       > header->chars_capacity
+    || line->spans_begin % header->spans_capacity + line->spans_count
+       > header->spans_capacity
+    || line->meta.level > RBTTY_LEVEL_ERROR)
+      return 0;
+    line_spans = spans + (line->spans_begin - lines[0].spans_begin);
+    FOR_EACH(size_t, j, 0, line->spans_count) {
+      if(line_spans[j].attrib >= header->attribs_count
+      || line_spans[j].start > line->length
+      || line_spans[j].length > line->length - line_spans[j].start)
+        return 0;
+    }
+    chars_end = line->begin + line->length;
+    spans_end = line->spans_begin + line->spans_count;
+  }
+  return 1;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_snapshot functions
+ *
+ ******************************************************************************/
+enum rbtty_error
+rbtty_snapshot_save(struct rbtty_screen* scr, const char* path)
+{
+  struct file_header header;
+  struct writer writer;
+  const struct rbtty_scrollback* sb = NULL;
+  const struct rbtty_history* history = NULL;
+  const struct rbtty_cmdline* cmdline = NULL;
+  const struct rbtty_line* first = NULL;
+  const wchar_t* prompt = NULL;
+  void* prompt_spans = NULL;
+  char* tmp_path = NULL;
+  size_t plen = 0;
+  size_t pspans_count = 0;
+  int len = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && path);
+
+  sb = &scr->scrollback;
+  history = &scr->history;
+  cmdline = &scr->cmdline;
+  writer.stream = NULL;
+
+  /* Write a temporary file renamed once complete so that the previous
+   * snapshot is kept if the write fails */
+  len = snprintf(NULL, 0, "%s.%ld.tmp", path, (long)getpid());
+  if(len < 0) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto error;
+  }
+  tmp_path = MEM_ALLOC(scr->allocator, (size_t)len + 1);
+  if(!tmp_path) {
+    rbtty_err = RBTTY_MEMORY_ERROR;
+    goto error;
+  }
+  snprintf(tmp_path, (size_t)len + 1, "%s.%ld.tmp", path, (long)getpid());
+  writer.stream = fopen(tmp_path, "wb");
+  if(!writer.stream) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto error;
+  }
+  writer.offset = 0;
+  writer.is_ok = 1;
+
+  SL(wstring_get(scr->prompt.string, &prompt));
+  SL(wstring_length(scr->prompt.string, &plen));
+  SL(vector_buffer
+    (scr->prompt.spans, &pspans_count, NULL, NULL, &prompt_spans));
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = RBTTY_SNAPSHOT_VERSION;
+  header.byte_order = SNAPSHOT_BYTE_ORDER;
+  header.wchar_size = (uint32_t)sizeof(wchar_t);
+  header.size_size = (uint32_t)sizeof(size_t);
+  header.lines_capacity = sb->lines_capacity;
+  header.chars_capacity = sb->chars_capacity;
+  header.spans_capacity = sb->spans_capacity;
+  header.lines_count = sb->lines_count;
+  header.lines_id = sb->lines_id;
+  if(sb->lines_count) {
+    const struct rbtty_line* open = sb->lines
+      + (sb->lines_first + sb->lines_count - 1) % sb->lines_capacity;
+    first = sb->lines + sb->lines_first;
+    header.chars_count = open->begin + open->length - first->begin;
+    header.spans_count =
+      open->spans_begin + open->spans_count - first->spans_begin;
+  }
+  header.scroll_id = scr->scroll_id;
+  header.scroll_row = scr->scroll_row;
+  header.attribs_count = scr->palette.count;
+  header.cmdout_attrib = scr->cmdout_attrib;
+  header.notice_attrib = scr->notice_attrib;
+  header.prompt_len = plen;
+  header.prompt_spans_count = pspans_count;
+  header.cmd_len = rbtty_cmdline_length(cmdline);
+  header.cmd_cursor = rbtty_cmdline_cursor(cmdline);
+  header.history_capacity = history->capacity;
+  FOR_EACH(size_t, id, history->first, history->end) {
+    const struct rbtty_history_entry* entry = rbtty_history_get(history, id);
+    if(entry) {
+      ++header.history_count;
+      header.history_chars_count += entry->len;
+    }
+  }
+
+  write_data(&writer, &header, sizeof(header));
+  write_padding(&writer);
+  write_data(&writer, scr->palette.attribs,
+    scr->palette.count * sizeof(struct rbtty_attrib));
+  write_padding(&writer);
+  if(first) {
+    write_ring(&writer, sb->lines, sb->lines_capacity,
+      sizeof(struct rbtty_line), sb->lines_first, sb->lines_count);
+    write_padding(&writer);
+    write_ring(&writer, sb->chars, sb->chars_capacity, sizeof(wchar_t),
+      first->begin, (size_t)header.chars_count);
+    write_padding(&writer);
+    write_ring(&writer, sb->spans, sb->spans_capacity,
+      sizeof(struct rbtty_span), first->spans_begin,
+      (size_t)header.spans_count);
+    write_padding(&writer);
+  }
+  write_data(&writer, prompt, plen * sizeof(wchar_t));
+  write_padding(&writer);
+  write_data(&writer, prompt_spans, pspans_count * sizeof(struct rbtty_span));
+  write_padding(&writer);
+  /* The command is stored around the gap of the command line */
+  write_data(&writer, cmdline->chars, cmdline->gap_begin * sizeof(wchar_t));
+  write_data(&writer, cmdline->chars + cmdline->gap_end,
+    (cmdline->capacity - cmdline->gap_end) * sizeof(wchar_t));
+  write_padding(&writer);
+  write_data(&writer, cmdline->attribs, cmdline->gap_begin*sizeof(uint16_t));
+  write_data(&writer, cmdline->attribs + cmdline->gap_end,
+    (cmdline->capacity - cmdline->gap_end) * sizeof(uint16_t));
+  write_padding(&writer);
+  FOR_EACH(size_t, id, history->first, history->end) {
+    const struct rbtty_history_entry* entry = rbtty_history_get(history, id);
+    if(entry) {
+      const uint64_t entry_len = entry->len;
+      write_data(&writer, &entry_len, sizeof(entry_len));
+    }
+  }
+  write_padding(&writer);
+  FOR_EACH(size_t, id, history->first, history->end) {
+    const struct rbtty_history_entry* entry = rbtty_history_get(history, id);
+    if(entry)
+      write_data(&writer, entry->chars, entry->len * sizeof(wchar_t));
+  }
+  write_padding(&writer);
+
+  rbtty_err = RBTTY_UNKNOWN_ERROR;
+  if(!writer.is_ok)
+    goto error;
+  if(fclose(writer.stream)) {
+    writer.stream = NULL;
+    goto error;
+  }
+  writer.stream = NULL;
+  if(rename(tmp_path, path))
+    goto error;
+  rbtty_err = RBTTY_NO_ERROR;
+
+exit:
+  if(tmp_path)
+    MEM_FREE(scr->allocator, tmp_path);
+  return rbtty_err;
+error:
+  if(writer.stream)
+    fclose(writer.stream);
+  if(tmp_path)
+    remove(tmp_path);
+  goto exit;
+}
+
+enum rbtty_error
+rbtty_snapshot_load(struct rbtty_screen* scr, const char* path)
+{
+  struct rbtty_palette palette;
+  struct rbtty_history history;
+  struct reader reader;
+  const struct file_header* header = NULL;
+  const struct rbtty_attrib* attribs = NULL;
+  const struct rbtty_line* lines = NULL;
+  const wchar_t* chars = NULL;
+  const struct rbtty_span* spans = NULL;
+  const wchar_t* prompt = NULL;
+  const struct rbtty_span* pspans = NULL;
+  const wchar_t* cmd = NULL;
+  const uint16_t* cmd_attribs = NULL;
+  const uint64_t* lens = NULL;
+  const wchar_t* hchars = NULL;
+  void* data = NULL;
+  size_t size = 0;
+  size_t pos = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  ASSERT(scr && path);
+
+  rbtty_palette_init(scr->allocator, &palette);
+  rbtty_history_init(scr->allocator, &history);
+
+  rbtty_err = map_file(path, &data, &size);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+  /* Validate the header */
+  rbtty_err = RBTTY_UNKNOWN_ERROR;
+  if(size < sizeof(struct file_header))
+    goto error;
+  header = data;
+  if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic))
+  || header->version != RBTTY_SNAPSHOT_VERSION
+  || header->byte_order != SNAPSHOT_BYTE_ORDER
+  || header->wchar_size != sizeof(wchar_t)
+  || header->size_size != sizeof(size_t)
+  || header->attribs_count > RBTTY_PALETTE_MAX_COUNT
+  || header->cmdout_attrib >= header->attribs_count
+  || header->notice_attrib >= header->attribs_count
+  || header->cmd_cursor > header->cmd_len
+  || header->history_count > header->history_capacity)
+    goto error;
+  /* The storages are allocated with the saved capacities */
+  if(header->lines_capacity > SIZE_MAX / sizeof(struct rbtty_line)
+  || header->chars_capacity > SIZE_MAX / sizeof(wchar_t)
+  || header->spans_capacity > SIZE_MAX / sizeof(struct rbtty_span)
+  || header->history_capacity > SIZE_MAX / sizeof(struct rbtty_history_entry)) {
+    rbtty_err = RBTTY_INVALID_ARGUMENT;
+    goto error;
+  }
+
+  /* Locate the sections */
+  reader.data = data;
+  reader.size = size;
+  reader.offset = sizeof(struct file_header);
+  #define READ(section, count, type)                                           \
+    {                                                                          \
+      section = read_section(&reader, header->count, sizeof(type));            \
+      if(!section)                                                             \
+        goto error;                                                            \
+    } (void) 0
+  READ(attribs, attribs_count, struct rbtty_attrib);
+  if(header->lines_capacity) {
+    READ(lines, lines_count, struct rbtty_line);
+    READ(chars, chars_count, wchar_t);
+    READ(spans, spans_count, struct rbtty_span);
+  }
+  READ(prompt, prompt_len, wchar_t);
+  READ(pspans, prompt_spans_count, struct rbtty_span);
+  READ(cmd, cmd_len, wchar_t);
+  READ(cmd_attribs, cmd_len, uint16_t);
+  READ(lens, history_count, uint64_t);
+  READ(hchars, history_chars_count, wchar_t);
+  #undef READ
+
+  /* Validate the sections */
+  if(!check_lines(header, lines, spans))
+    goto error;
+  FOR_EACH(size_t, i, 0, (size_t)header->prompt_spans_count) {
+    if(pspans[i].start != pos || pspans[i].attrib >= header->attribs_count
+    || pspans[i].length > header->prompt_len - pos)
+      goto error;
+    pos += pspans[i].length;
+  }
+  if(pos != header->prompt_len)
+    goto error;
+  FOR_EACH(size_t, i, 0, (size_t)header->cmd_len) {
+    if(cmd_attribs[i] >= header->attribs_count)
+      goto error;
+  }
+  pos = 0;
+  FOR_EACH(size_t, i, 0, (size_t)header->history_count) {
+    if(lens[i] > header->history_chars_count - pos)
+      goto error;
+    pos += (size_t)lens[i];
+  }
+
+  /* The attributes are registered in order and thus keep their id */
+  FOR_EACH(size_t, i, 0, (size_t)header->attribs_count) {
+    uint16_t id = 0;
+    rbtty_err = rbtty_palette_register(&palette, attribs + i, &id);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      goto error;
+    if(id != i) { /* Duplicated attribute */
+      rbtty_err = RBTTY_UNKNOWN_ERROR;
+      goto error;
+    }
+  }
+  rbtty_err = rbtty_history_setup(&history, (size_t)header->history_capacity);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+  pos = 0;
+  FOR_EACH(size_t, i, 0, (size_t)header->history_count) {
+    rbtty_err = rbtty_history_push(&history, hchars + pos, (size_t)lens[i]);
+    if(rbtty_err != RBTTY_NO_ERROR)
+      goto error;
+    pos += (size_t)lens[i];
+  }
+  rbtty_err = rbtty_scrollback_restore(&scr->scrollback,
+    (size_t)header->lines_capacity, (size_t)header->chars_capacity,
+    (size_t)header->spans_capacity, (size_t)header->lines_id,
+    lines, (size_t)header->lines_count,
+    chars, (size_t)header->chars_count,
+    spans, (size_t)header->spans_count);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+  /* Adopt the restored palette and history */
+  rbtty_palette_shutdown(&scr->palette);
+  scr->palette = palette;
+  rbtty_palette_init(scr->allocator, &palette);
+  rbtty_history_shutdown(&scr->history);
+  scr->history = history;
+  rbtty_history_init(scr->allocator, &history);
+
+  scr->cmdout_attrib = (uint16_t)header->cmdout_attrib;
+  scr->notice_attrib = (uint16_t)header->notice_attrib;
+  scr->scroll_id = (size_t)header->scroll_id;
+  scr->scroll_row = (size_t)header->scroll_row;
+  rbtty_utf8_decoder_init(&scr->utf8);
+  rbtty_sgr_init(&scr->sgr);
+  scr->dirty_line = 0;
+  rbtty_err = rbtty_screen_rebuild_views(scr);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+  rbtty_err = rbtty_screen_set_cmdbuf(scr, prompt,
+    (size_t)header->prompt_len, pspans, (size_t)header->prompt_spans_count,
+    cmd, cmd_attribs, (size_t)header->cmd_len, (size_t)header->cmd_cursor);
+  if(rbtty_err != RBTTY_NO_ERROR)
+    goto error;
+
+exit:
+  if(data)
+    munmap(data, size);
+  rbtty_palette_shutdown(&palette);
+  rbtty_history_shutdown(&history);
+  return rbtty_err;
+error:
+  goto exit;
+}
+
@@ -0,0 +1,34 @@
+#ifndef RBTTY_SNAPSHOT_H
+#define RBTTY_SNAPSHOT_H
+
+#include "rbtty_error.h"
+#include <snlsys/snlsys.h>
+
+/* Bump it whenever the layout of the file changes */
+#define RBTTY_SNAPSHOT_VERSION 3
+
+struct rbtty_screen;
+
+/* Write the state of `screen' into the snapshot file `path', i.e. the lines
+ * of its scrollback and their attributes, its prompt and command line, its
+ * history and its scroll position. The cold lines are not saved. The file
+ * is replaced atomically */
+extern LOCAL_SYM enum rbtty_error
+rbtty_snapshot_save
+  (struct rbtty_screen* screen,
+   const char* path);
+
+/* Restore the state of `screen' from the snapshot file `path'. The file is
+ * mapped and its scrollback arenas are copied in bulk; the scrollback takes
+ * the capacities it was saved with and its views are populated again from
+ * the restored lines. On error the screen is left unchanged, except if the
+ * views cannot be populated, in which case they are emptied, or if the
+ * prompt or the command line cannot be restored, in which case they are
+ * cleared */
+extern LOCAL_SYM enum rbtty_error
+rbtty_snapshot_load
+  (struct rbtty_screen* screen,
+   const char* path);
+
+#endif /* RBTTY_SNAPSHOT_H */
+
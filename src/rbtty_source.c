@@ -0,0 +1,103 @@
+#define _POSIX_C_SOURCE 200112L /* fcntl, read */
+
+#include "rbtty_source.h"
+#include <snlsys/mem_allocator.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/*******************************************************************************
+ *
+ * rbtty_source functions
+ *
+ ******************************************************************************/
+void
+rbtty_source_init(struct mem_allocator* allocator, struct rbtty_source* src)
+{
+  ASSERT(allocator && src);
+  memset(src, 0, sizeof(struct rbtty_source));
+  src->allocator = allocator;
+  src->fd = -1;
+}
+
+void
+rbtty_source_shutdown(struct rbtty_source* src)
+{
+  ASSERT(src);
+  rbtty_source_detach(src);
+  if(src->buffer)
+    MEM_FREE(src->allocator, src->buffer);
+  src->buffer = NULL;
+  src->buffer_size = 0;
+}
+
+enum rbtty_error
+rbtty_source_attach
+  (struct rbtty_source* src,
+   const int fd,
+   const struct rbtty_fd_options* options)
+{
+  size_t size = 0;
+  int flags = 0;
+  ASSERT(src && fd >= 0 && options);
+
+  rbtty_source_detach(src);
+
+  size = options->buffer_size
+    ? options->buffer_size : RBTTY_SOURCE_DEFAULT_BUFFER_SIZE;
+  if(size != src->buffer_size) {
+    char* buffer = MEM_REALLOC(src->allocator, src->buffer, size);
+    if(!buffer)
+      return RBTTY_MEMORY_ERROR;
+    src->buffer = buffer;
+    src->buffer_size = size;
+  }
+  flags = fcntl(fd, F_GETFL);
+  if(flags < 0)
+    return RBTTY_INVALID_ARGUMENT;
+  if(!(flags & O_NONBLOCK) && fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    return RBTTY_UNKNOWN_ERROR;
+  src->fd = fd;
+  src->fd_flags = flags;
+  src->options = *options;
+  return RBTTY_NO_ERROR;
+}
+
+void
+rbtty_source_detach(struct rbtty_source* src)
+{
+  ASSERT(src);
+  if(src->fd < 0)
+    return;
+  if(src->options.close_fd) {
+    close(src->fd);
+  } else if(!(src->fd_flags & O_NONBLOCK)) {
+    fcntl(src->fd, F_SETFL, src->fd_flags);
+  }
+  src->fd = -1;
+}
+
+enum rbtty_source_status
+rbtty_source_read(struct rbtty_source* src, size_t* len)
+{
+  ssize_t n = 0;
+  ASSERT(src && src->fd >= 0 && len);
+
+  do {
+    n = read(src->fd, src->buffer, src->buffer_size);
+  } while(n < 0 && errno == EINTR);
+
+  if(n > 0) {
+    *len = (size_t)n;
+    return RBTTY_SOURCE_DATA;
+  }
+  if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return RBTTY_SOURCE_AGAIN;
+  /* The end of a growing file is the end of what was written so far */
+  if(n == 0 && src->options.follow)
+    return RBTTY_SOURCE_AGAIN;
+  /* The end of the stream. A pty whose slave side is closed fails with EIO */
+  return RBTTY_SOURCE_END;
+}
+
@@ -0,0 +1,65 @@
+#ifndef RBTTY_SOURCE_H
+#define RBTTY_SOURCE_H
+
+#include "rbtty.h"
+#include <snlsys/snlsys.h>
+
+/* Default size in bytes of the read buffer of a source */
+#define RBTTY_SOURCE_DEFAULT_BUFFER_SIZE (64 * 1024)
+
+struct mem_allocator;
+
+enum rbtty_source_status {
+  RBTTY_SOURCE_DATA, /* Bytes were read */
+  RBTTY_SOURCE_AGAIN, /* No byte is available yet */
+  RBTTY_SOURCE_END /* End of the stream or read error */
+};
+
+/* File descriptor read without blocking by the tty */
+struct rbtty_source {
+  int fd; /* -1 <=> detached */
+  int fd_flags; /* Status flags of the fd before it was attached */
+  struct rbtty_fd_options options;
+  char* buffer;
+  size_t buffer_size;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_source_init
+  (struct mem_allocator* allocator,
+   struct rbtty_source* src);
+
+extern LOCAL_SYM void
+rbtty_source_shutdown
+  (struct rbtty_source* src);
+
+/* Detach the previous fd, if any, and switch `fd' to the non blocking mode */
+extern LOCAL_SYM enum rbtty_error
+rbtty_source_attach
+  (struct rbtty_source* src,
+   const int fd,
+   const struct rbtty_fd_options* options);
+
+/* Restore the status flags of the fd, or close it, and forget it */
+extern LOCAL_SYM void
+rbtty_source_detach
+  (struct rbtty_source* src);
+
+static FINLINE int
+rbtty_source_is_attached(const struct rbtty_source* src)
+{
+  ASSERT(src);
+  return src->fd >= 0;
+}
+
+/* Read at most the buffer size. On RBTTY_SOURCE_DATA, `len' is the number of
+ * bytes read into the buffer of the source */
+extern LOCAL_SYM enum rbtty_source_status
+rbtty_source_read
+  (struct rbtty_source* src,
+   size_t* len);
+
+#endif /* RBTTY_SOURCE_H */
+
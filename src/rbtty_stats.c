@@ -0,0 +1,211 @@
+#define _POSIX_C_SOURCE 200112L /* clock_gettime */
+
+#include "rbtty_stats.h"
+#include <snlsys/math.h>
+#include <string.h>
+#include <time.h>
+
+/* Size of the header storing the size of an allocation in front of it. It
+ * keeps the alignment of the allocations */
+#define HEADER_SIZE 16
+
+struct header {
+  size_t size;
+  size_t offset; /* From the address returned by the proxied allocator */
+};
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE struct header*
+get_header(void* mem)
+{
+  return (struct header*)((char*)mem - HEADER_SIZE);
+}
+
+/* Register the `size' bytes allocated at `base' and return the memory
+ * following their header */
+static void*
+counter_register
+  (struct rbtty_mem_counter* counter,
+   void* base,
+   const size_t offset,
+   const size_t size)
+{
+  struct header* header = NULL;
+  void* mem = NULL;
+  if(!base)
+    return NULL;
+  mem = (char*)base + offset;
+  header = get_header(mem);
+  header->size = size;
+  header->offset = offset;
+  __atomic_add_fetch(&counter->allocs_count, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&counter->size, size, __ATOMIC_RELAXED);
+  return mem;
+}
+
+static void*
+counter_alloc
+  (void* data,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  struct rbtty_mem_counter* counter = data;
+  if(size > SIZE_MAX - HEADER_SIZE)
+    return NULL;
+  return counter_register(counter, counter->proxied->alloc
+    (counter->proxied->data, size + HEADER_SIZE, filename, fileline),
+    HEADER_SIZE, size);
+}
+
+static void*
+counter_calloc
+  (void* data,
+   const size_t nbelmts,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  struct rbtty_mem_counter* counter = data;
+  if(size && nbelmts > (SIZE_MAX - HEADER_SIZE) / size)
+    return NULL;
+  return counter_register(counter, counter->proxied->calloc
+    (counter->proxied->data, 1, nbelmts*size + HEADER_SIZE, filename,
+     fileline),
+    HEADER_SIZE, nbelmts*size);
+}
+
+static void*
+counter_aligned_alloc
+  (void* data,
+   const size_t size,
+   const size_t alignment,
+   const char* filename,
+   const unsigned int fileline)
+{
+  struct rbtty_mem_counter* counter = data;
+  const size_t offset = alignment > HEADER_SIZE ? alignment : HEADER_SIZE;
+  if(size > SIZE_MAX - offset)
+    return NULL;
+  return counter_register(counter, counter->proxied->aligned_alloc
+    (counter->proxied->data, size + offset, alignment, filename, fileline),
+    offset, size);
+}
+
+static void
+counter_free(void* data, void* mem)
+{
+  struct rbtty_mem_counter* counter = data;
+  struct header* header = NULL;
+  if(!mem)
+    return;
+  header = get_header(mem);
+  __atomic_add_fetch(&counter->frees_count, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&counter->size, header->size, __ATOMIC_RELAXED);
+  counter->proxied->free(counter->proxied->data, (char*)mem - header->offset);
+}
+
+static void*
+counter_realloc
+  (void* data,
+   void* mem,
+   const size_t size,
+   const char* filename,
+   const unsigned int fileline)
+{
+  struct rbtty_mem_counter* counter = data;
+  struct header* header = NULL;
+  size_t prev_size = 0;
+  void* base = NULL;
+
+  if(!mem)
+    return counter_alloc(data, size, filename, fileline);
+  if(!size) {
+    counter_free(data, mem);
+    return NULL;
+  }
+  header = get_header(mem);
+  prev_size = header->size;
+  if(header->offset != HEADER_SIZE) { /* Aligned allocation */
+    void* dst = counter_alloc(data, size, filename, fileline);
+    if(dst) {
+      memcpy(dst, mem, prev_size < size ? prev_size : size);
+      counter_free(data, mem);
+    }
+    return dst;
+  }
+  if(size > SIZE_MAX - HEADER_SIZE)
+    return NULL;
+  base = counter->proxied->realloc(counter->proxied->data,
+    (char*)mem - HEADER_SIZE, size + HEADER_SIZE, filename, fileline);
+  if(!base)
+    return NULL;
+  mem = (char*)base + HEADER_SIZE;
+  get_header(mem)->size = size;
+  __atomic_add_fetch(&counter->size, size, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&counter->size, prev_size, __ATOMIC_RELAXED);
+  return mem;
+}
+
+static size_t
+counter_allocated_size(const void* data)
+{
+  const struct rbtty_mem_counter* counter = data;
+  return __atomic_load_n(&counter->size, __ATOMIC_RELAXED);
+}
+
+static size_t
+counter_dump(const void* data, char* dump, const size_t max_dump_len)
+{
+  const struct rbtty_mem_counter* counter = data;
+  return counter->proxied->dump(counter->proxied->data, dump, max_dump_len);
+}
+
+/*******************************************************************************
+ *
+ * rbtty_stats functions
+ *
+ ******************************************************************************/
+struct mem_allocator*
+rbtty_mem_counter_init
+  (struct mem_allocator* proxied,
+   struct rbtty_mem_counter* counter)
+{
+  ASSERT(proxied && counter);
+  memset(counter, 0, sizeof(struct rbtty_mem_counter));
+  counter->proxied = proxied;
+  counter->allocator.alloc = counter_alloc;
+  counter->allocator.calloc = counter_calloc;
+  counter->allocator.realloc = counter_realloc;
+  counter->allocator.aligned_alloc = counter_aligned_alloc;
+  counter->allocator.free = counter_free;
+  counter->allocator.allocated_size = counter_allocated_size;
+  counter->allocator.dump = counter_dump;
+  counter->allocator.data = counter;
+  return &counter->allocator;
+}
+
+uint64_t
+rbtty_stats_time(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000u + (uint64_t)t.tv_nsec;
+}
+
+void
+rbtty_latency_record(struct rbtty_latency* latency, const uint64_t ns)
+{
+  const int log2 = ns ? 63 - __builtin_clzll((unsigned long long)ns) : 0;
+  ASSERT(latency);
+  ++latency->buckets[MIN(log2, RBTTY_LATENCY_BUCKETS_COUNT - 1)];
+  ++latency->count;
+  latency->total_ns += ns;
+  if(ns > latency->max_ns)
+    latency->max_ns = ns;
+}
+
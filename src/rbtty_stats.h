@@ -0,0 +1,48 @@
+#ifndef RBTTY_STATS_H
+#define RBTTY_STATS_H
+
+#include "rbtty.h"
+#include <snlsys/mem_allocator.h>
+#include <snlsys/snlsys.h>
+
+/* The counters are only updated if the statistics are enabled; otherwise
+ * the counter expressions are not even evaluated */
+#ifdef RBTTY_ENABLE_STATS
+  #define RBTTY_STATS_ADD(counter, n) ((counter) += (n))
+  #define RBTTY_LATENCY_BEGIN(t0) const uint64_t t0 = rbtty_stats_time()
+  #define RBTTY_LATENCY_END(latency, t0)                                       \
+    rbtty_latency_record(latency, rbtty_stats_time() - (t0))
+#else
+  #define RBTTY_STATS_ADD(counter, n) (void)0
+  #define RBTTY_LATENCY_BEGIN(t0) (void)0
+  #define RBTTY_LATENCY_END(latency, t0) (void)0
+#endif
+#define RBTTY_STATS_INC(counter) RBTTY_STATS_ADD(counter, 1)
+
+/* Proxy allocator counting the allocations and the allocated bytes of the
+ * `proxied' allocator. It is thread safe if `proxied' is */
+struct rbtty_mem_counter {
+  struct mem_allocator allocator;
+  struct mem_allocator* proxied;
+  uint64_t allocs_count; /* Accessed atomically */
+  uint64_t frees_count; /* Accessed atomically */
+  size_t size; /* Accessed atomically */
+};
+
+/* Return the proxy allocator of `counter' */
+extern LOCAL_SYM struct mem_allocator*
+rbtty_mem_counter_init
+  (struct mem_allocator* proxied,
+   struct rbtty_mem_counter* counter);
+
+/* Monotonic time in nanoseconds */
+extern LOCAL_SYM uint64_t
+rbtty_stats_time(void);
+
+extern LOCAL_SYM void
+rbtty_latency_record
+  (struct rbtty_latency* latency,
+   const uint64_t ns);
+
+#endif /* RBTTY_STATS_H */
+
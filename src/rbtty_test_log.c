@@ -0,0 +1,88 @@
+#include "rbtty.h"
+#include "rbtty_test_utils.h"
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static int
+is_info_equal
+  (const struct rbtty_line_info* a,
+   const struct rbtty_line_info* b)
+{
+  return a->level == b->level
+      && a->channel == b->channel
+      && a->timestamp == b->timestamp;
+}
+
+static void
+check_line_info
+  (struct rbtty* tty,
+   const size_t line,
+   const struct rbtty_line_info* expected)
+{
+  struct rbtty_line_info info;
+  CHECK(rbtty_get_line_info(tty, line, &info) == RBTTY_NO_ERROR);
+  CHECK(is_info_equal(&info, expected));
+}
+
+/*******************************************************************************
+ *
+ * Tests
+ *
+ ******************************************************************************/
+/* The logged lines keep their metadata while the open line, and thus the
+ * lines written afterwards, are not logged */
+static void
+test_open_line(struct rbtty* tty)
+{
+  const float white[3] = { 1.f, 1.f, 1.f };
+  const struct rbtty_line_info none = { RBTTY_LEVEL_INFO, 0, 0 };
+  const struct rbtty_line_info warning = { RBTTY_LEVEL_WARNING, 3, 42 };
+  const struct rbtty_line_info error = { RBTTY_LEVEL_ERROR, 7, 43 };
+  struct rbtty_line_info info;
+
+  /* Lines 0 and 1 are logged and the line 2 is the open one */
+  CHECK(rbtty_log_utf8(tty, &warning, "warning", 7, white) == RBTTY_NO_ERROR);
+  CHECK(rbtty_log_utf8(tty, &error, "error\n", 6, white) == RBTTY_NO_ERROR);
+  check_line_info(tty, 0, &warning);
+  check_line_info(tty, 1, &error);
+  check_line_info(tty, 2, &none);
+  CHECK(rbtty_get_line_info(tty, 3, &info) == RBTTY_INVALID_ARGUMENT);
+
+  /* The text written after the log is not tagged */
+  CHECK(rbtty_write_utf8(tty, RBTTY_STDOUT, "text", 4, white)
+    == RBTTY_NO_ERROR);
+  check_line_info(tty, 2, &none);
+  CHECK(rbtty_write_utf8(tty, RBTTY_STDOUT, "\n", 1, white)
+    == RBTTY_NO_ERROR);
+  check_line_info(tty, 2, &none);
+  check_line_info(tty, 3, &none);
+
+  /* A pending line is terminated before the log, without being tagged */
+  CHECK(rbtty_write_utf8(tty, RBTTY_STDOUT, "pending", 7, white)
+    == RBTTY_NO_ERROR);
+  CHECK(rbtty_log_utf8(tty, &warning, "a\nb", 3, white) == RBTTY_NO_ERROR);
+  check_line_info(tty, 3, &none);
+  check_line_info(tty, 4, &warning);
+  check_line_info(tty, 5, &warning);
+  check_line_info(tty, 6, &none);
+}
+
+int
+main(void)
+{
+  struct rbi rbi;
+  struct rbtty* tty = NULL;
+
+  setup_null_rbi(&rbi);
+  CHECK(rbtty_create(&rbi, NULL, NULL, &tty) == RBTTY_NO_ERROR);
+  CHECK(rbtty_set_viewport(tty, 0, 0, 640, 480) == RBTTY_NO_ERROR);
+
+  test_open_line(tty);
+
+  CHECK(rbtty_ref_put(tty) == RBTTY_NO_ERROR);
+  check_memory_leaks();
+  return 0;
+}
@@ -0,0 +1,205 @@
+#include "rbtty_lz.h"
+#include "rbtty_test_utils.h"
+#include <snlsys/math.h>
+#include <stdint.h>
+
+#define DATA_SIZE 4096
+/* Bytes following the decompression buffers that must not be written */
+#define GUARD_SIZE 64
+#define GUARD_BYTE 0xA5
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static uint32_t
+rand32(uint32_t* state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/* Decompress the `size' bytes of `src' into a buffer of `capacity' bytes and
+ * check that the bytes beyond `capacity' are left untouched */
+static size_t
+decompress
+  (const unsigned char* src,
+   const size_t size,
+   unsigned char* dst,
+   const size_t capacity)
+{
+  size_t len = 0;
+  memset(dst + capacity, GUARD_BYTE, GUARD_SIZE);
+  len = rbtty_lz_decompress(src, size, dst, capacity);
+  CHECK(len == SIZE_MAX || len <= capacity);
+  FOR_EACH(size_t, i, 0, GUARD_SIZE) {
+    CHECK(dst[capacity + i] == GUARD_BYTE);
+  }
+  return len;
+}
+
+/* Return the compressed size of the `size' bytes of `data' */
+static size_t
+check_roundtrip(const unsigned char* data, const size_t size)
+{
+  const size_t bound = rbtty_lz_bound(size);
+  unsigned char* packed = malloc(bound);
+  unsigned char* unpacked = malloc(size + GUARD_SIZE);
+  size_t packed_size = 0;
+  CHECK(packed && unpacked);
+
+  CHECK(rbtty_lz_compress(data, size, packed, bound - 1) == 0);
+  packed_size = rbtty_lz_compress(data, size, packed, bound);
+  CHECK(packed_size && packed_size <= bound);
+  CHECK(decompress(packed, packed_size, unpacked, size) == size);
+  CHECK(!size || !memcmp(data, unpacked, size));
+  /* One byte short of the decompressed size */
+  if(size) {
+    CHECK(decompress(packed, packed_size, unpacked, size - 1) == SIZE_MAX);
+  }
+  free(packed);
+  free(unpacked);
+  return packed_size;
+}
+
+/* Text lines with repeated words interleaved with random bytes */
+static void
+fill_mixed(unsigned char* data, const size_t size, uint32_t seed)
+{
+  static const char* words[] = { "rbtty ", "scrollback ", "line ", "\n" };
+  size_t i = 0;
+  while(i < size) {
+    const uint32_t r = rand32(&seed);
+    if(r % 5) {
+      const char* word = words[r % 4];
+      const size_t len = MIN(strlen(word), size - i);
+      memcpy(data + i, word, len);
+      i += len;
+    } else {
+      data[i++] = (unsigned char)(r >> 8);
+    }
+  }
+}
+
+/*******************************************************************************
+ *
+ * Tests
+ *
+ ******************************************************************************/
+static void
+test_empty(void)
+{
+  const unsigned char data = 0;
+  unsigned char dst[GUARD_SIZE];
+  CHECK(check_roundtrip(&data, 0) == 1);
+  CHECK(decompress(&data, 0, dst, 0) == 0);
+}
+
+/* Random bytes whose compression only grows by the tokens of the literals */
+static void
+test_incompressible(void)
+{
+  unsigned char data[DATA_SIZE];
+  uint32_t seed = 0x2545F491u;
+  FOR_EACH(size_t, i, 0, sizeof(data)) {
+    data[i] = (unsigned char)(rand32(&seed) >> 24);
+  }
+  FOR_EACH(size_t, size, 0, 300) {
+    check_roundtrip(data, size);
+  }
+  CHECK(check_roundtrip(data, sizeof(data)) > sizeof(data));
+}
+
+/* Matches that overlap the bytes they produce and whose lengths need
+ * extension bytes */
+static void
+test_repetitive(void)
+{
+  unsigned char data[DATA_SIZE];
+  const size_t periods[] = { 1, 2, 3, 7, 255 };
+
+  FOR_EACH(size_t, i, 0, sizeof(periods)/sizeof(periods[0])) {
+    FOR_EACH(size_t, j, 0, sizeof(data)) {
+      data[j] = (unsigned char)((j % periods[i]) * 37 + 1);
+    }
+    FOR_EACH(size_t, size, 0, 40) {
+      check_roundtrip(data, size);
+    }
+    CHECK(check_roundtrip(data, sizeof(data)) < sizeof(data) / 8);
+  }
+  fill_mixed(data, sizeof(data), 1);
+  CHECK(check_roundtrip(data, sizeof(data)) < sizeof(data));
+}
+
+/* Hand made blocks whose sequences overrun their input or their output */
+static void
+test_malformed(void)
+{
+  unsigned char dst[16 + GUARD_SIZE];
+  const unsigned char lits_overrun[] = { 0x30, 'a', 'b' };
+  const unsigned char length_overrun[] = { 0xF0 };
+  const unsigned char offset_truncated[] = { 0x10, 'a', 0x01 };
+  const unsigned char offset_null[] = { 0x10, 'a', 0x00, 0x00 };
+  const unsigned char offset_overrun[] = { 0x10, 'a', 0x02, 0x00 };
+  const unsigned char match_overrun[] = { 0x1F, 'a', 0x01, 0x00, 0xFF, 0x00 };
+  const unsigned char match_ok[] = { 0x1B, 'a', 0x01, 0x00 };
+
+  CHECK(decompress(lits_overrun, sizeof(lits_overrun), dst, 16) == SIZE_MAX);
+  CHECK(decompress(lits_overrun, sizeof(lits_overrun), dst, 0) == SIZE_MAX);
+  CHECK(decompress(length_overrun, sizeof(length_overrun), dst, 16)
+    == SIZE_MAX);
+  CHECK(decompress(offset_truncated, sizeof(offset_truncated), dst, 16)
+    == SIZE_MAX);
+  CHECK(decompress(offset_null, sizeof(offset_null), dst, 16) == SIZE_MAX);
+  CHECK(decompress(offset_overrun, sizeof(offset_overrun), dst, 16)
+    == SIZE_MAX);
+  CHECK(decompress(match_overrun, sizeof(match_overrun), dst, 16)
+    == SIZE_MAX);
+  /* A run of 16 bytes fills the output exactly */
+  CHECK(decompress(match_ok, sizeof(match_ok), dst, 16) == 16);
+  FOR_EACH(size_t, i, 0, 16) {
+    CHECK(dst[i] == 'a');
+  }
+  CHECK(decompress(match_ok, sizeof(match_ok), dst, 15) == SIZE_MAX);
+}
+
+/* Truncated and bit flipped blocks never write beyond the output */
+static void
+test_corrupted(void)
+{
+  unsigned char data[DATA_SIZE];
+  unsigned char packed[DATA_SIZE * 2];
+  unsigned char unpacked[DATA_SIZE + GUARD_SIZE];
+  size_t packed_size = 0;
+
+  fill_mixed(data, sizeof(data), 7);
+  packed_size = rbtty_lz_compress(data, sizeof(data), packed, sizeof(packed));
+  CHECK(packed_size);
+
+  FOR_EACH(size_t, size, 0, packed_size) {
+    /* Only the empty last sequence can be missing */
+    CHECK(decompress(packed, size, unpacked, sizeof(data)) != sizeof(data)
+       || size == packed_size - 1);
+  }
+  FOR_EACH(size_t, i, 0, packed_size) {
+    FOR_EACH(int, bit, 0, 8) {
+      packed[i] = (unsigned char)(packed[i] ^ (1 << bit));
+      decompress(packed, packed_size, unpacked, sizeof(data));
+      packed[i] = (unsigned char)(packed[i] ^ (1 << bit));
+    }
+  }
+}
+
+int
+main(void)
+{
+  test_empty();
+  test_incompressible();
+  test_repetitive();
+  test_malformed();
+  test_corrupted();
+  return 0;
+}
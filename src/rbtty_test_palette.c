@@ -0,0 +1,56 @@
+#include "rbtty.h"
+#include "rbtty_test_utils.h"
+
+/* Number of distinct truecolors written, more than the palette can hold */
+#define COLORS_COUNT 70000
+
+/*******************************************************************************
+ *
+ * Tests
+ *
+ ******************************************************************************/
+/* Once the palette is full, the writes of new colors keep succeeding */
+static void
+test_truecolors(struct rbtty* tty)
+{
+  const float white[3] = { 1.f, 1.f, 1.f };
+  char str[64];
+  size_t i = 0;
+
+  for(i = 0; i < COLORS_COUNT; ++i) {
+    const int len = snprintf(str, sizeof(str), "\033[38;2;%u;%u;%umx%s",
+      (unsigned)(i & 0xFF), (unsigned)((i >> 8) & 0xFF),
+      (unsigned)((i >> 16) & 0xFF), i % 64 ? "" : "\n");
+    CHECK(len > 0 && (size_t)len < sizeof(str));
+    CHECK(rbtty_write_utf8(tty, RBTTY_STDOUT, str, (size_t)len, white)
+      == RBTTY_NO_ERROR);
+  }
+  /* The default colors of the writes are not registered yet */
+  for(i = 0; i < 256; ++i) {
+    const float color[3] = { (float)i / 255.f, 0.5f, 0.25f };
+    CHECK(rbtty_write_utf8(tty, RBTTY_STDOUT, "\033[0mdefault\n", 12, color)
+      == RBTTY_NO_ERROR);
+    CHECK(rbtty_print_wstring(tty, RBTTY_PROMPT, L"> ", color)
+      == RBTTY_NO_ERROR);
+  }
+  CHECK(rbtty_queue_utf8(tty, RBTTY_STDOUT, "\033[38;2;1;2;3mqueued\n", 20,
+    white) == RBTTY_NO_ERROR);
+  CHECK(rbtty_flush(tty) == RBTTY_NO_ERROR);
+}
+
+int
+main(void)
+{
+  struct rbi rbi;
+  struct rbtty* tty = NULL;
+
+  setup_null_rbi(&rbi);
+  CHECK(rbtty_create(&rbi, NULL, NULL, &tty) == RBTTY_NO_ERROR);
+  CHECK(rbtty_set_viewport(tty, 0, 0, 640, 480) == RBTTY_NO_ERROR);
+
+  test_truecolors(tty);
+
+  CHECK(rbtty_ref_put(tty) == RBTTY_NO_ERROR);
+  check_memory_leaks();
+  return 0;
+}
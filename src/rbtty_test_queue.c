@@ -0,0 +1,351 @@
+#define _POSIX_C_SOURCE 200112L /* pthread, sched_yield */
+
+#include "rbtty_queue.h"
+#include "rbtty_screen.h"
+#include "rbtty_test_utils.h"
+#include <pthread.h>
+#include <sched.h>
+
+/* Size of the ring, whose records hold at most 96 bytes of text */
+#define QUEUE_SIZE 256
+#define PRODUCERS_COUNT 4
+#define BLOCK_PUSHES_COUNT 2000
+#define DROP_PUSHES_COUNT 5000
+/* Length of the messages of the drop test, i.e. their padded sequence number */
+#define MESSAGE_SIZE 40
+#define STREAM_SIZE (512 * 1024)
+
+/* Text written by the drained records, per producer */
+struct sink {
+  unsigned char streams[PRODUCERS_COUNT][STREAM_SIZE];
+  size_t sizes[PRODUCERS_COUNT];
+  wchar_t wstream[64];
+  size_t wsize;
+  size_t records_count;
+};
+
+struct producer {
+  struct rbtty_queue* queue;
+  size_t id;
+  unsigned char* stream; /* Text pushed by the producer */
+  size_t size;
+};
+
+static struct sink sink;
+static int producers_done;
+
+/*******************************************************************************
+ *
+ * Screen stubs, called by rbtty_queue_drain
+ *
+ ******************************************************************************/
+/* Return 1 if the `len' bytes of `str' are a sequence of whole chars */
+static int
+is_whole_utf8(const unsigned char* str, const size_t len)
+{
+  size_t i = 0;
+  while(i < len) {
+    size_t n = 0;
+    if(str[i] < 0x80) n = 1;
+    else if((str[i] & 0xE0) == 0xC0) n = 2;
+    else if((str[i] & 0xF0) == 0xE0) n = 3;
+    else return 0;
+    if(n > len - i)
+      return 0;
+    FOR_EACH(size_t, j, 1, n) {
+      if((str[i + j] & 0xC0) != 0x80)
+        return 0;
+    }
+    i += n;
+  }
+  return 1;
+}
+
+enum rbtty_error
+rbtty_screen_write_utf8
+  (struct rbtty_screen* screen,
+   const enum rbtty_output output,
+   const char* str,
+   const size_t len,
+   const float color[3])
+{
+  const size_t id = (size_t)color[0];
+  CHECK(screen && output == RBTTY_STDOUT && (str || !len));
+  CHECK(id < PRODUCERS_COUNT && color[1] == 0.5f && color[2] == 0.25f);
+  /* Records hold at most the half of the ring, split on a char boundary */
+  CHECK(len <= QUEUE_SIZE / 2 - 32);
+  CHECK(is_whole_utf8((const unsigned char*)str, len));
+  CHECK(len <= STREAM_SIZE - sink.sizes[id]);
+  memcpy(sink.streams[id] + sink.sizes[id], str, len);
+  sink.sizes[id] += len;
+  ++sink.records_count;
+  return RBTTY_NO_ERROR;
+}
+
+enum rbtty_error
+rbtty_screen_write_wstring
+  (struct rbtty_screen* screen,
+   const enum rbtty_output output,
+   const wchar_t* str,
+   const size_t len,
+   const float color[3])
+{
+  CHECK(screen && output == RBTTY_PROMPT && (str || !len) && color);
+  CHECK(len <= sizeof(sink.wstream)/sizeof(wchar_t) - sink.wsize);
+  memcpy(sink.wstream + sink.wsize, str, len * sizeof(wchar_t));
+  sink.wsize += len;
+  ++sink.records_count;
+  return RBTTY_NO_ERROR;
+}
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static void
+sink_clear(void)
+{
+  memset(&sink, 0, sizeof(sink));
+}
+
+/* Append the char `i' of `id' to `stream'. The chars are 1, 2 or 3 bytes
+ * long so that the records are split inside multibyte chars */
+static size_t
+write_char(unsigned char* stream, const size_t id, const size_t i)
+{
+  const unsigned cp = (unsigned)(i * 7 + id);
+  switch((i + i / 7 + id) % 3) {
+    case 0:
+      stream[0] = (unsigned char)('a' + cp % 26);
+      return 1;
+    case 1:
+      stream[0] = (unsigned char)(0xC4 | (cp >> 6 & 0x03));
+      stream[1] = (unsigned char)(0x80 | (cp & 0x3F));
+      return 2;
+    default:
+      stream[0] = 0xE4;
+      stream[1] = (unsigned char)(0x80 | (cp >> 6 & 0x3F));
+      stream[2] = (unsigned char)(0x80 | (cp & 0x3F));
+      return 3;
+  }
+}
+
+static void
+check_queue_empty(const struct rbtty_queue* queue)
+{
+  CHECK(queue->head == queue->tail);
+  FOR_EACH(size_t, i, 0, queue->capacity) {
+    CHECK(queue->buffer[i] == 0);
+  }
+}
+
+/* Drain the queue until all the producers are done */
+static void
+consume(struct rbtty_queue* queue, struct rbtty_screen* screen)
+{
+  while(__atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) < PRODUCERS_COUNT) {
+    CHECK(rbtty_queue_drain(queue, screen, SIZE_MAX) == RBTTY_NO_ERROR);
+    sched_yield();
+  }
+  CHECK(rbtty_queue_drain(queue, screen, SIZE_MAX) == RBTTY_NO_ERROR);
+  check_queue_empty(queue);
+}
+
+/* Push texts of 0 to 119 chars, most of them split into several records */
+static void*
+produce_texts(void* arg)
+{
+  struct producer* producer = arg;
+  const float color[3] = { (float)producer->id, 0.5f, 0.25f };
+  size_t ichar = 0;
+
+  FOR_EACH(size_t, i, 0, BLOCK_PUSHES_COUNT) {
+    const size_t begin = producer->size;
+    FOR_EACH(size_t, j, 0, (i * 37 + producer->id * 11) % 120) {
+      CHECK(STREAM_SIZE - producer->size >= 3);
+      producer->size += write_char
+        (producer->stream + producer->size, producer->id, ichar++);
+    }
+    CHECK(rbtty_queue_push(producer->queue, RBTTY_STDOUT, RBTTY_QUEUE_UTF8,
+      producer->stream + begin, producer->size - begin, color)
+      == RBTTY_NO_ERROR);
+  }
+  __atomic_add_fetch(&producers_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+/* Push messages fitting in one record, tagged with their sequence number */
+static void*
+produce_messages(void* arg)
+{
+  struct producer* producer = arg;
+  const float color[3] = { (float)producer->id, 0.5f, 0.25f };
+  char msg[MESSAGE_SIZE + 1];
+
+  FOR_EACH(size_t, i, 0, DROP_PUSHES_COUNT) {
+    CHECK(snprintf(msg, sizeof(msg), "%-*zu", MESSAGE_SIZE, i)
+      == MESSAGE_SIZE);
+    CHECK(rbtty_queue_push(producer->queue, RBTTY_STDOUT, RBTTY_QUEUE_UTF8,
+      msg, MESSAGE_SIZE, color) == RBTTY_NO_ERROR);
+    if(i % 4 == 0)
+      sched_yield(); /* Let the consumer drain some of the records */
+  }
+  __atomic_add_fetch(&producers_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+static void
+run_producers
+  (struct rbtty_queue* queue,
+   struct rbtty_screen* screen,
+   struct producer producers[PRODUCERS_COUNT],
+   void* (*produce)(void*))
+{
+  pthread_t threads[PRODUCERS_COUNT];
+  sink_clear();
+  producers_done = 0;
+  FOR_EACH(size_t, i, 0, PRODUCERS_COUNT) {
+    producers[i].queue = queue;
+    producers[i].id = i;
+    producers[i].size = 0;
+    CHECK(pthread_create(threads + i, NULL, produce, producers + i) == 0);
+  }
+  consume(queue, screen);
+  FOR_EACH(size_t, i, 0, PRODUCERS_COUNT) {
+    CHECK(pthread_join(threads[i], NULL) == 0);
+  }
+}
+
+/*******************************************************************************
+ *
+ * Tests
+ *
+ ******************************************************************************/
+/* A record that does not fit before the end of the ring follows a padding
+ * record */
+static void
+test_padding(struct rbtty_queue* queue, struct rbtty_screen* screen)
+{
+  const float color[3] = { 1.f, 0.5f, 0.25f };
+  unsigned char text[96];
+
+  CHECK(rbtty_queue_setup(queue, QUEUE_SIZE, RBTTY_QUEUE_BLOCK)
+    == RBTTY_NO_ERROR);
+  CHECK(queue->capacity == QUEUE_SIZE);
+  sink_clear();
+  memset(text, 'x', sizeof(text));
+
+  /* 3 records of 72 bytes leave 40 bytes before the end of the ring */
+  FOR_EACH(int, i, 0, 3) {
+    CHECK(rbtty_queue_push(queue, RBTTY_STDOUT, RBTTY_QUEUE_UTF8, text, 40,
+      color) == RBTTY_NO_ERROR);
+  }
+  CHECK(queue->tail == 216);
+  CHECK(rbtty_queue_drain(queue, screen, SIZE_MAX) == RBTTY_NO_ERROR);
+  /* A 128 bytes record is pushed after 40 bytes of padding */
+  CHECK(rbtty_queue_push(queue, RBTTY_STDOUT, RBTTY_QUEUE_UTF8, text, 96,
+    color) == RBTTY_NO_ERROR);
+  CHECK(queue->tail == 216 + 40 + 128);
+  CHECK(rbtty_queue_push(queue, RBTTY_PROMPT, RBTTY_QUEUE_WCHAR, L"> ",
+    2 * sizeof(wchar_t), color) == RBTTY_NO_ERROR);
+  CHECK(rbtty_queue_drain(queue, screen, SIZE_MAX) == RBTTY_NO_ERROR);
+  check_queue_empty(queue);
+
+  CHECK(sink.records_count == 5);
+  CHECK(sink.sizes[1] == 3 * 40 + 96);
+  CHECK(!memcmp(sink.streams[1], text, 96));
+  CHECK(sink.wsize == 2 && !wmemcmp(sink.wstream, L"> ", 2));
+}
+
+/* The producers wait for the room of their records and the drained text of
+ * each producer is the one it pushed */
+static void
+test_block(struct rbtty_queue* queue, struct rbtty_screen* screen)
+{
+  static struct producer producers[PRODUCERS_COUNT];
+  static unsigned char streams[PRODUCERS_COUNT][STREAM_SIZE];
+
+  CHECK(rbtty_queue_setup(queue, QUEUE_SIZE, RBTTY_QUEUE_BLOCK)
+    == RBTTY_NO_ERROR);
+  FOR_EACH(size_t, i, 0, PRODUCERS_COUNT) {
+    producers[i].stream = streams[i];
+  }
+  run_producers(queue, screen, producers, produce_texts);
+
+  CHECK(queue->dropped == 0);
+  /* The ring wrapped around many times */
+  CHECK(queue->tail > 1000 * QUEUE_SIZE);
+  FOR_EACH(size_t, i, 0, PRODUCERS_COUNT) {
+    CHECK(producers[i].size <= STREAM_SIZE);
+    CHECK(sink.sizes[i] == producers[i].size);
+    CHECK(!memcmp(sink.streams[i], producers[i].stream, producers[i].size));
+  }
+}
+
+/* The records that do not fit are dropped and counted, the others keep the
+ * order of each producer */
+static void
+test_drop(struct rbtty_queue* queue, struct rbtty_screen* screen)
+{
+  static struct producer producers[PRODUCERS_COUNT];
+  const float color[3] = { 2.f, 0.5f, 0.25f };
+  unsigned char text[300];
+  size_t received = 0;
+  size_t size = 0;
+  size_t ichar = 0;
+
+  CHECK(rbtty_queue_setup(queue, QUEUE_SIZE, RBTTY_QUEUE_DROP)
+    == RBTTY_NO_ERROR);
+  run_producers(queue, screen, producers, produce_messages);
+
+  FOR_EACH(size_t, i, 0, PRODUCERS_COUNT) {
+    size_t prev = SIZE_MAX;
+    CHECK(sink.sizes[i] % MESSAGE_SIZE == 0);
+    FOR_EACH(size_t, j, 0, sink.sizes[i] / MESSAGE_SIZE) {
+      char msg[MESSAGE_SIZE + 1];
+      size_t seq = 0;
+      memcpy(msg, sink.streams[i] + j * MESSAGE_SIZE, MESSAGE_SIZE);
+      msg[MESSAGE_SIZE] = '\0';
+      seq = strtoul(msg, NULL, 10);
+      CHECK(seq < DROP_PUSHES_COUNT && (prev == SIZE_MAX || seq > prev));
+      prev = seq;
+    }
+    received += sink.sizes[i] / MESSAGE_SIZE;
+  }
+  CHECK(received == sink.records_count);
+  CHECK(received + queue->dropped == PRODUCERS_COUNT * DROP_PUSHES_COUNT);
+
+  /* Only the first 2 of the 4 records of the text fit in the empty ring. The
+   * push is dropped once */
+  CHECK(rbtty_queue_setup(queue, QUEUE_SIZE, RBTTY_QUEUE_DROP)
+    == RBTTY_NO_ERROR);
+  sink_clear();
+  while(size < sizeof(text) - 3)
+    size += write_char(text + size, 2, ichar++);
+  CHECK(rbtty_queue_push(queue, RBTTY_STDOUT, RBTTY_QUEUE_UTF8, text, size,
+    color) == RBTTY_NO_ERROR);
+  CHECK(queue->dropped == 1);
+  CHECK(rbtty_queue_drain(queue, screen, SIZE_MAX) == RBTTY_NO_ERROR);
+  check_queue_empty(queue);
+  CHECK(sink.records_count == 2);
+  CHECK(sink.sizes[2] > 2 * 90 && sink.sizes[2] <= 2 * 96);
+  CHECK(!memcmp(sink.streams[2], text, sink.sizes[2]));
+}
+
+int
+main(void)
+{
+  static struct rbtty_screen screen;
+  struct rbtty_queue queue;
+
+  rbtty_queue_init(&mem_default_allocator, &queue);
+
+  test_padding(&queue, &screen);
+  test_block(&queue, &screen);
+  test_drop(&queue, &screen);
+
+  rbtty_queue_shutdown(&queue);
+  check_memory_leaks();
+  return 0;
+}
@@ -0,0 +1,177 @@
+#include "rbtty.h"
+#include "rbtty_test_utils.h"
+#include <stdint.h>
+
+#define SNAPSHOT_PATH "rbtty_test_snapshot.snap"
+#define CORRUPTED_PATH "rbtty_test_snapshot.bad"
+
+/* Offsets of the header fields of a snapshot file, see rbtty_snapshot.c */
+enum header_offset {
+  MAGIC_OFFSET = 0,
+  LINES_CAPACITY_OFFSET = 24,
+  CHARS_CAPACITY_OFFSET = 32,
+  SPANS_CAPACITY_OFFSET = 40,
+  LINES_COUNT_OFFSET = 48,
+  HISTORY_CAPACITY_OFFSET = 144,
+  HEADER_SIZE = 168
+};
+
+struct snapshot {
+  char* data;
+  size_t size;
+};
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static void
+read_snapshot(const char* path, struct snapshot* snap)
+{
+  FILE* stream = fopen(path, "rb");
+  long size = 0;
+  CHECK(stream != NULL);
+  CHECK(fseek(stream, 0, SEEK_END) == 0);
+  size = ftell(stream);
+  CHECK(size >= HEADER_SIZE);
+  CHECK(fseek(stream, 0, SEEK_SET) == 0);
+  snap->size = (size_t)size;
+  snap->data = malloc(snap->size);
+  CHECK(snap->data != NULL);
+  CHECK(fread(snap->data, snap->size, 1, stream) == 1);
+  fclose(stream);
+}
+
+/* Write the first `size' bytes of `snap' into a file and load it */
+static enum rbtty_error
+load_truncated
+  (struct rbtty* tty,
+   const struct snapshot* snap,
+   const size_t size)
+{
+  FILE* stream = fopen(CORRUPTED_PATH, "wb");
+  CHECK(stream != NULL && size <= snap->size);
+  CHECK(!size || fwrite(snap->data, size, 1, stream) == 1);
+  CHECK(fclose(stream) == 0);
+  return rbtty_load_snapshot(tty, CORRUPTED_PATH);
+}
+
+/* Load `snap' whose 64 bits field at `offset' is set to `value' */
+static enum rbtty_error
+load_corrupted
+  (struct rbtty* tty,
+   struct snapshot* snap,
+   const size_t offset,
+   const uint64_t value)
+{
+  uint64_t saved = 0;
+  enum rbtty_error rbtty_err = RBTTY_NO_ERROR;
+  CHECK(offset + sizeof(value) <= snap->size);
+  memcpy(&saved, snap->data + offset, sizeof(saved));
+  memcpy(snap->data + offset, &value, sizeof(value));
+  rbtty_err = load_truncated(tty, snap, snap->size);
+  memcpy(snap->data + offset, &saved, sizeof(saved));
+  return rbtty_err;
+}
+
+static void
+fill_tty(struct rbtty* tty)
+{
+  const float white[3] = { 1.f, 1.f, 1.f };
+  const float red[3] = { 1.f, 0.f, 0.f };
+  char line[64];
+  int i = 0;
+  for(i = 0; i < 24; ++i) {
+    const int len = snprintf(line, sizeof(line),
+      "line %d \033[1mbold\033[0m text\n", i);
+    CHECK(len > 0 && (size_t)len < sizeof(line));
+    CHECK(rbtty_write_utf8(tty, RBTTY_STDOUT, line, (size_t)len,
+      i % 2 ? white : red) == RBTTY_NO_ERROR);
+  }
+  CHECK(rbtty_write_utf8(tty, RBTTY_STDOUT, "open", 4, white)
+    == RBTTY_NO_ERROR);
+}
+
+/*******************************************************************************
+ *
+ * Tests
+ *
+ ******************************************************************************/
+/* Capacities whose storage size overflows a size_t are rejected before any
+ * allocation */
+static void
+test_capacities(struct rbtty* tty, struct snapshot* snap)
+{
+  CHECK(load_corrupted(tty, snap, CHARS_CAPACITY_OFFSET,
+    ((uint64_t)1 << 62) + 16) == RBTTY_INVALID_ARGUMENT);
+  CHECK(load_corrupted(tty, snap, CHARS_CAPACITY_OFFSET, UINT64_MAX)
+    == RBTTY_INVALID_ARGUMENT);
+  CHECK(load_corrupted(tty, snap, LINES_CAPACITY_OFFSET, UINT64_MAX / 2)
+    == RBTTY_INVALID_ARGUMENT);
+  CHECK(load_corrupted(tty, snap, SPANS_CAPACITY_OFFSET, UINT64_MAX)
+    == RBTTY_INVALID_ARGUMENT);
+  CHECK(load_corrupted(tty, snap, HISTORY_CAPACITY_OFFSET, UINT64_MAX)
+    == RBTTY_INVALID_ARGUMENT);
+  /* Addressable but larger than the scrollback arenas */
+  CHECK(load_corrupted(tty, snap, CHARS_CAPACITY_OFFSET, (uint64_t)1 << 40)
+    != RBTTY_NO_ERROR);
+}
+
+static void
+test_corrupted(struct rbtty* tty, struct snapshot* snap)
+{
+  uint64_t lines_capacity = 0;
+  memcpy(&lines_capacity, snap->data + LINES_CAPACITY_OFFSET,
+    sizeof(lines_capacity));
+
+  CHECK(load_corrupted(tty, snap, MAGIC_OFFSET, 0) != RBTTY_NO_ERROR);
+  CHECK(load_corrupted(tty, snap, LINES_COUNT_OFFSET, 0) != RBTTY_NO_ERROR);
+  CHECK(load_corrupted(tty, snap, LINES_COUNT_OFFSET, lines_capacity + 1)
+    != RBTTY_NO_ERROR);
+  CHECK(load_corrupted(tty, snap, LINES_CAPACITY_OFFSET, 1)
+    != RBTTY_NO_ERROR);
+  CHECK(load_corrupted(tty, snap, CHARS_CAPACITY_OFFSET, 0)
+    != RBTTY_NO_ERROR);
+}
+
+static void
+test_truncated(struct rbtty* tty, const struct snapshot* snap)
+{
+  size_t size = 0;
+  for(size = 0; size < snap->size; ++size) {
+    CHECK(load_truncated(tty, snap, size) != RBTTY_NO_ERROR);
+  }
+}
+
+int
+main(void)
+{
+  struct rbi rbi;
+  struct snapshot snap;
+  struct rbtty* tty = NULL;
+
+  setup_null_rbi(&rbi);
+  CHECK(rbtty_create(&rbi, NULL, NULL, &tty) == RBTTY_NO_ERROR);
+  CHECK(rbtty_set_viewport(tty, 0, 0, 640, 480) == RBTTY_NO_ERROR);
+  CHECK(rbtty_setup_scrollback(tty, 16, 0) == RBTTY_NO_ERROR);
+  fill_tty(tty);
+  CHECK(rbtty_save_snapshot(tty, SNAPSHOT_PATH) == RBTTY_NO_ERROR);
+  read_snapshot(SNAPSHOT_PATH, &snap);
+
+  test_capacities(tty, &snap);
+  test_corrupted(tty, &snap);
+  test_truncated(tty, &snap);
+
+  /* The rejected snapshots left the tty usable */
+  CHECK(load_truncated(tty, &snap, snap.size) == RBTTY_NO_ERROR);
+  CHECK(rbtty_load_snapshot(tty, SNAPSHOT_PATH) == RBTTY_NO_ERROR);
+  fill_tty(tty);
+
+  free(snap.data);
+  remove(SNAPSHOT_PATH);
+  remove(CORRUPTED_PATH);
+  CHECK(rbtty_ref_put(tty) == RBTTY_NO_ERROR);
+  check_memory_leaks();
+  return 0;
+}
@@ -0,0 +1,55 @@
+#ifndef RBTTY_TEST_UTILS_H
+#define RBTTY_TEST_UTILS_H
+
+#include <rb/rbi.h>
+#include <snlsys/mem_allocator.h>
+#include <snlsys/snlsys.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Exit on failure if `cond' is false */
+#define CHECK(cond)                                                            \
+  if(!(cond)) {                                                                \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    exit(1);                                                                   \
+  } (void)0
+
+/*******************************************************************************
+ *
+ * Null render backend
+ *
+ ******************************************************************************/
+static INLINE int
+rb_null(void)
+{
+  return 0;
+}
+
+static INLINE void
+setup_null_rbi(struct rbi* rbi)
+{
+  memset(rbi, 0, sizeof(struct rbi));
+  #define RB_FUNC(func_name, ...)                                              \
+    rbi->func_name = (__typeof__(rbi->func_name))(void(*)(void))rb_null;
+  #include <rb/rb_func.h>
+  #undef RB_FUNC
+}
+
+/*******************************************************************************
+ *
+ * Memory
+ *
+ ******************************************************************************/
+/* Exit on failure if some memory of the default allocator is not released */
+static INLINE void
+check_memory_leaks(void)
+{
+  if(MEM_ALLOCATED_SIZE(&mem_default_allocator)) {
+    fprintf(stderr, "Memory leaks: %zu bytes.\n",
+      MEM_ALLOCATED_SIZE(&mem_default_allocator));
+    exit(1);
+  }
+}
+
+#endif /* RBTTY_TEST_UTILS_H */
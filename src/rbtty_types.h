@@ -7,5 +7,39 @@ enum rbtty_output {
   RBTTY_PROMPT
 };
 
+/* Severity of a line of the stdout, in ascending order */
+enum rbtty_level {
+  RBTTY_LEVEL_DEBUG,
+  RBTTY_LEVEL_INFO,
+  RBTTY_LEVEL_WARNING,
+  RBTTY_LEVEL_ERROR
+};
+
+/* Behavior of the thread safe print functions when the queue is full */
+enum rbtty_queue_policy {
+  RBTTY_QUEUE_BLOCK, /* Wait for the queue to be drained */
+  RBTTY_QUEUE_DROP /* Discard the printed text */
+};
+
+/* Edition of the command line */
+enum rbtty_edit {
+  RBTTY_EDIT_LEFT,
+  RBTTY_EDIT_RIGHT,
+  RBTTY_EDIT_WORD_LEFT,
+  RBTTY_EDIT_WORD_RIGHT,
+  RBTTY_EDIT_HOME,
+  RBTTY_EDIT_END,
+  RBTTY_EDIT_DELETE, /* Delete the char under the cursor */
+  RBTTY_EDIT_BACKSPACE, /* Delete the char preceding the cursor */
+  RBTTY_EDIT_KILL_TO_END,
+  RBTTY_EDIT_KILL_TO_HOME,
+  RBTTY_EDIT_KILL_WORD, /* Kill the word preceding the cursor */
+  RBTTY_EDIT_YANK, /* Insert the last killed text */
+  /* Recall the previous/next command starting with the chars preceding the
+   * cursor when the recall began */
+  RBTTY_EDIT_HISTORY_PREV,
+  RBTTY_EDIT_HISTORY_NEXT
+};
+
 #endif /* RBTTY_TYPES_H */
 
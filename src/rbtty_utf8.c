@@ -0,0 +1,92 @@
+#include "rbtty_utf8.h"
+#include <string.h>
+
+#define ASCII_MASK 0x8080808080808080ULL
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+static FINLINE wchar_t
+to_wchar(const uint32_t codepoint)
+{
+  if(codepoint > 0x10FFFF
+  || (codepoint >= 0xD800 && codepoint <= 0xDFFF)
+  || codepoint > (uint32_t)WCHAR_MAX)
+    return RBTTY_REPLACEMENT_CHAR;
+  return (wchar_t)codepoint;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_utf8 functions
+ *
+ ******************************************************************************/
+size_t
+rbtty_utf8_decode
+  (struct rbtty_utf8_decoder* dec,
+   const char* src,
+   const size_t len,
+   wchar_t* dst)
+{
+  const unsigned char* bytes = (const unsigned char*)src;
+  wchar_t* out = dst;
+  size_t i = 0;
+  ASSERT(dec && (src || !len) && dst);
+
+  while(i < len) {
+    unsigned char c = 0;
+
+    if(!dec->remaining) {
+      /* ASCII fast path: check 8 bytes at once */
+      while(i + 8 <= len) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        if(word & ASCII_MASK)
+          break;
+        FOR_EACH(int, j, 0, 8)
+          out[j] = (wchar_t)bytes[i + (size_t)j];
+        out += 8;
+        i += 8;
+      }
+      if(i >= len)
+        break;
+
+      c = bytes[i++];
+      if(c < 0x80) {
+        *out++ = (wchar_t)c;
+      } else if((c & 0xE0) == 0xC0) {
+        dec->codepoint = c & 0x1Fu;
+        dec->codepoint_min = 0x80;
+        dec->remaining = 1;
+      } else if((c & 0xF0) == 0xE0) {
+        dec->codepoint = c & 0x0Fu;
+        dec->codepoint_min = 0x800;
+        dec->remaining = 2;
+      } else if((c & 0xF8) == 0xF0) {
+        dec->codepoint = c & 0x07u;
+        dec->codepoint_min = 0x10000;
+        dec->remaining = 3;
+      } else {
+        *out++ = RBTTY_REPLACEMENT_CHAR;
+      }
+    } else {
+      c = bytes[i];
+      if((c & 0xC0) != 0x80) {
+        /* Truncated sequence. The current byte is decoded from scratch */
+        dec->remaining = 0;
+        *out++ = RBTTY_REPLACEMENT_CHAR;
+        continue;
+      }
+      ++i;
+      dec->codepoint = (dec->codepoint << 6) | (c & 0x3Fu);
+      if(--dec->remaining == 0) {
+        *out++ = dec->codepoint < dec->codepoint_min
+          ? RBTTY_REPLACEMENT_CHAR : to_wchar(dec->codepoint);
+      }
+    }
+  }
+  return (size_t)(out - dst);
+}
+
@@ -0,0 +1,50 @@
+#ifndef RBTTY_UTF8_H
+#define RBTTY_UTF8_H
+
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+#define RBTTY_REPLACEMENT_CHAR ((wchar_t)0xFFFD)
+
+/* Streaming UTF-8 decoder. A multi-byte sequence may be split across several
+ * calls to rbtty_utf8_decode */
+struct rbtty_utf8_decoder {
+  uint32_t codepoint;
+  uint32_t codepoint_min; /* Used to reject overlong encodings */
+  int remaining; /* Number of continuation bytes still expected */
+};
+
+static FINLINE void
+rbtty_utf8_decoder_init(struct rbtty_utf8_decoder* dec)
+{
+  ASSERT(dec);
+  dec->codepoint = 0;
+  dec->codepoint_min = 0;
+  dec->remaining = 0;
+}
+
+/* Decode `len' bytes of `src' into `dst' and return the number of written
+ * chars. `dst' must be able to store at least `len + 1' chars. Invalid
+ * sequences are replaced by RBTTY_REPLACEMENT_CHAR */
+extern LOCAL_SYM size_t
+rbtty_utf8_decode
+  (struct rbtty_utf8_decoder* dec,
+   const char* src,
+   const size_t len,
+   wchar_t* dst);
+
+/* Terminate the pending sequence, if any, and return the number of chars
+ * written into `dst', i.e. 0 or 1 */
+static FINLINE size_t
+rbtty_utf8_decoder_flush(struct rbtty_utf8_decoder* dec, wchar_t* dst)
+{
+  ASSERT(dec && dst);
+  if(!dec->remaining)
+    return 0;
+  dec->remaining = 0;
+  *dst = RBTTY_REPLACEMENT_CHAR;
+  return 1;
+}
+
+#endif /* RBTTY_UTF8_H */
+
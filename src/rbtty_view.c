@@ -0,0 +1,94 @@
+#include "rbtty_view.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+/* Initial number of ids of a view */
+#define VIEW_MIN_CAPACITY 256
+
+/*******************************************************************************
+ *
+ * rbtty_view functions
+ *
+ ******************************************************************************/
+void
+rbtty_view_init
+  (struct mem_allocator* allocator,
+   const struct rbtty_filter* filter,
+   struct rbtty_view* view)
+{
+  ASSERT(allocator && filter && view);
+  memset(view, 0, sizeof(struct rbtty_view));
+  view->filter = *filter;
+  view->allocator = allocator;
+}
+
+void
+rbtty_view_shutdown(struct rbtty_view* view)
+{
+  ASSERT(view);
+  if(view->ids)
+    MEM_FREE(view->allocator, view->ids);
+  view->ids = NULL;
+  view->first = view->count = view->capacity = 0;
+}
+
+enum rbtty_error
+rbtty_view_push
+  (struct rbtty_view* view,
+   const size_t id,
+   const size_t first_id)
+{
+  ASSERT(view);
+  ASSERT(view->first == view->count || view->ids[view->count - 1] < id);
+
+  while(view->first < view->count && view->ids[view->first] < first_id)
+    ++view->first;
+
+  if(view->count == view->capacity) {
+    const size_t n = view->count - view->first;
+    if(view->first >= view->capacity / 2 && view->first) {
+      /* Reclaim the room of the purged ids */
+      memmove(view->ids, view->ids + view->first, n * sizeof(size_t));
+    } else {
+      const size_t capacity = MAX(view->capacity * 2, VIEW_MIN_CAPACITY);
+      size_t* ids = NULL;
+      if(UNLIKELY(capacity > SIZE_MAX / sizeof(size_t)))
+        return RBTTY_MEMORY_ERROR;
+      ids = MEM_ALLOC(view->allocator, capacity * sizeof(size_t));
+      if(!ids)
+        return RBTTY_MEMORY_ERROR;
+      if(view->ids) {
+        memcpy(ids, view->ids + view->first, n * sizeof(size_t));
+        MEM_FREE(view->allocator, view->ids);
+      }
+      view->ids = ids;
+      view->capacity = capacity;
+    }
+    view->first = 0;
+    view->count = n;
+  }
+  view->ids[view->count++] = id;
+  return RBTTY_NO_ERROR;
+}
+
+size_t
+rbtty_view_lower_bound(const struct rbtty_view* view, const size_t id)
+{
+  size_t lo = 0;
+  size_t hi = 0;
+  ASSERT(view);
+
+  lo = view->first;
+  hi = view->count;
+  while(lo < hi) {
+    const size_t mid = lo + (hi - lo) / 2;
+    if(view->ids[mid] < id) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
@@ -0,0 +1,70 @@
+#ifndef RBTTY_VIEW_H
+#define RBTTY_VIEW_H
+
+#include "rbtty.h"
+#include "rbtty_scrollback.h"
+#include <snlsys/snlsys.h>
+
+struct mem_allocator;
+
+/* Lines of the stdout matching a filter, i.e. the ascending list of their
+ * absolute ids. The ids are pushed as the lines are closed, so that the view
+ * is shown without scanning the scrollback. The lines that are evicted or
+ * moved to the cold tier leave the view: their ids are skipped from the id of
+ * the oldest hot line, and purged as new ids are pushed */
+struct rbtty_view {
+  struct rbtty_filter filter;
+  int is_used; /* The view slot of the screen is in use */
+  size_t* ids;
+  size_t first; /* Index of the first id that was not purged */
+  size_t count; /* Index past the last id */
+  size_t capacity;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM void
+rbtty_view_init
+  (struct mem_allocator* allocator,
+   const struct rbtty_filter* filter,
+   struct rbtty_view* view);
+
+extern LOCAL_SYM void
+rbtty_view_shutdown
+  (struct rbtty_view* view);
+
+/* Register the line `id'. The ids lesser than `first_id', i.e. of the
+ * evicted lines, are purged. `id' must be greater than the registered ones */
+extern LOCAL_SYM enum rbtty_error
+rbtty_view_push
+  (struct rbtty_view* view,
+   const size_t id,
+   const size_t first_id);
+
+/* Return the index of the first registered id greater than or equal to
+ * `id' */
+extern LOCAL_SYM size_t
+rbtty_view_lower_bound
+  (const struct rbtty_view* view,
+   const size_t id);
+
+static FINLINE void
+rbtty_view_clear(struct rbtty_view* view)
+{
+  ASSERT(view);
+  view->first = view->count = 0;
+}
+
+static FINLINE int
+rbtty_view_match
+  (const struct rbtty_view* view,
+   const struct rbtty_line_meta* meta)
+{
+  ASSERT(view && meta);
+  return meta->level >= view->filter.min_level
+      && (view->filter.channel == RBTTY_CHANNEL_ANY
+       || view->filter.channel == meta->channel);
+}
+
+#endif /* RBTTY_VIEW_H */
+
@@ -0,0 +1,147 @@
+#include "rbtty_advance.h"
+#include "rbtty_scrollback.h"
+#include "rbtty_wrap.h"
+#include <snlsys/math.h>
+#include <snlsys/mem_allocator.h>
+#include <string.h>
+
+/*******************************************************************************
+ *
+ * Helper functions
+ *
+ ******************************************************************************/
+/* Add a row starting at the `offset' char. Return 0 on allocation failure */
+static int
+line_add_row
+  (struct rbtty_wrap* wrap,
+   struct rbtty_wrap_line* line,
+   const size_t offset)
+{
+  ASSERT(wrap && line && line->rows_count);
+  if(offset > UINT32_MAX || line->rows_count == UINT32_MAX)
+    return 0;
+  if(line->rows_count - 1 == line->capacity) {
+    const uint32_t capacity = line->capacity ? line->capacity * 2 : 4;
+    uint32_t* breaks = MEM_REALLOC
+      (wrap->allocator, line->breaks, capacity * sizeof(uint32_t));
+    if(!breaks)
+      return 0;
+    line->breaks = breaks;
+    line->capacity = capacity;
+  }
+  line->breaks[line->rows_count - 1] = (uint32_t)offset;
+  ++line->rows_count;
+  return 1;
+}
+
+/*******************************************************************************
+ *
+ * rbtty_wrap functions
+ *
+ ******************************************************************************/
+enum rbtty_error
+rbtty_wrap_init
+  (struct mem_allocator* allocator,
+   struct rbtty_advance* advance,
+   struct rbtty_wrap* wrap)
+{
+  ASSERT(allocator && advance && wrap);
+  memset(wrap, 0, sizeof(struct rbtty_wrap));
+  wrap->allocator = allocator;
+  wrap->advance = advance;
+  wrap->lines = MEM_CALLOC
+    (allocator, RBTTY_WRAP_CACHE_SIZE, sizeof(struct rbtty_wrap_line));
+  if(!wrap->lines)
+    return RBTTY_MEMORY_ERROR;
+  FOR_EACH(size_t, i, 0, RBTTY_WRAP_CACHE_SIZE)
+    wrap->lines[i].line_id = SIZE_MAX;
+  return RBTTY_NO_ERROR;
+}
+
+void
+rbtty_wrap_shutdown(struct rbtty_wrap* wrap)
+{
+  ASSERT(wrap);
+  if(!wrap->lines)
+    return;
+  FOR_EACH(size_t, i, 0, RBTTY_WRAP_CACHE_SIZE) {
+    if(wrap->lines[i].breaks)
+      MEM_FREE(wrap->allocator, wrap->lines[i].breaks);
+  }
+  MEM_FREE(wrap->allocator, wrap->lines);
+  wrap->lines = NULL;
+}
+
+void
+rbtty_wrap_set_width(struct rbtty_wrap* wrap, const int width)
+{
+  ASSERT(wrap);
+  if(width != wrap->width) {
+    wrap->width = width;
+    rbtty_wrap_invalidate(wrap);
+  }
+}
+
+void
+rbtty_wrap_set_advance(struct rbtty_wrap* wrap, struct rbtty_advance* advance)
+{
+  ASSERT(wrap && advance);
+  if(advance != wrap->advance) {
+    wrap->advance = advance;
+    rbtty_wrap_invalidate(wrap);
+  }
+}
+
+const struct rbtty_wrap_line*
+rbtty_wrap_get
+  (struct rbtty_wrap* wrap,
+   const struct rbtty_scrollback* sb,
+   const size_t id)
+{
+  struct rbtty_wrap_line* line = NULL;
+  const wchar_t* chars = NULL;
+  const struct rbtty_span* spans = NULL;
+  size_t len = 0;
+  size_t spans_count = 0;
+  size_t line_id = 0;
+  size_t row_begin = 0;
+  size_t i = 0;
+  int x = 0;
+  ASSERT(wrap && wrap->lines && sb);
+
+  rbtty_scrollback_get_line(sb, id, &chars, &len, &spans, &spans_count);
+  line_id = rbtty_scrollback_line_id(sb, id);
+  line = wrap->lines + (line_id & (RBTTY_WRAP_CACHE_SIZE - 1));
+
+  if(line->line_id == line_id && line->chars == chars
+  && line->stamp == wrap->stamp && line->length <= len) {
+    if(line->length == len)
+      return line;
+    /* Chars were appended to the line. Resume from its last row */
+    i = line->length;
+    x = line->x;
+    row_begin = line->rows_count > 1 ? line->breaks[line->rows_count - 2] : 0;
+  } else {
+    line->line_id = line_id;
+    line->chars = chars;
+    line->stamp = wrap->stamp;
+    line->rows_count = 1;
+  }
+
+  if(wrap->width > 0) {
+    for(; i < len; ++i) {
+      const int w = rbtty_advance_get(wrap->advance, chars[i]);
+      if(x + w > wrap->width && i > row_begin) {
+        if(!line_add_row(wrap, line, i))
+          break; /* The remaining chars are cut at the end of the row */
+        row_begin = i;
+        x = 0;
+      }
+      x += w;
+    }
+  }
+  line->length = len;
+  line->x = x;
+  return line;
+}
+
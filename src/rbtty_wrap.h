@@ -0,0 +1,97 @@
+#ifndef RBTTY_WRAP_H
+#define RBTTY_WRAP_H
+
+#include "rbtty_error.h"
+#include <snlsys/snlsys.h>
+#include <wchar.h>
+
+/* Number of lines whose wrap points are cached. Power of 2 */
+#define RBTTY_WRAP_CACHE_SIZE 4096
+
+struct mem_allocator;
+struct rbtty_advance;
+struct rbtty_scrollback;
+
+/* Wrap points of a line, i.e. the offsets of the first char of its rows
+ * following the first one */
+struct rbtty_wrap_line {
+  size_t line_id; /* SIZE_MAX <=> unused */
+  const wchar_t* chars; /* Identify the line content along with its id */
+  size_t length; /* Number of wrapped chars */
+  uint32_t stamp;
+  uint32_t rows_count;
+  uint32_t* breaks;
+  uint32_t capacity;
+  int x; /* Width of the last row, from which the wrapping is resumed */
+};
+
+/* Soft wrapping of the lines of a scrollback to a width in pixels. The wrap
+ * points are computed on demand and cached per line, for the width and the
+ * advances they were computed with. A change of width or of font only bumps
+ * the stamp of the cache, so that the lines are wrapped again lazily, when
+ * they are drawn or scrolled through. The wrapping of a line whose chars
+ * were appended since is resumed from its last row */
+struct rbtty_wrap {
+  struct rbtty_wrap_line* lines; /* Direct mapped by line id */
+  int width; /* Width in pixels. <= 0 <=> no wrapping */
+  uint32_t stamp;
+  struct rbtty_advance* advance;
+  /* miscellaneous data */
+  struct mem_allocator* allocator;
+};
+
+extern LOCAL_SYM enum rbtty_error
+rbtty_wrap_init
+  (struct mem_allocator* allocator,
+   struct rbtty_advance* advance,
+   struct rbtty_wrap* wrap);
+
+extern LOCAL_SYM void
+rbtty_wrap_shutdown
+  (struct rbtty_wrap* wrap);
+
+/* Define the wrap width. The cached wrap points are invalidated if it
+ * changes */
+extern LOCAL_SYM void
+rbtty_wrap_set_width
+  (struct rbtty_wrap* wrap,
+   const int width);
+
+/* Wrap the lines with the advances of `advance'. The cached wrap points are
+ * invalidated if they change */
+extern LOCAL_SYM void
+rbtty_wrap_set_advance
+  (struct rbtty_wrap* wrap,
+   struct rbtty_advance* advance);
+
+/* Invalidate the cached wrap points, e.g. when the advances changed */
+static FINLINE void
+rbtty_wrap_invalidate(struct rbtty_wrap* wrap)
+{
+  ASSERT(wrap);
+  ++wrap->stamp;
+}
+
+/* Return the wrap points of the line `id' of `sb', 0 being the oldest line.
+ * They are valid until the next call */
+extern LOCAL_SYM const struct rbtty_wrap_line*
+rbtty_wrap_get
+  (struct rbtty_wrap* wrap,
+   const struct rbtty_scrollback* sb,
+   const size_t id);
+
+/* Range of the chars of the `row' row of `line' */
+static FINLINE void
+rbtty_wrap_row
+  (const struct rbtty_wrap_line* line,
+   const size_t row,
+   size_t* begin,
+   size_t* end)
+{
+  ASSERT(line && row < line->rows_count && begin && end);
+  *begin = row ? line->breaks[row - 1] : 0;
+  *end = row + 1 < line->rows_count ? line->breaks[row] : line->length;
+}
+
+#endif /* RBTTY_WRAP_H */
+